@@ -47,6 +47,7 @@
 
 using System;
 using System.Collections;
+using System.Collections.Generic;
 using UnityEngine;
 
 public class ServoUnityController : MonoBehaviour
@@ -77,11 +78,64 @@ public class ServoUnityController : MonoBehaviour
     public string Homepage = "https://servo.org/";
     [Tooltip("The user agent string passed with every request. If empty, Servo will use a suitable default.")]
     public string UserAgent = "";
+    [Tooltip("If set, each window's render size is reduced when it is small or distant on screen, or when frame time exceeds FrameTimeBudgetMs.")]
+    public bool DynamicResolution = false;
+    [Tooltip("Frame-time budget in milliseconds used by dynamic resolution.")]
+    public float FrameTimeBudgetMs = 1000.0f / 60.0f;
+    [Tooltip("The smallest fraction of a window's requested size that dynamic resolution may render at.")]
+    [Range(0.125f, 1.0f)]
+    public float DynamicResolutionMinScale = 0.25f;
+    [Tooltip("Time in milliseconds a window's size must remain unchanged before the page is laid out again at the new size.")]
+    public float ResizeSettleTimeMs = 250.0f;
+    [Tooltip("Named set of Servo prefs tuning the engine for a use. Can be changed while running with SetPerformanceProfile.")]
+    public ServoUnityPlugin.ServoUnityPerformanceProfile PerformanceProfile = ServoUnityPlugin.ServoUnityPerformanceProfile.Default;
+    [Tooltip("If set, each frame's input events are delivered to Servo as one batch, rather than processed one by one.")]
+    public bool BatchInput = true;
+    [Tooltip("Fraction of scroll momentum velocity remaining after one second, for pointers with kinetic scrolling enabled. Lower values stop sooner; 0 disables momentum.")]
+    [Range(0.0f, 0.95f)]
+    public float KineticScrollFriction = 0.135f;
+    [Tooltip("If set, two-finger touch gestures are recognised by the plugin as pinch-zoom, pan and fling.")]
+    public bool TouchGestures = true;
+    [Tooltip("Pixels the spacing between two fingers must change by before a pinch begins.")]
+    public float PinchThreshold = 24.0f;
+    [Tooltip("Pixels the midpoint between two fingers must move by before a pan begins.")]
+    public float PanThreshold = 12.0f;
+    [Tooltip("If set, a small snapshot of each page is kept, and shown when a window reopens or returns to the page, until Servo has drawn it.")]
+    public bool Snapshots = true;
+    [Tooltip("If set, page snapshots are also kept on disk, in the application's temporary cache directory, so they survive restarts.")]
+    public bool SnapshotsOnDisk = true;
+    [Tooltip("If set, Servo's plain HTTP requests go through a caching proxy in the plugin, which keeps responses on disk in the application's temporary cache directory, so that pages reload quickly and survive restarts. Read at startup.")]
+    public bool HTTPCache = false;
+    [Tooltip("Size budget of the HTTP cache, in megabytes. The least recently used responses are discarded beyond this.")]
+    public int HTTPCacheSizeMB = 256;
+    [Tooltip("If set, visited pages are remembered across restarts, in the application's persistent data directory, for address bar completion.")]
+    public bool PersistHistory = true;
+    [Tooltip("If set, the plugin watches for the system running low on memory, and in stages clears caches, then shrinks and finally suspends hidden windows. Read at startup.")]
+    public bool MemoryPressureResponse = true;
+    [Tooltip("GPU memory, in megabytes, for windows' textures. When over, the textures of the hidden windows least recently visible are reduced to a token size until shown again. 0 for no budget.")]
+    public int TextureBudgetMB = 0;
+    [Tooltip("If set, Servo and its windows keep running when this controller is disabled or its scene unloaded, and are taken over by windows with the same PersistenceKey in the next scene. They are shut down only at application quit.")]
+    public bool PersistentEngine = false;
+    [Tooltip("If set, Servo is started as soon as the controller starts, and windows wait for it, so that the first window appears without a hitch.")]
+    public bool Prewarm = true;
+    [Tooltip("The size the first window will be requested at. A different size will cost a resize once the window appears.")]
+    public int PrewarmWidth = 1920;
+    public int PrewarmHeight = 1080;
+
+    // True from when prewarm begins until the engine is ready. Windows wait until this is false before requesting creation.
+    public static bool EnginePrewarming { get; private set; } = false;
+    private const float PrewarmTimeout = 10.0f; // Seconds.
+    private float prewarmStartTime;
 
     private bool waitingForShutdown = false;
 
     [NonSerialized] public ServoUnityWindow NavbarWindow = null;
 
+    // Scratch space for the per-frame window update, reused to avoid per-frame allocations.
+    private List<ServoUnityWindow> windowsToUpdate = new List<ServoUnityWindow>();
+    private int[] windowIndicesToUpdate = new int[ServoUnityPlugin.RenderEventWindowsMax];
+    private Comparison<ServoUnityWindow> windowUpdatePriorityComparison;
+
     //
     // Static handlers for callbacks from plugin.
     //
@@ -130,6 +184,35 @@ public class ServoUnityController : MonoBehaviour
     [AOT.MonoPInvokeCallback(typeof(ServoUnityPluginBrowserEventCallback))]
     static void OnServoBrowserEvent(int uid, int eventType, int eventData0, int eventData1, System.String eventDataS)
     {
+        // Events which aren't specific to a window.
+        if (uid == 0)
+        {
+            switch ((ServoUnityPlugin.ServoUnityBrowserEventType)eventType)
+            {
+                case ServoUnityPlugin.ServoUnityBrowserEventType.EngineReady:
+                    if (eventData0 == 1) Debug.Log("Servo browser event: engine ready.");
+                    else Debug.LogWarning("Servo browser event: engine prewarm failed.");
+                    EnginePrewarming = false;
+                    break;
+                case ServoUnityPlugin.ServoUnityBrowserEventType.Shutdown:
+                    // From a window left detached by PersistentEngine, shut down at quit.
+                    ServoUnityController s = FindObjectOfType<ServoUnityController>();
+                    if (s) s.waitingForShutdown = false;
+                    break;
+                case ServoUnityPlugin.ServoUnityBrowserEventType.MemoryPressure:
+                    Debug.Log($"Servo plugin event: memory pressure {(ServoUnityPlugin.ServoUnityMemoryPressure)eventData0}, action {(ServoUnityPlugin.ServoUnityMemoryPressureAction)eventData1}.");
+                    if ((ServoUnityPlugin.ServoUnityMemoryPressureAction)eventData1 == ServoUnityPlugin.ServoUnityMemoryPressureAction.DropPluginCaches)
+                    {
+                        foreach (ServoUnityWindow w in ServoUnityWindow.ActiveWindows) w.ReleaseTexturePool();
+                    }
+                    break;
+                default:
+                    Debug.Log("Servo plugin event: unknown event.");
+                    break;
+            }
+            return;
+        }
+
         ServoUnityWindow window = ServoUnityWindow.FindWindowWithUID(uid);
         if (window == null)
         {
@@ -211,6 +294,14 @@ public class ServoUnityController : MonoBehaviour
                     suc.navbarController.OnURLChanged(suc.servo_unity_plugin.ServoUnityGetWindowURL(window.WindowIndex));
                 }
                 break;
+            case ServoUnityPlugin.ServoUnityBrowserEventType.MemoryPressure:
+                Debug.Log($"Servo browser event: memory pressure {(ServoUnityPlugin.ServoUnityMemoryPressure)eventData0}, action {(ServoUnityPlugin.ServoUnityMemoryPressureAction)eventData1}.");
+                break;
+            case ServoUnityPlugin.ServoUnityBrowserEventType.TexturesEvicted:
+                Debug.Log($"Servo browser event: textures {(eventData0 == 1 ? "evicted" : "restored")}.");
+                // The full-size texture was pooled by the resize to a token size.
+                if (eventData0 == 1) window.ReleaseTexturePool();
+                break;
             default:
                 Debug.Log("Servo browser event: unknown event.");
                 break;
@@ -278,12 +369,30 @@ public class ServoUnityController : MonoBehaviour
             servo_unity_plugin.ServoUnitySetParamBool(ServoUnityPlugin.ServoUnityParam.b_CloseNativeWindowOnClose, false);
         if (!String.IsNullOrEmpty(Homepage))
             servo_unity_plugin.ServoUnitySetParamString(ServoUnityPlugin.ServoUnityParam.s_Homepage, Homepage);
+        servo_unity_plugin.ServoUnitySetParamBool(ServoUnityPlugin.ServoUnityParam.b_DynamicResolution, DynamicResolution);
+        servo_unity_plugin.ServoUnitySetParamFloat(ServoUnityPlugin.ServoUnityParam.f_FrameTimeBudget, FrameTimeBudgetMs);
+        servo_unity_plugin.ServoUnitySetParamFloat(ServoUnityPlugin.ServoUnityParam.f_DynamicResolutionMinScale, DynamicResolutionMinScale);
+        servo_unity_plugin.ServoUnitySetParamFloat(ServoUnityPlugin.ServoUnityParam.f_ResizeSettleTime, ResizeSettleTimeMs);
+        servo_unity_plugin.ServoUnitySetParamInt(ServoUnityPlugin.ServoUnityParam.i_PerformanceProfile, (int)PerformanceProfile);
+        servo_unity_plugin.ServoUnitySetParamBool(ServoUnityPlugin.ServoUnityParam.b_BatchInput, BatchInput);
+        servo_unity_plugin.ServoUnitySetParamFloat(ServoUnityPlugin.ServoUnityParam.f_KineticScrollFriction, KineticScrollFriction);
+        servo_unity_plugin.ServoUnitySetParamBool(ServoUnityPlugin.ServoUnityParam.b_TouchGestures, TouchGestures);
+        servo_unity_plugin.ServoUnitySetParamFloat(ServoUnityPlugin.ServoUnityParam.f_PinchThreshold, PinchThreshold);
+        servo_unity_plugin.ServoUnitySetParamFloat(ServoUnityPlugin.ServoUnityParam.f_PanThreshold, PanThreshold);
+        servo_unity_plugin.ServoUnitySetParamBool(ServoUnityPlugin.ServoUnityParam.b_Snapshots, Snapshots);
+        servo_unity_plugin.ServoUnitySetParamString(ServoUnityPlugin.ServoUnityParam.s_CachePath, SnapshotsOnDisk ? Application.temporaryCachePath : "");
+        servo_unity_plugin.ServoUnitySetParamString(ServoUnityPlugin.ServoUnityParam.s_HTTPCachePath, HTTPCache ? System.IO.Path.Combine(Application.temporaryCachePath, "http-cache") : "");
+        servo_unity_plugin.ServoUnitySetParamInt(ServoUnityPlugin.ServoUnityParam.i_HTTPCacheSize, HTTPCacheSizeMB);
+        servo_unity_plugin.ServoUnitySetParamString(ServoUnityPlugin.ServoUnityParam.s_HistoryPath, PersistHistory ? Application.persistentDataPath : "");
+        servo_unity_plugin.ServoUnitySetParamBool(ServoUnityPlugin.ServoUnityParam.b_MemoryPressureResponse, MemoryPressureResponse);
+        servo_unity_plugin.ServoUnitySetParamInt(ServoUnityPlugin.ServoUnityParam.i_TextureBudgetMB, TextureBudgetMB);
 
         // Set the reference to the plugin in any other objects in the scene that need it.
         ServoUnityWindow[] servoUnityWindows = FindObjectsOfType<ServoUnityWindow>();
         foreach (ServoUnityWindow w in servoUnityWindows)
         {
             w.servo_unity_plugin = servo_unity_plugin;
+            if (w.Detached) w.Reattach(); // Windows not yet started will reattach in Start().
         }
     }
 
@@ -291,10 +400,13 @@ public class ServoUnityController : MonoBehaviour
     {
         Debug.Log("ServoUnityController.OnDisable()");
 
+        EnginePrewarming = false;
+
         // Clear the references to the plugin in any other objects in the scene that have it.
         ServoUnityWindow[] servoUnityWindows = FindObjectsOfType<ServoUnityWindow>();
         foreach (ServoUnityWindow w in servoUnityWindows)
         {
+            if (PersistentEngine) w.Detach(); // No-op at quit, as windows are closed by then.
             w.servo_unity_plugin = null;
         }
 
@@ -330,13 +442,56 @@ public class ServoUnityController : MonoBehaviour
         Debug.Log("Plugin version " + servo_unity_plugin.ServoUnityGetVersion());
 
         servo_unity_plugin.ServoUnityInit(OnServoWindowCreated, OnServoWindowResized, OnServoBrowserEvent, UserAgent);
+
+        // With a persistent engine, Servo may already be running from a previous scene.
+        if (Prewarm && !ServoUnityWindow.HasDetachedWindows)
+        {
+            EnginePrewarming = servo_unity_plugin.ServoUnityPrewarm(PrewarmWidth, PrewarmHeight);
+            prewarmStartTime = Time.realtimeSinceStartup;
+        }
+    }
+
+    public void SetPerformanceProfile(ServoUnityPlugin.ServoUnityPerformanceProfile profile)
+    {
+        PerformanceProfile = profile;
+        servo_unity_plugin?.ServoUnitySetParamInt(ServoUnityPlugin.ServoUnityParam.i_PerformanceProfile, (int)profile);
     }
 
     void Update()
     {
+        servo_unity_plugin.ServoUnityServicePluginEvents();
+        if (EnginePrewarming && Time.realtimeSinceStartup - prewarmStartTime > PrewarmTimeout)
+        {
+            Debug.LogWarning("Timed out waiting for engine prewarm.");
+            EnginePrewarming = false;
+        }
         servo_unity_plugin.ServoUnityFlushLog();
     }
 
+    void LateUpdate()
+    {
+        // Request texture updates for all windows in one render event, visible and nearer windows first.
+        windowsToUpdate.Clear();
+        windowsToUpdate.AddRange(ServoUnityWindow.ActiveWindows);
+        if (windowsToUpdate.Count == 0) return;
+        if (windowUpdatePriorityComparison == null) windowUpdatePriorityComparison = CompareWindowUpdatePriority;
+        windowsToUpdate.Sort(windowUpdatePriorityComparison);
+
+        int count = Math.Min(windowsToUpdate.Count, windowIndicesToUpdate.Length);
+        for (int i = 0; i < count; i++) windowIndicesToUpdate[i] = windowsToUpdate[i].WindowIndex;
+        servo_unity_plugin.ServoUnityRequestWindowsUpdate(windowIndicesToUpdate, count, Time.deltaTime);
+    }
+
+    private int CompareWindowUpdatePriority(ServoUnityWindow a, ServoUnityWindow b)
+    {
+        if (a.Visible != b.Visible) return a.Visible ? -1 : 1;
+        if (mainCamera == null) return 0;
+        Vector3 cameraPosition = mainCamera.transform.position;
+        float da = (a.transform.position - cameraPosition).sqrMagnitude;
+        float db = (b.transform.position - cameraPosition).sqrMagnitude;
+        return da.CompareTo(db);
+    }
+
     private void OnApplicationQuit()
     {
         Debug.Log("ServoUnityController.OnApplicationQuit()");
@@ -346,6 +501,12 @@ public class ServoUnityController : MonoBehaviour
         {
             w.CleanupRenderer();
         }
+        // Windows kept running by PersistentEngine which no object in this scene took over.
+        List<int> detachedWindowIndices = ServoUnityWindow.TakeDetachedWindowIndices();
+        foreach (int windowIndex in detachedWindowIndices)
+        {
+            servo_unity_plugin.ServoUnityCleanupRenderer(windowIndex);
+        }
 
         // Because Servo cleanup must happen on the GPU thread, we must wait until
         // the GPU thread has time to process the cleanup. We assume that the GPU thread
@@ -358,12 +519,15 @@ public class ServoUnityController : MonoBehaviour
 
         System.Diagnostics.Stopwatch stopWatch = new System.Diagnostics.Stopwatch();
         stopWatch.Start();
-        if (servoUnityWindows.Length > 0)
+        if (servoUnityWindows.Length > 0 || detachedWindowIndices.Count > 0)
         {
             waitingForShutdown = true;
             do
             {
-                servo_unity_plugin.ServoUnityServiceWindowEvents(servoUnityWindows[0].WindowIndex);
+                if (servoUnityWindows.Length > 0) servo_unity_plugin.ServoUnityServiceWindowEvents(servoUnityWindows[0].WindowIndex);
+                foreach (int windowIndex in detachedWindowIndices) servo_unity_plugin.ServoUnityServiceWindowEvents(windowIndex);
+                // A detached window's Shutdown arrives as a plugin event.
+                if (detachedWindowIndices.Count > 0) servo_unity_plugin.ServoUnityServicePluginEvents();
             } while (waitingForShutdown == true && stopWatch.ElapsedMilliseconds < 2000);
             stopWatch.Stop();
             if (waitingForShutdown)
@@ -380,6 +544,10 @@ public class ServoUnityController : MonoBehaviour
         {
             w.Close();
         }
+        foreach (int windowIndex in detachedWindowIndices)
+        {
+            servo_unity_plugin.ServoUnityCloseWindow(windowIndex);
+        }
 
         servo_unity_plugin.ServoUnityFinalise();
     }
@@ -1,3 +1,4 @@
+using System;
 using System.Collections;
 using System.Collections.Generic;
 using UnityEngine;
@@ -96,6 +97,16 @@ public class ServoUnityIME : MonoBehaviour
         _active = false;
     }
 
+    /// <summary>
+    /// Should be called by the IME when it commits text, e.g. a completed composition or a paste.
+    /// The whole text is sent in one call rather than as a key press per character.
+    /// </summary>
+    public void OnIMETextCommitted(string text)
+    {
+        if (!_active || String.IsNullOrEmpty(text)) return;
+        suc.Plugin.ServoUnityWindowTextInput(_windowIndex, text);
+    }
+
     /// <summary>
     /// Should be called by the IME when the user has completed input.
     /// </summary>
@@ -6,8 +6,10 @@
 //
 // Author(s): Philip Lamb
 
+using System;
 using System.Collections;
 using System.Collections.Generic;
+using System.Text;
 using UnityEngine;
 using UnityEngine.UI;
 
@@ -21,6 +23,12 @@ public class ServoUnityNavbarController : MonoBehaviour
     public Button HomeButton;
     public Text TitleText;
     public InputField URLOrSearchInputField;
+    [Tooltip("Optional. Lists pages from history matching what's being typed in the URL or search field.")]
+    public Text SuggestionsText;
+    public int MaxSuggestions = 5;
+
+    private string typed = ""; // What the user has typed in URLOrSearchInputField, without any inline completion.
+    private bool completing = false;
 
     void Awake()
     {
@@ -38,6 +46,7 @@ public class ServoUnityNavbarController : MonoBehaviour
         ReloadButton.gameObject.SetActive(true);
         BackButton.interactable = false;
         ForwardButton.interactable = false;
+        URLOrSearchInputField.onValueChanged.AddListener(OnURLOrSearchValueChanged);
     }
 
     public void OnLoadStateChanged(bool started)
@@ -60,6 +69,51 @@ public class ServoUnityNavbarController : MonoBehaviour
     public void OnURLChanged(string URL)
     {
         URLOrSearchInputField.text = URL;
+        typed = "";
+    }
+
+    // Strip what the plugin ignores when matching typed text against history.
+    private static string StripScheme(string URL)
+    {
+        if (URL.StartsWith("http://", StringComparison.OrdinalIgnoreCase)) URL = URL.Substring(7);
+        else if (URL.StartsWith("https://", StringComparison.OrdinalIgnoreCase)) URL = URL.Substring(8);
+        if (URL.StartsWith("www.", StringComparison.OrdinalIgnoreCase)) URL = URL.Substring(4);
+        return URL;
+    }
+
+    private void ShowSuggestions(ServoUnityPlugin.ServoUnitySuggestion[] suggestions)
+    {
+        if (!SuggestionsText) return;
+        var sb = new StringBuilder();
+        if (suggestions != null) {
+            foreach (ServoUnityPlugin.ServoUnitySuggestion s in suggestions) {
+                sb.AppendLine(string.IsNullOrEmpty(s.Title) ? StripScheme(s.URL) : s.Title + " - " + StripScheme(s.URL));
+            }
+        }
+        SuggestionsText.text = sb.ToString();
+    }
+
+    public void OnURLOrSearchValueChanged(string text)
+    {
+        if (completing || !URLOrSearchInputField.isFocused || !suc) return;
+        // Complete inline only as the user types forward, so that deleting a completion sticks.
+        bool deleting = text.Length <= typed.Length;
+        typed = text;
+        if (text.Length == 0) {
+            ShowSuggestions(null);
+            return;
+        }
+        ServoUnityPlugin.ServoUnitySuggestion[] suggestions = suc.Plugin.ServoUnityQuerySuggestions(text, MaxSuggestions);
+        ShowSuggestions(suggestions);
+        if (deleting || suggestions.Length == 0) return;
+        // The plugin resolves the completed text back to the page's URL on navigation.
+        string completion = StripScheme(suggestions[0].URL);
+        if (completion.Length <= text.Length || !completion.StartsWith(text, StringComparison.OrdinalIgnoreCase)) return;
+        completing = true;
+        URLOrSearchInputField.text = text + completion.Substring(text.Length);
+        URLOrSearchInputField.selectionAnchorPosition = URLOrSearchInputField.text.Length;
+        URLOrSearchInputField.selectionFocusPosition = text.Length;
+        completing = false;
     }
 
     public void OnBackPressed()
@@ -109,6 +163,8 @@ public class ServoUnityNavbarController : MonoBehaviour
     public void OnURLOrSearchEditingComplete()
     {
         Debug.Log("OnURLOrSearchEditingComplete()");
+        typed = "";
+        ShowSuggestions(null);
         if (suc && suc.NavbarWindow)
         {
             suc.Plugin.ServoUnityWindowBrowserControlEvent(suc.NavbarWindow.WindowIndex, ServoUnityPlugin.ServoUnityWindowBrowserControlEventID.Navigate, 0, 0, URLOrSearchInputField.text);
@@ -12,9 +12,11 @@
 //
 
 using System;
+using System.Collections.Generic;
 using System.Runtime.InteropServices;
 using System.Text;
 using UnityEngine;
+using UnityEngine.Rendering;
 
 // Delegate type declarations.
 public delegate void ServoUnityPluginLogCallback([MarshalAs(UnmanagedType.LPStr)] string msg);
@@ -42,6 +44,34 @@ public class ServoUnityPlugin
     private ServoUnityPluginBrowserEventCallback browserEventCallback = null;
     private GCHandle browserEventCallbackGCH;
 
+    //
+    // Render event payloads.
+    //
+
+    public const int RenderEventWindowsMax = 64; // SERVO_UNITY_RENDER_EVENT_WINDOWS_MAX
+    private const int RenderEventUpdateWindowsDataSize = 8 + 4 * RenderEventWindowsMax; // sizeof(ServoUnityRenderEventUpdateWindowsData)
+    // The render thread may run a frame or more behind, so payloads are written round-robin into a small ring.
+    private IntPtr[] renderEventDataBuffers = new IntPtr[3];
+    private int renderEventDataBufferNext = 0;
+    private float[] renderEventTimeDelta = new float[1];
+    private CommandBuffer renderEventCommandBuffer = null;
+    // ServoUnityRenderEventWindowData payloads, one per window index. A payload's contents never change,
+    // so any number of events for any windows can be in flight at once.
+    private Dictionary<int, IntPtr> renderEventWindowData = new Dictionary<int, IntPtr>();
+
+    //
+    // Window metadata cache. Strings are only fetched from the plugin when the window's metadata version changes.
+    //
+    private class WindowMetadata
+    {
+        public int version = 0;
+        public string title = "";
+        public string url = "";
+    }
+    private Dictionary<int, WindowMetadata> windowMetadata = new Dictionary<int, WindowMetadata>();
+    private StringBuilder titleStringBuilder = new StringBuilder(1024); // 1kb
+    private StringBuilder urlStringBuilder = new StringBuilder(16384); // 16kb
+
     public void ServoUnityRegisterLogCallback(ServoUnityPluginLogCallback lcb)
     {
         logCallback = lcb; // Set or unset.
@@ -102,6 +132,22 @@ public class ServoUnityPlugin
         windowCreatedCallbackGCH.Free();
         windowResizedCallbackGCH.Free();
         browserEventCallbackGCH.Free();
+
+        if (renderEventCommandBuffer != null)
+        {
+            renderEventCommandBuffer.Release();
+            renderEventCommandBuffer = null;
+        }
+        for (int i = 0; i < renderEventDataBuffers.Length; i++)
+        {
+            if (renderEventDataBuffers[i] != IntPtr.Zero)
+            {
+                Marshal.FreeHGlobal(renderEventDataBuffers[i]);
+                renderEventDataBuffers[i] = IntPtr.Zero;
+            }
+        }
+        foreach (IntPtr data in renderEventWindowData.Values) Marshal.FreeHGlobal(data);
+        renderEventWindowData.Clear();
     }
 
     public void ServoUnitySetResourcesPath(string path)
@@ -109,6 +155,8 @@ public class ServoUnityPlugin
         ServoUnityPlugin_pinvoke.servoUnitySetResourcesPath(path);
     }
 
+    // Must match the list SERVO_UNITY_KEY_CODES in the plugin's ServoUnityKeyMap.h, which also
+    // records which keys Servo has no equivalent for.
     public enum ServoUnityKeyCode
     {
         Null = 0,
@@ -193,21 +241,214 @@ public class ServoUnityPlugin
         ServoUnityPlugin_pinvoke.servoUnityKeyEvent(windowIndex, upDown ? 1 : 0, (int)keyCode, character);
     }
 
+    // Send a run of text, e.g. committed by an IME or pasted, as key presses in a single call.
+    public void ServoUnityWindowTextInput(int windowIndex, string text)
+    {
+        if (String.IsNullOrEmpty(text)) return;
+        byte[] utf8 = Encoding.UTF8.GetBytes(text);
+        ServoUnityPlugin_pinvoke.servoUnityWindowTextInput(windowIndex, utf8, utf8.Length);
+    }
+
     public int ServoUnityGetWindowCount()
     {
         return ServoUnityPlugin_pinvoke.servoUnityGetWindowCount();
     }
 
+    /// How many windows can be open at once, including prewarmed and detached windows. ServoUnityRequestNewWindow fails beyond this.
+    public int ServoUnityGetWindowCountMax()
+    {
+        return ServoUnityPlugin_pinvoke.servoUnityGetWindowCountMax();
+    }
+
     public bool ServoUnityRequestNewWindow(int uid, int widthPixelsRequested, int heightPixelsRequested)
     {
         return ServoUnityPlugin_pinvoke.servoUnityRequestNewWindow(uid, widthPixelsRequested, heightPixelsRequested);
     }
+
+    public bool ServoUnityDetachWindow(int windowIndex)
+    {
+        windowMetadata.Remove(windowIndex);
+        return ServoUnityPlugin_pinvoke.servoUnityDetachWindow(windowIndex);
+    }
+
+    public bool ServoUnityAttachWindow(int windowIndex, int uid, int widthPixelsRequested, int heightPixelsRequested)
+    {
+        return ServoUnityPlugin_pinvoke.servoUnityAttachWindow(windowIndex, uid, widthPixelsRequested, heightPixelsRequested);
+    }
     
+    public enum ServoUnityStartupPhase
+    {
+        Init = 0,
+        GStreamerEnv = 1,
+        WindowCreated = 2,
+        Prefs = 3,
+        EngineInit = 4,
+        FirstPerformUpdates = 5,
+        FirstLoadStarted = 6,
+        FirstFrame = 7,
+        FirstLoadEnded = 8,
+        Max
+    };
+
+    /// Fills startMs and durationMs, indexed by ServoUnityStartupPhase, with milliseconds since servoUnityInit
+    /// at which each phase began and its duration, or -1 if it hasn't completed.
+    public void ServoUnityGetStartupTimeline(double[] startMs, double[] durationMs)
+    {
+        int count = Math.Min(startMs.Length, durationMs.Length);
+        ServoUnityPlugin_pinvoke.servoUnityGetStartupTimeline(startMs, durationMs, count);
+    }
+
+    public enum ServoUnityGStreamerRegistryCacheState
+    {
+        Disabled = 0,
+        Hit = 1,
+        Miss = 2
+    };
+
+    /// savedMs receives the milliseconds of engine startup saved by the cache, or -1 if not known.
+    public ServoUnityGStreamerRegistryCacheState ServoUnityGetGStreamerRegistryCacheState(out double savedMs)
+    {
+        return (ServoUnityGStreamerRegistryCacheState)ServoUnityPlugin_pinvoke.servoUnityGetGStreamerRegistryCacheState(out savedMs);
+    }
+
+    public enum ServoUnityStat
+    {
+        Frames = 0,
+        TasksDelivered = 1,
+        FramesWithTasks = 2,
+        ServiceTimeMs = 3,
+        EngineCacheClears = 4,
+        PluginCacheDrops = 5,
+        WindowsShrunk = 6,
+        WindowsSuspended = 7,
+        TextureBytes = 8,
+        TextureBudgetBytes = 9,
+        TextureEvictions = 10,
+        WindowsEvicted = 11,
+        Max
+    };
+
+    public double ServoUnityGetStat(ServoUnityStat stat)
+    {
+        return ServoUnityPlugin_pinvoke.servoUnityGetStat((int)stat);
+    }
+
+    public void ServoUnityResetStats()
+    {
+        ServoUnityPlugin_pinvoke.servoUnityResetStats();
+    }
+
+    public enum ServoUnityNavigationPolicyCounter
+    {
+        Checked = 0,
+        Blocked = 1,
+        Redirected = 2,
+        Max
+    };
+
+    public ulong ServoUnityGetNavigationPolicyCounter(ServoUnityNavigationPolicyCounter counter)
+    {
+        return ServoUnityPlugin_pinvoke.servoUnityGetNavigationPolicyCounter((int)counter);
+    }
+
+    public int ServoUnityGetNavigationPolicyRuleCount()
+    {
+        return ServoUnityPlugin_pinvoke.servoUnityGetNavigationPolicyRuleCount();
+    }
+
+    /// Rules are indexed in the order of the rules file the policy was compiled from.
+    public ulong ServoUnityGetNavigationPolicyRuleHits(int rule, out string domain)
+    {
+        var sb = new StringBuilder(256);
+        ulong hits = ServoUnityPlugin_pinvoke.servoUnityGetNavigationPolicyRuleHits(rule, sb, sb.Capacity);
+        domain = sb.ToString();
+        return hits;
+    }
+
+    public struct ServoUnitySuggestion
+    {
+        public string URL;
+        public string Title; // Empty if the page had none.
+    };
+
+    /// Completions for text typed in an address bar, best first, from the pages visited in any window.
+    public ServoUnitySuggestion[] ServoUnityQuerySuggestions(string query, int maxResults)
+    {
+        var sb = new StringBuilder(16384);
+        int count = ServoUnityPlugin_pinvoke.servoUnityQuerySuggestions(query, maxResults, sb, sb.Capacity);
+        string[] lines = sb.ToString().Split(new char[] {'\n'}, StringSplitOptions.RemoveEmptyEntries);
+        var suggestions = new ServoUnitySuggestion[Math.Min(count, lines.Length)];
+        for (int i = 0; i < suggestions.Length; i++) {
+            int tab = lines[i].IndexOf('\t');
+            suggestions[i].URL = tab < 0 ? lines[i] : lines[i].Substring(0, tab);
+            suggestions[i].Title = tab < 0 ? "" : lines[i].Substring(tab + 1);
+        }
+        return suggestions;
+    }
+
+    public void ServoUnityClearHistory()
+    {
+        ServoUnityPlugin_pinvoke.servoUnityClearHistory();
+    }
+
+    public enum ServoUnityMemoryPressure
+    {
+        None = 0,
+        Low = 1,
+        Moderate = 2,
+        High = 3,
+        Critical = 4
+    };
+
+    public enum ServoUnityMemoryPressureAction
+    {
+        None = 0,
+        ClearEngineCaches = 1,
+        DropPluginCaches = 2,
+        ShrinkHiddenWindow = 3,
+        SuspendHiddenWindow = 4
+    };
+
+    public ServoUnityMemoryPressure ServoUnityGetMemoryPressureLevel()
+    {
+        return (ServoUnityMemoryPressure)ServoUnityPlugin_pinvoke.servoUnityGetMemoryPressureLevel();
+    }
+
+    /// Pass -1 to return to the measured level.
+    public void ServoUnityInjectMemoryPressure(int level)
+    {
+        ServoUnityPlugin_pinvoke.servoUnityInjectMemoryPressure(level);
+    }
+
+    public bool ServoUnityPrewarm(int widthPixels, int heightPixels)
+    {
+        int windowIndex = ServoUnityPlugin_pinvoke.servoUnityPrewarm(widthPixels, heightPixels);
+        if (windowIndex == 0) return false;
+        // Servo's startup must happen on the rendering thread.
+        IssueWindowRenderEvent(4, windowIndex);
+        return true;
+    }
+
+    public void ServoUnityServicePluginEvents()
+    {
+        ServoUnityPlugin_pinvoke.servoUnityServicePluginEvents();
+    }
+
     public bool ServoUnityRequestWindowSizeChange(int windowIndex, int widthPixelsRequested, int heightPixelsRequested)
     {
         return ServoUnityPlugin_pinvoke.servoUnityRequestWindowSizeChange(windowIndex, widthPixelsRequested, heightPixelsRequested);
     }
 
+    public void ServoUnitySetWindowProjectedSize(int windowIndex, int widthPixels, int heightPixels)
+    {
+        ServoUnityPlugin_pinvoke.servoUnitySetWindowProjectedSize(windowIndex, widthPixels, heightPixels);
+    }
+
+    public void ServoUnitySetWindowVisible(int windowIndex, bool visible)
+    {
+        ServoUnityPlugin_pinvoke.servoUnitySetWindowVisible(windowIndex, visible);
+    }
+
     public bool ServoUnityGetWindowTextureFormat(int windowIndex, out int width, out int height, out TextureFormat format,
         out bool mipChain, out bool linear, out IntPtr nativeTexureID)
     {
@@ -241,28 +482,103 @@ public class ServoUnityPlugin
         GL.InvalidateState();
     }
 
+    /// <summary>
+    /// Update several windows with a single render-thread event. Windows are updated in the order given,
+    /// so pass the highest priority windows first. At most RenderEventWindowsMax windows are updated.
+    /// </summary>
+    public void ServoUnityRequestWindowsUpdate(int[] windowIndices, int count, float timeDelta)
+    {
+        if (count <= 0) return;
+        if (count > RenderEventWindowsMax) count = RenderEventWindowsMax;
+
+        IntPtr data = renderEventDataBuffers[renderEventDataBufferNext];
+        if (data == IntPtr.Zero)
+        {
+            data = Marshal.AllocHGlobal(RenderEventUpdateWindowsDataSize);
+            renderEventDataBuffers[renderEventDataBufferNext] = data;
+        }
+        renderEventDataBufferNext = (renderEventDataBufferNext + 1) % renderEventDataBuffers.Length;
+
+        renderEventTimeDelta[0] = timeDelta;
+        Marshal.Copy(renderEventTimeDelta, 0, data, 1);
+        Marshal.WriteInt32(data, 4, count);
+        Marshal.Copy(windowIndices, 0, data + 8, count);
+
+        IssueRenderEventAndData(3, data);
+    }
+
+    // Issues a render event whose ServoUnityRenderEventWindowData payload names windowIndex.
+    private void IssueWindowRenderEvent(int eventID, int windowIndex)
+    {
+        IntPtr data;
+        if (!renderEventWindowData.TryGetValue(windowIndex, out data))
+        {
+            data = Marshal.AllocHGlobal(4);
+            Marshal.WriteInt32(data, windowIndex);
+            renderEventWindowData.Add(windowIndex, data);
+        }
+        IssueRenderEventAndData(eventID, data);
+    }
+
+    private void IssueRenderEventAndData(int eventID, IntPtr data)
+    {
+        if (renderEventCommandBuffer == null)
+        {
+            renderEventCommandBuffer = new CommandBuffer();
+            renderEventCommandBuffer.name = "ServoUnity render events";
+        }
+        renderEventCommandBuffer.Clear();
+        renderEventCommandBuffer.IssuePluginEventAndData(ServoUnityPlugin_pinvoke.GetRenderEventAndDataFunc(), eventID, data);
+        Graphics.ExecuteCommandBuffer(renderEventCommandBuffer);
+        GL.InvalidateState();
+    }
+
+
+    private WindowMetadata GetWindowMetadata(int windowIndex)
+    {
+        WindowMetadata metadata;
+        if (!windowMetadata.TryGetValue(windowIndex, out metadata))
+        {
+            metadata = new WindowMetadata();
+            windowMetadata.Add(windowIndex, metadata);
+        }
+        int version = ServoUnityPlugin_pinvoke.servoUnityGetWindowMetadataVersion(windowIndex);
+        if (version != 0 && version != metadata.version)
+        {
+            titleStringBuilder.Clear();
+            urlStringBuilder.Clear();
+            metadata.version = ServoUnityPlugin_pinvoke.servoUnityGetWindowMetadata(windowIndex, titleStringBuilder, titleStringBuilder.Capacity, urlStringBuilder, urlStringBuilder.Capacity);
+            metadata.title = titleStringBuilder.ToString();
+            metadata.url = urlStringBuilder.ToString();
+        }
+        return metadata;
+    }
+
+    public int ServoUnityGetWindowMetadataVersion(int windowIndex)
+    {
+        return ServoUnityPlugin_pinvoke.servoUnityGetWindowMetadataVersion(windowIndex);
+    }
 
     public string ServoUnityGetWindowTitle(int windowIndex)
     {
-        var sb = new StringBuilder(1024); // 1kb
-        ServoUnityPlugin_pinvoke.servoUnityGetWindowMetadata(windowIndex, sb, sb.Capacity, null, 0);
-        return sb.ToString();
+        return GetWindowMetadata(windowIndex).title;
     }
 
     public string ServoUnityGetWindowURL(int windowIndex)
     {
-        var sb = new StringBuilder(16384); // 16kb
-        ServoUnityPlugin_pinvoke.servoUnityGetWindowMetadata(windowIndex, null, 0, sb, sb.Capacity);
-        return sb.ToString();
+        return GetWindowMetadata(windowIndex).url;
+    }
+
+    public void ServoUnityGetWindowNavigationState(int windowIndex, out bool loading, out bool canGoBack, out bool canGoForward)
+    {
+        ServoUnityPlugin_pinvoke.servoUnityGetWindowNavigationState(windowIndex, out loading, out canGoBack, out canGoForward);
     }
 
     public void ServoUnityCleanupRenderer(int windowIndex)
     {
         // Rather than calling ServoUnityPlugin_pinvoke.servoUnityCleanupRenderer(windowIndex)
         // directly, make sure the call runs on the rendering thread.
-        ServoUnityPlugin_pinvoke.servoUnitySetRenderEventFunc2Param(windowIndex);
-        GL.IssuePluginEvent(ServoUnityPlugin_pinvoke.GetRenderEventFunc(), 2);
-        GL.InvalidateState();
+        IssueWindowRenderEvent(2, windowIndex);
     }
 
     public enum ServoUnityPointerEventID
@@ -278,6 +594,9 @@ public class ServoUnityPlugin
         TouchMove = 8,
         TouchEnd = 9,
         TouchCancel = 10,
+        ScrollGestureBegin = 11,
+        ScrollGestureUpdate = 12,
+        ScrollGestureEnd = 13,
         Max
     };
 
@@ -294,6 +613,31 @@ public class ServoUnityPlugin
         ServoUnityPlugin_pinvoke.servoUnityWindowPointerEvent(windowIndex, (int) eventID, eventParam0, eventParam1, windowX, windowY);
     }
 
+    public enum ServoUnityTouchPhase
+    {
+        Began = 0,
+        Moved = 1,
+        Ended = 2,
+        Cancelled = 3,
+        Max
+    };
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct ServoUnityTouch
+    {
+        public int touchID;
+        public int phase; // ServoUnityTouchPhase.
+        public int windowX;
+        public int windowY;
+    };
+
+    // Send a batch of touch events, e.g. all touch changes in a frame, in the order they occurred.
+    public void ServoUnityWindowTouchEvents(int windowIndex, ServoUnityTouch[] touches, int count)
+    {
+        if (touches == null || count <= 0) return;
+        ServoUnityPlugin_pinvoke.servoUnityWindowTouchEvents(windowIndex, touches, Math.Min(count, touches.Length));
+    }
+
     public enum ServoUnityWindowBrowserControlEventID
     {
         Refresh = 0,
@@ -322,11 +666,15 @@ public class ServoUnityPlugin
         HistoryChanged = 5, // eventData0: 0=CantGoBack, 1=CanGoBack, eventData1: 0=CantGoForward, 1=CanGoForward
         TitleChanged = 6,
         URLChanged = 7,
+        EngineReady = 8, // Not window-specific, so delivered with uid 0. eventData0: 0=Failed, 1=Ready.
+        MemoryPressure = 9, // eventData0: ServoUnityMemoryPressure, eventData1: ServoUnityMemoryPressureAction. Delivered with uid 0, except for actions on one window.
+        TexturesEvicted = 10, // eventData0: 1=Evicted, 0=Restored.
         Max
     };
 
     public bool ServoUnityCloseWindow(int windowIndex)
     {
+        windowMetadata.Remove(windowIndex);
         return ServoUnityPlugin_pinvoke.servoUnityCloseWindow(windowIndex);
     }
 
@@ -337,6 +685,7 @@ public class ServoUnityPlugin
 
     public bool ServoUnityCloseAllWindows()
     {
+        windowMetadata.Clear();
         return ServoUnityPlugin_pinvoke.servoUnityCloseAllWindows();
     }
 
@@ -344,6 +693,32 @@ public class ServoUnityPlugin
         b_CloseNativeWindowOnClose = 0,
         s_SearchURI = 1,
         s_Homepage = 2,
+        b_DynamicResolution = 3,
+        f_FrameTimeBudget = 4,
+        f_DynamicResolutionMinScale = 5,
+        f_ResizeSettleTime = 6,
+        i_PerformanceProfile = 7,
+        b_BatchInput = 8,
+        f_KineticScrollFriction = 9,
+        b_TouchGestures = 10,
+        f_PinchThreshold = 11,
+        f_PanThreshold = 12,
+        b_Snapshots = 13,
+        s_CachePath = 14,
+        s_HTTPCachePath = 15,
+        i_HTTPCacheSize = 16,
+        s_HistoryPath = 17,
+        b_MemoryPressureResponse = 18,
+        i_TextureBudgetMB = 19,
+        Max
+    };
+
+    public enum ServoUnityPerformanceProfile {
+        Default = 0,
+        LowLatency = 1,
+        BatterySaver = 2,
+        HighQuality = 3,
+        Kiosk = 4,
         Max
     };
 
@@ -357,7 +732,7 @@ public class ServoUnityPlugin
         ServoUnityPlugin_pinvoke.servoUnitySetParamInt((int)param, val);
     }
 
-    public void ServoUnitySetParamFloat(ServoUnityParam param, bool val)
+    public void ServoUnitySetParamFloat(ServoUnityParam param, float val)
     {
         ServoUnityPlugin_pinvoke.servoUnitySetParamFloat((int)param, val);
     }
@@ -23,6 +23,9 @@ public static class ServoUnityPlugin_pinvoke
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.StdCall)]
     public static extern IntPtr GetRenderEventFunc();
 
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.StdCall)]
+    public static extern IntPtr GetRenderEventAndDataFunc();
+
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnityRegisterLogCallback(ServoUnityPluginLogCallback callback);
 
@@ -51,22 +54,87 @@ public static class ServoUnityPlugin_pinvoke
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnitySetResourcesPath(string path);
 
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityGetStartupTimeline([Out] double[] startMs, [Out] double[] durationMs, int count);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityGetGStreamerRegistryCacheState(out double savedMs);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern double servoUnityGetStat(int stat);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnityResetStats();
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern ulong servoUnityGetNavigationPolicyCounter(int counter);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityGetNavigationPolicyRuleCount();
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern ulong servoUnityGetNavigationPolicyRuleHits(int rule, [MarshalAs(UnmanagedType.LPStr)] StringBuilder domainBuf, int domainBufLen);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityQuerySuggestions(string query, int maxResults, [MarshalAs(UnmanagedType.LPStr)] StringBuilder buf, int bufLen);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnityClearHistory();
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityGetMemoryPressureLevel();
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnityInjectMemoryPressure(int level);
+
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnityKeyEvent(int windowIndex, int upDown, int keyCode, int character);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnityWindowTextInput(int windowIndex, byte[] utf8, int len);
     
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnityWindowPointerEvent(int windowIndex, int eventID, int eventParam0, int eventParam1, int windowX, int windowY);
 
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnityWindowTouchEvents(int windowIndex, [In] ServoUnityPlugin.ServoUnityTouch[] touches, int count);
+
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnityWindowBrowserControlEvent(int windowIndex, int eventID, int eventParam0, int eventParam1, string eventParamS);
 
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern int servoUnityGetWindowCount();
 
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityGetWindowCountMax();
+
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     [return: MarshalAsAttribute(UnmanagedType.I1)]
     public static extern bool servoUnityRequestNewWindow(int uid, int widthPixelsRequested, int heightPixelsRequested);
 
+    /// Returns the index of the prewarm window, or 0 on error.
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityPrewarm(int widthPixels, int heightPixels);
+
+    ///
+    /// Must be called from rendering thread with active rendering context.
+    /// As an alternative to invoking directly, an equivalent invocation can be invoked via
+    /// render event 4 (Prewarm) issued with GetRenderEventAndDataFunc(). See ServoUnityPlugin.ServoUnityPrewarm.
+    ///
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnityPrewarmRenderer(int windowIndex);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAsAttribute(UnmanagedType.I1)]
+    public static extern bool servoUnityDetachWindow(int windowIndex);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAsAttribute(UnmanagedType.I1)]
+    public static extern bool servoUnityAttachWindow(int windowIndex, int uid, int widthPixelsRequested, int heightPixelsRequested);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnityServicePluginEvents();
+
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnityGetWindowTextureFormat(int windowIndex, out int width, out int height, out int format, [MarshalAsAttribute(UnmanagedType.I1)] out bool mipChain, [MarshalAsAttribute(UnmanagedType.I1)] out bool linear, IntPtr[] nativeTextureIDHandle);
 
@@ -78,6 +146,12 @@ public static class ServoUnityPlugin_pinvoke
     [return: MarshalAsAttribute(UnmanagedType.I1)]
     public static extern bool servoUnityRequestWindowSizeChange(int windowIndex, int width, int height);
 
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnitySetWindowProjectedSize(int windowIndex, int width, int height);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern void servoUnitySetWindowVisible(int windowIndex, [MarshalAs(UnmanagedType.I1)] bool visible);
+
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     [return: MarshalAsAttribute(UnmanagedType.I1)]
     public static extern bool servoUnityCloseWindow(int windowIndex);
@@ -90,7 +164,13 @@ public static class ServoUnityPlugin_pinvoke
     public static extern void servoUnityServiceWindowEvents(int windowIndex);
 
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
-    public static extern void servoUnityGetWindowMetadata(int windowIndex, [MarshalAs(UnmanagedType.LPStr)] StringBuilder titleBuf, int titleBufLen, [MarshalAs(UnmanagedType.LPStr)] StringBuilder urlBuf, int urlBufLen);
+    public static extern int servoUnityGetWindowMetadataVersion(int windowIndex);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityGetWindowMetadata(int windowIndex, [MarshalAs(UnmanagedType.LPStr)] StringBuilder titleBuf, int titleBufLen, [MarshalAs(UnmanagedType.LPStr)] StringBuilder urlBuf, int urlBufLen);
+
+    [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
+    public static extern int servoUnityGetWindowNavigationState(int windowIndex, [MarshalAsAttribute(UnmanagedType.I1)] out bool loading, [MarshalAsAttribute(UnmanagedType.I1)] out bool canGoBack, [MarshalAsAttribute(UnmanagedType.I1)] out bool canGoForward);
 
     ///
     /// Must be called from rendering thread with active rendering context.
@@ -103,18 +183,22 @@ public static class ServoUnityPlugin_pinvoke
 
     ///
     /// Must be called from rendering thread with active rendering context.
-    /// As an alternative to invoking directly, an equivalent invocation can be invoked via call this sequence:
-    ///     servoUnitySetRenderEventFunc2Param(windowIndex);
-    ///     (*GetRenderEventFunc())(2);
+    /// As an alternative to invoking directly, an equivalent invocation can be invoked via
+    /// render event 3 (UpdateWindows) issued with GetRenderEventAndDataFunc(). See ServoUnityPlugin.ServoUnityRequestWindowsUpdate.
     ///
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
-    public static extern void servoUnityCleanupRenderer(int windowIndex);
+    public static extern void servoUnityRequestWindowsUpdate(int[] windowIndices, int count, float timeDelta);
 
+    ///
+    /// Must be called from rendering thread with active rendering context.
+    /// As an alternative to invoking directly, an equivalent invocation can be invoked via
+    /// render event 2 (CleanupRenderer) issued with GetRenderEventAndDataFunc(). See ServoUnityPlugin.ServoUnityCleanupRenderer.
+    ///
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
-    public static extern void servoUnitySetRenderEventFunc1Params(int windowIndex, float timeDelta);
+    public static extern void servoUnityCleanupRenderer(int windowIndex);
 
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
-    public static extern void servoUnitySetRenderEventFunc2Param(int windowIndex);
+    public static extern void servoUnitySetRenderEventFunc1Params(int windowIndex, float timeDelta);
 
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnitySetParamBool(int param, bool flag);
@@ -123,7 +207,7 @@ public static class ServoUnityPlugin_pinvoke
     public static extern void servoUnitySetParamInt(int param, int flag);
 
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
-    public static extern void servoUnitySetParamFloat(int param, [MarshalAsAttribute(UnmanagedType.I1)] bool flag);
+    public static extern void servoUnitySetParamFloat(int param, float val);
 
     [DllImport(LIBRARY_NAME, CallingConvention = CallingConvention.Cdecl)]
     public static extern void servoUnitySetParamString(int param, string s);
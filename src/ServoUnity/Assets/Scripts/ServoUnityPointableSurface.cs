@@ -16,6 +16,7 @@ public class ServoUnityPointableSurface : MonoBehaviour
     public ServoUnityPlugin servo_unity_plugin = null; // Reference to the plugin. Will be set/cleared by ServoUnityController.
     protected Vector2Int videoSize;
     protected int _windowIndex = 0;
+    private ServoUnityPlugin.ServoUnityTouch[] touchBuffer = null;
 
     public void PointerEnter()
     {
@@ -70,4 +71,39 @@ public class ServoUnityPointableSurface : MonoBehaviour
         Debug.Log("PointerScrollDiscrete(" + scroll_x + ", " + scroll_y + ", " + windowCoord.x + ", " + windowCoord.y + ")");
         servo_unity_plugin?.ServoUnityWindowPointerEvent(_windowIndex, ServoUnityPlugin.ServoUnityPointerEventID.ScrollDiscrete, scroll_x, scroll_y, windowCoord.x, windowCoord.y);
     }
+
+    // Send this frame's touches, given in texture coordinates. Two-finger gestures are recognised by the plugin.
+    public void TouchEvents(int[] touchIDs, ServoUnityPlugin.ServoUnityTouchPhase[] phases, Vector2[] texCoords, int count)
+    {
+        if (touchBuffer == null || touchBuffer.Length < count) touchBuffer = new ServoUnityPlugin.ServoUnityTouch[count];
+        for (int i = 0; i < count; i++)
+        {
+            Vector2Int windowCoord = GetWindowCoordForTexCoord(texCoords[i]);
+            touchBuffer[i].touchID = touchIDs[i];
+            touchBuffer[i].phase = (int)phases[i];
+            touchBuffer[i].windowX = windowCoord.x;
+            touchBuffer[i].windowY = windowCoord.y;
+        }
+        servo_unity_plugin?.ServoUnityWindowTouchEvents(_windowIndex, touchBuffer, count);
+    }
+
+    public void ScrollGestureBegin(Vector2 texCoord)
+    {
+        Vector2Int windowCoord = GetWindowCoordForTexCoord(texCoord);
+        servo_unity_plugin?.ServoUnityWindowPointerEvent(_windowIndex, ServoUnityPlugin.ServoUnityPointerEventID.ScrollGestureBegin, 0, 0, windowCoord.x, windowCoord.y);
+    }
+
+    // delta is in pixels, with the same sign convention as PointerScrollDiscrete.
+    public void ScrollGestureUpdate(Vector2 delta, Vector2 texCoord)
+    {
+        Vector2Int windowCoord = GetWindowCoordForTexCoord(texCoord);
+        servo_unity_plugin?.ServoUnityWindowPointerEvent(_windowIndex, ServoUnityPlugin.ServoUnityPointerEventID.ScrollGestureUpdate, (int)delta.x, (int)delta.y, windowCoord.x, windowCoord.y);
+    }
+
+    // velocity is in pixels per second. The plugin continues the scroll with momentum from this velocity.
+    public void ScrollGestureEnd(Vector2 velocity, Vector2 texCoord)
+    {
+        Vector2Int windowCoord = GetWindowCoordForTexCoord(texCoord);
+        servo_unity_plugin?.ServoUnityWindowPointerEvent(_windowIndex, ServoUnityPlugin.ServoUnityPointerEventID.ScrollGestureEnd, (int)velocity.x, (int)velocity.y, windowCoord.x, windowCoord.y);
+    }
 }
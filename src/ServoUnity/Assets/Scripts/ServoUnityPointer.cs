@@ -33,6 +33,10 @@ public class ServoUnityPointer : MonoBehaviour
     public float reticleRadius = 0.01f;
     public float maximumPointerDistance = 100.0f;
     public float discreteScrollStepSize = 10.0f;
+    // If true, scrolling is sent as a gesture in pixels, and continues with momentum once scrolling stops.
+    public bool kineticScroll = false;
+    public float kineticScrollStepSize = 40.0f; // Pixels per unit of scrollDelta.
+    public float kineticScrollGestureTimeout = 0.1f; // Seconds without scrolling after which a gesture ends.
  
     private GameObject reticle;
 
@@ -61,6 +65,11 @@ public class ServoUnityPointer : MonoBehaviour
     protected Vector2 previousCoord = resetCoord;
     protected Transform[] previousContactButtonDown = { null, null, null };
 
+    private ServoUnityPointableSurface scrollGestureSurface = null;
+    private Vector2 scrollGestureCoord;
+    private Vector2 scrollGestureVelocity;
+    private float scrollGestureLastTime;
+
     protected virtual void Awake()
     {
         // Create the reticle.
@@ -208,6 +217,7 @@ public class ServoUnityPointer : MonoBehaviour
 
         if (previousContact && (!bHit || previousContact != hit.transform))
         {
+            EndScrollGesture(false);
             ServoUnityPointableSurface sups = previousContact.gameObject.GetComponentInParent(typeof(ServoUnityPointableSurface)) as ServoUnityPointableSurface; // Uses GetComponentInParent rather than GetComponent since the MeshCollider is created on VideoSurface, which is a child object of the PointableSurface.
             if (sups != null)
             {
@@ -312,12 +322,49 @@ public class ServoUnityPointer : MonoBehaviour
                 previousCoord = hit.textureCoord;
             }
 
-            if (scrollDelta != Vector2.zero)
+            if (kineticScroll)
+            {
+                UpdateScrollGesture(sups, hit.textureCoord);
+            }
+            else if (scrollDelta != Vector2.zero)
             {
                 sups.PointerScrollDiscrete(scrollDelta * discreteScrollStepSize, hit.textureCoord);
             }
         } // bHit
     }
+
+    private void UpdateScrollGesture(ServoUnityPointableSurface sups, Vector2 texCoord)
+    {
+        if (scrollDelta == Vector2.zero)
+        {
+            if (scrollGestureSurface != null && Time.time - scrollGestureLastTime > kineticScrollGestureTimeout) EndScrollGesture(true);
+            return;
+        }
+
+        Vector2 delta = scrollDelta * kineticScrollStepSize;
+        if (scrollGestureSurface == null)
+        {
+            scrollGestureSurface = sups;
+            scrollGestureVelocity = Vector2.zero;
+            sups.ScrollGestureBegin(texCoord);
+        }
+        else
+        {
+            // Smooth the velocity over the gesture, since scroll input often arrives in uneven steps.
+            float dt = Mathf.Max(Time.time - scrollGestureLastTime, Time.deltaTime);
+            if (dt > 0.0f) scrollGestureVelocity = Vector2.Lerp(scrollGestureVelocity, delta / dt, 0.5f);
+        }
+        sups.ScrollGestureUpdate(delta, texCoord);
+        scrollGestureCoord = texCoord;
+        scrollGestureLastTime = Time.time;
+    }
+
+    private void EndScrollGesture(bool withMomentum)
+    {
+        if (scrollGestureSurface == null) return;
+        scrollGestureSurface.ScrollGestureEnd(withMomentum ? scrollGestureVelocity : Vector2.zero, scrollGestureCoord);
+        scrollGestureSurface = null;
+    }
 }
 
 public struct PointerEventArgs
@@ -33,13 +33,8 @@ public class ServoUnityTextureUtils : MonoBehaviour
         vt.wrapMode = TextureWrapMode.Clamp;
         vt.anisoLevel = 0;
 
-        // Initialise the video texture to black.
-        Color32[] arr = new Color32[width * height];
-        Color32 blackOpaque = new Color32(0, 0, 0, 255);
-        for (int i = 0; i < arr.Length; i++) arr[i] = blackOpaque;
-        vt.SetPixels32(arr);
-        vt.Apply(); // Pushes all SetPixels*() ops to texture.
-        arr = null;
+        // The texture's contents are not initialised here. Once the texture is passed to the plugin
+        // via ServoUnitySetWindowUnityTextureID, the plugin clears it to black on the GPU.
 
         return vt;
     }
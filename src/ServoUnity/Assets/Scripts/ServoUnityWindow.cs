@@ -19,6 +19,8 @@ public class ServoUnityWindow : ServoUnityPointableSurface
     public int DefaultHeightToRequest = 1080;
     public bool flipX = false;
     public bool flipY = false;
+    [Tooltip("With ServoUnityController.PersistentEngine, identifies the browser window this object shows across scenes. Defaults to the GameObject's name.")]
+    public string PersistenceKey = "";
     private static float DefaultWidth = 3.0f;
     public float Width = DefaultWidth;
     private float Height;
@@ -29,8 +31,26 @@ public class ServoUnityWindow : ServoUnityPointableSurface
 
     private Texture2D _videoTexture = null; // Texture object with the video image.
 
+    // Textures from previous sizes, most recently used first, kept for reuse if the window returns to that size.
+    private List<Texture2D> _texturePool = new List<Texture2D>();
+    private const int TexturePoolMax = 2;
+
     private TextureFormat _textureFormat;
 
+    private Vector2Int _projectedSize = Vector2Int.zero; // Last on-screen size sent to the plugin.
+
+    // Windows which have been created on the plugin side, and so need updating each frame.
+    private static List<ServoUnityWindow> s_activeWindows = new List<ServoUnityWindow>();
+    public static List<ServoUnityWindow> ActiveWindows => s_activeWindows;
+
+    // Plugin-side windows kept running, without a Unity object, by PersistentEngine. Keyed by PersistenceKey.
+    // Keys default to GameObject names, which needn't be unique, so each key holds a list, oldest first.
+    private static Dictionary<string, List<int>> s_detachedWindows = new Dictionary<string, List<int>>();
+    public static bool HasDetachedWindows => s_detachedWindows.Count > 0;
+    private bool _detached = false; // This object's window was detached, and will be reattached when the controller is next enabled.
+
+    private string Key => String.IsNullOrEmpty(PersistenceKey) ? gameObject.name : PersistenceKey;
+
     public Vector2Int PixelSize
     {
         get => videoSize;
@@ -72,6 +92,7 @@ public class ServoUnityWindow : ServoUnityPointableSurface
 
     void OnDestroy()
     {
+        s_activeWindows.Remove(this);
         suc = null;
     }
 
@@ -85,6 +106,7 @@ public class ServoUnityWindow : ServoUnityPointableSurface
             {
                 _videoMeshGO.SetActive(visible);
             }
+            if (_windowIndex != 0) servo_unity_plugin?.ServoUnitySetWindowVisible(_windowIndex, visible);
         }
     }
 
@@ -99,15 +121,77 @@ public class ServoUnityWindow : ServoUnityPointableSurface
     {
     }
 
-    void Start()
+    IEnumerator Start()
     {
         Debug.Log("ServoUnityWindow.Start()");
 
-        if (_windowIndex == 0) {
-            servo_unity_plugin?.ServoUnityRequestNewWindow(GetInstanceID(), DefaultWidthToRequest, DefaultHeightToRequest);
+        // If the engine is being prewarmed, wait for it, so that this window appears without a hitch.
+        while (ServoUnityController.EnginePrewarming) yield return null;
+
+        if (_windowIndex == 0 && !Reattach()) {
+            if (servo_unity_plugin != null && !servo_unity_plugin.ServoUnityRequestNewWindow(GetInstanceID(), DefaultWidthToRequest, DefaultHeightToRequest)) {
+                Debug.LogError("Unable to open a Servo window. Note that at most " + servo_unity_plugin.ServoUnityGetWindowCountMax() + " can be open at once, including detached windows.");
+            }
         }
     }
 
+    /// Leave the plugin-side window and its engine running, for a later Reattach by this or
+    /// another object with the same PersistenceKey, e.g. in the next scene.
+    public void Detach()
+    {
+        if (_windowIndex == 0 || servo_unity_plugin == null) return;
+        Debug.Log("ServoUnityWindow.Detach(), key " + Key);
+        if (!servo_unity_plugin.ServoUnityDetachWindow(_windowIndex)) return;
+        List<int> windowIndices;
+        if (!s_detachedWindows.TryGetValue(Key, out windowIndices))
+        {
+            windowIndices = new List<int>();
+            s_detachedWindows.Add(Key, windowIndices);
+        }
+        else
+        {
+            Debug.LogWarning("ServoUnityWindow.Detach(): another window is already detached with key " + Key + ". Give each persistent window a unique PersistenceKey so that it is reattached to the right object.");
+        }
+        windowIndices.Add(_windowIndex);
+        s_activeWindows.Remove(this);
+        _windowIndex = 0;
+        _detached = true;
+        DestroyWindow(); // Textures are recreated when the window is reattached.
+    }
+
+    /// Take over a detached window with this object's PersistenceKey, if there is one.
+    public bool Reattach()
+    {
+        _detached = false;
+        List<int> windowIndices;
+        if (servo_unity_plugin == null || !s_detachedWindows.TryGetValue(Key, out windowIndices)) return false;
+        Debug.Log("ServoUnityWindow.Reattach(), key " + Key);
+        int windowIndex = windowIndices[0];
+        windowIndices.RemoveAt(0);
+        if (windowIndices.Count == 0) s_detachedWindows.Remove(Key);
+        // The plugin calls back into WasCreated.
+        if (servo_unity_plugin.ServoUnityAttachWindow(windowIndex, GetInstanceID(), DefaultWidthToRequest, DefaultHeightToRequest)) return true;
+        // The plugin keeps a window it couldn't attach detached, so keep it for teardown at quit.
+        if (!s_detachedWindows.TryGetValue(Key, out windowIndices))
+        {
+            windowIndices = new List<int>();
+            s_detachedWindows.Add(Key, windowIndices);
+        }
+        windowIndices.Insert(0, windowIndex);
+        return false;
+    }
+
+    public bool Detached => _detached;
+
+    /// For teardown at application quit. Returns the indices of windows left detached, and forgets them.
+    public static List<int> TakeDetachedWindowIndices()
+    {
+        List<int> indices = new List<int>();
+        foreach (List<int> windowIndices in s_detachedWindows.Values) indices.AddRange(windowIndices);
+        s_detachedWindows.Clear();
+        return indices;
+    }
+
     public void CleanupRenderer()
     {
         Debug.Log("ServoUnityWindow.CleanupRenderer()");
@@ -123,6 +207,7 @@ public class ServoUnityWindow : ServoUnityPointableSurface
 
         servo_unity_plugin?.ServoUnityCloseWindow(_windowIndex);
         _windowIndex = 0;
+        s_activeWindows.Remove(this);
     }
 
     public void RequestSizeMultiple(float sizeMultiple)
@@ -134,11 +219,18 @@ public class ServoUnityWindow : ServoUnityPointableSurface
 
     public bool Resize(int widthPixels, int heightPixels)
     {
-        if (servo_unity_plugin != null)
+        if (servo_unity_plugin == null || widthPixels <= 0 || heightPixels <= 0) return false;
+        if (!servo_unity_plugin.ServoUnityRequestWindowSizeChange(_windowIndex, widthPixels, heightPixels)) return false;
+
+        // The plugin waits for the size to settle before resizing, so until WasResized is called,
+        // show the existing texture stretched over the new shape.
+        if (_videoMeshGO != null)
         {
-            return servo_unity_plugin.ServoUnityRequestWindowSizeChange(_windowIndex, widthPixels, heightPixels);
+            Height = (Width / widthPixels) * heightPixels;
+            ServoUnityTextureUtils.Configure2DVideoSurface(_videoMeshGO, _videoTexture, textureScaleU, textureScaleV, Width,
+                Height, flipX, flipY);
         }
-        return false;
+        return true;
     }
 
     /// <summary>
@@ -153,6 +245,7 @@ public class ServoUnityWindow : ServoUnityPointableSurface
         Debug.Log("ServoUnityWindow.WasCreated(windowIndex:" + windowIndex + ", widthPixels:" + widthPixels +
                   ", heightPixels:" + heightPixels + ", format:" + format + ")");
         _windowIndex = windowIndex;
+        servo_unity_plugin?.ServoUnitySetWindowVisible(_windowIndex, Visible);
         Height = (Width / widthPixels) * heightPixels;
         videoSize = new Vector2Int(widthPixels, heightPixels);
         _textureFormat = format;
@@ -163,6 +256,7 @@ public class ServoUnityWindow : ServoUnityPointableSurface
         _videoMeshGO.transform.localPosition = Vector3.zero;
         _videoMeshGO.transform.localRotation = Quaternion.identity;
         _videoMeshGO.SetActive(Visible);
+        if (!s_activeWindows.Contains(this)) s_activeWindows.Add(this);
 
         suc.NavbarWindow = this; // Set ourself as the active window for the navbar.
     }
@@ -176,7 +270,15 @@ public class ServoUnityWindow : ServoUnityPointableSurface
         videoSize = new Vector2Int(widthPixels, heightPixels);
         var oldTexture = _videoTexture;
         _videoTexture = CreateWindowTexture(videoSize.x, videoSize.y, _textureFormat, out textureScaleU, out textureScaleV);
-        Destroy(oldTexture);
+        if (oldTexture != null)
+        {
+            _texturePool.Insert(0, oldTexture);
+            while (_texturePool.Count > TexturePoolMax)
+            {
+                Destroy(_texturePool[_texturePool.Count - 1]);
+                _texturePool.RemoveAt(_texturePool.Count - 1);
+            }
+        }
 
         ServoUnityTextureUtils.Configure2DVideoSurface(_videoMeshGO, _videoTexture, textureScaleU, textureScaleV, Width,
             Height, flipX, flipY);
@@ -189,15 +291,53 @@ public class ServoUnityWindow : ServoUnityPointableSurface
 
         servo_unity_plugin?.ServoUnityServiceWindowEvents(_windowIndex);
 
-        //Debug.Log("ServoUnityWindow.Update() with _windowIndex == " + _windowIndex);
-        servo_unity_plugin?.ServoUnityRequestWindowUpdate(_windowIndex, Time.deltaTime);
+        if (suc != null && suc.DynamicResolution) UpdateProjectedSize();
+
+        // The texture update itself is requested by ServoUnityController, for all windows at once.
+    }
+
+    // Let the plugin know how many screen pixels the window covers, so that it can choose a render size.
+    private void UpdateProjectedSize()
+    {
+        Vector2Int size = Vector2Int.zero;
+        Camera cam = Camera.main;
+        if (cam != null && _videoMeshGO != null)
+        {
+            Transform t = _videoMeshGO.transform;
+            Vector3 p0 = cam.WorldToScreenPoint(t.TransformPoint(new Vector3(-Width * 0.5f, 0.0f, 0.0f)));
+            Vector3 p1 = cam.WorldToScreenPoint(t.TransformPoint(new Vector3(Width * 0.5f, 0.0f, 0.0f)));
+            Vector3 p2 = cam.WorldToScreenPoint(t.TransformPoint(new Vector3(Width * 0.5f, Height, 0.0f)));
+            Vector3 p3 = cam.WorldToScreenPoint(t.TransformPoint(new Vector3(-Width * 0.5f, Height, 0.0f)));
+            // If any corner is behind the camera, the projection is meaningless, so report the size as unknown.
+            if (p0.z > 0.0f && p1.z > 0.0f && p2.z > 0.0f && p3.z > 0.0f)
+            {
+                float w = Mathf.Max(Vector2.Distance(p0, p1), Vector2.Distance(p3, p2));
+                float h = Mathf.Max(Vector2.Distance(p0, p3), Vector2.Distance(p1, p2));
+                size = new Vector2Int(Mathf.CeilToInt(w), Mathf.CeilToInt(h));
+            }
+        }
+        if (size != _projectedSize)
+        {
+            _projectedSize = size;
+            servo_unity_plugin?.ServoUnitySetWindowProjectedSize(_windowIndex, size.x, size.y);
+        }
     }
 
     private Texture2D CreateWindowTexture(int videoWidth, int videoHeight, TextureFormat format,
         out float textureScaleU, out float textureScaleV)
     {
-        // Check parameters.
-        var vt = ServoUnityTextureUtils.CreateTexture(videoWidth, videoHeight, format);
+        // Reuse a pooled texture of the right size, if we have one.
+        Texture2D vt = null;
+        int i = _texturePool.FindIndex(t => t.width == videoWidth && t.height == videoHeight && t.format == format);
+        if (i >= 0)
+        {
+            vt = _texturePool[i];
+            _texturePool.RemoveAt(i);
+        }
+        else
+        {
+            vt = ServoUnityTextureUtils.CreateTexture(videoWidth, videoHeight, format);
+        }
         if (vt == null)
         {
             textureScaleU = 0;
@@ -217,6 +357,13 @@ public class ServoUnityWindow : ServoUnityPointableSurface
         return vt;
     }
 
+    /// Destroy textures kept for reuse by a later resize, e.g. under memory pressure.
+    public void ReleaseTexturePool()
+    {
+        foreach (Texture2D t in _texturePool) Destroy(t);
+        _texturePool.Clear();
+    }
+
     private void DestroyWindow()
     {
         bool ed = Application.isEditor;
@@ -227,6 +374,13 @@ public class ServoUnityWindow : ServoUnityPointableSurface
             _videoTexture = null;
         }
 
+        foreach (Texture2D t in _texturePool)
+        {
+            if (ed) DestroyImmediate(t);
+            else Destroy(t);
+        }
+        _texturePool.Clear();
+
         if (_videoMeshGO != null)
         {
             if (ed) DestroyImmediate(_videoMeshGO);
@@ -0,0 +1,313 @@
+//
+// ServoUnityCompilePolicy.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Build-time tool which compiles navigation rules into a policy for
+// ServoUnityNavigationPolicy. Usage:
+//
+//     ServoUnityCompilePolicy <rules file> [<output file>]
+//
+// The output defaults to navigation_policy.sunp beside the rules file. Place it in
+// the resources directory before packing it with ServoUnityPackResources.
+//
+// Rules are one per line, with '#' starting a comment:
+//     block <domain>
+//     allow <domain>
+//     redirect <domain> <url>
+// Each applies to the domain and its subdomains, and the most specific rule wins,
+// so "allow" can make exceptions to a "block" of a parent domain. Lines in hosts
+// file form ("0.0.0.0 <domain>" or "127.0.0.1 <domain>") are taken as blocks, so
+// that published blocklists can be used directly.
+//
+// Build with any C++14 compiler, e.g.:
+//     c++ -std=c++14 -O2 -I../ServoUnityPlugin ServoUnityCompilePolicy.cpp ../ServoUnityPlugin/ServoUnityFiles.cpp -o ServoUnityCompilePolicy
+//     cl /std:c++14 /O2 /EHsc /I..\ServoUnityPlugin ServoUnityCompilePolicy.cpp ..\ServoUnityPlugin\ServoUnityFiles.cpp
+//
+
+#include "ServoUnityNavigationPolicy.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+    struct Rule {
+        std::string domain;
+        uint8_t action;
+        std::string redirect;
+        int line;
+    };
+
+    struct TrieNode {
+        std::string label;
+        std::map<std::string, int> children; // std::string orders bytewise, then shorter first, as the plugin expects.
+        int rule = -1;
+        int parent = 0;
+        uint32_t index = 0; // In the output.
+    };
+}
+
+// Lowercases domain and strips any leading "*." or "." and trailing ".". Returns false if it isn't a plausible host name.
+static bool normaliseDomain(std::string& domain)
+{
+    if (domain.compare(0, 2, "*.") == 0) domain.erase(0, 2);
+    else if (!domain.empty() && domain[0] == '.') domain.erase(0, 1);
+    if (!domain.empty() && domain.back() == '.') domain.pop_back();
+    if (domain.empty() || domain.size() > 253) return false;
+    for (char& c : domain) {
+        if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+        else if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || (unsigned char)c >= 0x80)) return false;
+    }
+    return domain.find("..") == std::string::npos;
+}
+
+static std::vector<std::string> labelsOf(const std::string& domain)
+{
+    std::vector<std::string> labels; // Top-level domain first.
+    size_t end = domain.size();
+    for (;;) {
+        size_t dot = domain.rfind('.', end - 1);
+        size_t start = (dot == std::string::npos ? 0 : dot + 1);
+        labels.push_back(domain.substr(start, end - start));
+        if (dot == std::string::npos) break;
+        end = dot;
+    }
+    return labels;
+}
+
+static bool readRules(const char *path, std::vector<Rule>& rules)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Unable to open rules file '%s'.\n", path);
+        return false;
+    }
+    std::string text;
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) text.append(buf, n);
+    fclose(fp);
+
+    std::map<std::string, size_t> byDomain;
+    std::istringstream in(text);
+    std::string line;
+    int lineNumber = 0;
+    bool ok = true;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream words(line);
+        std::string verb, domain, redirect, extra;
+        if (!(words >> verb)) continue;
+        words >> domain >> redirect >> extra;
+        bool hostsForm = (verb == "0.0.0.0" || verb == "127.0.0.1");
+        Rule rule;
+        rule.line = lineNumber;
+        if (verb == "block" && redirect.empty()) rule.action = ServoUnityNavigationPolicyAction_Block;
+        else if (verb == "allow" && redirect.empty()) rule.action = ServoUnityNavigationPolicyAction_Allow;
+        else if (verb == "redirect" && !redirect.empty() && extra.empty()) rule.action = ServoUnityNavigationPolicyAction_Redirect;
+        else if (hostsForm && redirect.empty()) rule.action = ServoUnityNavigationPolicyAction_Block;
+        else {
+            fprintf(stderr, "%s:%d: Unrecognised rule.\n", path, lineNumber);
+            ok = false;
+            continue;
+        }
+        if (hostsForm && (domain == "localhost" || domain == "localhost.localdomain" || domain == "local" || domain == "broadcasthost")) continue; // Hosts file boilerplate.
+        if (!normaliseDomain(domain)) {
+            if (hostsForm) continue; // E.g. "0.0.0.0 0.0.0.0".
+            fprintf(stderr, "%s:%d: Invalid domain '%s'.\n", path, lineNumber, domain.c_str());
+            ok = false;
+            continue;
+        }
+        if (redirect.size() > 0xFFFF) {
+            fprintf(stderr, "%s:%d: Redirect URL too long.\n", path, lineNumber);
+            ok = false;
+            continue;
+        }
+        rule.domain = domain;
+        rule.redirect = redirect;
+        auto it = byDomain.find(domain);
+        if (it != byDomain.end()) {
+            if (rules[it->second].action != rule.action || rules[it->second].redirect != rule.redirect) {
+                fprintf(stderr, "%s:%d: Warning: replaces the rule for '%s' on line %d.\n", path, lineNumber, domain.c_str(), rules[it->second].line);
+            }
+            rules[it->second] = rule;
+        } else {
+            byDomain[domain] = rules.size();
+            rules.push_back(rule);
+        }
+    }
+    return ok;
+}
+
+// Decides a host against the rules as the plugin will, returning the matching rule or -1.
+static int match(const std::vector<TrieNode>& trie, const std::string& host)
+{
+    int node = 0, rule = -1;
+    for (const std::string& label : labelsOf(host)) {
+        auto it = trie[node].children.find(label);
+        if (it == trie[node].children.end()) break;
+        node = it->second;
+        if (trie[node].rule >= 0) rule = trie[node].rule;
+    }
+    return rule;
+}
+
+static std::string hostOfURL(const std::string& url)
+{
+    size_t start = url.find("://");
+    if (start == std::string::npos) return std::string();
+    start += 3;
+    size_t end = url.find_first_of("/?#", start);
+    std::string authority = url.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    size_t at = authority.rfind('@');
+    if (at != std::string::npos) authority.erase(0, at + 1);
+    if (!authority.empty() && authority[0] == '[') return std::string(); // Literal IPv6 addresses match no rule.
+    std::string host = authority.substr(0, authority.find(':'));
+    return normaliseDomain(host) ? host : std::string();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <rules file> [<output file>]\n", argv[0]);
+        return 1;
+    }
+    std::string rulesPath = argv[1];
+    std::string outPath;
+    if (argc == 3) outPath = argv[2];
+    else {
+        size_t slash = rulesPath.find_last_of("/\\");
+        outPath = (slash == std::string::npos ? std::string() : rulesPath.substr(0, slash + 1)) + SERVO_UNITY_NAVIGATION_POLICY_NAME;
+    }
+
+    std::vector<Rule> rules;
+    if (!readRules(rulesPath.c_str(), rules)) return 1;
+
+    // Build the trie, top-level domain first.
+    std::vector<TrieNode> trie(1);
+    for (size_t r = 0; r < rules.size(); r++) {
+        int node = 0;
+        for (const std::string& label : labelsOf(rules[r].domain)) {
+            auto it = trie[node].children.find(label);
+            if (it == trie[node].children.end()) {
+                TrieNode child;
+                child.label = label;
+                child.parent = node;
+                trie.push_back(child);
+                it = trie[node].children.emplace(label, (int)trie.size() - 1).first;
+            }
+            node = it->second;
+        }
+        trie[node].rule = (int)r;
+    }
+
+    // A redirect to somewhere itself blocked or redirected would fail or loop.
+    bool ok = true;
+    for (const Rule& rule : rules) {
+        if (rule.action != ServoUnityNavigationPolicyAction_Redirect) continue;
+        std::string host = hostOfURL(rule.redirect);
+        int target = host.empty() ? -1 : match(trie, host);
+        if (target >= 0 && rules[target].action != ServoUnityNavigationPolicyAction_Allow) {
+            fprintf(stderr, "%s:%d: Redirect target '%s' is itself %s by line %d.\n", rulesPath.c_str(), rule.line, rule.redirect.c_str(),
+                rules[target].action == ServoUnityNavigationPolicyAction_Block ? "blocked" : "redirected", rules[target].line);
+            ok = false;
+        }
+    }
+    if (!ok) return 1;
+
+    // Number nodes breadth-first, so that each node's children are contiguous and follow it.
+    std::vector<int> order;
+    std::deque<int> queue(1, 0);
+    while (!queue.empty()) {
+        int node = queue.front();
+        queue.pop_front();
+        trie[node].index = (uint32_t)order.size();
+        order.push_back(node);
+        for (const auto& child : trie[node].children) queue.push_back(child.second);
+    }
+
+    // Bloom filter of about 10 bits per rule, with 7 hashes, for under 1% false positives.
+    uint32_t bloomWords = 1;
+    while ((uint64_t)bloomWords * 64 < rules.size() * 10) bloomWords *= 2;
+    const uint32_t bloomHashes = 7;
+    std::vector<uint64_t> bloom(bloomWords, 0);
+    uint64_t bitMask = (uint64_t)bloomWords * 64 - 1;
+    for (const Rule& rule : rules) {
+        uint64_t h = ServoUnityFiles::kHashSeed;
+        for (const std::string& label : labelsOf(rule.domain)) servoUnityNavigationPolicyHashLabel(h, label.data(), label.size());
+        for (uint32_t i = 0; i < bloomHashes; i++) {
+            uint64_t bit = servoUnityNavigationPolicyBloomBit(h, i, bitMask);
+            bloom[bit >> 6] |= 1ULL << (bit & 63);
+        }
+    }
+
+    std::string strings;
+    std::vector<ServoUnityNavigationPolicyNode> nodes;
+    for (int node : order) {
+        const TrieNode& t = trie[node];
+        ServoUnityNavigationPolicyNode n = {};
+        n.labelOffset = (uint32_t)strings.size();
+        n.labelLength = (uint32_t)t.label.size();
+        strings += t.label;
+        n.firstChild = t.children.empty() ? 0 : trie[t.children.begin()->second].index;
+        n.childCount = (uint32_t)t.children.size();
+        n.parent = trie[t.parent].index;
+        n.rule = kServoUnityNavigationPolicyNoRule;
+        n.action = ServoUnityNavigationPolicyAction_None;
+        if (t.rule >= 0) {
+            const Rule& rule = rules[t.rule];
+            n.rule = (uint32_t)t.rule;
+            n.action = rule.action;
+            n.redirectOffset = (uint32_t)strings.size();
+            n.redirectLength = (uint16_t)rule.redirect.size();
+            strings += rule.redirect;
+        }
+        nodes.push_back(n);
+    }
+    std::vector<uint32_t> ruleNodes(rules.size());
+    for (const TrieNode& t : trie) {
+        if (t.rule >= 0) ruleNodes[t.rule] = t.index;
+    }
+
+    ServoUnityNavigationPolicyHeader header;
+    memcpy(header.magic, SERVO_UNITY_NAVIGATION_POLICY_MAGIC, 4);
+    header.version = SERVO_UNITY_NAVIGATION_POLICY_VERSION;
+    header.nodeCount = (uint32_t)nodes.size();
+    header.ruleCount = (uint32_t)rules.size();
+    header.bloomWords = bloomWords;
+    header.bloomHashes = bloomHashes;
+    header.size = sizeof(header) + bloom.size() * sizeof(uint64_t) + nodes.size() * sizeof(ServoUnityNavigationPolicyNode)
+        + ruleNodes.size() * sizeof(uint32_t) + strings.size();
+
+    FILE *out = fopen(outPath.c_str(), "wb");
+    if (!out) {
+        fprintf(stderr, "Unable to create '%s'.\n", outPath.c_str());
+        return 1;
+    }
+    ok = fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(bloom.data(), sizeof(uint64_t), bloom.size(), out) == bloom.size()
+        && (nodes.empty() || fwrite(nodes.data(), sizeof(ServoUnityNavigationPolicyNode), nodes.size(), out) == nodes.size())
+        && (ruleNodes.empty() || fwrite(ruleNodes.data(), sizeof(uint32_t), ruleNodes.size(), out) == ruleNodes.size())
+        && fwrite(strings.data(), 1, strings.size(), out) == strings.size();
+    if (fclose(out) != 0 || !ok) {
+        fprintf(stderr, "Error writing '%s'.\n", outPath.c_str());
+        remove(outPath.c_str());
+        return 1;
+    }
+    printf("Compiled %zu rules (%zu trie nodes, %u-byte bloom filter) into '%s' (%llu bytes).\n",
+        rules.size(), nodes.size(), bloomWords * 8, outPath.c_str(), (unsigned long long)header.size);
+    return 0;
+}
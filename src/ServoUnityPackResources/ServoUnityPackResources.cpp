@@ -0,0 +1,161 @@
+//
+// ServoUnityPackResources.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Build-time tool which packs a resources directory into a single archive
+// for ServoUnityResourceArchive. Usage:
+//
+//     ServoUnityPackResources <resources directory> [<output file>]
+//
+// The output defaults to resources.supak inside the resources directory, which
+// is where the plugin looks for it (e.g. Assets/StreamingAssets). Existing
+// archives are not packed into the new one.
+//
+// Build with any C++14 compiler, e.g.:
+//     c++ -std=c++14 -O2 -I../ServoUnityPlugin ServoUnityPackResources.cpp -o ServoUnityPackResources
+//     cl /std:c++14 /O2 /EHsc /I..\ServoUnityPlugin ServoUnityPackResources.cpp
+//
+
+#include "ServoUnityResourceArchive.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <dirent.h>
+#  include <sys/stat.h>
+#endif
+
+namespace {
+    struct Resource {
+        std::string name; // Relative, '/'-separated.
+        std::string path;
+    };
+}
+
+static bool hasSuffix(const std::string& s, const char *suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static void listResources(const std::string& dir, const std::string& prefix, std::vector<Resource>& resources)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+    if (h == INVALID_HANDLE_VALUE) return;
+    do {
+        std::string name = fd.cFileName;
+        if (name == "." || name == "..") continue;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) listResources(dir + "\\" + name, prefix + name + "/", resources);
+        else resources.push_back({prefix + name, dir + "\\" + name});
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    DIR *d = opendir(dir.c_str());
+    if (!d) return;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        std::string name = de->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode)) listResources(path, prefix + name + "/", resources);
+        else if (S_ISREG(st.st_mode)) resources.push_back({prefix + name, path});
+    }
+    closedir(d);
+#endif
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data.resize(size > 0 ? (size_t)size : 0);
+    bool ok = (size >= 0 && fread(data.data(), 1, data.size(), fp) == data.size());
+    fclose(fp);
+    return ok;
+}
+
+static void align8(std::vector<uint8_t>& blob)
+{
+    while (blob.size() % 8) blob.push_back(0);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "Usage: %s <resources directory> [<output file>]\n", argv[0]);
+        return 1;
+    }
+    std::string dir = argv[1];
+    while (dir.size() > 1 && (dir.back() == '/' || dir.back() == '\\')) dir.pop_back();
+    std::string output = (argc == 3 ? argv[2] : dir + "/" SERVO_UNITY_RESOURCE_ARCHIVE_NAME);
+
+    std::vector<Resource> resources;
+    listResources(dir, "", resources);
+    resources.erase(std::remove_if(resources.begin(), resources.end(), [](const Resource& r) { return hasSuffix(r.name, ".supak"); }), resources.end());
+    // Sorted bytewise, to match the reader's strcmp() binary search.
+    std::sort(resources.begin(), resources.end(), [](const Resource& a, const Resource& b) { return strcmp(a.name.c_str(), b.name.c_str()) < 0; });
+
+    // Header and index first, then names and data.
+    size_t indexEnd = sizeof(ServoUnityResourceArchiveHeader) + resources.size() * sizeof(ServoUnityResourceArchiveEntry);
+    std::vector<uint8_t> blob(indexEnd, 0);
+    align8(blob);
+    std::vector<ServoUnityResourceArchiveEntry> entries;
+    for (const Resource& r : resources) {
+        std::vector<uint8_t> data;
+        if (!readFile(r.path, data)) {
+            fprintf(stderr, "Error: unable to read '%s'.\n", r.path.c_str());
+            return 1;
+        }
+        ServoUnityResourceArchiveEntry e;
+        e.nameOffset = blob.size();
+        blob.insert(blob.end(), r.name.c_str(), r.name.c_str() + r.name.size() + 1);
+        align8(blob);
+        e.dataOffset = blob.size();
+        e.dataLength = data.size();
+        blob.insert(blob.end(), data.begin(), data.end());
+        align8(blob);
+        entries.push_back(e);
+    }
+
+    ServoUnityResourceArchiveHeader header;
+    memcpy(header.magic, SERVO_UNITY_RESOURCE_ARCHIVE_MAGIC, 4);
+    header.version = SERVO_UNITY_RESOURCE_ARCHIVE_VERSION;
+    header.count = (uint32_t)entries.size();
+    header.reserved = 0;
+    header.size = blob.size();
+    memcpy(blob.data(), &header, sizeof(header));
+    if (!entries.empty()) memcpy(blob.data() + sizeof(header), entries.data(), entries.size() * sizeof(ServoUnityResourceArchiveEntry));
+
+    // Write to a temporary file and rename, so a running player never maps a partial archive.
+    std::string tmp = output + ".tmp";
+    FILE *fp = fopen(tmp.c_str(), "wb");
+    if (!fp || fwrite(blob.data(), 1, blob.size(), fp) != blob.size() || fclose(fp) != 0) {
+        fprintf(stderr, "Error: unable to write '%s'.\n", tmp.c_str());
+        return 1;
+    }
+    remove(output.c_str());
+    if (rename(tmp.c_str(), output.c_str()) != 0) {
+        fprintf(stderr, "Error: unable to rename '%s' to '%s'.\n", tmp.c_str(), output.c_str());
+        return 1;
+    }
+    printf("Packed %zu resources (%zu bytes) into '%s'.\n", entries.size(), blob.size(), output.c_str());
+    return 0;
+}
@@ -0,0 +1,134 @@
+//
+// ServoUnityDynamicResolution.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityDynamicResolution.h"
+#include <algorithm>
+
+// Render sizes are restricted to a few fixed fractions of the nominal size.
+// As well as limiting the number of distinct sizes Servo is asked to render at,
+// this means that a window moving back and forth will revisit the same sizes.
+static const float kScales[] = {1.0f, 0.75f, 0.5f, 0.375f, 0.25f, 0.125f};
+static const int kScaleCount = sizeof(kScales) / sizeof(kScales[0]);
+
+static const float kFrameTimeAverageWeight = 0.1f;
+static const float kBudgetOverFactor = 1.1f; // Reduce resolution when the average frame time exceeds the budget by this factor...
+static const float kBudgetUnderFactor = 0.75f; // ... and restore it when the average falls below this fraction of the budget.
+static const float kBudgetCooldown = 1.0f; // Seconds.
+static const float kHoldTimeFiner = 0.25f; // Seconds a finer step must be preferred before switching to it.
+static const float kHoldTimeCoarser = 1.0f; // Seconds a coarser step must be preferred before switching to it.
+
+ServoUnityDynamicResolution::ServoUnityDynamicResolution() :
+    m_nominalWidth(0),
+    m_nominalHeight(0),
+    m_projectedWidth(0),
+    m_projectedHeight(0)
+{
+    reset();
+}
+
+void ServoUnityDynamicResolution::setNominalSize(int width, int height)
+{
+    m_nominalWidth = width;
+    m_nominalHeight = height;
+}
+
+void ServoUnityDynamicResolution::getNominalSize(int *width_p, int *height_p) const
+{
+    if (width_p) *width_p = m_nominalWidth;
+    if (height_p) *height_p = m_nominalHeight;
+}
+
+void ServoUnityDynamicResolution::setProjectedSize(int width, int height)
+{
+    m_projectedWidth = width;
+    m_projectedHeight = height;
+}
+
+void ServoUnityDynamicResolution::reset()
+{
+    m_frameTimeAverage = 0.0f;
+    m_budgetSteps = 0;
+    m_budgetCooldown = 0.0f;
+    m_step = 0;
+    m_candidateStep = 0;
+    m_candidateTime = 0.0f;
+}
+
+float ServoUnityDynamicResolution::scale() const
+{
+    return kScales[m_step];
+}
+
+int ServoUnityDynamicResolution::stepForProjectedSize(int stepMax) const
+{
+    if (m_projectedWidth <= 0 || m_projectedHeight <= 0 || m_nominalWidth <= 0 || m_nominalHeight <= 0) return 0;
+
+    // Choose the smallest step that still has at least as many pixels as the window covers on screen.
+    float required = std::max((float)m_projectedWidth / (float)m_nominalWidth, (float)m_projectedHeight / (float)m_nominalHeight);
+    int step = 0;
+    while (step < stepMax && kScales[step + 1] >= required) step++;
+    return step;
+}
+
+void ServoUnityDynamicResolution::sizeForStep(int step, int *width_p, int *height_p) const
+{
+    if (step == 0) {
+        *width_p = m_nominalWidth;
+        *height_p = m_nominalHeight;
+        return;
+    }
+    // Round to even dimensions, and never to zero.
+    *width_p = std::max(2, ((int)(m_nominalWidth * kScales[step] + 0.5f) + 1) & ~1);
+    *height_p = std::max(2, ((int)(m_nominalHeight * kScales[step] + 0.5f) + 1) & ~1);
+}
+
+void ServoUnityDynamicResolution::update(float timeDelta, float budget, float minScale, int *width_p, int *height_p)
+{
+    int stepMax = 0;
+    while (stepMax < kScaleCount - 1 && kScales[stepMax + 1] >= minScale) stepMax++;
+
+    // Frame-time pressure.
+    if (timeDelta > 0.0f) {
+        if (m_frameTimeAverage == 0.0f) m_frameTimeAverage = timeDelta;
+        else m_frameTimeAverage += (timeDelta - m_frameTimeAverage) * kFrameTimeAverageWeight;
+        m_budgetCooldown -= timeDelta;
+    }
+    if (budget > 0.0f && m_budgetCooldown <= 0.0f) {
+        if (m_frameTimeAverage > budget * kBudgetOverFactor && m_budgetSteps < stepMax) {
+            m_budgetSteps++;
+            m_budgetCooldown = kBudgetCooldown;
+        } else if (m_frameTimeAverage < budget * kBudgetUnderFactor && m_budgetSteps > 0) {
+            m_budgetSteps--;
+            m_budgetCooldown = kBudgetCooldown;
+        }
+    }
+
+    int target = std::min(stepForProjectedSize(stepMax) + m_budgetSteps, stepMax);
+
+    // Hysteresis.
+    if (target == m_step) {
+        m_candidateStep = m_step;
+        m_candidateTime = 0.0f;
+    } else if (target != m_candidateStep) {
+        m_candidateStep = target;
+        m_candidateTime = 0.0f;
+    } else {
+        m_candidateTime += timeDelta;
+        if (m_candidateTime >= (target < m_step ? kHoldTimeFiner : kHoldTimeCoarser)) {
+            m_step = target;
+            m_candidateTime = 0.0f;
+        }
+    }
+    if (m_step > stepMax) m_step = stepMax; // minScale may have been raised.
+
+    sizeForStep(m_step, width_p, height_p);
+}
@@ -0,0 +1,59 @@
+//
+// ServoUnityDynamicResolution.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Chooses the render resolution of a window from its projected on-screen size
+// and a frame-time budget.
+//
+
+#pragma once
+
+class ServoUnityDynamicResolution
+{
+public:
+    ServoUnityDynamicResolution();
+
+    /// Set the size requested for the window. This is the largest size that will be recommended.
+    void setNominalSize(int width, int height);
+    void getNominalSize(int *width_p, int *height_p) const;
+
+    /// Set the size, in screen pixels, that the window currently occupies. Pass 0, 0 if unknown.
+    void setProjectedSize(int width, int height);
+
+    /// Return to full resolution and discard frame-time history.
+    void reset();
+
+    ///
+    /// Feed the duration of the last frame, and get the recommended render size.
+    /// Changes to the recommended scale are only made once the new scale has been
+    /// consistently preferred for a hold period, so that the render size doesn't thrash.
+    /// @param timeDelta Duration of the last frame, in seconds.
+    /// @param budget Frame-time budget, in seconds.
+    /// @param minScale The smallest fraction of the nominal size that may be recommended.
+    ///
+    void update(float timeDelta, float budget, float minScale, int *width_p, int *height_p);
+
+    float scale() const;
+
+private:
+    int stepForProjectedSize(int stepMax) const;
+    void sizeForStep(int step, int *width_p, int *height_p) const;
+
+    int m_nominalWidth;
+    int m_nominalHeight;
+    int m_projectedWidth;
+    int m_projectedHeight;
+    float m_frameTimeAverage; // Exponentially-weighted moving average, in seconds.
+    int m_budgetSteps; // Additional reduction steps imposed by frame-time pressure.
+    float m_budgetCooldown; // Seconds until the budget reduction may change again.
+    int m_step; // Currently recommended step.
+    int m_candidateStep; // Step we'd like to move to.
+    float m_candidateTime; // Seconds for which m_candidateStep has been preferred.
+};
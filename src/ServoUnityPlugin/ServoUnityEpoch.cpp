@@ -0,0 +1,124 @@
+//
+// ServoUnityEpoch.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityEpoch.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Each reading thread claims a record, in which it publishes the global epoch it
+// observed on entry, or 0 while it is outside. The global epoch can only advance
+// once every active reader has observed the current value, so an object retired
+// in epoch e is unreachable by the time the global epoch reaches e + 2.
+static const int kRecordsMax = 64;
+
+namespace {
+    struct Record {
+        std::atomic<bool> claimed;
+        std::atomic<uint64_t> epoch;
+    };
+
+    struct ThreadRecord {
+        int index = -1;
+        int depth = 0;
+        ~ThreadRecord();
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        std::function<void()> reclaim;
+    };
+}
+
+static std::atomic<uint64_t> s_globalEpoch(1);
+static Record s_records[kRecordsMax];
+static std::atomic<int> s_overflowReaders(0); // Readers which couldn't claim a record. The epoch won't advance while any are inside.
+static std::deque<Retired> s_retired;
+static std::mutex s_retiredLock;
+static thread_local ThreadRecord t_record;
+
+ThreadRecord::~ThreadRecord()
+{
+    if (index >= 0) s_records[index].claimed.store(false);
+}
+
+static bool claimRecord(ThreadRecord& tr)
+{
+    for (int i = 0; i < kRecordsMax; i++) {
+        bool expected = false;
+        if (s_records[i].claimed.compare_exchange_strong(expected, true)) {
+            s_records[i].epoch.store(0);
+            tr.index = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ServoUnityEpoch::enter(void)
+{
+    ThreadRecord& tr = t_record;
+    if (tr.depth++ > 0) return;
+
+    if (tr.index >= 0 || claimRecord(tr)) {
+        // Re-check after publishing, in case the epoch advanced before collect() could see us.
+        uint64_t epoch;
+        do {
+            epoch = s_globalEpoch.load();
+            s_records[tr.index].epoch.store(epoch);
+        } while (s_globalEpoch.load() != epoch);
+    } else {
+        s_overflowReaders++;
+    }
+}
+
+void ServoUnityEpoch::exit(void)
+{
+    ThreadRecord& tr = t_record;
+    if (--tr.depth > 0) return;
+
+    if (tr.index >= 0) s_records[tr.index].epoch.store(0);
+    else s_overflowReaders--;
+}
+
+void ServoUnityEpoch::retire(std::function<void()> reclaim)
+{
+    std::lock_guard<std::mutex> lock(s_retiredLock);
+    s_retired.push_back({s_globalEpoch.load(), std::move(reclaim)});
+}
+
+int ServoUnityEpoch::collect(void)
+{
+    uint64_t epoch = s_globalEpoch.load();
+    bool canAdvance = (s_overflowReaders.load() == 0);
+    for (int i = 0; i < kRecordsMax && canAdvance; i++) {
+        uint64_t e = s_records[i].epoch.load();
+        if (e != 0 && e != epoch) canAdvance = false;
+    }
+    if (canAdvance && s_globalEpoch.compare_exchange_strong(epoch, epoch + 1)) epoch++;
+
+    // Run reclaims outside the lock, as they may themselves retire objects.
+    std::vector<std::function<void()>> ready;
+    int pending;
+    {
+        std::lock_guard<std::mutex> lock(s_retiredLock);
+        while (!s_retired.empty() && s_retired.front().epoch + 2 <= epoch) {
+            ready.push_back(std::move(s_retired.front().reclaim));
+            s_retired.pop_front();
+        }
+        pending = (int)s_retired.size();
+    }
+    for (auto& reclaim : ready) reclaim();
+    return pending;
+}
@@ -0,0 +1,48 @@
+//
+// ServoUnityEpoch.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Epoch-based reclamation of objects shared between threads without locks.
+//
+
+#pragma once
+
+#include <functional>
+
+//
+// Readers bracket their use of shared objects with ServoUnityEpoch::enter()/exit()
+// (or a ServoUnityEpochGuard). A writer that unpublishes an object passes it to
+// retire(), and it is reclaimed by a later collect() once every thread that might
+// still hold a reference has left the epoch in which it was retired.
+//
+// enter()/exit() are lock-free and may be nested and called from any thread.
+//
+class ServoUnityEpoch
+{
+public:
+    static void enter(void);
+    static void exit(void);
+
+    /// Queue reclaim to be run once no reader can still be using the retired object. May be called from any thread.
+    static void retire(std::function<void()> reclaim);
+
+    /// Advance the epoch if possible, and run any reclaims which are now safe. Reclaims run on the
+    /// calling thread, so this should be called from the main thread. Returns the number still pending.
+    static int collect(void);
+};
+
+class ServoUnityEpochGuard
+{
+public:
+    ServoUnityEpochGuard() { ServoUnityEpoch::enter(); }
+    ~ServoUnityEpochGuard() { ServoUnityEpoch::exit(); }
+    ServoUnityEpochGuard(const ServoUnityEpochGuard&) = delete;
+    ServoUnityEpochGuard& operator=(const ServoUnityEpochGuard&) = delete;
+};
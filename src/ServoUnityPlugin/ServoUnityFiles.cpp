@@ -0,0 +1,154 @@
+//
+// ServoUnityFiles.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityFiles.h"
+#include <cstdio>
+#ifdef _WIN32
+#  include <windows.h>
+#  include <direct.h> // _mkdir
+#else
+#  include <dirent.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/time.h>
+#  include <unistd.h>
+#endif
+
+namespace ServoUnityFiles {
+
+bool listDirectory(const std::string& dir, std::vector<FileInfo>& files)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA fd;
+    HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+    if (h == INVALID_HANDLE_VALUE) return false;
+    do {
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        files.push_back({fd.cFileName,
+                         ((uint64_t)fd.nFileSizeHigh << 32) | fd.nFileSizeLow,
+                         ((uint64_t)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime});
+    } while (FindNextFileA(h, &fd));
+    FindClose(h);
+#else
+    DIR *d = opendir(dir.c_str());
+    if (!d) return false;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        struct stat st;
+        if (stat((dir + kDirSeparator + de->d_name).c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+        files.push_back({de->d_name, (uint64_t)st.st_size, (uint64_t)st.st_mtime});
+    }
+    closedir(d);
+#endif
+    return true;
+}
+
+bool makeDirectory(const std::string& dir)
+{
+#ifdef _WIN32
+    return (_mkdir(dir.c_str()) == 0 || GetFileAttributesA(dir.c_str()) != INVALID_FILE_ATTRIBUTES);
+#else
+    struct stat st;
+    return (mkdir(dir.c_str(), 0755) == 0 || (stat(dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode)));
+#endif
+}
+
+bool fileExists(const std::string& path)
+{
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    bool nonEmpty = (fseek(fp, 0, SEEK_END) == 0 && ftell(fp) > 0);
+    fclose(fp);
+    return nonEmpty;
+}
+
+bool replaceFile(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+void touchFile(const std::string& path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(file, NULL, NULL, &now);
+    CloseHandle(file);
+#else
+    utimes(path.c_str(), NULL);
+#endif
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+    std::unique_ptr<MappedFile> mf(new MappedFile());
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    mf->m_file = file;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return nullptr;
+    mf->m_size = (size_t)size.QuadPart;
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) return nullptr;
+    mf->m_mapping = mapping;
+    mf->m_base = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    mf->m_size = (size_t)st.st_size;
+    void *base = mmap(NULL, mf->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file open.
+    mf->m_base = (base == MAP_FAILED ? nullptr : (const uint8_t *)base);
+#endif
+    if (!mf->m_base) return nullptr;
+    return mf;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (m_base) UnmapViewOfFile(m_base);
+    if (m_mapping) CloseHandle((HANDLE)m_mapping);
+    if (m_file) CloseHandle((HANDLE)m_file);
+#else
+    if (m_base) munmap((void *)m_base, m_size);
+#endif
+}
+
+void hash(uint64_t& h, const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+}
+
+void hash(uint64_t& h, const std::string& s)
+{
+    hash(h, s.c_str(), s.size() + 1);
+}
+
+} // namespace ServoUnityFiles
@@ -0,0 +1,79 @@
+//
+// ServoUnityFiles.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Small filesystem and hashing helpers shared by the plugin's on-disk caches.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ServoUnityFiles {
+
+#ifdef _WIN32
+    const char kDirSeparator = '\\';
+    const char kPathListSeparator = ';';
+#else
+    const char kDirSeparator = '/';
+    const char kPathListSeparator = ':';
+#endif
+
+    struct FileInfo {
+        std::string name;
+        uint64_t size;
+        uint64_t mtime; // Platform-specific units; only for comparison.
+    };
+
+    /// Lists regular files in dir. Returns false if dir can't be read.
+    bool listDirectory(const std::string& dir, std::vector<FileInfo>& files);
+    /// Creates dir if it doesn't exist. Its parent must exist. Returns false if dir isn't available.
+    bool makeDirectory(const std::string& dir);
+    /// True if path exists and is non-empty.
+    bool fileExists(const std::string& path);
+    /// Renames from to to, replacing any existing file at to.
+    bool replaceFile(const std::string& from, const std::string& to);
+    /// Sets the modification time of path to now, so that it sorts as most recently used.
+    void touchFile(const std::string& path);
+
+    /// A whole file mapped read-only into memory. Other handles may still write or delete the file.
+    class MappedFile
+    {
+    public:
+        /// Returns nullptr if path doesn't exist, is empty or can't be mapped.
+        static std::unique_ptr<MappedFile> open(const std::string& path);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const uint8_t *data(void) const { return m_base; }
+        size_t size(void) const { return m_size; }
+
+    private:
+        MappedFile() {}
+        const uint8_t *m_base = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void *m_file = nullptr;
+        void *m_mapping = nullptr;
+#endif
+    };
+
+    /// FNV-1a, 64-bit.
+    const uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+    void hash(uint64_t& h, const void *data, size_t len);
+    /// Hashes s including its terminating nul, so that concatenations can't collide.
+    void hash(uint64_t& h, const std::string& s);
+
+} // namespace ServoUnityFiles
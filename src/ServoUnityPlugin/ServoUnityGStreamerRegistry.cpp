@@ -0,0 +1,140 @@
+//
+// ServoUnityGStreamerRegistry.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityGStreamerRegistry.h"
+#include "ServoUnityFiles.h"
+#include "servo_unity_c.h"
+#include "servo_unity_log.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Bump if anything about how the cache is keyed or used changes.
+static const char *kCacheFormat = "gst-registry-cache-1";
+static const char *kFilePrefix = "registry-";
+static const char *kFileSuffix = ".bin";
+static const char *kColdTimeSuffix = ".coldms"; // Appended to the cache filename. Holds engine startup time when the cache was built.
+
+static int s_state = ServoUnityGStreamerRegistryCache_Disabled;
+static int s_pluginFileCount = 0;
+static std::string s_path;
+static double s_savedMs = -1.0;
+
+using namespace ServoUnityFiles;
+
+int ServoUnityGStreamerRegistry::configure(const char *cacheDir, const char *pluginPath, const char *salt)
+{
+    s_state = ServoUnityGStreamerRegistryCache_Disabled;
+    s_pluginFileCount = 0;
+    s_path.clear();
+    s_savedMs = -1.0;
+    if (!cacheDir || !cacheDir[0] || !pluginPath || !pluginPath[0]) return s_state;
+
+    // Fingerprint the plugin set. Directories are hashed in the order given, as that's GStreamer's search order.
+    uint64_t h = kHashSeed;
+    hash(h, kCacheFormat);
+    hash(h, salt ? salt : "");
+    std::string paths(pluginPath);
+    size_t start = 0;
+    while (start <= paths.size()) {
+        size_t end = paths.find(kPathListSeparator, start);
+        if (end == std::string::npos) end = paths.size();
+        std::string dir = paths.substr(start, end - start);
+        start = end + 1;
+        if (dir.empty()) continue;
+
+        std::vector<FileInfo> files;
+        if (!listDirectory(dir, files)) {
+            SERVOUNITYLOGw("Unable to read GStreamer plugin directory '%s'.\n", dir.c_str());
+        }
+        std::sort(files.begin(), files.end(), [](const FileInfo& a, const FileInfo& b) { return a.name < b.name; });
+        hash(h, dir);
+        for (const FileInfo& f : files) {
+            hash(h, f.name);
+            hash(h, &f.size, sizeof(f.size));
+            hash(h, &f.mtime, sizeof(f.mtime));
+        }
+        s_pluginFileCount += (int)files.size();
+    }
+
+    std::string dir = std::string(cacheDir) + kDirSeparator + "gstreamer-registry";
+    if (!makeDirectory(dir)) {
+        SERVOUNITYLOGw("Unable to create GStreamer registry cache directory '%s'. Registry will not be cached.\n", dir.c_str());
+        return s_state;
+    }
+    char fingerprint[17];
+    snprintf(fingerprint, sizeof(fingerprint), "%016" PRIx64, h);
+    std::string name = std::string(kFilePrefix) + fingerprint + kFileSuffix;
+    std::string path = dir + kDirSeparator + name;
+
+    // Delete caches for other plugin sets, including any temporary files GStreamer left behind while writing them.
+    std::vector<FileInfo> cached;
+    listDirectory(dir, cached);
+    for (const FileInfo& f : cached) {
+        if (f.name.compare(0, strlen(kFilePrefix), kFilePrefix) != 0 || f.name.compare(0, name.size(), name) == 0) continue;
+        SERVOUNITYLOGd("Removing stale GStreamer registry cache '%s'.\n", f.name.c_str());
+        remove((dir + kDirSeparator + f.name).c_str());
+    }
+
+    setEnvVar("GST_REGISTRY", path.c_str());
+    s_path = path;
+    if (fileExists(path)) {
+        setEnvVar("GST_REGISTRY_UPDATE", "no");
+        s_state = ServoUnityGStreamerRegistryCache_Hit;
+        SERVOUNITYLOGi("Using cached GStreamer registry '%s'; %d plugin files will not be rescanned.\n", path.c_str(), s_pluginFileCount);
+    } else {
+        setEnvVar("GST_REGISTRY_UPDATE", "yes");
+        s_state = ServoUnityGStreamerRegistryCache_Miss;
+        SERVOUNITYLOGi("No cached GStreamer registry for this plugin set; GStreamer will scan %d plugin files and write '%s'.\n", s_pluginFileCount, path.c_str());
+    }
+    return s_state;
+}
+
+int ServoUnityGStreamerRegistry::state(void)
+{
+    return s_state;
+}
+
+int ServoUnityGStreamerRegistry::pluginFileCount(void)
+{
+    return s_pluginFileCount;
+}
+
+void ServoUnityGStreamerRegistry::engineInitEnded(double durationMs)
+{
+    std::string coldPath = s_path + kColdTimeSuffix;
+    if (s_state == ServoUnityGStreamerRegistryCache_Miss) {
+        FILE *fp = fopen(coldPath.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "%.1f\n", durationMs);
+            fclose(fp);
+        }
+    } else if (s_state == ServoUnityGStreamerRegistryCache_Hit) {
+        FILE *fp = fopen(coldPath.c_str(), "r");
+        if (!fp) return;
+        double coldMs;
+        if (fscanf(fp, "%lf", &coldMs) == 1) {
+            s_savedMs = std::max(coldMs - durationMs, 0.0);
+            SERVOUNITYLOGi("Cached GStreamer registry saved %.1f ms of engine startup (%.1f ms, versus %.1f ms when the cache was built).\n", s_savedMs, durationMs, coldMs);
+        }
+        fclose(fp);
+    }
+}
+
+double ServoUnityGStreamerRegistry::savedMs(void)
+{
+    return s_savedMs;
+}
@@ -0,0 +1,51 @@
+//
+// ServoUnityGStreamerRegistry.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Persistent cache of GStreamer's plugin registry.
+//
+
+#pragma once
+
+//
+// Without GST_REGISTRY, GStreamer loads and introspects every plugin on first
+// use, on every launch. configure() points GST_REGISTRY at a file in a cache
+// directory whose name is a fingerprint of the plugin files (names, sizes and
+// modification times) plus a caller-supplied salt. GStreamer writes the file
+// the first time it initialises with a given plugin set; afterwards it is
+// reused as-is, with GST_REGISTRY_UPDATE=no, since any change to the plugins
+// changes the fingerprint and so the filename. Cache files for other
+// fingerprints are deleted.
+//
+// GStreamer is initialised as part of Servo's startup, so the cost of a scan
+// appears in ServoUnityStartupPhase_EngineInit. That phase's duration on a miss
+// is stored alongside the cache, so that on a hit the saving can be reported.
+//
+// configure() must be called before GStreamer is initialised, i.e. before Servo starts.
+//
+class ServoUnityGStreamerRegistry
+{
+public:
+    /// Returns one of ServoUnityGStreamerRegistryCache_*.
+    /// @param cacheDir Directory in which to keep the cache. Created if it doesn't exist.
+    /// @param pluginPath GStreamer plugin path, as would be set in GST_PLUGIN_PATH.
+    /// @param salt Anything else the registry contents depend on, e.g. the Servo (and hence GStreamer) version. May be NULL.
+    static int configure(const char *cacheDir, const char *pluginPath, const char *salt);
+
+    /// The result of the last call to configure().
+    static int state(void);
+    /// The number of plugin files fingerprinted by the last call to configure().
+    static int pluginFileCount(void);
+
+    /// Called with the duration of Servo's startup, which includes GStreamer's initialisation.
+    static void engineInitEnded(double durationMs);
+    /// Milliseconds of engine startup saved by using the cache, or -1 if not (yet) known.
+    static double savedMs(void);
+};
@@ -0,0 +1,231 @@
+//
+// ServoUnityGestureRecognizer.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityGestureRecognizer.h"
+#include "simpleservo2.h"
+#include <cmath>
+#include <vector>
+
+static const float kFlingIdleTime = 0.1f; // Seconds. Fingers held still for longer than this before lifting don't fling.
+
+ServoUnityGestureRecognizer::ServoUnityGestureRecognizer(ServoUnityScrollIntegrator *scroll) :
+    m_scroll(scroll),
+    m_touchCount(0),
+    m_mode(Mode::Idle),
+    m_dualIDs{-1, -1},
+    m_startSpan(0.0f),
+    m_startX(0.0f),
+    m_startY(0.0f),
+    m_pinching(false),
+    m_lastSpan(0.0f),
+    m_panning(false),
+    m_lastX(0.0f),
+    m_lastY(0.0f),
+    m_sampleX(0.0f),
+    m_sampleY(0.0f),
+    m_vx(0.0f),
+    m_vy(0.0f),
+    m_sampleTime()
+{
+}
+
+void ServoUnityGestureRecognizer::reset(void)
+{
+    m_touchCount = 0;
+    m_mode = Mode::Idle;
+}
+
+ServoUnityGestureRecognizer::Touch *ServoUnityGestureRecognizer::find(int id)
+{
+    for (int i = 0; i < m_touchCount; i++) {
+        if (m_touches[i].id == id) return &m_touches[i];
+    }
+    return nullptr;
+}
+
+void ServoUnityGestureRecognizer::remove(int id)
+{
+    for (int i = 0; i < m_touchCount; i++) {
+        if (m_touches[i].id == id) {
+            m_touches[i] = m_touches[--m_touchCount];
+            return;
+        }
+    }
+}
+
+void ServoUnityGestureRecognizer::process(const ServoUnityTouch *touches, int count, const Config& config)
+{
+    // Coalesce moves: a move replaces an earlier move of the same touch, unless the touch
+    // began or ended in between.
+    std::vector<ServoUnityTouch> events;
+    events.reserve(count);
+    for (int i = 0; i < count; i++) {
+        const ServoUnityTouch& t = touches[i];
+        if (t.touchID < 0) continue;
+        bool coalesced = false;
+        if (t.phase == ServoUnityTouchPhase_Moved) {
+            for (auto e = events.rbegin(); e != events.rend(); e++) {
+                if (e->touchID != t.touchID) continue;
+                if (e->phase == ServoUnityTouchPhase_Moved) {
+                    e->windowX = t.windowX;
+                    e->windowY = t.windowY;
+                    coalesced = true;
+                }
+                break;
+            }
+        }
+        if (!coalesced) events.push_back(t);
+    }
+
+    bool dualMoved = false;
+    for (const ServoUnityTouch& t : events) {
+        float x = (float)t.windowX;
+        float y = (float)t.windowY;
+        Touch *touch = find(t.touchID);
+        switch (t.phase) {
+            case ServoUnityTouchPhase_Began:
+                if (touch || m_touchCount == kTouchesMax) break;
+                touch = &m_touches[m_touchCount++];
+                *touch = {t.touchID, x, y, false};
+                if (!config.gestures) {
+                    touch_down(x, y, t.touchID);
+                    touch->forwarded = true;
+                } else if (m_mode == Mode::Idle) {
+                    ServoUnityScrollIntegrator::send(m_scroll->cancel()); // A finger down stops any momentum.
+                    touch_down(x, y, t.touchID);
+                    touch->forwarded = true;
+                    m_mode = Mode::Single;
+                } else if (m_mode == Mode::Single) {
+                    // The first touch now belongs to the gesture, so withdraw it from Servo.
+                    Touch *first = &m_touches[0];
+                    if (first->forwarded) {
+                        touch_cancel(first->x, first->y, first->id);
+                        first->forwarded = false;
+                    }
+                    m_dualIDs[0] = first->id;
+                    m_dualIDs[1] = t.touchID;
+                    dualBegin();
+                    m_mode = Mode::Dual;
+                }
+                break;
+            case ServoUnityTouchPhase_Moved:
+                if (!touch) break;
+                touch->x = x;
+                touch->y = y;
+                if (touch->forwarded) touch_move(x, y, t.touchID);
+                if (m_mode == Mode::Dual && (t.touchID == m_dualIDs[0] || t.touchID == m_dualIDs[1])) dualMoved = true;
+                break;
+            case ServoUnityTouchPhase_Ended:
+            case ServoUnityTouchPhase_Cancelled:
+                if (!touch) break;
+                touch->x = x;
+                touch->y = y;
+                if (touch->forwarded) {
+                    if (t.phase == ServoUnityTouchPhase_Ended) touch_up(x, y, t.touchID);
+                    else touch_cancel(x, y, t.touchID);
+                }
+                if (m_mode == Mode::Dual && (t.touchID == m_dualIDs[0] || t.touchID == m_dualIDs[1])) {
+                    if (dualMoved) dualUpdate(config);
+                    dualMoved = false;
+                    dualEnd(t.phase == ServoUnityTouchPhase_Ended, config);
+                    m_mode = Mode::Ignore;
+                }
+                remove(t.touchID);
+                if (m_touchCount == 0) m_mode = Mode::Idle;
+                break;
+            default:
+                break;
+        }
+    }
+    if (dualMoved) dualUpdate(config);
+}
+
+void ServoUnityGestureRecognizer::dualMeasure(float *span, float *cx, float *cy)
+{
+    Touch *a = find(m_dualIDs[0]);
+    Touch *b = find(m_dualIDs[1]);
+    if (!a || !b) return;
+    float dx = b->x - a->x;
+    float dy = b->y - a->y;
+    *span = std::sqrt(dx * dx + dy * dy);
+    *cx = (a->x + b->x) * 0.5f;
+    *cy = (a->y + b->y) * 0.5f;
+}
+
+void ServoUnityGestureRecognizer::dualBegin(void)
+{
+    dualMeasure(&m_startSpan, &m_startX, &m_startY);
+    m_pinching = false;
+    m_panning = false;
+    m_lastSpan = m_startSpan;
+    m_lastX = m_sampleX = m_startX;
+    m_lastY = m_sampleY = m_startY;
+    m_vx = m_vy = 0.0f;
+    m_sampleTime = std::chrono::steady_clock::now();
+}
+
+void ServoUnityGestureRecognizer::dualUpdate(const Config& config)
+{
+    float span = m_lastSpan, cx = m_lastX, cy = m_lastY;
+    dualMeasure(&span, &cx, &cy);
+
+    // Pinch. Servo's zoom factor is relative to the current zoom, so each call sends the change since the last.
+    if (!m_pinching && std::fabs(span - m_startSpan) > config.pinchThreshold && m_startSpan > 0.0f) {
+        pinchzoom_start(1.0f, (int32_t)cx, (int32_t)cy);
+        m_pinching = true;
+        m_lastSpan = span; // Start from here, rather than jumping by the threshold.
+    }
+    if (m_pinching && span > 0.0f && m_lastSpan > 0.0f && span != m_lastSpan) {
+        pinchzoom(span / m_lastSpan, (int32_t)cx, (int32_t)cy);
+        m_lastSpan = span;
+    }
+
+    // Pan.
+    if (!m_panning && std::hypot(cx - m_startX, cy - m_startY) > config.panThreshold) {
+        ServoUnityScrollIntegrator::send(m_scroll->begin((int)cx, (int)cy));
+        m_panning = true;
+        m_lastX = cx;
+        m_lastY = cy;
+    }
+    if (m_panning) {
+        int dx = (int)(cx - m_lastX);
+        int dy = (int)(cy - m_lastY);
+        m_lastX += dx; // Keep the fractional remainder for next time.
+        m_lastY += dy;
+        ServoUnityScrollIntegrator::send(m_scroll->update(dx, dy, (int)cx, (int)cy));
+    }
+
+    // Velocity, for fling.
+    auto now = std::chrono::steady_clock::now();
+    float dt = std::chrono::duration<float>(now - m_sampleTime).count();
+    if (dt > 0.0f) {
+        m_vx = 0.5f * m_vx + 0.5f * (cx - m_sampleX) / dt;
+        m_vy = 0.5f * m_vy + 0.5f * (cy - m_sampleY) / dt;
+        m_sampleX = cx;
+        m_sampleY = cy;
+        m_sampleTime = now;
+    }
+}
+
+void ServoUnityGestureRecognizer::dualEnd(bool fling, const Config& config)
+{
+    if (m_pinching) {
+        pinchzoom_end(1.0f, (int32_t)m_lastX, (int32_t)m_lastY);
+        m_pinching = false;
+    }
+    if (m_panning) {
+        float idle = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_sampleTime).count();
+        if (!fling || idle > kFlingIdleTime) m_vx = m_vy = 0.0f;
+        ServoUnityScrollIntegrator::send(m_scroll->end(m_vx, m_vy, config.friction));
+        m_panning = false;
+    }
+}
@@ -0,0 +1,83 @@
+//
+// ServoUnityGestureRecognizer.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Recognises two-finger pinch, pan and fling in batched touch input, and drives Servo's
+// pinchzoom_* and scroll_* calls from them. Single touches are passed to Servo unchanged.
+//
+
+#pragma once
+
+#include "servo_unity_c.h"
+#include "ServoUnityScrollIntegrator.h"
+#include <chrono>
+
+class ServoUnityGestureRecognizer
+{
+public:
+    struct Config {
+        bool gestures; // If false, all touches are passed to Servo unchanged.
+        float pinchThreshold; // Pixels the finger spacing must change by before a pinch begins.
+        float panThreshold; // Pixels the midpoint between fingers must move by before a pan begins.
+        float friction; // Passed to ServoUnityScrollIntegrator::end() when a pan is released.
+    };
+
+    /// Pans and flings are sent through scroll, so that they share momentum with other scroll gestures.
+    ServoUnityGestureRecognizer(ServoUnityScrollIntegrator *scroll);
+
+    /// Process one batch of touch events, in order. Successive moves of the same touch within the batch
+    /// are coalesced into one. Must be called from the render thread, with a running Servo instance.
+    void process(const ServoUnityTouch *touches, int count, const Config& config);
+    /// Drop all touches, without calling Servo, e.g. because Servo has shut down.
+    void reset(void);
+
+private:
+    static const int kTouchesMax = 10;
+    enum class Mode {
+        Idle, // No touches.
+        Single, // One touch, passed to Servo.
+        Dual, // Two touches, recognised as a pinch and/or pan.
+        Ignore // A two-finger gesture ended with touches still down. Ignored until all are lifted.
+    };
+    struct Touch {
+        int id;
+        float x;
+        float y;
+        bool forwarded; // Servo has been sent touch_down for this touch.
+    };
+
+    Touch *find(int id);
+    void remove(int id);
+    void dualBegin(void);
+    void dualUpdate(const Config& config);
+    void dualEnd(bool fling, const Config& config);
+    void dualMeasure(float *span, float *cx, float *cy);
+
+    ServoUnityScrollIntegrator *m_scroll;
+    Touch m_touches[kTouchesMax];
+    int m_touchCount;
+    Mode m_mode;
+
+    // Dual-touch gesture state.
+    int m_dualIDs[2];
+    float m_startSpan;
+    float m_startX; // Midpoint at gesture start.
+    float m_startY;
+    bool m_pinching;
+    float m_lastSpan;
+    bool m_panning;
+    float m_lastX; // Midpoint last sent in a scroll.
+    float m_lastY;
+    float m_sampleX; // Midpoint at the last velocity sample.
+    float m_sampleY;
+    float m_vx; // Smoothed midpoint velocity, pixels per second.
+    float m_vy;
+    std::chrono::steady_clock::time_point m_sampleTime;
+};
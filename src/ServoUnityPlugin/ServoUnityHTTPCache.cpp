@@ -0,0 +1,224 @@
+//
+// ServoUnityHTTPCache.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityHTTPCache.h"
+#include "servo_unity_log.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+using namespace ServoUnityFiles;
+
+static const char kFileMagic[4] = {'S', 'U', 'H', 'C'};
+static const uint32_t kFileVersion = 2;
+static const char *kFileSuffix = ".http";
+static const char *kTmpSuffix = ".tmp";
+
+namespace {
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t urlLength;
+        uint32_t headLength;
+        uint64_t bodyLength;
+        int64_t freshUntil;
+        int64_t generatedAt;
+    };
+}
+
+static std::string fileNameForURL(const std::string& url)
+{
+    uint64_t h = kHashSeed;
+    hash(h, url);
+    char name[17];
+    snprintf(name, sizeof(name), "%016" PRIx64, h);
+    return std::string(name) + kFileSuffix;
+}
+
+static bool hasSuffix(const std::string& s, const char *suffix)
+{
+    size_t len = strlen(suffix);
+    return s.size() >= len && s.compare(s.size() - len, std::string::npos, suffix) == 0;
+}
+
+ServoUnityHTTPCache::ServoUnityHTTPCache(const std::string& dir, uint64_t budget) :
+    m_budget(budget)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (!makeDirectory(dir)) {
+        SERVOUNITYLOGe("Unable to create HTTP cache directory '%s'.\n", dir.c_str());
+        return;
+    }
+    std::vector<FileInfo> files;
+    if (!listDirectory(dir, files)) {
+        SERVOUNITYLOGe("Unable to read HTTP cache directory '%s'.\n", dir.c_str());
+        return;
+    }
+    m_dir = dir;
+
+    // Oldest first, so that each push to the front leaves the most recently used at the front.
+    std::sort(files.begin(), files.end(), [](const FileInfo& a, const FileInfo& b) { return a.mtime < b.mtime; });
+    for (const FileInfo& f : files) {
+        if (hasSuffix(f.name, kTmpSuffix)) {
+            std::remove((m_dir + kDirSeparator + f.name).c_str()); // Left by an interrupted store.
+        } else if (hasSuffix(f.name, kFileSuffix)) {
+            m_files.push_front({f.name, f.size});
+            m_index[f.name] = m_files.begin();
+            m_total += f.size;
+        }
+    }
+    evict(0);
+    SERVOUNITYLOGi("HTTP cache '%s' holds %zu responses (%" PRIu64 " bytes).\n", m_dir.c_str(), m_files.size(), m_total);
+}
+
+uint64_t ServoUnityHTTPCache::maxEntrySize(void)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_budget / 8;
+}
+
+void ServoUnityHTTPCache::setBudget(uint64_t budget)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_budget = budget;
+    evict(0);
+}
+
+void ServoUnityHTTPCache::evict(uint64_t incoming)
+{
+    while (!m_files.empty() && m_total + incoming > m_budget) {
+        const File& f = m_files.back();
+        std::remove((m_dir + kDirSeparator + f.name).c_str());
+        m_total -= f.size;
+        m_index.erase(f.name);
+        m_files.pop_back();
+    }
+}
+
+void ServoUnityHTTPCache::forget(const std::string& name)
+{
+    auto it = m_index.find(name);
+    if (it == m_index.end()) return;
+    m_total -= it->second->size;
+    m_files.erase(it->second);
+    m_index.erase(it);
+}
+
+bool ServoUnityHTTPCache::lookup(const std::string& url, Entry& entry)
+{
+    if (!ok()) return false;
+    std::string name = fileNameForURL(url);
+    std::string path = m_dir + kDirSeparator + name;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_index.find(name);
+        if (it == m_index.end()) return false;
+        m_files.splice(m_files.begin(), m_files, it->second);
+    }
+
+    std::shared_ptr<MappedFile> file = MappedFile::open(path);
+    const FileHeader *header = file ? (const FileHeader *)file->data() : nullptr;
+    size_t size = file ? file->size() : 0;
+    bool ok = size >= sizeof(FileHeader)
+        && memcmp(header->magic, kFileMagic, sizeof(kFileMagic)) == 0
+        && header->version == kFileVersion
+        && header->urlLength == url.size()
+        && (uint64_t)header->urlLength + header->headLength + header->bodyLength == size - sizeof(FileHeader)
+        && memcmp(file->data() + sizeof(FileHeader), url.data(), url.size()) == 0; // Guard against hash collisions.
+    if (!ok) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        forget(name); // Deleted behind our back, or corrupt; a later store will replace it.
+        return false;
+    }
+
+    entry.file = file;
+    entry.head = (const char *)file->data() + sizeof(FileHeader) + header->urlLength;
+    entry.headLength = header->headLength;
+    entry.body = file->data() + sizeof(FileHeader) + header->urlLength + header->headLength;
+    entry.bodyLength = (size_t)header->bodyLength;
+    entry.freshUntil = header->freshUntil;
+    entry.generatedAt = header->generatedAt;
+    touchFile(path);
+    return true;
+}
+
+bool ServoUnityHTTPCache::store(const std::string& url, const std::string& head, const uint8_t *body, size_t bodyLength, int64_t freshUntil, int64_t generatedAt)
+{
+    if (!ok()) return false;
+    uint64_t size = sizeof(FileHeader) + url.size() + head.size() + bodyLength;
+    std::string name = fileNameForURL(url);
+    std::string tmpPath;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (size > m_budget / 8) return false;
+        char tmpName[32];
+        snprintf(tmpName, sizeof(tmpName), "%" PRIu64, m_tmpCount++);
+        tmpPath = m_dir + kDirSeparator + name + "." + tmpName + kTmpSuffix;
+    }
+
+    // Written aside and renamed into place, so that lookups never see a partial file.
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (!fp) {
+        SERVOUNITYLOGw("Unable to write HTTP cache file '%s'.\n", tmpPath.c_str());
+        return false;
+    }
+    FileHeader header;
+    memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.version = kFileVersion;
+    header.urlLength = (uint32_t)url.size();
+    header.headLength = (uint32_t)head.size();
+    header.bodyLength = bodyLength;
+    header.freshUntil = freshUntil;
+    header.generatedAt = generatedAt;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(url.data(), 1, url.size(), fp) == url.size()
+        && fwrite(head.data(), 1, head.size(), fp) == head.size()
+        && (bodyLength == 0 || fwrite(body, 1, bodyLength, fp) == bodyLength);
+    ok = (fclose(fp) == 0) && ok;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (ok) ok = replaceFile(tmpPath, m_dir + kDirSeparator + name);
+    if (!ok) {
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    forget(name);
+    evict(size);
+    m_files.push_front({name, size});
+    m_index[name] = m_files.begin();
+    m_total += size;
+    return true;
+}
+
+void ServoUnityHTTPCache::refresh(const std::string& url, int64_t freshUntil, int64_t generatedAt)
+{
+    if (!ok()) return;
+    std::string path = m_dir + kDirSeparator + fileNameForURL(url);
+    std::lock_guard<std::mutex> lock(m_lock);
+    FILE *fp = fopen(path.c_str(), "r+b");
+    if (!fp) return;
+    if (fseek(fp, offsetof(FileHeader, freshUntil), SEEK_SET) == 0) fwrite(&freshUntil, sizeof(freshUntil), 1, fp);
+    if (fseek(fp, offsetof(FileHeader, generatedAt), SEEK_SET) == 0) fwrite(&generatedAt, sizeof(generatedAt), 1, fp);
+    fclose(fp);
+}
+
+void ServoUnityHTTPCache::remove(const std::string& url)
+{
+    if (!ok()) return;
+    std::string name = fileNameForURL(url);
+    std::lock_guard<std::mutex> lock(m_lock);
+    std::remove((m_dir + kDirSeparator + name).c_str());
+    forget(name);
+}
@@ -0,0 +1,82 @@
+//
+// ServoUnityHTTPCache.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Size-bounded on-disk store of HTTP responses, used by ServoUnityHTTPProxy.
+//
+
+#pragma once
+
+#include "ServoUnityFiles.h"
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+//
+// Each response is one file in the cache directory, named for a hash of its URL, holding
+// the response head (status line and headers, without the terminating blank line) and the
+// body exactly as it is to be sent to the client. Lookups map the file into memory, so
+// that a hit is sent straight from the page cache. Files are replaced atomically, so a
+// reader still holding an old mapping is unaffected by a newer store.
+//
+// The least recently used files are deleted once the directory exceeds the budget. Use
+// order survives restarts via the files' modification times.
+//
+// All functions are thread-safe.
+//
+class ServoUnityHTTPCache
+{
+public:
+    struct Entry {
+        std::shared_ptr<ServoUnityFiles::MappedFile> file; // Keeps head and body valid.
+        const char *head = nullptr;
+        size_t headLength = 0;
+        const uint8_t *body = nullptr;
+        size_t bodyLength = 0;
+        int64_t freshUntil = 0; // Seconds since the Unix epoch.
+        int64_t generatedAt = 0; // When the origin generated the response, by our clock. Its Age is the time since.
+    };
+
+    /// Opens the cache in dir, which is created if it doesn't exist. Use ok() to check.
+    ServoUnityHTTPCache(const std::string& dir, uint64_t budget);
+    ServoUnityHTTPCache(const ServoUnityHTTPCache&) = delete;
+    ServoUnityHTTPCache& operator=(const ServoUnityHTTPCache&) = delete;
+    bool ok(void) const { return !m_dir.empty(); }
+
+    /// Largest response worth storing; anything bigger would evict too much else.
+    uint64_t maxEntrySize(void);
+    void setBudget(uint64_t budget);
+
+    bool lookup(const std::string& url, Entry& entry);
+    bool store(const std::string& url, const std::string& head, const uint8_t *body, size_t bodyLength, int64_t freshUntil, int64_t generatedAt);
+    /// Updates the freshness and age of a stored response, e.g. after the origin has revalidated it.
+    void refresh(const std::string& url, int64_t freshUntil, int64_t generatedAt);
+    void remove(const std::string& url);
+
+private:
+    struct File {
+        std::string name;
+        uint64_t size;
+    };
+    // Must be called with m_lock held.
+    void evict(uint64_t incoming);
+    void forget(const std::string& name);
+
+    std::mutex m_lock;
+    std::string m_dir;
+    uint64_t m_budget;
+    uint64_t m_total = 0;
+    uint64_t m_tmpCount = 0;
+    std::list<File> m_files; // Most recently used first.
+    std::unordered_map<std::string, std::list<File>::iterator> m_index;
+};
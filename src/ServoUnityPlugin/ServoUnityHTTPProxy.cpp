@@ -0,0 +1,891 @@
+//
+// ServoUnityHTTPProxy.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#ifdef _WIN32
+#  include <winsock2.h> // Must precede anything including windows.h.
+#  include <ws2tcpip.h>
+#  pragma comment(lib, "ws2_32.lib")
+#else
+#  include <arpa/inet.h>
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <netdb.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#  include <poll.h>
+#  include <sys/socket.h>
+#  include <sys/time.h>
+#  include <unistd.h>
+#endif
+#include "ServoUnityHTTPProxy.h"
+#include "ServoUnityHTTPCache.h"
+#include "servo_unity_log.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+typedef SOCKET Socket;
+static const Socket kInvalidSocket = INVALID_SOCKET;
+static const int kShutdownBoth = SD_BOTH;
+static const int kSendFlags = 0;
+static void closeSocket(Socket s) { closesocket(s); }
+static int pollSockets(WSAPOLLFD *fds, ULONG count, int timeoutMs) { return WSAPoll(fds, count, timeoutMs); }
+typedef WSAPOLLFD PollFD;
+#else
+typedef int Socket;
+static const Socket kInvalidSocket = -1;
+static const int kShutdownBoth = SHUT_RDWR;
+#  ifdef MSG_NOSIGNAL
+static const int kSendFlags = MSG_NOSIGNAL;
+#  else
+static const int kSendFlags = 0; // SO_NOSIGPIPE is set on each socket instead.
+#  endif
+static void closeSocket(Socket s) { close(s); }
+static int pollSockets(struct pollfd *fds, nfds_t count, int timeoutMs) { return poll(fds, count, timeoutMs); }
+typedef struct pollfd PollFD;
+#endif
+
+static const size_t kMaxHeadSize = 64 * 1024;
+static const int kConnectTimeoutMs = 10000;
+static const int kOriginTimeoutSeconds = 30; // Between reads from the origin.
+static const int kIdleTimeoutSeconds = 60; // Before an idle client connection is closed.
+static const int64_t kHeuristicFreshnessMax = 24 * 60 * 60;
+
+static std::mutex s_lock;
+static std::condition_variable s_idle; // Signalled as connections finish.
+static std::atomic<bool> s_running(false);
+static Socket s_listener = kInvalidSocket;
+static int s_port = 0;
+static std::thread s_acceptThread;
+static std::shared_ptr<ServoUnityHTTPCache> s_cache;
+static std::set<Socket> s_sockets; // Client and origin sockets, shut down by stop().
+static int s_connections = 0;
+
+// --------------------------------------------------------------------------
+//  Message parsing
+
+namespace {
+    struct Message {
+        std::string startLine;
+        std::string method; // Requests only.
+        std::string target; // Requests only.
+        std::string version;
+        int status = 0; // Responses only.
+        std::vector<std::pair<std::string, std::string>> headers;
+
+        const std::string *header(const char *name) const;
+    };
+
+    struct Target {
+        std::string host;
+        std::string port;
+        std::string authority; // For the Host header.
+        std::string path;
+        std::string url; // Without any fragment; the cache key.
+    };
+
+    enum Framing {
+        FramingNone,
+        FramingLength,
+        FramingChunked,
+        FramingClose
+    };
+
+    // Accumulates a copy of a body, giving up once it exceeds max.
+    struct Tee {
+        std::string data;
+        size_t max = 0;
+        bool full = false;
+        void add(const char *p, size_t n) {
+            if (full) return;
+            if (data.size() + n > max) {
+                full = true;
+                std::string().swap(data);
+            } else data.append(p, n);
+        }
+    };
+
+    // Finds the end of a chunked body, without decoding it.
+    class ChunkScanner {
+    public:
+        bool done = false;
+        bool error = false;
+        /// Returns how many bytes of p belong to the body; any remainder follows it.
+        size_t scan(const char *p, size_t n);
+    private:
+        enum State { Size, Data, DataEnd, Trailer } m_state = Size;
+        uint64_t m_remaining = 0;
+        std::string m_line;
+    };
+}
+
+static bool equalsIgnoreCase(const std::string& a, const char *b)
+{
+    size_t len = strlen(b);
+    if (a.size() != len) return false;
+    for (size_t i = 0; i < len; i++) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) return false;
+    }
+    return true;
+}
+
+static std::string trim(const std::string& s)
+{
+    size_t start = s.find_first_not_of(" \t");
+    if (start == std::string::npos) return std::string();
+    return s.substr(start, s.find_last_not_of(" \t") - start + 1);
+}
+
+const std::string *Message::header(const char *name) const
+{
+    for (const auto& h : headers) {
+        if (equalsIgnoreCase(h.first, name)) return &h.second;
+    }
+    return nullptr;
+}
+
+// Splits a head into its start line and headers. Obsolete line folding is unfolded.
+static bool parseHead(const std::string& head, Message& m)
+{
+    size_t pos = 0;
+    bool first = true;
+    while (pos < head.size()) {
+        size_t eol = head.find("\r\n", pos);
+        if (eol == std::string::npos) eol = head.size();
+        std::string line = head.substr(pos, eol - pos);
+        pos = eol + 2;
+        if (first) {
+            m.startLine = line;
+            first = false;
+        } else if (!line.empty() && (line[0] == ' ' || line[0] == '\t')) {
+            if (m.headers.empty()) return false;
+            m.headers.back().second += " " + trim(line);
+        } else {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos || colon == 0) return false;
+            m.headers.emplace_back(line.substr(0, colon), trim(line.substr(colon + 1)));
+        }
+    }
+    return !first;
+}
+
+static bool parseRequestLine(Message& m)
+{
+    size_t sp1 = m.startLine.find(' ');
+    size_t sp2 = (sp1 == std::string::npos ? sp1 : m.startLine.find(' ', sp1 + 1));
+    if (sp2 == std::string::npos) return false;
+    m.method = m.startLine.substr(0, sp1);
+    m.target = m.startLine.substr(sp1 + 1, sp2 - sp1 - 1);
+    m.version = m.startLine.substr(sp2 + 1);
+    return !m.method.empty() && !m.target.empty() && m.version.compare(0, 5, "HTTP/") == 0;
+}
+
+static bool parseStatusLine(Message& m)
+{
+    size_t sp = m.startLine.find(' ');
+    if (sp == std::string::npos || m.startLine.compare(0, 5, "HTTP/") != 0) return false;
+    m.version = m.startLine.substr(0, sp);
+    m.status = atoi(m.startLine.c_str() + sp + 1);
+    return m.status >= 100 && m.status <= 999;
+}
+
+static std::vector<std::string> splitList(const std::string& s)
+{
+    std::vector<std::string> items;
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        std::string item = trim(s.substr(pos, comma - pos));
+        if (!item.empty()) items.push_back(item);
+        pos = comma + 1;
+    }
+    return items;
+}
+
+// Finds a directive, e.g. "max-age=60" in Cache-Control, or a token, e.g. "close" in Connection,
+// in every instance of a comma-separated header. Names are case-insensitive.
+static bool findDirective(const Message& m, const char *header, const char *name, std::string *value = nullptr)
+{
+    for (const auto& h : m.headers) {
+        if (!equalsIgnoreCase(h.first, header)) continue;
+        for (const std::string& item : splitList(h.second)) {
+            size_t eq = item.find('=');
+            if (!equalsIgnoreCase(trim(item.substr(0, eq)), name)) continue;
+            if (value) {
+                *value = (eq == std::string::npos ? std::string() : trim(item.substr(eq + 1)));
+                if (value->size() >= 2 && value->front() == '"' && value->back() == '"') *value = value->substr(1, value->size() - 2);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isHopByHop(const Message& m, const std::string& name)
+{
+    static const char *kHopByHop[] = {"Connection", "Keep-Alive", "Proxy-Connection", "Proxy-Authenticate", "Proxy-Authorization", "TE", "Trailer", "Upgrade"};
+    for (const char *h : kHopByHop) {
+        if (equalsIgnoreCase(name, h)) return true;
+    }
+    return findDirective(m, "Connection", name.c_str());
+}
+
+// The end-to-end headers of m, as header lines, less any named in skip.
+static std::string forwardedHeaders(const Message& m, std::initializer_list<const char *> skip)
+{
+    std::string out;
+    for (const auto& h : m.headers) {
+        if (isHopByHop(m, h.first)) continue;
+        bool skipped = false;
+        for (const char *s : skip) {
+            if (s && equalsIgnoreCase(h.first, s)) skipped = true;
+        }
+        if (!skipped) out += h.first + ": " + h.second + "\r\n";
+    }
+    return out;
+}
+
+// Splits "host:port" or "[v6addr]:port". Returns false if there's no host.
+static bool splitAuthority(const std::string& authority, const char *defaultPort, std::string& host, std::string& port)
+{
+    size_t colon;
+    if (!authority.empty() && authority[0] == '[') {
+        size_t close = authority.find(']');
+        if (close == std::string::npos) return false;
+        host = authority.substr(1, close - 1);
+        colon = (close + 1 < authority.size() && authority[close + 1] == ':' ? close + 1 : std::string::npos);
+    } else {
+        colon = authority.rfind(':');
+        host = authority.substr(0, colon);
+    }
+    port = (colon == std::string::npos || colon + 1 == authority.size() ? std::string(defaultPort) : authority.substr(colon + 1));
+    return !host.empty();
+}
+
+// Parses the absolute-form request target sent to a proxy. Only http:// is accepted.
+static bool parseTarget(const std::string& url, Target& t)
+{
+    if (url.size() < 8 || !equalsIgnoreCase(url.substr(0, 7), "http://")) return false;
+    size_t end = url.find('#');
+    if (end == std::string::npos) end = url.size();
+    size_t pathStart = url.find_first_of("/?", 7);
+    if (pathStart == std::string::npos || pathStart > end) pathStart = end;
+    t.authority = url.substr(7, pathStart - 7);
+    size_t at = t.authority.rfind('@');
+    if (at != std::string::npos) t.authority.erase(0, at + 1); // Credentials aren't sent in the Host header.
+    if (!splitAuthority(t.authority, "80", t.host, t.port)) return false;
+    t.path = url.substr(pathStart, end - pathStart);
+    if (t.path.empty() || t.path[0] != '/') t.path.insert(0, "/");
+    t.url = "http://" + t.authority + t.path;
+    return true;
+}
+
+size_t ChunkScanner::scan(const char *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n && !done && !error) {
+        if (m_state == Data) {
+            size_t k = (size_t)std::min<uint64_t>(m_remaining, n - i);
+            i += k;
+            m_remaining -= k;
+            if (m_remaining == 0) m_state = DataEnd;
+            continue;
+        }
+        // The other states consume a line at a time.
+        char c = p[i++];
+        if (c != '\n') {
+            if (m_line.size() < 1024) m_line += c;
+            else error = true;
+            continue;
+        }
+        if (!m_line.empty() && m_line.back() == '\r') m_line.pop_back();
+        if (m_state == Size) {
+            char *endp;
+            m_remaining = strtoull(m_line.c_str(), &endp, 16);
+            if (endp == m_line.c_str()) error = true;
+            else m_state = (m_remaining == 0 ? Trailer : Data);
+        } else if (m_state == DataEnd) {
+            if (!m_line.empty()) error = true;
+            m_state = Size;
+        } else { // Trailer.
+            if (m_line.empty()) done = true;
+        }
+        m_line.clear();
+    }
+    return i;
+}
+
+// --------------------------------------------------------------------------
+//  Caching policy
+
+static int64_t daysFromCivil(int64_t y, int m, int d)
+{
+    y -= (m <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+int64_t ServoUnityHTTPProxy::parseHTTPDate(const std::string& s)
+{
+    static const char *kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    char month[4] = {0};
+    int day, year, hour, minute, second;
+    if (sscanf(s.c_str(), "%*3s, %d %3s %d %d:%d:%d", &day, month, &year, &hour, &minute, &second) == 6) {
+        // IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+    } else if (sscanf(s.c_str(), "%*[^,], %d-%3s-%d %d:%d:%d", &day, month, &year, &hour, &minute, &second) == 6) {
+        // RFC 850, e.g. "Sunday, 06-Nov-94 08:49:37 GMT".
+        if (year < 100) year += (year < 70 ? 2000 : 1900);
+    } else if (sscanf(s.c_str(), "%*3s %3s %d %d:%d:%d %d", month, &day, &hour, &minute, &second, &year) == 6) {
+        // asctime, e.g. "Sun Nov  6 08:49:37 1994".
+    } else return -1;
+    int m = 0;
+    while (m < 12 && strcmp(month, kMonths[m]) != 0) m++;
+    if (m == 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) return -1;
+    return daysFromCivil(year, m + 1, day) * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// Returns false if the response mustn't be stored. Otherwise, sets lifetime to how many seconds
+// it may be served without revalidation, which may be 0. This is a private cache, so
+// Cache-Control: private doesn't prevent storing, and s-maxage doesn't apply.
+static bool freshness(const Message& res, int64_t now, int64_t *lifetime)
+{
+    std::string value;
+    *lifetime = 0;
+    if (findDirective(res, "Cache-Control", "no-store")) return false;
+    if (findDirective(res, "Cache-Control", "no-cache")) return true;
+    if (findDirective(res, "Cache-Control", "max-age", &value)) {
+        *lifetime = std::max<int64_t>(0, strtoll(value.c_str(), nullptr, 10));
+        return true;
+    }
+    const std::string *date = res.header("Date");
+    int64_t dateTime = (date ? ServoUnityHTTPProxy::parseHTTPDate(*date) : -1);
+    if (dateTime < 0) dateTime = now;
+    const std::string *expires = res.header("Expires");
+    if (expires) {
+        int64_t expiresTime = ServoUnityHTTPProxy::parseHTTPDate(*expires); // Invalid means already expired.
+        if (expiresTime > dateTime) *lifetime = expiresTime - dateTime;
+        return true;
+    }
+    // Heuristic freshness: a tenth of the time since the resource last changed.
+    const std::string *lastModified = res.header("Last-Modified");
+    if (lastModified) {
+        int64_t lastModifiedTime = ServoUnityHTTPProxy::parseHTTPDate(*lastModified);
+        if (lastModifiedTime >= 0 && dateTime > lastModifiedTime) *lifetime = std::min((dateTime - lastModifiedTime) / 10, kHeuristicFreshnessMax);
+    }
+    return true;
+}
+
+// When, by our clock, the origin generated res, which was requested at requestTime and whose head
+// arrived at responseTime. The response's current age is the time since (RFC 7234 section 4.2.3).
+static int64_t generatedTime(const Message& res, int64_t requestTime, int64_t responseTime)
+{
+    const std::string *date = res.header("Date");
+    int64_t dateTime = (date ? ServoUnityHTTPProxy::parseHTTPDate(*date) : -1);
+    int64_t apparentAge = (dateTime < 0 ? 0 : std::max<int64_t>(0, responseTime - dateTime));
+    const std::string *age = res.header("Age");
+    int64_t correctedAge = (age ? std::max<int64_t>(0, strtoll(age->c_str(), nullptr, 10)) : 0) + (responseTime - requestTime);
+    return responseTime - std::max(apparentAge, correctedAge);
+}
+
+static bool storable(const Message& res)
+{
+    // Statuses cacheable by default (RFC 7231 section 6.1, RFC 7538).
+    static const int kStatuses[] = {200, 203, 300, 301, 308, 404, 410};
+    if (std::find(std::begin(kStatuses), std::end(kStatuses), res.status) == std::end(kStatuses)) return false;
+    if (res.header("Set-Cookie")) return false; // Replaying it would reset the cookie.
+    // Servo's Accept-Encoding never changes, so that is the only variance that can be ignored.
+    for (const auto& h : res.headers) {
+        if (!equalsIgnoreCase(h.first, "Vary")) continue;
+        for (const std::string& item : splitList(h.second)) {
+            if (!equalsIgnoreCase(item, "Accept-Encoding")) return false;
+        }
+    }
+    return true;
+}
+
+// --------------------------------------------------------------------------
+//  Sockets
+
+static void prepareSocket(Socket s, int timeoutSeconds)
+{
+#ifdef _WIN32
+    DWORD ms = (DWORD)timeoutSeconds * 1000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char *)&ms, sizeof(ms));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char *)&ms, sizeof(ms));
+#else
+    struct timeval tv = {timeoutSeconds, 0};
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#  ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#  endif
+#endif
+    int noDelay = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+}
+
+static void setBlocking(Socket s, bool blocking)
+{
+#ifdef _WIN32
+    u_long nonBlocking = blocking ? 0 : 1;
+    ioctlsocket(s, FIONBIO, &nonBlocking);
+#else
+    int flags = fcntl(s, F_GETFL, 0);
+    fcntl(s, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+#endif
+}
+
+// Registers s to be shut down by stop(). Returns false if stopping.
+static bool track(Socket s)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (!s_running) return false;
+    s_sockets.insert(s);
+    return true;
+}
+
+static void untrackAndClose(Socket s)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    s_sockets.erase(s);
+    closeSocket(s);
+}
+
+// Connects in slices, so that stop() needn't wait out an unresponsive host.
+static bool connectWithTimeout(Socket s, const struct sockaddr *addr, size_t addrLen)
+{
+    setBlocking(s, false);
+    if (connect(s, addr, (int)addrLen) != 0) {
+#ifdef _WIN32
+        if (WSAGetLastError() != WSAEWOULDBLOCK) return false;
+#else
+        if (errno != EINPROGRESS) return false;
+#endif
+        for (int waited = 0; ; waited += 250) {
+            if (!s_running || waited >= kConnectTimeoutMs) return false;
+            PollFD p = {};
+            p.fd = s;
+            p.events = POLLOUT;
+            int n = pollSockets(&p, 1, 250);
+            if (n < 0) return false;
+            if (n > 0) break;
+        }
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        if (getsockopt(s, SOL_SOCKET, SO_ERROR, (char *)&err, &errLen) != 0 || err != 0) return false;
+    }
+    setBlocking(s, true);
+    return true;
+}
+
+static Socket connectTo(const std::string& host, const std::string& port)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = nullptr;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) {
+        SERVOUNITYLOGd("HTTP proxy unable to resolve '%s'.\n", host.c_str());
+        return kInvalidSocket;
+    }
+    Socket s = kInvalidSocket;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s == kInvalidSocket) continue;
+        if (track(s)) {
+            prepareSocket(s, kOriginTimeoutSeconds);
+            if (connectWithTimeout(s, ai->ai_addr, ai->ai_addrlen)) break;
+        }
+        untrackAndClose(s);
+        s = kInvalidSocket;
+    }
+    freeaddrinfo(res);
+    return s;
+}
+
+static bool sendAll(Socket s, const void *data, size_t len)
+{
+    const char *p = (const char *)data;
+    while (len > 0) {
+        int n = send(s, p, (int)std::min(len, (size_t)(1 << 30)), kSendFlags);
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+static bool sendAll(Socket s, const std::string& str)
+{
+    return sendAll(s, str.data(), str.size());
+}
+
+// Appends whatever is available from s to buf. Returns the count received, 0 at end of stream, or < 0 on error.
+static int receive(Socket s, std::string& buf)
+{
+    char data[16384];
+    int n = recv(s, data, sizeof(data), 0);
+    if (n > 0) buf.append(data, (size_t)n);
+    return n;
+}
+
+// Reads a message head from s into head, less the blank line which ends it. buf holds data already
+// received from s, and is left holding any which follows the head.
+static bool readHead(Socket s, std::string& buf, std::string& head)
+{
+    size_t searched = 0;
+    for (;;) {
+        size_t end = buf.find("\r\n\r\n", searched);
+        if (end != std::string::npos) {
+            head = buf.substr(0, end + 2);
+            buf.erase(0, end + 4);
+            return true;
+        }
+        if (buf.size() > kMaxHeadSize) return false;
+        searched = (buf.size() >= 3 ? buf.size() - 3 : 0);
+        if (receive(s, buf) <= 0) return false;
+    }
+}
+
+// Relays a body from one socket to another, verbatim. buf holds data already received from from,
+// and is left holding any which follows the body. Returns false if the body was cut short.
+static bool relayBody(Socket from, std::string& buf, Socket to, Framing framing, uint64_t length, Tee *tee)
+{
+    if (framing == FramingNone) return true;
+    ChunkScanner chunks;
+    uint64_t remaining = length;
+    for (;;) {
+        if (!buf.empty()) {
+            size_t n = buf.size();
+            if (framing == FramingLength) n = (size_t)std::min<uint64_t>(n, remaining);
+            else if (framing == FramingChunked) {
+                n = chunks.scan(buf.data(), n);
+                if (chunks.error) return false;
+            }
+            if (!sendAll(to, buf.data(), n)) return false;
+            if (tee) tee->add(buf.data(), n);
+            buf.erase(0, n);
+            if (framing == FramingLength) remaining -= n;
+        }
+        if ((framing == FramingLength && remaining == 0) || (framing == FramingChunked && chunks.done)) return true;
+        int n = receive(from, buf);
+        if (n == 0) return framing == FramingClose;
+        if (n < 0) return false;
+    }
+}
+
+static void sendError(Socket client, int status, const char *reason)
+{
+    char response[256];
+    snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n%s", status, reason, strlen(reason), reason);
+    sendAll(client, response, strlen(response));
+}
+
+static bool sendCached(Socket client, const ServoUnityHTTPCache::Entry& entry, int64_t now, const char *warning)
+{
+    std::string head(entry.head, entry.headLength);
+    head += "Age: " + std::to_string(std::max<int64_t>(0, now - entry.generatedAt)) + "\r\n";
+    if (warning) head += std::string("Warning: ") + warning + "\r\n";
+    head += "\r\n";
+    return sendAll(client, head) && sendAll(client, entry.body, entry.bodyLength);
+}
+
+// --------------------------------------------------------------------------
+//  Connections
+
+// Removes the stored responses that a successful unsafe request may have changed (RFC 7234 section 4.4):
+// that of the request's own URL, and those named by Location and Content-Location on the same host.
+static void invalidate(ServoUnityHTTPCache *cache, const Target& t, const Message& res)
+{
+    cache->remove(t.url);
+    for (const char *name : {"Location", "Content-Location"}) {
+        const std::string *value = res.header(name);
+        if (!value || value->empty()) continue;
+        bool relative = ((*value)[0] == '/' && value->compare(0, 2, "//") != 0);
+        Target other;
+        if (parseTarget(relative ? "http://" + t.authority + *value : *value, other) && equalsIgnoreCase(other.authority, t.authority.c_str())) cache->remove(other.url);
+    }
+}
+
+// Handles a request whose head has been read from client. Returns true if the connection may be reused.
+static bool handleRequest(Socket client, std::string& clientBuf, const Message& req, ServoUnityHTTPCache *cache)
+{
+    Target t;
+    if (!parseTarget(req.target, t)) {
+        sendError(client, 400, "Bad Request");
+        return false;
+    }
+    uint64_t requestLength = 0;
+    if (req.header("Transfer-Encoding")) {
+        sendError(client, 411, "Length Required");
+        return false;
+    }
+    const std::string *contentLength = req.header("Content-Length");
+    if (contentLength) requestLength = strtoull(contentLength->c_str(), nullptr, 10);
+
+    int64_t now = (int64_t)time(nullptr);
+    bool cacheable = req.method == "GET" && requestLength == 0 && !req.header("Range") && !findDirective(req, "Cache-Control", "no-store");
+    ServoUnityHTTPCache::Entry entry;
+    Message cached;
+    bool haveEntry = cacheable && cache->lookup(t.url, entry) && parseHead(std::string(entry.head, entry.headLength), cached) && parseStatusLine(cached);
+    std::string maxAge;
+    bool revalidate = findDirective(req, "Cache-Control", "no-cache") || findDirective(req, "Pragma", "no-cache")
+        || (findDirective(req, "Cache-Control", "max-age", &maxAge) && atoi(maxAge.c_str()) == 0);
+    if (haveEntry && !revalidate && now < entry.freshUntil) return sendCached(client, entry, now, nullptr);
+
+    // Forward to the origin, revalidating our copy if we have one. The origin is asked to close the
+    // connection after responding, so that the end of every response can be found.
+    const std::string *etag = (haveEntry ? cached.header("ETag") : nullptr);
+    const std::string *lastModified = (haveEntry ? cached.header("Last-Modified") : nullptr);
+    bool conditional = (etag || lastModified);
+    std::string out = req.method + " " + t.path + " HTTP/1.1\r\nHost: " + t.authority + "\r\n";
+    out += forwardedHeaders(req, {"Host", "Expect", conditional ? "If-None-Match" : nullptr, conditional ? "If-Modified-Since" : nullptr});
+    if (etag) out += "If-None-Match: " + *etag + "\r\n";
+    if (lastModified) out += "If-Modified-Since: " + *lastModified + "\r\n";
+    out += "Connection: close\r\n\r\n";
+
+    Socket origin = connectTo(t.host, t.port);
+    bool ok = (origin != kInvalidSocket) && sendAll(origin, out)
+        && relayBody(client, clientBuf, origin, requestLength ? FramingLength : FramingNone, requestLength, nullptr);
+    std::string originBuf, head;
+    Message res;
+    while (ok) {
+        res = Message();
+        ok = readHead(origin, originBuf, head) && parseHead(head, res) && parseStatusLine(res);
+        if (!ok || res.status >= 200) break; // Skip interim responses.
+    }
+    if (!ok) {
+        if (origin != kInvalidSocket) untrackAndClose(origin);
+        if (haveEntry) return sendCached(client, entry, now, "111 - \"Revalidation Failed\"");
+        sendError(client, 502, "Bad Gateway");
+        return false;
+    }
+
+    int64_t responseTime = (int64_t)time(nullptr);
+    int64_t generated = generatedTime(res, now, responseTime);
+    bool safe = (req.method == "GET" || req.method == "HEAD" || req.method == "OPTIONS" || req.method == "TRACE");
+    if (!safe && res.status < 400) invalidate(cache, t, res);
+
+    if (res.status == 304 && conditional) {
+        untrackAndClose(origin);
+        // Headers in the 304 update those stored; for freshness and age, only these matter.
+        int64_t lifetime;
+        if (freshness((res.header("Cache-Control") || res.header("Expires")) ? res : cached, now, &lifetime)) {
+            cache->refresh(t.url, generated + lifetime, generated);
+            entry.generatedAt = generated;
+        }
+        return sendCached(client, entry, responseTime, nullptr);
+    }
+    entry = ServoUnityHTTPCache::Entry(); // Superseded; release the mapping.
+
+    Framing framing;
+    uint64_t length = 0;
+    if (req.method == "HEAD" || res.status == 204 || res.status == 304) framing = FramingNone;
+    else if (findDirective(res, "Transfer-Encoding", "chunked")) framing = FramingChunked;
+    else if ((contentLength = res.header("Content-Length"))) {
+        framing = FramingLength;
+        length = strtoull(contentLength->c_str(), nullptr, 10);
+    } else framing = FramingClose;
+
+    std::string responseHead = res.startLine + "\r\n" + forwardedHeaders(res, {"Age"}); // Replays compute their own Age.
+    const std::string *age = res.header("Age");
+    int64_t lifetime = 0;
+    bool store = cacheable && framing != FramingNone && storable(res) && freshness(res, now, &lifetime)
+        && (lifetime > 0 || res.header("ETag") || res.header("Last-Modified"))
+        && !(framing == FramingLength && length > cache->maxEntrySize());
+    if (!store && haveEntry) cache->remove(t.url);
+
+    Tee tee;
+    tee.max = (size_t)(store ? cache->maxEntrySize() : 0);
+    ok = sendAll(client, responseHead + (age ? "Age: " + *age + "\r\n" : "") + (framing == FramingClose ? "Connection: close\r\n\r\n" : "\r\n"))
+        && relayBody(origin, originBuf, client, framing, length, store ? &tee : nullptr);
+    untrackAndClose(origin);
+    if (ok && store && !tee.full) {
+        if (framing == FramingClose) responseHead += "Content-Length: " + std::to_string(tee.data.size()) + "\r\n"; // So that replays needn't close.
+        cache->store(t.url, responseHead, (const uint8_t *)tee.data.data(), tee.data.size(), generated + lifetime, generated);
+    }
+    return ok && framing != FramingClose && req.version == "HTTP/1.1" && !findDirective(req, "Connection", "close") && !findDirective(req, "Proxy-Connection", "close");
+}
+
+// Opens a tunnel for CONNECT, and relays in both directions until either side closes.
+static void tunnel(Socket client, std::string& clientBuf, const Message& req)
+{
+    std::string host, port;
+    if (!splitAuthority(req.target, "443", host, port)) {
+        sendError(client, 400, "Bad Request");
+        return;
+    }
+    Socket origin = connectTo(host, port);
+    if (origin == kInvalidSocket) {
+        sendError(client, 502, "Bad Gateway");
+        return;
+    }
+    bool ok = sendAll(client, std::string("HTTP/1.1 200 Connection Established\r\n\r\n")) && sendAll(origin, clientBuf);
+    clientBuf.clear();
+    char data[16384];
+    while (ok) {
+        PollFD p[2] = {};
+        p[0].fd = client;
+        p[0].events = POLLIN;
+        p[1].fd = origin;
+        p[1].events = POLLIN;
+        if (pollSockets(p, 2, -1) <= 0) break; // Woken by stop() shutting the sockets down.
+        for (int i = 0; i < 2 && ok; i++) {
+            if (!p[i].revents) continue;
+            int n = recv(p[i].fd, data, sizeof(data), 0);
+            ok = (n > 0 && sendAll(p[1 - i].fd, data, (size_t)n));
+        }
+    }
+    untrackAndClose(origin);
+}
+
+static void serve(Socket client, ServoUnityHTTPCache *cache)
+{
+    std::string buf, head;
+    while (readHead(client, buf, head)) {
+        Message req;
+        if (!parseHead(head, req) || !parseRequestLine(req)) {
+            sendError(client, 400, "Bad Request");
+            break;
+        }
+        if (req.method == "CONNECT") {
+            tunnel(client, buf, req);
+            break;
+        }
+        if (!handleRequest(client, buf, req, cache)) break;
+    }
+    untrackAndClose(client);
+}
+
+static void acceptLoop(Socket listener, std::shared_ptr<ServoUnityHTTPCache> cache)
+{
+    while (s_running) {
+        // Polled in slices, as closing a listening socket doesn't wake accept() on every platform.
+        PollFD p = {};
+        p.fd = listener;
+        p.events = POLLIN;
+        if (pollSockets(&p, 1, 250) <= 0) continue;
+        Socket client = accept(listener, nullptr, nullptr);
+        if (client == kInvalidSocket) continue;
+        prepareSocket(client, kIdleTimeoutSeconds);
+        {
+            std::lock_guard<std::mutex> lock(s_lock);
+            if (!s_running) {
+                closeSocket(client);
+                break;
+            }
+            s_sockets.insert(client);
+            s_connections++;
+        }
+        std::thread([client, cache]() {
+            serve(client, cache.get());
+            std::lock_guard<std::mutex> lock(s_lock);
+            s_connections--;
+            s_idle.notify_all();
+        }).detach();
+    }
+}
+
+// --------------------------------------------------------------------------
+
+bool ServoUnityHTTPProxy::start(const std::string& cacheDir, uint64_t budget)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (s_running) return true;
+
+#ifdef _WIN32
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        SERVOUNITYLOGe("Unable to initialise Winsock for HTTP proxy.\n");
+        return false;
+    }
+#endif
+    std::shared_ptr<ServoUnityHTTPCache> cache = std::make_shared<ServoUnityHTTPCache>(cacheDir, budget);
+    Socket listener = kInvalidSocket;
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0; // Any free port.
+    socklen_t addrLen = sizeof(addr);
+    bool ok = cache->ok()
+        && (listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP)) != kInvalidSocket
+        && bind(listener, (struct sockaddr *)&addr, sizeof(addr)) == 0
+        && listen(listener, SOMAXCONN) == 0
+        && getsockname(listener, (struct sockaddr *)&addr, &addrLen) == 0;
+    if (!ok) {
+        SERVOUNITYLOGe("Unable to start HTTP proxy.\n");
+        if (listener != kInvalidSocket) closeSocket(listener);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        return false;
+    }
+
+    s_listener = listener;
+    s_port = ntohs(addr.sin_port);
+    s_cache = cache;
+    s_running = true;
+    s_acceptThread = std::thread(acceptLoop, listener, cache);
+    SERVOUNITYLOGi("HTTP caching proxy listening on 127.0.0.1:%d.\n", s_port);
+    return true;
+}
+
+void ServoUnityHTTPProxy::stop(void)
+{
+    std::unique_lock<std::mutex> lock(s_lock);
+    if (!s_running) return;
+    s_running = false;
+    for (Socket s : s_sockets) shutdown(s, kShutdownBoth);
+    lock.unlock();
+    s_acceptThread.join();
+    lock.lock();
+    s_idle.wait(lock, []() { return s_connections == 0; });
+    closeSocket(s_listener);
+    s_listener = kInvalidSocket;
+    s_port = 0;
+    s_cache.reset();
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    SERVOUNITYLOGi("HTTP caching proxy stopped.\n");
+}
+
+void ServoUnityHTTPProxy::setBudget(uint64_t budget)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (s_cache) s_cache->setBudget(budget);
+}
+
+int ServoUnityHTTPProxy::port(void)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    return s_port;
+}
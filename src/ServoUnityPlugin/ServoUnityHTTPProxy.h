@@ -0,0 +1,42 @@
+//
+// ServoUnityHTTPProxy.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// In-process caching HTTP proxy on the loopback interface.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+//
+// Plain http:// GET responses are stored in a ServoUnityHTTPCache, and served from it
+// while fresh by their Cache-Control, Expires or Last-Modified headers. Stale responses
+// are revalidated with the origin, and are served anyway if the origin can't be reached.
+// https:// traffic is tunnelled with CONNECT and can't be cached. Other methods are
+// passed through. Clients are expected to speak HTTP/1.1, as Servo does.
+//
+// Each client connection is served by its own thread. All functions are thread-safe.
+//
+class ServoUnityHTTPProxy
+{
+public:
+    /// Starts listening on 127.0.0.1 on an ephemeral port, caching in cacheDir. Returns false on failure.
+    static bool start(const std::string& cacheDir, uint64_t budget);
+    /// Closes the listener and all connections, waiting for their threads to finish.
+    static void stop(void);
+    static void setBudget(uint64_t budget);
+    /// The port listened on, or 0 if not running.
+    static int port(void);
+
+    /// Parses an RFC 7231 HTTP-date (IMF-fixdate, RFC 850 or asctime). Returns -1 if unparseable.
+    static int64_t parseHTTPDate(const std::string& s);
+};
@@ -0,0 +1,579 @@
+//
+// ServoUnityHistory.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityHistory.h"
+#include "ServoUnityFiles.h"
+#include "servo_unity_log.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+using namespace ServoUnityFiles;
+
+//
+// The log is text, one record per line, after a header line:
+//     V <time> <url>                      a visit to url at time (seconds since the epoch)
+//     T <url>\t<title>                    url's title changed
+//     E <visits> <time> <url>\t<title>    an entry, as written by compaction
+// URLs never contain whitespace, and titles have control characters replaced, so records
+// can't run together. A final line without its newline is an interrupted write, and ignored.
+//
+static const char *kLogName = "history.log";
+static const char *kLogHeader = "SUHL 1\n";
+static const size_t kMaxURLLength = 2048;
+static const size_t kMaxTitleLength = 256;
+static const double kRecencyDays = 30.0; // A visit this long ago counts half as much as one now.
+static const double kPrefixBonus = 4.0; // Typing the start of a URL is a strong signal.
+static const size_t kMaxRecentByKey = 256; // New entries indexed apart from byKey, which is costly to insert into.
+
+namespace {
+    struct Entry {
+        std::string url;
+        std::string key;
+        std::string title;
+        std::string titleLower;
+    };
+    // Everything ranking needs, kept apart from Entry so that ranking many candidates reads little memory.
+    struct Ranking {
+        uint32_t visits;
+        uint32_t urlLength;
+        int64_t lastVisit;
+    };
+    struct Ranked {
+        double score;
+        uint32_t id;
+    };
+    struct History {
+        std::vector<Entry> entries;
+        std::vector<Ranking> rankings; // By entry id.
+        std::unordered_map<std::string, uint32_t> byURL;
+        std::vector<uint32_t> byKey; // Entry ids, sorted by key.
+        std::vector<uint32_t> recentByKey; // Ids of entries added since byKey was last merged with this, sorted by key.
+        // Ids of entries containing each trigram. Ascending when loaded, but entries retitled since are appended, so a
+        // list may hold an id twice, or ids of entries which no longer contain the trigram.
+        std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+    };
+    struct LogWrite {
+        std::string path; // Empty to close the log.
+        std::string text;
+        bool truncate; // Start the log afresh before writing text.
+    };
+    struct KeyLess {
+        const History& h;
+        bool operator()(uint32_t a, uint32_t b) const { return h.entries[a].key < h.entries[b].key; }
+    };
+}
+
+static std::mutex s_lock;
+static History s_history;
+static std::string s_logPath; // Empty while there is no log to append to.
+static bool s_loading = false; // Whether the loader is reading the log. Visits meanwhile are merged into what it reads.
+static bool s_clearedWhileLoading = false;
+
+// Serialises setDiskPath(), which waits for the previous loader while holding it. The loader doesn't take it.
+static std::mutex s_pathLock;
+static std::string s_dir;
+static std::thread s_loader;
+
+// Log writes. These are run in order by s_writer, so that recording a visit never waits on the disk.
+// All but the file I/O is under s_lock.
+static std::deque<LogWrite> s_writes;
+static bool s_writing = false; // s_writer has taken writes from s_writes, and not finished them.
+static std::condition_variable s_wake;
+static std::thread s_writer; // Started by the first write, and runs until stop().
+static bool s_stopRequested = false;
+
+static void lowercase(std::string& s)
+{
+    for (char& c : s) if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+}
+
+static std::string keyOf(const std::string& url)
+{
+    std::string key = url;
+    lowercase(key);
+    size_t start = 0;
+    if (key.compare(0, 7, "http://") == 0) start = 7;
+    else if (key.compare(0, 8, "https://") == 0) start = 8;
+    if (key.compare(start, 4, "www.") == 0) start += 4;
+    return key.substr(start);
+}
+
+static bool isRecordable(const std::string& url)
+{
+    if (url.size() > kMaxURLLength) return false;
+    if (url.compare(0, 7, "http://") != 0 && url.compare(0, 8, "https://") != 0) return false;
+    for (char c : url) if ((unsigned char)c <= ' ') return false;
+    return true;
+}
+
+static std::string sanitiseTitle(const std::string& title)
+{
+    std::string t = title;
+    if (t.size() > kMaxTitleLength) {
+        size_t len = kMaxTitleLength;
+        while (len > 0 && ((unsigned char)t[len] & 0xC0) == 0x80) len--; // Don't split a UTF-8 sequence.
+        t.resize(len);
+    }
+    for (char& c : t) if ((unsigned char)c < ' ' || c == 0x7F) c = ' ';
+    return t;
+}
+
+static inline uint32_t trigramAt(const char *p)
+{
+    return ((uint32_t)(uint8_t)p[0] << 16) | ((uint32_t)(uint8_t)p[1] << 8) | (uint32_t)(uint8_t)p[2];
+}
+
+static void addTrigrams(History& h, uint32_t id, const std::string& s)
+{
+    for (size_t i = 0; i + 3 <= s.size(); i++) {
+        std::vector<uint32_t>& list = h.trigrams[trigramAt(s.data() + i)];
+        if (list.empty() || list.back() != id) list.push_back(id);
+    }
+}
+
+// Restores the trigram lists to ascending order without duplicates, after a load.
+static void sortTrigrams(History& h)
+{
+    for (auto& t : h.trigrams) {
+        std::sort(t.second.begin(), t.second.end());
+        t.second.erase(std::unique(t.second.begin(), t.second.end()), t.second.end());
+    }
+}
+
+static void sortByKey(History& h)
+{
+    std::sort(h.byKey.begin(), h.byKey.end(), KeyLess{h});
+}
+
+// Linear in the size of the history, so done only once per kMaxRecentByKey new entries.
+static void mergeRecentByKey(History& h)
+{
+    size_t mid = h.byKey.size();
+    h.byKey.insert(h.byKey.end(), h.recentByKey.begin(), h.recentByKey.end());
+    std::inplace_merge(h.byKey.begin(), h.byKey.begin() + mid, h.byKey.end(), KeyLess{h});
+    h.recentByKey.clear();
+}
+
+// When indexKey is false, the caller must sortByKey() afterwards.
+static uint32_t findOrAdd(History& h, const std::string& url, bool indexKey)
+{
+    std::unordered_map<std::string, uint32_t>::const_iterator it = h.byURL.find(url);
+    if (it != h.byURL.end()) return it->second;
+    uint32_t id = (uint32_t)h.entries.size();
+    Entry e;
+    e.url = url;
+    e.key = keyOf(url);
+    h.entries.push_back(std::move(e));
+    h.rankings.push_back({0, (uint32_t)url.size(), 0});
+    h.byURL.emplace(url, id);
+    if (!indexKey) h.byKey.push_back(id);
+    else {
+        h.recentByKey.insert(std::upper_bound(h.recentByKey.begin(), h.recentByKey.end(), id, KeyLess{h}), id);
+        if (h.recentByKey.size() >= kMaxRecentByKey) mergeRecentByKey(h);
+    }
+    addTrigrams(h, id, h.entries[id].key);
+    return id;
+}
+
+static bool setTitleOf(History& h, uint32_t id, const std::string& title)
+{
+    Entry& e = h.entries[id];
+    if (e.title == title) return false;
+    e.title = title;
+    e.titleLower = title;
+    lowercase(e.titleLower);
+    addTrigrams(h, id, e.titleLower);
+    return true;
+}
+
+// Applies the log's records. Returns false if it isn't a history log.
+static bool replay(History& h, const char *p, const char *end)
+{
+    size_t headerLength = strlen(kLogHeader);
+    if ((size_t)(end - p) < headerLength || memcmp(p, kLogHeader, headerLength) != 0) return false;
+    p += headerLength;
+    while (p < end) {
+        const char *eol = (const char *)memchr(p, '\n', end - p);
+        if (!eol) break;
+        std::string line(p, eol);
+        p = eol + 1;
+        if (line.size() < 3 || line[1] != ' ') continue;
+        const char *s = line.c_str() + 2;
+        char *next;
+        uint32_t visits = 1;
+        int64_t time = 0;
+        if (line[0] == 'E') {
+            visits = (uint32_t)strtoul(s, &next, 10);
+            if (*next != ' ') continue;
+            s = next + 1;
+        }
+        if (line[0] == 'E' || line[0] == 'V') {
+            time = strtoll(s, &next, 10);
+            if (*next != ' ') continue;
+            s = next + 1;
+        } else if (line[0] != 'T') continue;
+        const char *tab = strchr(s, '\t');
+        std::string url(s, tab ? tab - s : strlen(s));
+        if (!isRecordable(url) || (line[0] == 'V') == (tab != nullptr)) continue;
+        if (line[0] == 'T' && h.byURL.find(url) == h.byURL.end()) continue;
+        uint32_t id = findOrAdd(h, url, false);
+        if (line[0] != 'T') {
+            h.rankings[id].visits += visits;
+            h.rankings[id].lastVisit = std::max(h.rankings[id].lastVisit, time);
+        }
+        if (tab) setTitleOf(h, id, sanitiseTitle(tab + 1));
+    }
+    return true;
+}
+
+static std::string entryRecord(const History& h, uint32_t id)
+{
+    const Entry& e = h.entries[id];
+    return "E " + std::to_string(h.rankings[id].visits) + " " + std::to_string((long long)h.rankings[id].lastVisit) + " " + e.url + "\t" + e.title + "\n";
+}
+
+static bool writeCompacted(const History& h, const std::string& path)
+{
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    fputs(kLogHeader, fp);
+    for (uint32_t id = 0; id < (uint32_t)h.entries.size(); id++) fputs(entryRecord(h, id).c_str(), fp);
+    bool ok = !ferror(fp);
+    if (fclose(fp) != 0) ok = false;
+    return ok;
+}
+
+static void writerLoop(void)
+{
+    FILE *fp = nullptr;
+    std::string fpPath;
+    std::unique_lock<std::mutex> lock(s_lock);
+    while (true) {
+        s_wake.wait(lock, [] { return !s_writes.empty() || s_stopRequested; });
+        if (s_writes.empty()) break; // Only once stop is requested, so that queued writes aren't lost.
+        std::deque<LogWrite> writes;
+        writes.swap(s_writes);
+        s_writing = true;
+        lock.unlock();
+
+        for (const LogWrite& w : writes) {
+            if (w.truncate || w.path != fpPath) {
+                if (fp) fclose(fp);
+                fp = nullptr;
+                fpPath = w.path;
+                if (!fpPath.empty()) {
+                    fp = fopen(fpPath.c_str(), w.truncate ? "wb" : "ab");
+                    if (!fp) SERVOUNITYLOGw("Unable to open history log '%s'. History will be kept in memory only.\n", fpPath.c_str());
+                    else if (w.truncate) fputs(kLogHeader, fp);
+                }
+            }
+            if (fp) fputs(w.text.c_str(), fp);
+        }
+        if (fp) fflush(fp);
+
+        lock.lock();
+        s_writing = false;
+        s_wake.notify_all(); // For load(), which waits for the log to be closed.
+    }
+    if (fp) fclose(fp);
+}
+
+// Must be called with s_lock held.
+static void queueWrite(const std::string& path, std::string text, bool truncate = false)
+{
+    s_writes.push_back({path, std::move(text), truncate});
+    if (!s_writer.joinable()) s_writer = std::thread(writerLoop);
+    else if (s_writes.size() > 1 || s_writing) return; // The writer will take this once it has finished what it has.
+    s_wake.notify_all();
+}
+
+// Runs on its own thread, as a large log takes long enough to read and compact to stall a frame.
+static void load(std::string dir)
+{
+    std::string path = dir + kDirSeparator + kLogName;
+    History h;
+    bool haveDir = makeDirectory(dir);
+    if (!haveDir) {
+        SERVOUNITYLOGw("Unable to create history directory '%s'. History will be kept in memory only.\n", dir.c_str());
+    } else {
+        {
+            std::unique_ptr<MappedFile> file = MappedFile::open(path);
+            if (file && !replay(h, (const char *)file->data(), (const char *)file->data() + file->size())) {
+                SERVOUNITYLOGw("History log '%s' is unreadable and will be replaced.\n", path.c_str());
+            }
+        }
+        sortByKey(h);
+        sortTrigrams(h);
+        {
+            // The writer may still have this log open, from when the directory was last set to it.
+            std::unique_lock<std::mutex> lock(s_lock);
+            s_wake.wait(lock, [] { return s_writes.empty() && !s_writing; });
+        }
+        // Rewrite the log with one record per entry, so that it grows only with this session's changes.
+        std::string tmpPath = path + ".tmp";
+        if (!writeCompacted(h, tmpPath) || !replaceFile(tmpPath, path)) {
+            remove(tmpPath.c_str());
+            SERVOUNITYLOGw("Unable to compact history log '%s'.\n", path.c_str());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    s_loading = false;
+    if (!haveDir) return;
+    if (s_clearedWhileLoading) h = History();
+
+    // Merge in the visits made while loading, and log them, as they weren't.
+    std::string records;
+    for (uint32_t i = 0; i < (uint32_t)s_history.entries.size(); i++) {
+        const Entry& e = s_history.entries[i];
+        const Ranking& r = s_history.rankings[i];
+        uint32_t id = findOrAdd(h, e.url, true);
+        h.rankings[id].visits += r.visits;
+        h.rankings[id].lastVisit = std::max(h.rankings[id].lastVisit, r.lastVisit);
+        if (!e.title.empty()) setTitleOf(h, id, e.title);
+        records += entryRecord(h, id);
+    }
+    s_history = std::move(h);
+    s_logPath = path;
+    if (s_clearedWhileLoading || !records.empty()) queueWrite(s_logPath, std::move(records), s_clearedWhileLoading);
+    SERVOUNITYLOGi("Loaded %zu history entries.\n", s_history.entries.size());
+}
+
+void ServoUnityHistory::setDiskPath(const char *dir)
+{
+    std::lock_guard<std::mutex> pathLock(s_pathLock);
+    std::string d = (dir ? dir : "");
+    if (d == s_dir) return;
+    s_dir = d;
+    if (s_loader.joinable()) s_loader.join();
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (!s_logPath.empty()) {
+        queueWrite(std::string(), std::string()); // Closes the log.
+        s_logPath.clear();
+    }
+    if (d.empty()) return;
+    s_history = History();
+    s_loading = true;
+    s_clearedWhileLoading = false;
+    s_loader = std::thread(load, d);
+}
+
+void ServoUnityHistory::stop(void)
+{
+    std::lock_guard<std::mutex> pathLock(s_pathLock);
+    if (s_loader.joinable()) s_loader.join();
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (!s_writer.joinable()) return;
+        s_stopRequested = true;
+    }
+    s_wake.notify_all();
+    s_writer.join();
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    s_stopRequested = false;
+    // Any queued after the writer finished are dropped, so that the next write starts a new one.
+    s_writes.clear();
+}
+
+void ServoUnityHistory::visit(const std::string& url)
+{
+    if (!isRecordable(url)) return;
+    int64_t now = (int64_t)time(NULL);
+    std::lock_guard<std::mutex> lock(s_lock);
+    Ranking& r = s_history.rankings[findOrAdd(s_history, url, true)];
+    r.visits++;
+    r.lastVisit = now;
+    if (!s_logPath.empty()) queueWrite(s_logPath, "V " + std::to_string((long long)now) + " " + url + "\n");
+}
+
+void ServoUnityHistory::setTitle(const std::string& url, const std::string& title)
+{
+    std::string t = sanitiseTitle(title);
+    std::lock_guard<std::mutex> lock(s_lock);
+    std::unordered_map<std::string, uint32_t>::const_iterator it = s_history.byURL.find(url);
+    if (it == s_history.byURL.end() || !setTitleOf(s_history, it->second, t)) return;
+    if (!s_logPath.empty()) queueWrite(s_logPath, "T " + url + "\t" + t + "\n");
+}
+
+void ServoUnityHistory::clear(void)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    s_history = History();
+    if (s_loading) s_clearedWhileLoading = true;
+    if (!s_logPath.empty()) queueWrite(s_logPath, std::string(), true);
+}
+
+size_t ServoUnityHistory::count(void)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    return s_history.entries.size();
+}
+
+static double frecency(uint32_t id, int64_t now)
+{
+    const Ranking& r = s_history.rankings[id];
+    double ageDays = (double)std::max<int64_t>(now - r.lastVisit, 0) / 86400.0;
+    return r.visits * kRecencyDays / (kRecencyDays + ageDays);
+}
+
+static bool rankedBefore(const Ranked& a, const Ranked& b)
+{
+    if (a.score != b.score) return a.score > b.score;
+    uint32_t la = s_history.rankings[a.id].urlLength, lb = s_history.rankings[b.id].urlLength;
+    if (la != lb) return la < lb;
+    return a.id < b.id;
+}
+
+// Calls f with the id of each entry whose key starts with prefix or, if exact is set, equals it.
+template <typename F>
+static void forEachKeyMatch(const std::string& prefix, bool exact, F f)
+{
+    for (const std::vector<uint32_t> *index : {&s_history.byKey, &s_history.recentByKey}) {
+        std::vector<uint32_t>::const_iterator it = std::lower_bound(index->begin(), index->end(), prefix, [](uint32_t id, const std::string& s) { return s_history.entries[id].key < s; });
+        for (; it != index->end(); ++it) {
+            const std::string& key = s_history.entries[*it].key;
+            if (exact ? key != prefix : key.compare(0, prefix.size(), prefix) != 0) break;
+            f(*it);
+        }
+    }
+}
+
+// Whether a candidate would displace one of the best n so far, if it matches. Cheaper to check
+// than whether it matches, so most candidates are never looked at.
+static bool contends(const std::vector<Ranked>& best, size_t n, const Ranked& r)
+{
+    return best.size() < n || rankedBefore(r, best.back());
+}
+
+// Keeps the best n offered, best first.
+static void offer(std::vector<Ranked>& best, size_t n, const Ranked& r)
+{
+    best.insert(std::upper_bound(best.begin(), best.end(), r, rankedBefore), r);
+    if (best.size() > n) best.pop_back();
+}
+
+static bool containsWords(const Entry& e, const std::vector<std::string>& words, size_t first)
+{
+    for (size_t i = first; i < words.size(); i++) {
+        if (e.key.find(words[i]) == std::string::npos && e.titleLower.find(words[i]) == std::string::npos) return false;
+    }
+    return true;
+}
+
+// Ids of entries which may contain word, which must be at least 3 long, in their key or title: the
+// shortest posting list of its trigrams. Intersecting all of them costs more than checking the few
+// candidates which contend, as common words have long lists.
+static const std::vector<uint32_t> *trigramCandidates(const std::string& word)
+{
+    const std::vector<uint32_t> *shortest = nullptr;
+    for (size_t i = 0; i + 3 <= word.size(); i++) {
+        std::unordered_map<uint32_t, std::vector<uint32_t>>::const_iterator it = s_history.trigrams.find(trigramAt(word.data() + i));
+        if (it == s_history.trigrams.end()) return nullptr;
+        if (!shortest || it->second.size() < shortest->size()) shortest = &it->second;
+    }
+    return shortest;
+}
+
+void ServoUnityHistory::query(const std::string& query, int maxResults, std::vector<Suggestion>& results)
+{
+    results.clear();
+    if (maxResults <= 0) return;
+    size_t n = (size_t)(maxResults < kMaxSuggestions ? maxResults : kMaxSuggestions);
+
+    std::string q = query;
+    lowercase(q);
+    std::vector<std::string> words;
+    size_t pos = 0;
+    while (pos < q.size()) {
+        size_t start = q.find_first_not_of(" \t", pos);
+        if (start == std::string::npos) break;
+        pos = q.find_first_of(" \t", start);
+        if (pos == std::string::npos) pos = q.size();
+        words.push_back(q.substr(start, pos - start));
+    }
+    if (words.empty()) return;
+    words[0] = keyOf(words[0]); // Typing "https://www." shouldn't narrow the match.
+    if (words[0].empty()) words.erase(words.begin());
+    if (words.empty()) return;
+    const std::string& first = words[0];
+
+    int64_t now = (int64_t)time(NULL);
+    std::vector<Ranked> best;
+    std::lock_guard<std::mutex> lock(s_lock);
+
+    // Entries whose key starts with the first word.
+    forEachKeyMatch(first, false, [&](uint32_t id) {
+        Ranked r = {frecency(id, now) * kPrefixBonus, id};
+        if (!contends(best, n, r) || (words.size() > 1 && !containsWords(s_history.entries[id], words, 1))) return;
+        offer(best, n, r);
+    });
+
+    // Entries containing every word anywhere in their key or title, found by a trigram of the longest.
+    const std::string *longest = &first;
+    for (const std::string& w : words) if (w.size() > longest->size()) longest = &w;
+    const std::vector<uint32_t> *candidates = (longest->size() >= 3 ? trigramCandidates(*longest) : nullptr);
+    if (candidates) {
+        for (uint32_t id : *candidates) {
+            Ranked r = {frecency(id, now), id};
+            if (!contends(best, n, r)) continue;
+            const Entry& e = s_history.entries[id];
+            if (e.key.compare(0, first.size(), first) == 0) continue; // Already offered.
+            if (std::any_of(best.begin(), best.end(), [id](const Ranked& b) { return b.id == id; })) continue; // Listed twice.
+            if (!containsWords(e, words, 0)) continue;
+            offer(best, n, r);
+        }
+    }
+
+    for (const Ranked& r : best) results.push_back({s_history.entries[r.id].url, s_history.entries[r.id].title});
+}
+
+bool ServoUnityHistory::resolve(const std::string& text, std::string *url)
+{
+    size_t start = text.find_first_not_of(" \t");
+    if (start == std::string::npos) return false;
+    size_t end = text.find_last_not_of(" \t") + 1;
+    std::string key = keyOf(text.substr(start, end - start));
+    if (key.empty() || key.find_first_of(" \t") != std::string::npos) return false;
+
+    int64_t now = (int64_t)time(NULL);
+    std::lock_guard<std::mutex> lock(s_lock);
+    // A bare host is recorded with its root path.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        const Entry *match = nullptr;
+        double matchScore = 0.0;
+        forEachKeyMatch(key, true, [&](uint32_t id) {
+            double score = frecency(id, now);
+            if (!match || score > matchScore) {
+                match = &s_history.entries[id];
+                matchScore = score;
+            }
+        });
+        if (match) {
+            if (url) *url = match->url;
+            return true;
+        }
+        if (key.find('/') != std::string::npos) break;
+        key += '/';
+    }
+    return false;
+}
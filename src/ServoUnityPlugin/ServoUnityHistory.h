@@ -0,0 +1,66 @@
+//
+// ServoUnityHistory.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Store of visited pages, indexed for omnibox autocompletion.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Pages are recorded from Servo's URL and title callbacks, one entry per URL, with a visit
+// count and the time of the last visit. If a directory has been set with setDiskPath(), every
+// change is appended to a log there, by a background thread. The log is read back and compacted
+// to one record per entry on another background thread when the directory is set, i.e. at
+// startup; visits made meanwhile are merged in when it finishes.
+//
+// Entries are matched against a query by their key: the URL lowercased, without its scheme
+// and any leading "www.". Short queries match keys by prefix, via a sorted index. Longer
+// queries match anywhere in the key or the title, via an index of the trigrams in each, and
+// queries of several words must match all of them. Matches are ranked by frecency (visits,
+// decayed by time since the last visit), with a bonus for matching the start of the key.
+//
+// Only http: and https: URLs are recorded. All functions are thread-safe.
+//
+class ServoUnityHistory
+{
+public:
+    static const int kMaxSuggestions = 32;
+
+    struct Suggestion {
+        std::string URL;
+        std::string title;
+    };
+
+    /// Directory for the log, created if it doesn't exist. Empty or NULL keeps history in memory only.
+    /// Any history already in memory is replaced by the directory's, which is loaded asynchronously.
+    /// Does nothing if dir is the directory already set.
+    static void setDiskPath(const char *dir);
+    /// Waits for a load started by setDiskPath() and any queued log writes to finish, and stops the log writer.
+    static void stop(void);
+
+    /// Record a visit to url.
+    static void visit(const std::string& url);
+    /// Set the title of the page at url, if it has been visited.
+    static void setTitle(const std::string& url, const std::string& title);
+    /// Forget all history, including the log.
+    static void clear(void);
+
+    /// Up to maxResults (at most kMaxSuggestions) entries matching query, best first.
+    static void query(const std::string& query, int maxResults, std::vector<Suggestion>& results);
+    /// If text is exactly the key of a visited URL, e.g. "example.com/page", gets the most frecent such URL.
+    static bool resolve(const std::string& text, std::string *url);
+    static size_t count(void);
+};
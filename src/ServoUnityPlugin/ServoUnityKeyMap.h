@@ -0,0 +1,141 @@
+//
+// ServoUnityKeyMap.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Mapping from ServoUnityKeyCode_* to Servo's CKeyType, generated at compile time
+// from a single list.
+//
+
+#pragma once
+
+#include "servo_unity_c.h"
+#include "simpleservo2.h"
+#include <cstdint>
+
+//
+// The list of key codes, in order of value. This list, the ServoUnityKeyCode_* enum in servo_unity_c.h,
+// and the ServoUnityKeyCode enum in ServoUnityPlugin.cs must agree; the static_asserts below check the first two.
+// X(name, value, type, character): type is the CKeyType sent to Servo, or kNone if Servo has no equivalent,
+// in which case the key is dropped. If character is non-zero, it is sent in place of the event's character.
+//
+#define SERVO_UNITY_KEY_CODES(X) \
+    X(Null,           0,  kNone,           0) \
+    X(Character,      1,  kCharacter,      0) \
+    X(Backspace,      2,  kBackspace,      0) \
+    X(Delete,         3,  kDelete,         0) \
+    X(Tab,            4,  kTab,            0) \
+    X(Clear,          5,  kNone,           0) \
+    X(Return,         6,  kEnter,          0) \
+    X(Pause,          7,  kPause,          0) \
+    X(Escape,         8,  kEscape,         0) \
+    X(Space,          9,  kCharacter,      ' ') \
+    X(UpArrow,        10, kUpArrow,        0) \
+    X(DownArrow,      11, kDownArrow,      0) \
+    X(RightArrow,     12, kRightArrow,     0) \
+    X(LeftArrow,      13, kLeftArrow,      0) \
+    X(Insert,         14, kInsert,         0) \
+    X(Home,           15, kHome,           0) \
+    X(End,            16, kEnd,            0) \
+    X(PageUp,         17, kPageUp,         0) \
+    X(PageDown,       18, kPageDown,       0) \
+    X(F1,             19, kF1,             0) \
+    X(F2,             20, kF2,             0) \
+    X(F3,             21, kF3,             0) \
+    X(F4,             22, kF4,             0) \
+    X(F5,             23, kF5,             0) \
+    X(F6,             24, kF6,             0) \
+    X(F7,             25, kF7,             0) \
+    X(F8,             26, kF8,             0) \
+    X(F9,             27, kF9,             0) \
+    X(F10,            28, kF10,            0) \
+    X(F11,            29, kF11,            0) \
+    X(F12,            30, kF12,            0) \
+    X(F13,            31, kNone,           0) \
+    X(F14,            32, kNone,           0) \
+    X(F15,            33, kNone,           0) \
+    X(F16,            34, kNone,           0) \
+    X(F17,            35, kNone,           0) \
+    X(F18,            36, kNone,           0) \
+    X(F19,            37, kNone,           0) \
+    X(Numlock,        38, kNumLock,        0) \
+    X(CapsLock,       39, kCapsLock,       0) \
+    X(ScrollLock,     40, kScrollLock,     0) \
+    X(RightShift,     41, kShift,          0) \
+    X(LeftShift,      42, kShift,          0) \
+    X(RightControl,   43, kControl,        0) \
+    X(LeftControl,    44, kControl,        0) \
+    X(RightAlt,       45, kOptionAlt,      0) \
+    X(LeftAlt,        46, kOptionAlt,      0) \
+    X(LeftCommand,    47, kCommandWindows, 0) \
+    X(LeftWindows,    48, kCommandWindows, 0) \
+    X(RightCommand,   49, kCommandWindows, 0) \
+    X(RightWindows,   50, kCommandWindows, 0) \
+    X(AltGr,          51, kAltGr,          0) \
+    X(Help,           52, kHelp,           0) \
+    X(Print,          53, kPrint,          0) \
+    X(SysReq,         54, kNone,           0) \
+    X(Break,          55, kPause,          0) \
+    X(Menu,           56, kNone,           0) \
+    X(Keypad0,        57, kCharacter,      '0') \
+    X(Keypad1,        58, kCharacter,      '1') \
+    X(Keypad2,        59, kCharacter,      '2') \
+    X(Keypad3,        60, kCharacter,      '3') \
+    X(Keypad4,        61, kCharacter,      '4') \
+    X(Keypad5,        62, kCharacter,      '5') \
+    X(Keypad6,        63, kCharacter,      '6') \
+    X(Keypad7,        64, kCharacter,      '7') \
+    X(Keypad8,        65, kCharacter,      '8') \
+    X(Keypad9,        66, kCharacter,      '9') \
+    X(KeypadPeriod,   67, kCharacter,      '.') \
+    X(KeypadDivide,   68, kCharacter,      '/') \
+    X(KeypadMultiply, 69, kCharacter,      '*') \
+    X(KeypadMinus,    70, kCharacter,      '-') \
+    X(KeypadPlus,     71, kCharacter,      '+') \
+    X(KeypadEnter,    72, kEnter,          0) \
+    X(KeypadEquals,   73, kCharacter,      '=')
+
+struct ServoUnityKeyMapping {
+    int keyCode;
+    CKeyType type;
+    uint32_t character;
+};
+
+#define SERVO_UNITY_KEY_MAPPING(name, value, type, character) { value, CKeyType::type, character },
+static constexpr ServoUnityKeyMapping kServoUnityKeyMap[] = { SERVO_UNITY_KEY_CODES(SERVO_UNITY_KEY_MAPPING) };
+#undef SERVO_UNITY_KEY_MAPPING
+static constexpr int kServoUnityKeyMapCount = (int)(sizeof(kServoUnityKeyMap) / sizeof(kServoUnityKeyMap[0]));
+
+// The list must agree with the public enum, name for name and value for value.
+#define SERVO_UNITY_KEY_CHECK(name, value, type, character) static_assert(ServoUnityKeyCode_##name == value, "ServoUnityKeyCode_" #name " doesn't match the key map.");
+SERVO_UNITY_KEY_CODES(SERVO_UNITY_KEY_CHECK)
+#undef SERVO_UNITY_KEY_CHECK
+
+// The list must be dense and in order, so that a key code is its own index.
+static constexpr bool servoUnityKeyMapIsIndexed(int i = 0)
+{
+    return i == kServoUnityKeyMapCount || (kServoUnityKeyMap[i].keyCode == i && servoUnityKeyMapIsIndexed(i + 1));
+}
+static_assert(servoUnityKeyMapIsIndexed(), "Key map entries must be in order, with no gaps.");
+static_assert(kServoUnityKeyMapCount == ServoUnityKeyCode_KeypadEquals + 1, "Key map doesn't cover every key code.");
+
+// Spot checks of the generated table.
+static_assert(kServoUnityKeyMap[ServoUnityKeyCode_Character].type == CKeyType::kCharacter && kServoUnityKeyMap[ServoUnityKeyCode_Character].character == 0, "Character must pass the event's character through.");
+static_assert(kServoUnityKeyMap[ServoUnityKeyCode_Space].type == CKeyType::kCharacter && kServoUnityKeyMap[ServoUnityKeyCode_Space].character == ' ', "Space must map to ' '.");
+static_assert(kServoUnityKeyMap[ServoUnityKeyCode_Return].type == CKeyType::kEnter && kServoUnityKeyMap[ServoUnityKeyCode_KeypadEnter].type == CKeyType::kEnter, "Both Enter keys must map to kEnter.");
+static_assert(kServoUnityKeyMap[ServoUnityKeyCode_KeypadEquals].character == '=', "Keypad keys must map to their characters.");
+static_assert(kServoUnityKeyMap[ServoUnityKeyCode_Null].type == CKeyType::kNone, "Null must be dropped.");
+
+/// Look up the mapping for a key code. Returns nullptr if keyCode is out of range, or Servo has no equivalent key.
+inline const ServoUnityKeyMapping *servoUnityKeyMapping(int keyCode)
+{
+    if (keyCode < 0 || keyCode >= kServoUnityKeyMapCount) return nullptr;
+    const ServoUnityKeyMapping *m = &kServoUnityKeyMap[keyCode];
+    return (m->type == CKeyType::kNone ? nullptr : m);
+}
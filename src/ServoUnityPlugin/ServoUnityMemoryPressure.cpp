@@ -0,0 +1,422 @@
+//
+// ServoUnityMemoryPressure.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#ifdef _WIN32
+#  define NOMINMAX
+#  include <windows.h>
+#elif defined(__APPLE__)
+#  include <sys/types.h>
+#  include <sys/sysctl.h>
+#else
+#  include <fcntl.h>
+#  include <poll.h>
+#  include <unistd.h>
+#endif
+#include "ServoUnityMemoryPressure.h"
+#include "servo_unity_c.h"
+#include "servo_unity_log.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+const int ServoUnityMemoryPressure::kSampleIntervalMs;
+const int ServoUnityMemoryPressure::kFallDelaySeconds;
+
+static const int kSliceMs = 250; // Longest the monitor thread waits before noticing it's been stopped.
+
+static std::mutex s_lock; // Guards s_thread, and waits on s_wake.
+static std::condition_variable s_wake;
+static std::thread s_thread;
+static std::atomic<bool> s_running(false);
+static std::atomic<int> s_measuredLevel(ServoUnityMemoryPressure_None);
+static std::atomic<int> s_injectedLevel(-1);
+static std::atomic<int> s_source(ServoUnityMemoryPressure::Source_None);
+
+int ServoUnityMemoryPressure::levelForStalls(double someAvg10, double fullAvg10)
+{
+    if (fullAvg10 >= 10.0) return ServoUnityMemoryPressure_Critical;
+    if (someAvg10 >= 20.0 || fullAvg10 >= 5.0) return ServoUnityMemoryPressure_High;
+    if (someAvg10 >= 10.0) return ServoUnityMemoryPressure_Moderate;
+    if (someAvg10 >= 5.0) return ServoUnityMemoryPressure_Low;
+    return ServoUnityMemoryPressure_None;
+}
+
+int ServoUnityMemoryPressure::levelForUsage(double usedFraction)
+{
+    if (usedFraction >= 0.97) return ServoUnityMemoryPressure_Critical;
+    if (usedFraction >= 0.92) return ServoUnityMemoryPressure_High;
+    if (usedFraction >= 0.85) return ServoUnityMemoryPressure_Moderate;
+    if (usedFraction >= 0.75) return ServoUnityMemoryPressure_Low;
+    return ServoUnityMemoryPressure_None;
+}
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+
+namespace {
+    struct Sampler {
+        std::string cgroupDir; // Empty if not in a cgroup with a memory limit.
+        bool cgroupV2 = false;
+        bool eventsRead = false;
+        uint64_t limitEvents = 0; // Times the cgroup reclaimed at its limit: memory.events high + max, or memory.failcnt on v1.
+        uint64_t oomKills = 0; // memory.events oom_kill, or memory.oom_control oom_kill on v1.
+        std::string psiPath; // Empty if PSI is unavailable.
+        int triggerFD = -1;
+    };
+}
+
+static const uint64_t kNoLimit = UINT64_MAX;
+
+static bool readFile(const std::string& path, std::string& contents)
+{
+    FILE *fp = fopen(path.c_str(), "r");
+    if (!fp) return false;
+    char buf[4096];
+    size_t n;
+    contents.clear();
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0 && contents.size() < 65536) contents.append(buf, n);
+    bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+// A file holding one number, or "max" for none. Returns kNoLimit if unreadable.
+static uint64_t readNumber(const std::string& path)
+{
+    std::string s;
+    if (!readFile(path, s) || s.compare(0, 3, "max") == 0) return kNoLimit;
+    char *end;
+    unsigned long long v = strtoull(s.c_str(), &end, 10);
+    return end == s.c_str() ? kNoLimit : (uint64_t)v;
+}
+
+// The number after key at the start of a line, e.g. "inactive_file 1234" or "MemAvailable:   1234 kB". 0 if absent.
+static uint64_t field(const std::string& text, const char *key)
+{
+    size_t keyLength = strlen(key);
+    size_t pos = 0;
+    while (pos < text.size()) {
+        if (text.compare(pos, keyLength, key) == 0 && (text[pos + keyLength] == ' ' || text[pos + keyLength] == ':')) {
+            return strtoull(text.c_str() + pos + keyLength + 1, nullptr, 10);
+        }
+        pos = text.find('\n', pos);
+        if (pos == std::string::npos) break;
+        pos++;
+    }
+    return 0;
+}
+
+// Reads the avg10 of the "some" and "full" lines of a PSI file.
+static bool readStalls(const std::string& path, double *some, double *full)
+{
+    std::string text;
+    if (!readFile(path, text)) return false;
+    const char *s = strstr(text.c_str(), "some avg10=");
+    if (!s) return false;
+    *some = strtod(s + 11, nullptr);
+    const char *f = strstr(text.c_str(), "full avg10=");
+    *full = f ? strtod(f + 11, nullptr) : 0.0;
+    return true;
+}
+
+static uint64_t memTotal(void)
+{
+    std::string meminfo;
+    if (!readFile("/proc/meminfo", meminfo)) return 0;
+    return field(meminfo, "MemTotal") * 1024;
+}
+
+static bool fileExists(const std::string& path)
+{
+    return access(path.c_str(), R_OK) == 0;
+}
+
+// Finds the process's memory cgroup, from /proc/self/cgroup lines "hierarchy-ID:controllers:path".
+// Inside a cgroup namespace, the cgroup is mounted at the root of the hierarchy rather than at path.
+static void findCGroup(Sampler& s)
+{
+    std::string text;
+    if (!readFile("/proc/self/cgroup", text)) return;
+    std::string v1Path, v2Path;
+    bool haveV2 = false;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string::npos) eol = text.size();
+        std::string line = text.substr(pos, eol - pos);
+        pos = eol + 1;
+        size_t c1 = line.find(':'), c2 = (c1 == std::string::npos ? c1 : line.find(':', c1 + 1));
+        if (c2 == std::string::npos) continue;
+        std::string controllers = line.substr(c1 + 1, c2 - c1 - 1);
+        std::string path = line.substr(c2 + 1);
+        if (path == "/") path.clear();
+        if (controllers.empty()) {
+            v2Path = path;
+            haveV2 = true;
+        } else if (("," + controllers + ",").find(",memory,") != std::string::npos) {
+            v1Path = path;
+        }
+    }
+    const char *v2Roots[] = {"/sys/fs/cgroup", "/sys/fs/cgroup/unified"};
+    for (const char *root : v2Roots) {
+        if (!haveV2) break;
+        for (const std::string& dir : {root + v2Path, std::string(root)}) {
+            if (fileExists(dir + "/memory.max")) {
+                s.cgroupDir = dir;
+                s.cgroupV2 = true;
+                break;
+            }
+        }
+        if (!s.cgroupDir.empty()) break;
+    }
+    if (s.cgroupDir.empty()) {
+        for (const std::string& dir : {"/sys/fs/cgroup/memory" + v1Path, std::string("/sys/fs/cgroup/memory")}) {
+            if (fileExists(dir + "/memory.limit_in_bytes")) {
+                s.cgroupDir = dir;
+                break;
+            }
+        }
+    }
+    if (s.cgroupDir.empty()) return;
+
+    // A limit at or above physical memory is no limit.
+    uint64_t limit = s.cgroupV2 ? std::min(readNumber(s.cgroupDir + "/memory.high"), readNumber(s.cgroupDir + "/memory.max"))
+        : readNumber(s.cgroupDir + "/memory.limit_in_bytes");
+    uint64_t total = memTotal();
+    if (limit == kNoLimit || (total && limit >= total)) {
+        if (s.cgroupV2 && fileExists(s.cgroupDir + "/memory.pressure")) s.psiPath = s.cgroupDir + "/memory.pressure";
+        s.cgroupDir.clear();
+    } else if (s.cgroupV2 && fileExists(s.cgroupDir + "/memory.pressure")) {
+        s.psiPath = s.cgroupDir + "/memory.pressure";
+    }
+}
+
+static void openSampler(Sampler& s)
+{
+    findCGroup(s);
+    double some, full;
+    if (s.psiPath.empty() && readStalls("/proc/pressure/memory", &some, &full)) s.psiPath = "/proc/pressure/memory";
+    if (!s.psiPath.empty() && !readStalls(s.psiPath, &some, &full)) s.psiPath.clear(); // E.g. PSI disabled at boot.
+
+    // Ask to be woken when tasks stall on memory for 150 ms in any 2 s. Unprivileged triggers need a window of a multiple of 2 s.
+    if (!s.psiPath.empty()) {
+        s.triggerFD = open(s.psiPath.c_str(), O_RDWR | O_NONBLOCK);
+        const char *trigger = "some 150000 2000000";
+        if (s.triggerFD >= 0 && write(s.triggerFD, trigger, strlen(trigger) + 1) < 0) {
+            close(s.triggerFD);
+            s.triggerFD = -1;
+        }
+    }
+    s_source = (!s.cgroupDir.empty() ? ServoUnityMemoryPressure::Source_CGroup : (!s.psiPath.empty() ? ServoUnityMemoryPressure::Source_PSI : ServoUnityMemoryPressure::Source_System));
+    SERVOUNITYLOGi("Memory pressure monitor using %s%s%s%s.\n",
+        !s.cgroupDir.empty() ? (s.cgroupV2 ? "cgroup v2 " : "cgroup v1 ") : "",
+        !s.cgroupDir.empty() ? s.cgroupDir.c_str() : (s.psiPath.empty() ? "/proc/meminfo" : ""),
+        !s.psiPath.empty() ? (!s.cgroupDir.empty() ? " and " : "") : "",
+        !s.psiPath.empty() ? (s.psiPath + (s.triggerFD >= 0 ? " with trigger" : "")).c_str() : "");
+}
+
+static void closeSampler(Sampler& s)
+{
+    if (s.triggerFD >= 0) close(s.triggerFD);
+    s.triggerFD = -1;
+}
+
+static int sample(Sampler& s)
+{
+    int level = ServoUnityMemoryPressure_None;
+    if (!s.cgroupDir.empty()) {
+        std::string stat, events;
+        readFile(s.cgroupDir + "/memory.stat", stat);
+        uint64_t limit, usage, inactive, limitEvents, oomKills;
+        if (s.cgroupV2) {
+            limit = std::min(readNumber(s.cgroupDir + "/memory.high"), readNumber(s.cgroupDir + "/memory.max"));
+            usage = readNumber(s.cgroupDir + "/memory.current");
+            inactive = field(stat, "inactive_file");
+            readFile(s.cgroupDir + "/memory.events", events);
+            limitEvents = field(events, "high") + field(events, "max");
+            oomKills = field(events, "oom_kill");
+        } else {
+            limit = readNumber(s.cgroupDir + "/memory.limit_in_bytes");
+            usage = readNumber(s.cgroupDir + "/memory.usage_in_bytes");
+            inactive = field(stat, "total_inactive_file");
+            limitEvents = readNumber(s.cgroupDir + "/memory.failcnt");
+            readFile(s.cgroupDir + "/memory.oom_control", events);
+            oomKills = field(events, "oom_kill");
+        }
+        // Inactive page cache is reclaimed before anything is pushed out, so it isn't pressure.
+        if (limit != kNoLimit && limit > 0 && usage != kNoLimit) {
+            uint64_t workingSet = usage > inactive ? usage - inactive : 0;
+            level = std::max(level, ServoUnityMemoryPressure::levelForUsage((double)workingSet / (double)limit));
+        }
+        // Reclaim at the limit also happens when it's merely full of page cache, so is only a hint, but
+        // another process in the cgroup being killed means this one could be next.
+        if (s.eventsRead) {
+            if (oomKills > s.oomKills) level = ServoUnityMemoryPressure_Critical;
+            else if (limitEvents != kNoLimit && limitEvents > s.limitEvents) level = std::max(level, (int)ServoUnityMemoryPressure_Low);
+        }
+        s.eventsRead = true;
+        s.oomKills = oomKills;
+        if (limitEvents != kNoLimit) s.limitEvents = limitEvents;
+    } else {
+        std::string meminfo;
+        if (readFile("/proc/meminfo", meminfo)) {
+            uint64_t total = field(meminfo, "MemTotal"), available = field(meminfo, "MemAvailable");
+            if (total > 0 && available <= total) level = ServoUnityMemoryPressure::levelForUsage(1.0 - (double)available / (double)total);
+        }
+    }
+    double some, full;
+    if (!s.psiPath.empty() && readStalls(s.psiPath, &some, &full)) level = std::max(level, ServoUnityMemoryPressure::levelForStalls(some, full));
+    return level;
+}
+
+// Waits until the next sample is due, the trigger fires, or the monitor is stopped.
+static void waitForSample(Sampler& s)
+{
+    for (int waited = 0; waited < ServoUnityMemoryPressure::kSampleIntervalMs && s_running; waited += kSliceMs) {
+        if (s.triggerFD >= 0) {
+            struct pollfd p = {s.triggerFD, POLLPRI, 0};
+            if (poll(&p, 1, kSliceMs) > 0) {
+                if (p.revents & POLLPRI) return;
+                if (p.revents & (POLLERR | POLLNVAL)) closeSampler(s);
+            }
+        } else {
+            std::unique_lock<std::mutex> lock(s_lock);
+            s_wake.wait_for(lock, std::chrono::milliseconds(kSliceMs), [] { return !s_running; });
+        }
+    }
+}
+
+#else // _WIN32 || __APPLE__
+
+namespace {
+    struct Sampler {};
+}
+
+static void openSampler(Sampler& s)
+{
+    s_source = ServoUnityMemoryPressure::Source_System;
+    SERVOUNITYLOGi("Memory pressure monitor using system available memory.\n");
+}
+
+static void closeSampler(Sampler& s)
+{
+}
+
+static int sample(Sampler& s)
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (!GlobalMemoryStatusEx(&status) || status.ullTotalPhys == 0 || status.ullTotalPageFile == 0) return ServoUnityMemoryPressure_None;
+    // Running out of commit fails allocations just as surely as running out of physical memory.
+    double physical = 1.0 - (double)status.ullAvailPhys / (double)status.ullTotalPhys;
+    double commit = 1.0 - (double)status.ullAvailPageFile / (double)status.ullTotalPageFile;
+    return ServoUnityMemoryPressure::levelForUsage(std::max(physical, commit));
+#else
+    int percentAvailable = 0;
+    size_t length = sizeof(percentAvailable);
+    if (sysctlbyname("kern.memorystatus_level", &percentAvailable, &length, nullptr, 0) != 0) return ServoUnityMemoryPressure_None;
+    return ServoUnityMemoryPressure::levelForUsage(1.0 - percentAvailable / 100.0);
+#endif
+}
+
+static void waitForSample(Sampler& s)
+{
+    std::unique_lock<std::mutex> lock(s_lock);
+    s_wake.wait_for(lock, std::chrono::milliseconds(ServoUnityMemoryPressure::kSampleIntervalMs), [] { return !s_running; });
+}
+
+#endif // _WIN32 || __APPLE__
+
+static void monitorLoop(void)
+{
+    Sampler s;
+    openSampler(s);
+    bool falling = false;
+    int fallingLevel = ServoUnityMemoryPressure_None;
+    std::chrono::steady_clock::time_point fallingSince;
+    while (s_running) {
+        int sampled = sample(s);
+        int current = s_measuredLevel.load();
+        int level = current;
+        if (sampled >= current) {
+            level = sampled;
+            falling = false;
+        } else {
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (!falling) {
+                falling = true;
+                fallingSince = now;
+                fallingLevel = sampled;
+            } else {
+                fallingLevel = std::max(fallingLevel, sampled);
+            }
+            if (now - fallingSince >= std::chrono::seconds(ServoUnityMemoryPressure::kFallDelaySeconds)) {
+                level = fallingLevel;
+                falling = false;
+            }
+        }
+        if (level != current) {
+            SERVOUNITYLOGi("Measured memory pressure level changed from %d to %d.\n", current, level);
+            s_measuredLevel = level;
+        }
+        waitForSample(s);
+    }
+    closeSampler(s);
+}
+
+void ServoUnityMemoryPressure::start(void)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (s_running) return;
+    s_running = true;
+    s_measuredLevel = ServoUnityMemoryPressure_None;
+    s_thread = std::thread(monitorLoop);
+}
+
+void ServoUnityMemoryPressure::stop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (!s_running) return;
+        s_running = false;
+    }
+    s_wake.notify_all();
+    s_thread.join();
+    s_measuredLevel = ServoUnityMemoryPressure_None;
+    s_source = Source_None;
+}
+
+int ServoUnityMemoryPressure::level(void)
+{
+    int injected = s_injectedLevel.load();
+    return injected >= 0 ? injected : s_measuredLevel.load();
+}
+
+void ServoUnityMemoryPressure::inject(int level)
+{
+    if (level > ServoUnityMemoryPressure_Critical) level = ServoUnityMemoryPressure_Critical;
+    if (level < 0) level = -1;
+    SERVOUNITYLOGi(level < 0 ? "Memory pressure level no longer injected.\n" : "Memory pressure level %d injected.\n", level);
+    s_injectedLevel = level;
+}
+
+ServoUnityMemoryPressure::Source ServoUnityMemoryPressure::source(void)
+{
+    return (Source)s_source.load();
+}
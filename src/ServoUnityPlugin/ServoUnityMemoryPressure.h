@@ -0,0 +1,67 @@
+//
+// ServoUnityMemoryPressure.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Monitor of the memory pressure the process is under.
+//
+
+#pragma once
+
+#include <cstdint>
+
+//
+// A background thread samples the signals available, and takes the highest of the
+// ServoUnityMemoryPressure_* levels they call for:
+//   - On Linux (including Android) in a cgroup with a memory limit: the cgroup's working set
+//     against the limit (memory.high and memory.max on v2, memory.limit_in_bytes on v1), new
+//     reclaim at the limit and OOM kills (memory.events on v2, memory.failcnt and
+//     memory.oom_control on v1).
+//   - Otherwise on Linux: MemAvailable against MemTotal.
+//   - Also on Linux, pressure stall information (PSI): the cgroup's memory.pressure on v2,
+//     otherwise system-wide from /proc/pressure/memory.
+//   - On Windows and macOS: the system's available physical memory.
+// Where the kernel allows it, a PSI trigger wakes the thread as soon as stalls begin, rather
+// than at its next sample.
+//
+// The level rises as soon as a sample calls for it, but falls only once samples have called
+// for a lower level for kFallDelaySeconds, so that responses aren't undone by the relief
+// they bring. An injected level overrides the measured one, for testing.
+//
+// All functions are thread-safe.
+//
+class ServoUnityMemoryPressure
+{
+public:
+    static const int kSampleIntervalMs = 1000;
+    static const int kFallDelaySeconds = 10;
+
+    enum Source {
+        Source_None = 0,
+        Source_CGroup,
+        Source_PSI,
+        Source_System
+    };
+
+    /// Starts sampling. Has no effect if already started.
+    static void start(void);
+    static void stop(void);
+
+    /// The injected level if there is one, otherwise the measured level.
+    static int level(void);
+    /// Override the measured level with one of ServoUnityMemoryPressure_*, or pass -1 to stop overriding it.
+    static void inject(int level);
+    /// The signal levels are being measured from, or Source_None if the monitor isn't running.
+    static Source source(void);
+
+    /// The level for a PSI sample, in percent of the last 10 seconds stalled.
+    static int levelForStalls(double someAvg10, double fullAvg10);
+    /// The level for a fraction of the available memory in use.
+    static int levelForUsage(double usedFraction);
+};
@@ -0,0 +1,194 @@
+//
+// ServoUnityNavigationPolicy.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityNavigationPolicy.h"
+#include "servo_unity_log.h"
+#include <cstring>
+
+static const size_t kMaxHostLength = 253;
+
+std::unique_ptr<ServoUnityNavigationPolicy> ServoUnityNavigationPolicy::load(std::shared_ptr<const ServoUnityResourceArchive> archive)
+{
+    const uint8_t *data;
+    size_t length;
+    if (!archive || !archive->find(SERVO_UNITY_NAVIGATION_POLICY_NAME, &data, &length)) return nullptr;
+    std::unique_ptr<ServoUnityNavigationPolicy> policy = fromData(data, length);
+    if (!policy) return nullptr;
+    policy->m_archive = archive;
+    SERVOUNITYLOGi("Loaded navigation policy with %u rules.\n", policy->m_header->ruleCount);
+    return policy;
+}
+
+std::unique_ptr<ServoUnityNavigationPolicy> ServoUnityNavigationPolicy::fromData(const uint8_t *data, size_t length)
+{
+    // Validate everything up front, so that decisions needn't.
+    const ServoUnityNavigationPolicyHeader *header = (const ServoUnityNavigationPolicyHeader *)data;
+    if (length < sizeof(ServoUnityNavigationPolicyHeader)
+        || memcmp(header->magic, SERVO_UNITY_NAVIGATION_POLICY_MAGIC, 4) != 0
+        || header->version != SERVO_UNITY_NAVIGATION_POLICY_VERSION
+        || header->size != length
+        || header->nodeCount == 0
+        || header->bloomWords == 0 || (header->bloomWords & (header->bloomWords - 1)) != 0
+        || header->bloomHashes == 0) {
+        SERVOUNITYLOGe("Navigation policy is invalid or from an incompatible version.\n");
+        return nullptr;
+    }
+    uint64_t stringsOffset = sizeof(ServoUnityNavigationPolicyHeader) + (uint64_t)header->bloomWords * sizeof(uint64_t)
+        + (uint64_t)header->nodeCount * sizeof(ServoUnityNavigationPolicyNode) + (uint64_t)header->ruleCount * sizeof(uint32_t);
+    if (stringsOffset > length) {
+        SERVOUNITYLOGe("Navigation policy is truncated.\n");
+        return nullptr;
+    }
+
+    std::unique_ptr<ServoUnityNavigationPolicy> policy(new ServoUnityNavigationPolicy());
+    policy->m_header = header;
+    policy->m_bloom = (const uint64_t *)(header + 1);
+    policy->m_nodes = (const ServoUnityNavigationPolicyNode *)(policy->m_bloom + header->bloomWords);
+    policy->m_ruleNodes = (const uint32_t *)(policy->m_nodes + header->nodeCount);
+    policy->m_strings = (const char *)data + stringsOffset;
+    policy->m_stringsLength = length - (size_t)stringsOffset;
+    for (uint32_t i = 0; i < header->nodeCount; i++) {
+        const ServoUnityNavigationPolicyNode& n = policy->m_nodes[i];
+        if (n.labelOffset > policy->m_stringsLength || n.labelLength > policy->m_stringsLength - n.labelOffset
+            || n.redirectOffset > policy->m_stringsLength || n.redirectLength > policy->m_stringsLength - n.redirectOffset
+            || n.firstChild > header->nodeCount || n.childCount > header->nodeCount - n.firstChild
+            || (n.childCount && n.firstChild <= i) // Children come after their parent, so walks terminate.
+            || n.parent >= header->nodeCount || (i && n.parent >= i)
+            || n.action > ServoUnityNavigationPolicyAction_Redirect
+            || (n.action != ServoUnityNavigationPolicyAction_None) != (n.rule < header->ruleCount)) {
+            SERVOUNITYLOGe("Navigation policy is corrupt (node %u).\n", i);
+            return nullptr;
+        }
+    }
+    for (uint32_t r = 0; r < header->ruleCount; r++) {
+        if (policy->m_ruleNodes[r] >= header->nodeCount || policy->m_nodes[policy->m_ruleNodes[r]].rule != r) {
+            SERVOUNITYLOGe("Navigation policy is corrupt (rule %u).\n", r);
+            return nullptr;
+        }
+    }
+
+    policy->m_hits.reset(new std::atomic<uint64_t>[header->ruleCount ? header->ruleCount : 1]);
+    for (uint32_t r = 0; r < header->ruleCount; r++) policy->m_hits[r] = 0;
+    for (int c = 0; c < Counter_Max; c++) policy->m_counters[c] = 0;
+    return policy;
+}
+
+bool ServoUnityNavigationPolicy::bloomContains(uint64_t h) const
+{
+    uint64_t bitMask = (uint64_t)m_header->bloomWords * 64 - 1;
+    for (uint32_t i = 0; i < m_header->bloomHashes; i++) {
+        uint64_t bit = servoUnityNavigationPolicyBloomBit(h, i, bitMask);
+        if (!(m_bloom[bit >> 6] & (1ULL << (bit & 63)))) return false;
+    }
+    return true;
+}
+
+uint32_t ServoUnityNavigationPolicy::findChild(uint32_t node, const char *label, size_t length) const
+{
+    uint32_t lo = m_nodes[node].firstChild, hi = lo + m_nodes[node].childCount;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const ServoUnityNavigationPolicyNode& n = m_nodes[mid];
+        int c = memcmp(label, m_strings + n.labelOffset, length < n.labelLength ? length : n.labelLength);
+        if (c == 0) c = (length < n.labelLength ? -1 : (length > n.labelLength ? 1 : 0));
+        if (c == 0) return mid;
+        if (c < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return 0; // The root is never a child.
+}
+
+// Copies the host of url, lowercased and without any trailing dot, into host. Returns its length, or 0 if there is none.
+static size_t hostOf(const char *url, char *host)
+{
+    const char *p = url;
+    while (*p && *p != ':' && *p != '/') p++;
+    if (p == url || p[0] != ':' || p[1] != '/' || p[2] != '/') return 0; // No scheme, or no authority (about:, data:, etc.).
+    const char *start = p + 3;
+    const char *end = start + strcspn(start, "/?#");
+    for (const char *q = start; q < end; q++) {
+        if (*q == '@') start = q + 1; // Skip credentials.
+    }
+    if (start < end && *start == '[') {
+        const char *close = (const char *)memchr(start, ']', end - start);
+        if (!close) return 0;
+        start++;
+        end = close;
+    } else {
+        const char *colon = (const char *)memchr(start, ':', end - start);
+        if (colon) end = colon;
+    }
+    if (end > start && end[-1] == '.') end--;
+    size_t length = (size_t)(end - start);
+    if (length == 0 || length > kMaxHostLength) return 0;
+    for (size_t i = 0; i < length; i++) host[i] = (start[i] >= 'A' && start[i] <= 'Z') ? start[i] + ('a' - 'A') : start[i];
+    return length;
+}
+
+int ServoUnityNavigationPolicy::decide(const char *url, std::string *redirect) const
+{
+    if (!url) return ServoUnityNavigationPolicyAction_Allow;
+    m_counters[Counter_Checked].fetch_add(1, std::memory_order_relaxed);
+    char host[kMaxHostLength];
+    size_t length = hostOf(url, host);
+    if (!length) return ServoUnityNavigationPolicyAction_Allow;
+
+    // Any rule for the host must be for one of its suffixes, so check those against the bloom filter first.
+    uint64_t h = ServoUnityFiles::kHashSeed;
+    bool candidate = false;
+    size_t end = length;
+    while (!candidate) {
+        size_t start = end;
+        while (start > 0 && host[start - 1] != '.') start--;
+        servoUnityNavigationPolicyHashLabel(h, host + start, end - start);
+        candidate = bloomContains(h);
+        if (start == 0) break;
+        end = start - 1;
+    }
+    if (!candidate) return ServoUnityNavigationPolicyAction_Allow;
+
+    // Walk down the trie, remembering the deepest rule passed.
+    uint32_t node = 0, match = 0;
+    end = length;
+    for (;;) {
+        size_t start = end;
+        while (start > 0 && host[start - 1] != '.') start--;
+        node = findChild(node, host + start, end - start);
+        if (!node) break;
+        if (m_nodes[node].action != ServoUnityNavigationPolicyAction_None) match = node;
+        if (start == 0) break;
+        end = start - 1;
+    }
+    if (!match) return ServoUnityNavigationPolicyAction_Allow;
+
+    const ServoUnityNavigationPolicyNode& n = m_nodes[match];
+    m_hits[n.rule].fetch_add(1, std::memory_order_relaxed);
+    if (n.action == ServoUnityNavigationPolicyAction_Block) m_counters[Counter_Blocked].fetch_add(1, std::memory_order_relaxed);
+    else if (n.action == ServoUnityNavigationPolicyAction_Redirect) {
+        m_counters[Counter_Redirected].fetch_add(1, std::memory_order_relaxed);
+        if (redirect) redirect->assign(m_strings + n.redirectOffset, n.redirectLength);
+    }
+    return n.action;
+}
+
+uint64_t ServoUnityNavigationPolicy::ruleHits(int rule, std::string *domain) const
+{
+    if (rule < 0 || (uint32_t)rule >= m_header->ruleCount) return 0;
+    if (domain) {
+        domain->clear();
+        for (uint32_t node = m_ruleNodes[rule]; node; node = m_nodes[node].parent) {
+            if (!domain->empty()) *domain += '.';
+            domain->append(m_strings + m_nodes[node].labelOffset, m_nodes[node].labelLength);
+        }
+    }
+    return m_hits[rule].load(std::memory_order_relaxed);
+}
@@ -0,0 +1,135 @@
+//
+// ServoUnityNavigationPolicy.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Precompiled per-domain policy deciding whether Servo may navigate to a URL.
+//
+
+#pragma once
+
+#include "ServoUnityFiles.h"
+#include "ServoUnityResourceArchive.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+//
+// The policy is compiled from a rules file by the ServoUnityCompilePolicy tool, and read
+// in place from the resource archive. Each rule applies to a domain and all of its
+// subdomains; where rules for a domain and a parent domain both match a host, the rule
+// for the longer domain wins. Hosts matching no rule are allowed.
+//
+// Layout (all integers little-endian):
+//     ServoUnityNavigationPolicyHeader
+//     uint64_t bloom[bloomWords]
+//     ServoUnityNavigationPolicyNode[nodeCount]
+//     uint32_t ruleNodes[ruleCount], the node of each rule, in rules file order
+//     labels and redirect URLs, not nul-terminated
+//
+// The nodes form a trie of domain labels from the top-level domain down, rooted at node 0,
+// with each node's children contiguous and sorted by label (bytewise, then shorter first).
+// The bloom filter holds every rule's domain, hashed with servoUnityNavigationPolicyHashLabel,
+// so that most hosts are allowed without touching the trie.
+//
+
+#define SERVO_UNITY_NAVIGATION_POLICY_NAME "navigation_policy.sunp"
+#define SERVO_UNITY_NAVIGATION_POLICY_MAGIC "SUNP"
+#define SERVO_UNITY_NAVIGATION_POLICY_VERSION 1
+
+enum {
+    ServoUnityNavigationPolicyAction_None = 0, // Interior node; no rule for this domain.
+    ServoUnityNavigationPolicyAction_Allow = 1,
+    ServoUnityNavigationPolicyAction_Block = 2,
+    ServoUnityNavigationPolicyAction_Redirect = 3
+};
+
+struct ServoUnityNavigationPolicyHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t nodeCount;
+    uint32_t ruleCount;
+    uint32_t bloomWords; // A power of two.
+    uint32_t bloomHashes;
+    uint64_t size; // Of the whole policy, to detect truncation.
+};
+
+struct ServoUnityNavigationPolicyNode {
+    uint32_t labelOffset;
+    uint32_t labelLength;
+    uint32_t firstChild;
+    uint32_t childCount;
+    uint32_t parent;
+    uint32_t rule; // Index into ruleNodes, or kServoUnityNavigationPolicyNoRule.
+    uint32_t redirectOffset;
+    uint16_t redirectLength;
+    uint8_t action; // ServoUnityNavigationPolicyAction_*.
+    uint8_t reserved;
+};
+
+const uint32_t kServoUnityNavigationPolicyNoRule = 0xFFFFFFFF;
+
+/// Extends the hash of a domain suffix by the next label down. Start from ServoUnityFiles::kHashSeed and the top-level domain.
+inline void servoUnityNavigationPolicyHashLabel(uint64_t& h, const char *label, size_t length)
+{
+    ServoUnityFiles::hash(h, label, length);
+    ServoUnityFiles::hash(h, ".", 1);
+}
+
+/// The bloom filter bit for hash function i of bloomHashes, by double hashing.
+inline uint64_t servoUnityNavigationPolicyBloomBit(uint64_t h, uint32_t i, uint64_t bitMask)
+{
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1;
+    return (h1 + (uint64_t)i * h2) & bitMask;
+}
+
+class ServoUnityNavigationPolicy
+{
+public:
+    enum Counter {
+        Counter_Checked = 0,
+        Counter_Blocked,
+        Counter_Redirected,
+        Counter_Max
+    };
+
+    /// Reads the policy from archive. Returns nullptr if it has none, or it is invalid.
+    static std::unique_ptr<ServoUnityNavigationPolicy> load(std::shared_ptr<const ServoUnityResourceArchive> archive);
+    /// Validates a compiled policy, e.g. as written by the compiler tool. On success, data must outlive the returned policy.
+    static std::unique_ptr<ServoUnityNavigationPolicy> fromData(const uint8_t *data, size_t length);
+    ServoUnityNavigationPolicy(const ServoUnityNavigationPolicy&) = delete;
+    ServoUnityNavigationPolicy& operator=(const ServoUnityNavigationPolicy&) = delete;
+
+    /// Returns one of ServoUnityNavigationPolicyAction_Allow, _Block or _Redirect for url, and counts the decision.
+    /// For _Redirect, redirect receives the URL to load instead. URLs without a host are always allowed.
+    int decide(const char *url, std::string *redirect) const;
+
+    int ruleCount(void) const { return (int)m_header->ruleCount; }
+    /// Navigations decided by rule since the policy was loaded. If domain is non-NULL, it receives the rule's domain.
+    uint64_t ruleHits(int rule, std::string *domain) const;
+    uint64_t counter(Counter c) const { return m_counters[c].load(std::memory_order_relaxed); }
+
+private:
+    ServoUnityNavigationPolicy() {}
+    bool bloomContains(uint64_t h) const;
+    uint32_t findChild(uint32_t node, const char *label, size_t length) const;
+
+    std::shared_ptr<const ServoUnityResourceArchive> m_archive; // Keeps the data mapped.
+    const ServoUnityNavigationPolicyHeader *m_header = nullptr;
+    const uint64_t *m_bloom = nullptr;
+    const ServoUnityNavigationPolicyNode *m_nodes = nullptr;
+    const uint32_t *m_ruleNodes = nullptr;
+    const char *m_strings = nullptr;
+    size_t m_stringsLength = 0;
+    std::unique_ptr<std::atomic<uint64_t>[]> m_hits;
+    mutable std::atomic<uint64_t> m_counters[Counter_Max];
+};
@@ -0,0 +1,136 @@
+//
+// ServoUnityPerformanceProfile.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityPerformanceProfile.h"
+#include "servo_unity_c.h"
+#include "servo_unity_log.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    struct ProfilePref {
+        const char *key;
+        CPrefType type;
+        bool runtime; // false if Servo only reads this pref at startup.
+        bool b;
+        int64_t i;
+        double f;
+    };
+
+    struct Profile {
+        const char *name;
+        const ProfilePref *prefs;
+        int count;
+    };
+}
+
+#define BOOL_PREF(key, runtime, v) {key, CPrefType::Bool, runtime, v, 0, 0.0}
+#define INT_PREF(key, runtime, v) {key, CPrefType::Int, runtime, false, v, 0.0}
+
+// Layout threads apply to documents created after the change; GC slice time to
+// the next slice; media and network prefs to the next player or request.
+static const ProfilePref kLowLatencyPrefs[] = {
+    INT_PREF("layout.threads", true, 4),
+    INT_PREF("js.mem.gc.incremental.slice_ms", true, 5),
+    BOOL_PREF("js.offthreadcompilation.enabled", true, true),
+    BOOL_PREF("media.glvideo.enabled", true, true),
+};
+static const ProfilePref kBatterySaverPrefs[] = {
+    INT_PREF("layout.threads", true, 1),
+    INT_PREF("js.mem.gc.incremental.slice_ms", true, 20),
+    BOOL_PREF("js.offthreadcompilation.enabled", true, false),
+    BOOL_PREF("media.glvideo.enabled", true, true), // Avoids a CPU copy of every video frame.
+};
+static const ProfilePref kHighQualityPrefs[] = {
+    BOOL_PREF("gfx.subpixel-text-antialiasing.enabled", false, true),
+    INT_PREF("layout.threads", true, 4),
+    BOOL_PREF("media.glvideo.enabled", true, true),
+};
+static const ProfilePref kKioskPrefs[] = {
+    INT_PREF("layout.threads", true, 2),
+    INT_PREF("session-history.max-length", true, 5),
+    BOOL_PREF("network.http-cache.disabled", true, false),
+    BOOL_PREF("media.glvideo.enabled", true, true),
+};
+
+#define PROFILE(name, prefs) {name, prefs, (int)(sizeof(prefs) / sizeof(prefs[0]))}
+
+static const Profile kProfiles[ServoUnityPerformanceProfile_Max] = {
+    {"default", nullptr, 0},
+    PROFILE("low-latency", kLowLatencyPrefs),
+    PROFILE("battery-saver", kBatterySaverPrefs),
+    PROFILE("high-quality", kHighQualityPrefs),
+    PROFILE("kiosk", kKioskPrefs),
+};
+
+bool ServoUnityPerformanceProfile::isValid(int profile)
+{
+    return (profile >= 0 && profile < ServoUnityPerformanceProfile_Max);
+}
+
+const char *ServoUnityPerformanceProfile::name(int profile)
+{
+    return isValid(profile) ? kProfiles[profile].name : "invalid";
+}
+
+void ServoUnityPerformanceProfile::addInitPrefs(int profile, std::vector<CPref>& prefs)
+{
+    if (!isValid(profile)) return;
+    const Profile& p = kProfiles[profile];
+    for (int i = 0; i < p.count; i++) {
+        const ProfilePref& pp = p.prefs[i];
+        CPref cpref;
+        cpref.key = pp.key;
+        cpref.pref_type = pp.type;
+        cpref.value = (pp.type == CPrefType::Bool ? (const void *)&pp.b : pp.type == CPrefType::Int ? (const void *)&pp.i : (const void *)&pp.f);
+        cpref.is_default = false;
+        // Override any value already in the list rather than passing Servo the key twice.
+        auto it = std::find_if(prefs.begin(), prefs.end(), [&](const CPref& existing) { return strcmp(existing.key, pp.key) == 0; });
+        if (it != prefs.end()) *it = cpref;
+        else prefs.push_back(cpref);
+    }
+}
+
+void ServoUnityPerformanceProfile::apply(int profile)
+{
+    if (!isValid(profile)) return;
+    SERVOUNITYLOGi("Applying performance profile '%s'.\n", name(profile));
+
+    // Reset anything another profile may have set which this one doesn't.
+    const Profile& p = kProfiles[profile];
+    for (int j = 0; j < ServoUnityPerformanceProfile_Max; j++) {
+        if (j == profile) continue;
+        for (int k = 0; k < kProfiles[j].count; k++) {
+            const ProfilePref& other = kProfiles[j].prefs[k];
+            if (!other.runtime) continue;
+            bool inProfile = false;
+            for (int i = 0; i < p.count && !inProfile; i++) inProfile = (strcmp(p.prefs[i].key, other.key) == 0);
+            if (!inProfile) reset_pref(other.key);
+        }
+    }
+
+    for (int i = 0; i < p.count; i++) {
+        const ProfilePref& pp = p.prefs[i];
+        if (!pp.runtime) {
+            SERVOUNITYLOGd("Pref '%s' takes effect only when Servo next starts.\n", pp.key);
+            continue;
+        }
+        bool ok;
+        switch (pp.type) {
+            case CPrefType::Bool: ok = set_bool_pref(pp.key, pp.b); break;
+            case CPrefType::Int: ok = set_int_pref(pp.key, pp.i); break;
+            case CPrefType::Float: ok = set_float_pref(pp.key, pp.f); break;
+            default: ok = false; break;
+        }
+        if (!ok) SERVOUNITYLOGw("Servo rejected pref '%s' from performance profile '%s'.\n", pp.key, name(profile));
+    }
+}
@@ -0,0 +1,33 @@
+//
+// ServoUnityPerformanceProfile.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Named sets of Servo prefs (ServoUnityPerformanceProfile_*) for tuning the engine.
+//
+
+#pragma once
+
+#include "simpleservo2.h"
+#include <vector>
+
+class ServoUnityPerformanceProfile
+{
+public:
+    static bool isValid(int profile);
+    static const char *name(int profile);
+
+    /// Add the profile's prefs to prefs, for passing to Servo at startup, replacing any already there with the
+    /// same key. The values point to static storage.
+    static void addInitPrefs(int profile, std::vector<CPref>& prefs);
+
+    /// Switch the running engine to profile, via set_*_pref. Prefs set by other profiles are first reset
+    /// to Servo's defaults. Prefs which Servo only reads at startup are left unchanged. Must be called on Servo's thread.
+    static void apply(int profile);
+};
@@ -0,0 +1,75 @@
+//
+// ServoUnityResourceArchive.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityResourceArchive.h"
+#include "servo_unity_log.h"
+#include <cstring>
+
+std::unique_ptr<ServoUnityResourceArchive> ServoUnityResourceArchive::open(const std::string& path)
+{
+    if (!ServoUnityFiles::fileExists(path)) return nullptr;
+    std::unique_ptr<ServoUnityResourceArchive> archive(new ServoUnityResourceArchive());
+    archive->m_file = ServoUnityFiles::MappedFile::open(path);
+    if (!archive->m_file) {
+        SERVOUNITYLOGe("Unable to map resource archive '%s'.\n", path.c_str());
+        return nullptr;
+    }
+    archive->m_base = archive->m_file->data();
+    archive->m_size = archive->m_file->size();
+
+    // Validate everything up front, so that lookups needn't.
+    const ServoUnityResourceArchiveHeader *header = (const ServoUnityResourceArchiveHeader *)archive->m_base;
+    if (archive->m_size < sizeof(ServoUnityResourceArchiveHeader)
+        || memcmp(header->magic, SERVO_UNITY_RESOURCE_ARCHIVE_MAGIC, 4) != 0
+        || header->version != SERVO_UNITY_RESOURCE_ARCHIVE_VERSION
+        || header->size != archive->m_size
+        || header->count > (archive->m_size - sizeof(ServoUnityResourceArchiveHeader)) / sizeof(ServoUnityResourceArchiveEntry)) {
+        SERVOUNITYLOGe("Resource archive '%s' is invalid or from an incompatible version.\n", path.c_str());
+        return nullptr;
+    }
+    archive->m_header = header;
+    archive->m_entries = (const ServoUnityResourceArchiveEntry *)(header + 1);
+    for (uint32_t i = 0; i < header->count; i++) {
+        const ServoUnityResourceArchiveEntry& e = archive->m_entries[i];
+        if (e.nameOffset >= archive->m_size || !memchr(archive->m_base + e.nameOffset, '\0', archive->m_size - e.nameOffset)
+            || e.dataOffset > archive->m_size || e.dataLength > archive->m_size - e.dataOffset) {
+            SERVOUNITYLOGe("Resource archive '%s' is corrupt (entry %u).\n", path.c_str(), i);
+            return nullptr;
+        }
+    }
+
+    SERVOUNITYLOGi("Mapped resource archive '%s' (%u resources, %zu bytes).\n", path.c_str(), header->count, archive->m_size);
+    return archive;
+}
+
+ServoUnityResourceArchive::~ServoUnityResourceArchive()
+{
+}
+
+bool ServoUnityResourceArchive::find(const char *name, const uint8_t **data, size_t *length) const
+{
+    if (!name) return false;
+    uint32_t lo = 0, hi = m_header->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const ServoUnityResourceArchiveEntry& e = m_entries[mid];
+        int c = strcmp(name, (const char *)(m_base + e.nameOffset));
+        if (c == 0) {
+            if (data) *data = m_base + e.dataOffset;
+            if (length) *length = (size_t)e.dataLength;
+            return true;
+        }
+        if (c < 0) hi = mid;
+        else lo = mid + 1;
+    }
+    return false;
+}
@@ -0,0 +1,73 @@
+//
+// ServoUnityResourceArchive.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Read-only, memory-mapped archive of resource files.
+//
+
+#pragma once
+
+#include "ServoUnityFiles.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+//
+// The archive is a single file, built from a resources directory by the
+// ServoUnityPackResources tool, and mapped into memory whole when opened, so
+// that looking up and reading a resource costs no file system calls.
+//
+// Layout (all integers little-endian):
+//     ServoUnityResourceArchiveHeader
+//     ServoUnityResourceArchiveEntry[count], sorted by name (bytewise)
+//     names and data, each name nul-terminated and each data block 8-byte aligned.
+// Names are paths relative to the packed directory, with '/' as separator.
+//
+
+#define SERVO_UNITY_RESOURCE_ARCHIVE_NAME "resources.supak"
+#define SERVO_UNITY_RESOURCE_ARCHIVE_MAGIC "SUPK"
+#define SERVO_UNITY_RESOURCE_ARCHIVE_VERSION 1
+
+struct ServoUnityResourceArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t size; // Of the whole archive, to detect truncation.
+};
+
+struct ServoUnityResourceArchiveEntry {
+    uint64_t nameOffset;
+    uint64_t dataOffset;
+    uint64_t dataLength;
+};
+
+class ServoUnityResourceArchive
+{
+public:
+    /// Map the archive at path. Returns nullptr if it doesn't exist or is invalid.
+    static std::unique_ptr<ServoUnityResourceArchive> open(const std::string& path);
+    ~ServoUnityResourceArchive();
+    ServoUnityResourceArchive(const ServoUnityResourceArchive&) = delete;
+    ServoUnityResourceArchive& operator=(const ServoUnityResourceArchive&) = delete;
+
+    /// Look up a resource by name. On success, data points into the mapping and remains valid for the life of the archive.
+    bool find(const char *name, const uint8_t **data, size_t *length) const;
+    int count(void) const { return (int)m_header->count; }
+
+private:
+    ServoUnityResourceArchive() {}
+    std::unique_ptr<ServoUnityFiles::MappedFile> m_file;
+    const uint8_t *m_base = nullptr;
+    size_t m_size = 0;
+    const ServoUnityResourceArchiveHeader *m_header = nullptr;
+    const ServoUnityResourceArchiveEntry *m_entries = nullptr;
+};
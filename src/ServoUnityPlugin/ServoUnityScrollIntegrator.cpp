@@ -0,0 +1,126 @@
+//
+// ServoUnityScrollIntegrator.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityScrollIntegrator.h"
+#include "simpleservo2.h"
+#include <algorithm>
+#include <cmath>
+
+static const float kVelocityMin = 20.0f; // Pixels per second. Slower than this, momentum stops.
+static const float kVelocityMax = 10000.0f; // Pixels per second. Release velocities are clamped to this.
+
+ServoUnityScrollIntegrator::ServoUnityScrollIntegrator() :
+    m_state(State::Idle),
+    m_x(0),
+    m_y(0),
+    m_vx(0.0f),
+    m_vy(0.0f),
+    m_remainderX(0.0f),
+    m_remainderY(0.0f),
+    m_friction(0.135f)
+{
+}
+
+ServoUnityScrollIntegrator::Output ServoUnityScrollIntegrator::begin(int x, int y)
+{
+    State previous = m_state;
+    m_state = State::Gesture;
+    m_vx = m_vy = 0.0f;
+    if (previous == State::Momentum) return output(None, 0, 0); // Caught; the scroll continues.
+    m_x = x;
+    m_y = y;
+    m_remainderX = m_remainderY = 0.0f;
+    if (previous == State::Gesture) return output(None, 0, 0); // Unbalanced begin.
+    return output(Start, 0, 0);
+}
+
+ServoUnityScrollIntegrator::Output ServoUnityScrollIntegrator::update(int dx, int dy, int x, int y)
+{
+    if (m_state == State::Idle) {
+        // Missed begin. Start the gesture here and deliver this movement as a Move now, rather than
+        // dropping it. Servo handles a scroll with no scroll_start before it like any other.
+        m_remainderX = m_remainderY = 0.0f;
+    }
+    m_state = State::Gesture;
+    m_x = x;
+    m_y = y;
+    if (dx == 0 && dy == 0) return output(None, 0, 0);
+    return output(Move, dx, dy);
+}
+
+ServoUnityScrollIntegrator::Output ServoUnityScrollIntegrator::end(float vx, float vy, float friction)
+{
+    if (m_state != State::Gesture) return output(None, 0, 0);
+    float speed = std::sqrt(vx * vx + vy * vy);
+    if (friction <= 0.0f || friction >= 1.0f || speed < kVelocityMin) {
+        m_state = State::Idle;
+        return output(End, 0, 0);
+    }
+    if (speed > kVelocityMax) {
+        vx *= kVelocityMax / speed;
+        vy *= kVelocityMax / speed;
+    }
+    m_vx = vx;
+    m_vy = vy;
+    m_friction = friction;
+    m_state = State::Momentum;
+    return output(None, 0, 0);
+}
+
+ServoUnityScrollIntegrator::Output ServoUnityScrollIntegrator::cancel(void)
+{
+    if (m_state == State::Idle) return output(None, 0, 0);
+    m_state = State::Idle;
+    return output(End, 0, 0);
+}
+
+ServoUnityScrollIntegrator::Output ServoUnityScrollIntegrator::step(float timeDelta)
+{
+    if (m_state != State::Momentum || timeDelta <= 0.0f) return output(None, 0, 0);
+
+    // Exponential decay; integrating over the frame keeps the total distance independent of frame rate.
+    float decay = std::pow(m_friction, timeDelta);
+    float k = (decay - 1.0f) / std::log(m_friction); // = integral of friction^t over [0, timeDelta].
+    m_remainderX += m_vx * k;
+    m_remainderY += m_vy * k;
+    m_vx *= decay;
+    m_vy *= decay;
+
+    int dx = (int)m_remainderX;
+    int dy = (int)m_remainderY;
+    m_remainderX -= dx;
+    m_remainderY -= dy;
+
+    if (std::sqrt(m_vx * m_vx + m_vy * m_vy) < kVelocityMin) {
+        m_state = State::Idle;
+        return output(End, dx, dy);
+    }
+    if (dx == 0 && dy == 0) return output(None, 0, 0);
+    return output(Move, dx, dy);
+}
+
+bool ServoUnityScrollIntegrator::send(const Output& out)
+{
+    switch (out.phase) {
+        case Start:
+            scroll_start(out.dx, out.dy, out.x, out.y);
+            return true;
+        case Move:
+            scroll(out.dx, out.dy, out.x, out.y);
+            return true;
+        case End:
+            scroll_end(out.dx, out.dy, out.x, out.y);
+            return true;
+        default:
+            return false;
+    }
+}
@@ -0,0 +1,69 @@
+//
+// ServoUnityScrollIntegrator.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Turns scroll gestures into bracketed scroll_start/scroll/scroll_end calls,
+// continuing each gesture with decelerating momentum after it is released.
+//
+
+#pragma once
+
+class ServoUnityScrollIntegrator
+{
+public:
+    enum Phase {
+        None = 0, // Nothing to send.
+        Start, // Send scroll_start.
+        Move, // Send scroll.
+        End // Send scroll_end.
+    };
+    struct Output {
+        Phase phase;
+        int dx;
+        int dy;
+        int x;
+        int y;
+    };
+
+    ServoUnityScrollIntegrator();
+
+    /// Begin a gesture at window position x, y. If momentum from a previous gesture is still running,
+    /// it is caught, and the new gesture continues the same scroll, so Phase is None.
+    Output begin(int x, int y);
+    /// Move by dx, dy pixels during a gesture. Without a preceding begin(), a gesture is started here.
+    Output update(int dx, int dy, int x, int y);
+    /// Release the gesture with velocity vx, vy in pixels per second. If fast enough, momentum begins
+    /// and the scroll is ended later by step(), so Phase is None.
+    /// @param friction Fraction of momentum velocity remaining after one second.
+    Output end(float vx, float vy, float friction);
+    /// End any gesture or momentum now.
+    Output cancel(void);
+
+    /// Advance momentum by timeDelta seconds. Call once per frame.
+    Output step(float timeDelta);
+
+    bool active(void) const { return m_state != State::Idle; }
+
+    /// Make the Servo call described by out. Must be called from the render thread.
+    /// Returns true if a call was made.
+    static bool send(const Output& out);
+
+private:
+    enum class State { Idle, Gesture, Momentum };
+    Output output(Phase phase, int dx, int dy) const { return { phase, dx, dy, m_x, m_y }; }
+    State m_state;
+    int m_x;
+    int m_y;
+    float m_vx; // Pixels per second.
+    float m_vy;
+    float m_remainderX; // Sub-pixel movement not yet sent.
+    float m_remainderY;
+    float m_friction;
+};
@@ -0,0 +1,451 @@
+//
+// ServoUnitySnapshotCache.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnitySnapshotCache.h"
+#include "ServoUnityFiles.h"
+#include "servo_unity_log.h"
+#include "utils.h"
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace ServoUnityFiles;
+
+static const char kFileMagic[4] = {'S', 'U', 'S', 'N'};
+static const uint32_t kFileVersion = 1;
+static const char *kFileSuffix = ".snap";
+static const size_t kMaxQueuedWrites = 8; // Beyond this, the oldest are dropped; the disk tier is only a cache.
+static const size_t kMaxMissing = 1024;
+
+namespace {
+    struct Snapshot {
+        std::string url;
+        int width;
+        int height;
+        std::vector<uint16_t> data; // RLE-encoded RGB565.
+    };
+    struct DiskJob {
+        enum class Type { Write, Read, Remove } type;
+        std::string dir;
+        std::string url;
+        std::shared_ptr<const Snapshot> snapshot; // For Write.
+    };
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t urlLength;
+        uint32_t dataWords;
+    };
+}
+
+static std::mutex s_lock;
+static std::list<Snapshot> s_snapshots; // Most recently used first.
+static std::unordered_map<std::string, std::list<Snapshot>::iterator> s_index;
+static size_t s_memoryBytes = 0;
+static std::string s_diskPath;
+
+// Disk tier. Jobs are run in order by s_worker; all but the file I/O is under s_lock.
+static std::deque<DiskJob> s_jobs;
+static size_t s_queuedWrites = 0;
+static std::unordered_set<std::string> s_reading; // URLs with a Read queued or running.
+static std::unordered_set<std::string> s_missing; // URLs known not to be on disk.
+static std::condition_variable s_wake;
+static std::thread s_worker; // Started by the first job, and runs until stop().
+static bool s_stopRequested = false;
+
+static size_t bytesOf(const Snapshot& s)
+{
+    return sizeof(Snapshot) + s.url.size() + s.data.size() * sizeof(uint16_t);
+}
+
+//
+// RLE on 16-bit words. A control word with the top bit set is followed by one word, repeated
+// (control & 0x7FFF) times. Otherwise, it is followed by (control) literal words.
+//
+static void encode(const uint8_t *rgba, size_t pixelCount, std::vector<uint16_t>& out)
+{
+    std::vector<uint16_t> px(pixelCount);
+    for (size_t i = 0; i < pixelCount; i++) {
+        const uint8_t *p = rgba + i * 4;
+        px[i] = (uint16_t)(((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3));
+    }
+    out.clear();
+    size_t i = 0;
+    while (i < pixelCount) {
+        size_t run = 1;
+        while (i + run < pixelCount && px[i + run] == px[i] && run < 0x7FFF) run++;
+        if (run >= 3) {
+            out.push_back((uint16_t)(0x8000 | run));
+            out.push_back(px[i]);
+            i += run;
+            continue;
+        }
+        // Literals, up to the next run of 3 or more.
+        size_t start = i;
+        while (i < pixelCount && i - start < 0x7FFF) {
+            if (i + 2 < pixelCount && px[i] == px[i + 1] && px[i] == px[i + 2]) break;
+            i++;
+        }
+        out.push_back((uint16_t)(i - start));
+        out.insert(out.end(), px.begin() + start, px.begin() + i);
+    }
+}
+
+static bool decode(const std::vector<uint16_t>& in, size_t pixelCount, std::vector<uint8_t>& rgba)
+{
+    rgba.resize(pixelCount * 4);
+    size_t o = 0;
+    size_t i = 0;
+    auto put = [&](uint16_t v) {
+        uint8_t *p = &rgba[o * 4];
+        uint8_t r = (v >> 11) & 0x1F, g = (v >> 5) & 0x3F, b = v & 0x1F;
+        p[0] = (uint8_t)((r << 3) | (r >> 2));
+        p[1] = (uint8_t)((g << 2) | (g >> 4));
+        p[2] = (uint8_t)((b << 3) | (b >> 2));
+        p[3] = 0xFF;
+        o++;
+    };
+    while (i < in.size() && o < pixelCount) {
+        uint16_t control = in[i++];
+        size_t n = control & 0x7FFF;
+        if (control & 0x8000) {
+            if (i >= in.size() || o + n > pixelCount) return false;
+            uint16_t v = in[i++];
+            for (size_t k = 0; k < n; k++) put(v);
+        } else {
+            if (i + n > in.size() || o + n > pixelCount) return false;
+            for (size_t k = 0; k < n; k++) put(in[i++]);
+        }
+    }
+    return (o == pixelCount);
+}
+
+static std::string fileNameForURL(const std::string& url)
+{
+    uint64_t h = kHashSeed;
+    hash(h, url);
+    char name[17];
+    snprintf(name, sizeof(name), "%016" PRIx64, h);
+    return std::string(name) + kFileSuffix;
+}
+
+// Must be called with s_lock held.
+static void insert(Snapshot&& s)
+{
+    auto it = s_index.find(s.url);
+    if (it != s_index.end()) {
+        s_memoryBytes -= bytesOf(*it->second);
+        s_snapshots.erase(it->second);
+        s_index.erase(it);
+    }
+    size_t bytes = bytesOf(s);
+    if (bytes > ServoUnitySnapshotCache::kMemoryBudget) return;
+    while (!s_snapshots.empty() && s_memoryBytes + bytes > ServoUnitySnapshotCache::kMemoryBudget) {
+        s_memoryBytes -= bytesOf(s_snapshots.back());
+        s_index.erase(s_snapshots.back().url);
+        s_snapshots.pop_back();
+    }
+    s_snapshots.push_front(std::move(s));
+    s_index[s_snapshots.front().url] = s_snapshots.begin();
+    s_memoryBytes += bytes;
+}
+
+// Called on the worker, without s_lock held.
+static void writeFile(const std::string& dir, const Snapshot& s)
+{
+    std::string path = dir + kDirSeparator + fileNameForURL(s.url);
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        SERVOUNITYLOGw("Unable to write snapshot '%s'.\n", path.c_str());
+        return;
+    }
+    FileHeader header;
+    memcpy(header.magic, kFileMagic, sizeof(kFileMagic));
+    header.version = kFileVersion;
+    header.width = (uint32_t)s.width;
+    header.height = (uint32_t)s.height;
+    header.urlLength = (uint32_t)s.url.size();
+    header.dataWords = (uint32_t)s.data.size();
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(s.url.data(), 1, s.url.size(), fp) == s.url.size()
+        && fwrite(s.data.data(), sizeof(uint16_t), s.data.size(), fp) == s.data.size();
+    fclose(fp);
+    if (!ok) {
+        remove(path.c_str());
+        return;
+    }
+
+    // Keep the directory within budget, deleting the oldest snapshots first.
+    std::vector<FileInfo> files;
+    if (!listDirectory(dir, files)) return;
+    uint64_t total = 0;
+    for (const FileInfo& f : files) total += f.size;
+    if (total <= ServoUnitySnapshotCache::kDiskBudget) return;
+    std::sort(files.begin(), files.end(), [](const FileInfo& a, const FileInfo& b) { return a.mtime < b.mtime; });
+    for (const FileInfo& f : files) {
+        if (total <= ServoUnitySnapshotCache::kDiskBudget) break;
+        if (f.name.size() < strlen(kFileSuffix) || f.name.compare(f.name.size() - strlen(kFileSuffix), std::string::npos, kFileSuffix) != 0) continue;
+        if (remove((dir + kDirSeparator + f.name).c_str()) == 0) total -= f.size;
+    }
+}
+
+// Called on the worker, without s_lock held.
+static bool readFile(const std::string& dir, const std::string& url, Snapshot& s)
+{
+    std::string path = dir + kDirSeparator + fileNameForURL(url);
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (!fp) return false;
+    FileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1
+        && memcmp(header.magic, kFileMagic, sizeof(kFileMagic)) == 0
+        && header.version == kFileVersion
+        && header.width > 0 && header.width <= ServoUnitySnapshotCache::kMaxDimension
+        && header.height > 0 && header.height <= ServoUnitySnapshotCache::kMaxDimension
+        && header.urlLength == url.size()
+        && header.dataWords <= 2 * header.width * header.height;
+    if (ok) {
+        std::string fileURL(header.urlLength, '\0');
+        ok = fread(&fileURL[0], 1, fileURL.size(), fp) == fileURL.size() && fileURL == url; // Guard against hash collisions.
+    }
+    if (ok) {
+        s.url = url;
+        s.width = (int)header.width;
+        s.height = (int)header.height;
+        s.data.resize(header.dataWords);
+        ok = fread(s.data.data(), sizeof(uint16_t), s.data.size(), fp) == s.data.size();
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void workerLoop(void)
+{
+    std::unique_lock<std::mutex> lock(s_lock);
+    while (true) {
+        s_wake.wait(lock, [] { return !s_jobs.empty() || s_stopRequested; });
+        if (s_jobs.empty()) break; // Only once stop is requested, so that queued writes aren't lost.
+        DiskJob job = std::move(s_jobs.front());
+        s_jobs.pop_front();
+        if (job.type == DiskJob::Type::Write) s_queuedWrites--;
+        lock.unlock();
+
+        Snapshot s;
+        bool found = false;
+        switch (job.type) {
+            case DiskJob::Type::Write:
+                writeFile(job.dir, *job.snapshot);
+                break;
+            case DiskJob::Type::Read:
+                found = readFile(job.dir, job.url, s);
+                break;
+            case DiskJob::Type::Remove:
+                remove((job.dir + kDirSeparator + fileNameForURL(job.url)).c_str());
+                break;
+        }
+
+        lock.lock();
+        if (job.type == DiskJob::Type::Write) {
+            s_missing.erase(job.url); // In case a Read queued before it found nothing.
+        } else if (job.type == DiskJob::Type::Read) {
+            s_reading.erase(job.url);
+            if (job.dir == s_diskPath) {
+                if (!found) {
+                    if (s_missing.size() >= kMaxMissing) s_missing.clear();
+                    s_missing.insert(job.url);
+                } else if (s_index.find(job.url) == s_index.end()) {
+                    insert(std::move(s));
+                }
+            }
+        }
+    }
+}
+
+// Must be called with s_lock held, and s_diskPath set.
+static void queueJob(DiskJob::Type type, const std::string& url, std::shared_ptr<const Snapshot> snapshot)
+{
+    if (type == DiskJob::Type::Write) {
+        if (s_queuedWrites >= kMaxQueuedWrites) {
+            std::deque<DiskJob>::iterator it = std::find_if(s_jobs.begin(), s_jobs.end(), [](const DiskJob& j) { return j.type == DiskJob::Type::Write; });
+            if (it != s_jobs.end()) {
+                s_jobs.erase(it);
+                s_queuedWrites--;
+            }
+        }
+        s_queuedWrites++;
+    }
+    s_jobs.push_back({type, s_diskPath, url, std::move(snapshot)});
+    if (!s_worker.joinable()) s_worker = std::thread(workerLoop);
+    s_wake.notify_one();
+}
+
+void ServoUnitySnapshotCache::setDiskPath(const char *dir)
+{
+    std::string path;
+    if (dir && dir[0]) {
+        path = std::string(dir) + kDirSeparator + "snapshots";
+        if (!makeDirectory(path)) {
+            SERVOUNITYLOGw("Unable to create snapshot cache directory '%s'. Snapshots will be kept in memory only.\n", path.c_str());
+            path.clear();
+        }
+    }
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (path != s_diskPath) s_missing.clear();
+    s_diskPath = path;
+}
+
+void ServoUnitySnapshotCache::store(const std::string& url, const uint8_t *rgba, int width, int height)
+{
+    if (url.empty() || !rgba || width <= 0 || height <= 0) return;
+
+    Snapshot s;
+    s.url = url;
+    fitSize(width, height, kMaxDimension, &s.width, &s.height);
+    if (s.width != width || s.height != height) {
+        std::vector<uint8_t> scaled((size_t)s.width * s.height * 4);
+        downsample(rgba, width, height, (size_t)width * 4, scaled.data(), s.width, s.height);
+        encode(scaled.data(), (size_t)s.width * s.height, s.data);
+    } else {
+        encode(rgba, (size_t)width * height, s.data);
+    }
+    SERVOUNITYLOGd("Snapshot of %s: %dx%d, %zu bytes.\n", url.c_str(), s.width, s.height, s.data.size() * sizeof(uint16_t));
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (!s_diskPath.empty()) {
+        s_missing.erase(url);
+        queueJob(DiskJob::Type::Write, url, std::make_shared<const Snapshot>(s));
+    }
+    insert(std::move(s));
+}
+
+ServoUnitySnapshotCache::FetchResult ServoUnitySnapshotCache::fetch(const std::string& url, std::vector<uint8_t>& rgba, int *width, int *height)
+{
+    if (url.empty() || !width || !height) return FetchResult::Missing;
+    std::lock_guard<std::mutex> lock(s_lock);
+    auto it = s_index.find(url);
+    if (it == s_index.end()) {
+        if (s_diskPath.empty() || s_missing.count(url)) return FetchResult::Missing;
+        if (s_reading.insert(url).second) queueJob(DiskJob::Type::Read, url, nullptr);
+        return FetchResult::Pending;
+    }
+    s_snapshots.splice(s_snapshots.begin(), s_snapshots, it->second); // Now most recently used.
+    const Snapshot& s = *it->second;
+    if (!decode(s.data, (size_t)s.width * s.height, rgba)) {
+        SERVOUNITYLOGw("Discarding corrupt snapshot of %s.\n", url.c_str());
+        s_memoryBytes -= bytesOf(s);
+        s_snapshots.erase(it->second);
+        s_index.erase(it);
+        if (!s_diskPath.empty()) {
+            s_missing.insert(url);
+            queueJob(DiskJob::Type::Remove, url, nullptr);
+        }
+        return FetchResult::Missing;
+    }
+    *width = s.width;
+    *height = s.height;
+    return FetchResult::Found;
+}
+
+void ServoUnitySnapshotCache::clear(void)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    s_snapshots.clear();
+    s_index.clear();
+    s_memoryBytes = 0;
+}
+
+void ServoUnitySnapshotCache::stop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (!s_worker.joinable()) return;
+        s_stopRequested = true;
+    }
+    s_wake.notify_all();
+    s_worker.join();
+
+    std::lock_guard<std::mutex> lock(s_lock);
+    s_stopRequested = false;
+    // Any queued after the worker finished are dropped, so that the next job starts a new one.
+    s_jobs.clear();
+    s_queuedWrites = 0;
+    s_reading.clear();
+}
+
+void ServoUnitySnapshotCache::fitSize(int width, int height, int maxDimension, int *fitWidth, int *fitHeight)
+{
+    int longest = std::max(width, height);
+    if (longest <= maxDimension) {
+        *fitWidth = width;
+        *fitHeight = height;
+    } else {
+        *fitWidth = std::max(1, (int)((int64_t)width * maxDimension / longest));
+        *fitHeight = std::max(1, (int)((int64_t)height * maxDimension / longest));
+    }
+}
+
+void ServoUnitySnapshotCache::downsample(const uint8_t *src, int srcWidth, int srcHeight, size_t srcRowBytes, uint8_t *dst, int dstWidth, int dstHeight)
+{
+    for (int y = 0; y < dstHeight; y++) {
+        int y0 = (int)((int64_t)y * srcHeight / dstHeight);
+        int y1 = std::max(y0 + 1, (int)((int64_t)(y + 1) * srcHeight / dstHeight));
+        for (int x = 0; x < dstWidth; x++) {
+            int x0 = (int)((int64_t)x * srcWidth / dstWidth);
+            int x1 = std::max(x0 + 1, (int)((int64_t)(x + 1) * srcWidth / dstWidth));
+            uint32_t sum[4] = {0, 0, 0, 0};
+            for (int sy = y0; sy < y1; sy++) {
+                const uint8_t *p = src + sy * srcRowBytes + x0 * 4;
+                for (int sx = x0; sx < x1; sx++, p += 4) {
+                    sum[0] += p[0]; sum[1] += p[1]; sum[2] += p[2]; sum[3] += p[3];
+                }
+            }
+            uint32_t n = (uint32_t)((y1 - y0) * (x1 - x0));
+            uint8_t *d = dst + ((size_t)y * dstWidth + x) * 4;
+            for (int c = 0; c < 4; c++) d[c] = (uint8_t)(sum[c] / n);
+        }
+    }
+}
+
+void ServoUnitySnapshotCache::upsample(const uint8_t *src, int srcWidth, int srcHeight, uint8_t *dst, int dstWidth, int dstHeight, size_t dstRowBytes)
+{
+    for (int y = 0; y < dstHeight; y++) {
+        float fy = std::max(0.0f, ((float)y + 0.5f) * srcHeight / dstHeight - 0.5f);
+        int y0 = std::min((int)fy, srcHeight - 1);
+        int y1 = std::min(y0 + 1, srcHeight - 1);
+        float wy = fy - y0;
+        uint8_t *d = dst + y * dstRowBytes;
+        for (int x = 0; x < dstWidth; x++, d += 4) {
+            float fx = std::max(0.0f, ((float)x + 0.5f) * srcWidth / dstWidth - 0.5f);
+            int x0 = std::min((int)fx, srcWidth - 1);
+            int x1 = std::min(x0 + 1, srcWidth - 1);
+            float wx = fx - x0;
+            const uint8_t *p00 = src + ((size_t)y0 * srcWidth + x0) * 4;
+            const uint8_t *p01 = src + ((size_t)y0 * srcWidth + x1) * 4;
+            const uint8_t *p10 = src + ((size_t)y1 * srcWidth + x0) * 4;
+            const uint8_t *p11 = src + ((size_t)y1 * srcWidth + x1) * 4;
+            for (int c = 0; c < 4; c++) {
+                float top = p00[c] + (p01[c] - p00[c]) * wx;
+                float bottom = p10[c] + (p11[c] - p10[c]) * wx;
+                d[c] = (uint8_t)(top + (bottom - top) * wy + 0.5f);
+            }
+        }
+    }
+}
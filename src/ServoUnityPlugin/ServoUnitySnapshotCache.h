@@ -0,0 +1,63 @@
+//
+// ServoUnitySnapshotCache.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Bounded cache of downscaled page snapshots, keyed by URL, shown in a window
+// while Servo renders the page.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Snapshots are stored as RGB565 with run-length encoding, which suits the large flat
+// areas of most pages. The memory tier holds the most recently used snapshots up to
+// kMemoryBudget bytes. If a directory has been set with setDiskPath(), every snapshot
+// is also written there, and snapshots not in memory are read back from it; the
+// least recently written files are deleted once the directory exceeds kDiskBudget bytes.
+// The disk tier is only touched by a worker thread, so that callers on the render thread
+// never wait on file I/O.
+//
+// Pixels passed in and out are RGBA, 4 bytes per pixel, top row first, tightly packed.
+// All functions are thread-safe.
+//
+class ServoUnitySnapshotCache
+{
+public:
+    static const int kMaxDimension = 512; // Longest side of a stored snapshot, in pixels.
+    static const size_t kMemoryBudget = 16 * 1024 * 1024;
+    static const size_t kDiskBudget = 64 * 1024 * 1024;
+
+    /// Directory for the disk tier, created if it doesn't exist. Empty or NULL disables the disk tier.
+    static void setDiskPath(const char *dir);
+
+    enum class FetchResult { Found, Pending, Missing };
+
+    /// Store a snapshot for url, replacing any previous one. Larger than kMaxDimension pixels are downscaled.
+    /// It is written to the disk tier in the background.
+    static void store(const std::string& url, const uint8_t *rgba, int width, int height);
+    /// Fetch the snapshot for url from memory. If it isn't there but may be on disk, starts reading it
+    /// into memory and returns Pending, in which case fetch again later.
+    static FetchResult fetch(const std::string& url, std::vector<uint8_t>& rgba, int *width, int *height);
+    /// Empty the memory tier. The disk tier is left in place.
+    static void clear(void);
+    /// Wait for queued disk writes to finish, and stop the worker. It is restarted when next needed.
+    static void stop(void);
+
+    /// Size which fits width x height within maxDimension on the longest side, preserving aspect ratio.
+    static void fitSize(int width, int height, int maxDimension, int *fitWidth, int *fitHeight);
+    /// Area-average src into dst, which must be no larger than src in either dimension.
+    static void downsample(const uint8_t *src, int srcWidth, int srcHeight, size_t srcRowBytes, uint8_t *dst, int dstWidth, int dstHeight);
+    /// Bilinear-filter src into dst, which may be any size.
+    static void upsample(const uint8_t *src, int srcWidth, int srcHeight, uint8_t *dst, int dstWidth, int dstHeight, size_t dstRowBytes);
+};
@@ -0,0 +1,141 @@
+//
+// ServoUnityStartupTimeline.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityStartupTimeline.h"
+#include "ServoUnityGStreamerRegistry.h"
+#include "servo_unity_c.h"
+#include "servo_unity_log.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+typedef std::chrono::steady_clock Clock;
+
+static const char *kPhaseNames[ServoUnityStartupPhase_Max] = {
+    "servoUnityInit",
+    "GStreamer environment setup",
+    "Window creation callback",
+    "Prefs marshalling",
+    "Engine init",
+    "First perform_updates",
+    "First on_load_started",
+    "First frame",
+    "First on_load_ended",
+};
+
+namespace {
+    struct Phase {
+        std::atomic<bool> begun;
+        std::atomic<bool> ended;
+        double startMs;
+        double durationMs;
+    };
+}
+
+static Clock::time_point s_t0 = Clock::now();
+static Phase s_phases[ServoUnityStartupPhase_Max];
+static std::mutex s_lock; // Guards the non-atomic fields of s_phases, and s_t0.
+
+static double msSinceT0(Clock::time_point t)
+{
+    return std::chrono::duration<double, std::milli>(t - s_t0).count();
+}
+
+void ServoUnityStartupTimeline::reset(void)
+{
+    std::lock_guard<std::mutex> lock(s_lock);
+    s_t0 = Clock::now();
+    for (int i = 0; i < ServoUnityStartupPhase_Max; i++) {
+        s_phases[i].begun.store(false);
+        s_phases[i].ended.store(false);
+        s_phases[i].startMs = s_phases[i].durationMs = -1.0;
+    }
+}
+
+void ServoUnityStartupTimeline::begin(int phase)
+{
+    if (phase < 0 || phase >= ServoUnityStartupPhase_Max || s_phases[phase].begun.load()) return;
+    Clock::time_point now = Clock::now();
+    std::lock_guard<std::mutex> lock(s_lock);
+    if (s_phases[phase].begun.load()) return;
+    s_phases[phase].startMs = msSinceT0(now);
+    s_phases[phase].begun.store(true);
+}
+
+void ServoUnityStartupTimeline::end(int phase)
+{
+    if (phase < 0 || phase >= ServoUnityStartupPhase_Max || s_phases[phase].ended.load()) return;
+    Clock::time_point now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (!s_phases[phase].begun.load() || s_phases[phase].ended.load()) return;
+        s_phases[phase].durationMs = msSinceT0(now) - s_phases[phase].startMs;
+        s_phases[phase].ended.store(true);
+    }
+    SERVOUNITYLOGi("Startup: %s took %.1f ms.\n", kPhaseNames[phase], s_phases[phase].durationMs);
+
+    // Engine init includes GStreamer's initialisation, and so any plugin scan.
+    if (phase == ServoUnityStartupPhase_EngineInit) ServoUnityGStreamerRegistry::engineInitEnded(s_phases[phase].durationMs);
+}
+
+void ServoUnityStartupTimeline::mark(int phase)
+{
+    if (phase < 0 || phase >= ServoUnityStartupPhase_Max || s_phases[phase].ended.load()) return;
+    begin(phase);
+    {
+        std::lock_guard<std::mutex> lock(s_lock);
+        if (s_phases[phase].ended.load()) return;
+        s_phases[phase].durationMs = 0.0;
+        s_phases[phase].ended.store(true);
+    }
+    SERVOUNITYLOGi("Startup: %s at %.1f ms.\n", kPhaseNames[phase], s_phases[phase].startMs);
+
+    // Loading the first page completes startup.
+    if (phase == ServoUnityStartupPhase_FirstLoadEnded) log();
+}
+
+int ServoUnityStartupTimeline::get(double *startMs, double *durationMs, int count)
+{
+    if (count > ServoUnityStartupPhase_Max) count = ServoUnityStartupPhase_Max;
+    std::lock_guard<std::mutex> lock(s_lock);
+    for (int i = 0; i < count; i++) {
+        bool ended = s_phases[i].ended.load();
+        if (startMs) *startMs++ = ended ? s_phases[i].startMs : -1.0;
+        if (durationMs) *durationMs++ = ended ? s_phases[i].durationMs : -1.0;
+    }
+    return count < 0 ? 0 : count;
+}
+
+void ServoUnityStartupTimeline::log(void)
+{
+    double startMs[ServoUnityStartupPhase_Max];
+    double durationMs[ServoUnityStartupPhase_Max];
+    int count = get(startMs, durationMs, ServoUnityStartupPhase_Max);
+
+    SERVOUNITYLOGi("Startup timeline (ms from servoUnityInit):\n");
+    for (int i = 0; i < count; i++) {
+        if (startMs[i] < 0.0) SERVOUNITYLOGi("    %-28s not reached\n", kPhaseNames[i]);
+        else if (durationMs[i] > 0.0) SERVOUNITYLOGi("    %-28s %9.1f  (%.1f ms)\n", kPhaseNames[i], startMs[i], durationMs[i]);
+        else SERVOUNITYLOGi("    %-28s %9.1f\n", kPhaseNames[i], startMs[i]);
+    }
+    switch (ServoUnityGStreamerRegistry::state()) {
+        case ServoUnityGStreamerRegistryCache_Hit:
+            if (ServoUnityGStreamerRegistry::savedMs() >= 0.0) SERVOUNITYLOGi("    GStreamer registry cache hit; saved %.1f ms.\n", ServoUnityGStreamerRegistry::savedMs());
+            else SERVOUNITYLOGi("    GStreamer registry cache hit.\n");
+            break;
+        case ServoUnityGStreamerRegistryCache_Miss:
+            SERVOUNITYLOGi("    GStreamer registry cache miss; %d plugin files scanned.\n", ServoUnityGStreamerRegistry::pluginFileCount());
+            break;
+        default:
+            break;
+    }
+}
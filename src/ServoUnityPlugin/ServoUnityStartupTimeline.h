@@ -0,0 +1,51 @@
+//
+// ServoUnityStartupTimeline.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Records when each phase of startup (ServoUnityStartupPhase_*) first happens.
+//
+
+#pragma once
+
+//
+// Times are measured with a monotonic high-resolution clock, relative to the
+// start of servoUnityInit. Only the first occurrence of each phase is recorded,
+// so calls may be left in paths which run repeatedly; after the first time,
+// they cost one atomic load.
+//
+class ServoUnityStartupTimeline
+{
+public:
+    /// Clear all phases and restart the clock.
+    static void reset(void);
+
+    static void begin(int phase);
+    static void end(int phase);
+    /// Record an instantaneous phase.
+    static void mark(int phase);
+
+    /// Fill startMs and durationMs (each of length count) with each phase's start time and
+    /// duration in milliseconds, or -1 for phases not yet reached. Returns the number of phases filled.
+    static int get(double *startMs, double *durationMs, int count);
+
+    /// Write the timeline to the log.
+    static void log(void);
+};
+
+class ServoUnityStartupPhaseScope
+{
+public:
+    explicit ServoUnityStartupPhaseScope(int phase) : m_phase(phase) { ServoUnityStartupTimeline::begin(phase); }
+    ~ServoUnityStartupPhaseScope() { ServoUnityStartupTimeline::end(m_phase); }
+    ServoUnityStartupPhaseScope(const ServoUnityStartupPhaseScope&) = delete;
+    ServoUnityStartupPhaseScope& operator=(const ServoUnityStartupPhaseScope&) = delete;
+private:
+    int m_phase;
+};
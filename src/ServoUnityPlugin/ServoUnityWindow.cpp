@@ -12,18 +12,52 @@
 //
 
 #include "ServoUnityWindow.h"
+#include "ServoUnityEpoch.h"
+#include "ServoUnityStartupTimeline.h"
+#include "ServoUnityResourceArchive.h"
+#include "ServoUnityNavigationPolicy.h"
+#include "ServoUnityPerformanceProfile.h"
+#include "ServoUnityKeyMap.h"
+#include "ServoUnitySnapshotCache.h"
+#include "ServoUnityHistory.h"
 #include <stdlib.h>
+#include <climits>
 #include "servo_unity_internal.h"
 #include "servo_unity_log.h"
 #include "utils.h"
 #include <vector>
+#include <utility>
+#include <algorithm>
 
 
 // Unfortunately the simpleservo interface doesn't allow arbitrary userdata
-// to be passed along with callbacks, so we have to keep a global static
-// instance pointer so that we can correctly call back to the correct window
-// instance.
-ServoUnityWindow *ServoUnityWindow::s_servo = nullptr;
+// to be passed along with callbacks, so each Servo instance is assigned a slot
+// in this table, and is given callbacks specialised on that slot which look up
+// the window instance to call back to.
+std::atomic<ServoUnityWindow *> ServoUnityWindow::s_instances[ServoUnityWindow::kInstancesMax];
+
+// How many Servo instances can run at once. libsimpleservo2 keeps its engine in
+// process-global state, so for now this is one, and servoUnityRequestNewWindow
+// refuses further windows until the first is closed. A Servo build offering separate
+// instances (or multiple webviews per instance) needs only to raise this.
+static const int kInstancesSupported = 1;
+
+// Longest a page snapshot is shown in place of a loading page, in seconds, before Servo's own frames are shown.
+static const float kSnapshotHoldMax = 1.5f;
+
+// Fraction of its size a hidden window renders at under ServoUnityMemoryPressure_High.
+static const float kShrunkScale = 0.25f;
+
+// Longest side, in pixels, of a hidden window whose textures have been evicted to keep within s_param_TextureBudgetMB.
+static const int kEvictedDimension = 16;
+
+namespace {
+    struct InstanceCallbacks {
+        void (*wakeup)(void);
+        CHostCallbacks (*hostCallbacks)(void);
+    };
+}
+static const InstanceCallbacks& instanceCallbacks(int slot); // Defined with the callback implementations below.
 
 ServoUnityWindow::ServoUnityWindow(int uid, int uidExt) :
     m_uid(uid),
@@ -31,13 +65,83 @@ ServoUnityWindow::ServoUnityWindow(int uid, int uidExt) :
     m_windowCreatedCallback(nullptr),
     m_windowResizedCallback(nullptr),
     m_browserEventCallback(nullptr),
+    m_instance(-1),
+    m_removed(false),
+    m_instanceUnavailableLogged(false),
     m_updateContinuously(false),
     m_updateOnce(false),
-    m_title(std::string()),
-    m_URL(std::string()),
     m_userAgent(std::string()),
-    m_waitingForShutdown(false)
+    m_servoShuttingDown(false),
+    m_waitingForShutdown(false),
+    m_dynamicResolution(),
+    m_resizedPending(false),
+    m_resizeSettlingWidth(0),
+    m_resizeSettlingHeight(0),
+    m_resizeSettlingTime(0.0f),
+    m_scrollIntegrator(),
+    m_frameTimeDelta(0.0f),
+    m_gestureRecognizer(&m_scrollIntegrator),
+    m_visible(true),
+    m_shrunk(false),
+    m_suspended(false),
+    m_resizeImmediately(false),
+    m_evicted(false),
+    m_lastVisibleFrame(0),
+    m_snapshotURL(),
+    m_snapshotLoading(false),
+    m_snapshotFrameShown(false),
+    m_snapshotCapturePending(false),
+    m_snapshotPresentPending(false),
+    m_snapshotHeld(false),
+    m_snapshotHeldTime(0.0f),
+    m_snapshotReadbackURL(),
+    m_metadata(new Metadata{std::string(), std::string(), false, false, false, 1})
+{
+}
+
+ServoUnityWindow::~ServoUnityWindow()
 {
+    // Ensure late callbacks from Servo can't reach a deleted window.
+    unbindInstance();
+    // The window itself is only deleted once no reader can see it, so neither can they see its metadata.
+    delete m_metadata.load();
+}
+
+bool ServoUnityWindow::bindInstance(void)
+{
+    static_assert(kInstancesSupported <= kInstancesMax, "kInstancesSupported exceeds the instance table size.");
+    for (int i = 0; i < kInstancesSupported; i++) {
+        ServoUnityWindow *expected = nullptr;
+        if (s_instances[i].compare_exchange_strong(expected, this)) {
+            m_instance = i;
+            // Checked after binding, so that either this sees the removal, or markRemoved() sees the instance.
+            if (m_removed) {
+                unbindInstance();
+                return false;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void ServoUnityWindow::unbindInstance(void)
+{
+    int instance = m_instance.exchange(-1);
+    if (instance < 0) return;
+    ServoUnityWindow *expected = this;
+    s_instances[instance].compare_exchange_strong(expected, nullptr);
+}
+
+bool ServoUnityWindow::markRemoved(void)
+{
+    m_removed = true;
+    return m_instance >= 0;
+}
+
+int ServoUnityWindow::instancesSupported(void)
+{
+    return kInstancesSupported;
 }
 
 bool ServoUnityWindow::init(PFN_WINDOWCREATEDCALLBACK windowCreatedCallback, PFN_WINDOWRESIZEDCALLBACK windowResizedCallback, PFN_BROWSEREVENTCALLBACK browserEventCallback, const std::string& userAgent)
@@ -47,9 +151,98 @@ bool ServoUnityWindow::init(PFN_WINDOWCREATEDCALLBACK windowCreatedCallback, PFN
     m_browserEventCallback = browserEventCallback;
     m_userAgent = userAgent;
 
+    {
+        std::lock_guard<std::mutex> lock(m_sizeLock);
+        int w, h;
+        m_dynamicResolution.getNominalSize(&w, &h);
+        if (w <= 0 || h <= 0) { // Not already set by adopt().
+            Size s = size();
+            m_dynamicResolution.setNominalSize(s.w, s.h);
+        }
+    }
+
 	return true;
 }
 
+void ServoUnityWindow::adopt(int uidExt, Size size)
+{
+    m_uidExt = uidExt;
+    requestSize(size);
+}
+
+void ServoUnityWindow::detach(void)
+{
+    m_uidExt = 0;
+    m_windowCreatedCallback = nullptr;
+    m_windowResizedCallback = nullptr;
+    m_browserEventCallback = nullptr;
+    setNativePtr(nullptr);
+}
+
+void ServoUnityWindow::requestSize(Size size)
+{
+    std::lock_guard<std::mutex> lock(m_sizeLock);
+    m_dynamicResolution.setNominalSize(size.w, size.h);
+}
+
+void ServoUnityWindow::setProjectedSize(Size size)
+{
+    std::lock_guard<std::mutex> lock(m_sizeLock);
+    m_dynamicResolution.setProjectedSize(size.w, size.h);
+}
+
+void ServoUnityWindow::updateSize(float timeDelta)
+{
+    Size sizeNew;
+    {
+        std::lock_guard<std::mutex> lock(m_sizeLock);
+        if (s_param_DynamicResolution) {
+            m_dynamicResolution.update(timeDelta, s_param_FrameTimeBudget / 1000.0f, s_param_DynamicResolutionMinScale, &sizeNew.w, &sizeNew.h);
+        } else {
+            m_dynamicResolution.reset();
+            m_dynamicResolution.getNominalSize(&sizeNew.w, &sizeNew.h);
+        }
+    }
+    if (sizeNew.w <= 0 || sizeNew.h <= 0) return;
+    if (m_evicted) {
+        int longest = std::max(sizeNew.w, sizeNew.h);
+        sizeNew.w = std::max(1, sizeNew.w * kEvictedDimension / longest);
+        sizeNew.h = std::max(1, sizeNew.h * kEvictedDimension / longest);
+    } else if (m_shrunk) {
+        sizeNew.w = std::max(1, (int)(sizeNew.w * kShrunkScale));
+        sizeNew.h = std::max(1, (int)(sizeNew.h * kShrunkScale));
+    }
+
+    Size sizeOld = size();
+    if (sizeNew.w == sizeOld.w && sizeNew.h == sizeOld.h) {
+        m_resizeSettlingWidth = m_resizeSettlingHeight = 0;
+        return;
+    }
+
+    // Once Servo is running, resizing is expensive, so wait until the size has settled,
+    // e.g. at the end of a drag. Meanwhile, Unity continues to show the previous texture.
+    if (m_instance >= 0 && s_param_ResizeSettleTime > 0.0f && !m_resizeImmediately) {
+        if (sizeNew.w != m_resizeSettlingWidth || sizeNew.h != m_resizeSettlingHeight) {
+            m_resizeSettlingWidth = sizeNew.w;
+            m_resizeSettlingHeight = sizeNew.h;
+            m_resizeSettlingTime = 0.0f;
+            return;
+        }
+        m_resizeSettlingTime += timeDelta * 1000.0f;
+        if (m_resizeSettlingTime < s_param_ResizeSettleTime) return;
+    }
+    m_resizeSettlingWidth = m_resizeSettlingHeight = 0;
+    m_resizeImmediately = false;
+
+    SERVOUNITYLOGi("Resizing window %d from %dx%d to %dx%d.\n", m_uid, sizeOld.w, sizeOld.h, sizeNew.w, sizeNew.h);
+    setSize(sizeNew);
+    if (m_instance >= 0) resize(sizeNew.w, sizeNew.h);
+
+    // Unity will be told about the new size from serviceWindowEvents().
+    std::lock_guard<std::mutex> lock(m_sizeLock);
+    m_resizedPending = true;
+}
+
 static std::unique_ptr<char*>cstr2ptr(const char* cstr) {
     size_t l = strlen(cstr) + 1;
     char *c = new char[l];
@@ -57,12 +250,90 @@ static std::unique_ptr<char*>cstr2ptr(const char* cstr) {
     return std::make_unique<char *>(c);
 }
 
-void ServoUnityWindow::requestUpdate(float timeDelta) {
-    SERVOUNITYLOGd("ServoUnityWindow::requestUpdate(%f)\n", timeDelta);
+// Parses pref overrides, one "key = value" per line, with '#' starting a comment line.
+// Values true/false are bools, values parseable as a whole as integer or floating point
+// numbers are ints or floats, and anything else (optionally double-quoted) is a string.
+// Each replaces any pref already in cprefs with the same key.
+static void addPrefOverrides(const char *text, size_t length, std::vector<CPref>& cprefs,
+                             std::vector<std::unique_ptr<char*>>& memChar, std::vector<std::unique_ptr<bool>>& memBool,
+                             std::vector<std::unique_ptr<int64_t>>& memInt, std::vector<std::unique_ptr<double>>& memDouble)
+{
+    const char *whitespace = " \t\r";
+    std::string all(text, length);
+    size_t start = 0;
+    while (start < all.size()) {
+        size_t end = all.find('\n', start);
+        if (end == std::string::npos) end = all.size();
+        std::string line = all.substr(start, end - start);
+        start = end + 1;
+
+        size_t first = line.find_first_not_of(whitespace);
+        if (first == std::string::npos || line[first] == '#') continue;
+        size_t eq = line.find('=', first);
+        if (eq == std::string::npos) {
+            SERVOUNITYLOGw("Ignoring malformed pref override '%s'.\n", line.c_str());
+            continue;
+        }
+        std::string key = line.substr(first, line.find_last_not_of(whitespace, eq - 1) + 1 - first);
+        size_t valStart = line.find_first_not_of(whitespace, eq + 1);
+        std::string value = (valStart == std::string::npos ? std::string() : line.substr(valStart, line.find_last_not_of(whitespace) + 1 - valStart));
+
+        CPref cpref;
+        auto keyPtr = cstr2ptr(key.c_str());
+        cpref.key = *keyPtr;
+        memChar.push_back(std::move(keyPtr));
+        char *parseEnd;
+        if (value == "true" || value == "false") {
+            cpref.pref_type = CPrefType::Bool;
+            auto val = std::make_unique<bool>(value == "true");
+            cpref.value = val.get();
+            memBool.push_back(std::move(val));
+        } else if (!value.empty() && (strtoll(value.c_str(), &parseEnd, 10), *parseEnd == '\0')) {
+            cpref.pref_type = CPrefType::Int;
+            auto val = std::make_unique<int64_t>((int64_t)strtoll(value.c_str(), nullptr, 10));
+            cpref.value = val.get();
+            memInt.push_back(std::move(val));
+        } else if (!value.empty() && (strtod(value.c_str(), &parseEnd), *parseEnd == '\0')) {
+            cpref.pref_type = CPrefType::Float;
+            auto val = std::make_unique<double>(strtod(value.c_str(), nullptr));
+            cpref.value = val.get();
+            memDouble.push_back(std::move(val));
+        } else {
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') value = value.substr(1, value.size() - 2);
+            cpref.pref_type = CPrefType::Str;
+            auto val = cstr2ptr(value.c_str());
+            cpref.value = *val;
+            memChar.push_back(std::move(val));
+        }
+        cpref.is_default = false;
+        auto it = std::find_if(cprefs.begin(), cprefs.end(), [&](const CPref& existing) { return strcmp(existing.key, cpref.key) == 0; });
+        if (it != cprefs.end()) *it = cpref;
+        else cprefs.push_back(cpref);
+    }
+}
+
+bool ServoUnityWindow::prepareUpdate(float timeDelta) {
+    SERVOUNITYLOGd("ServoUnityWindow::prepareUpdate(%f)\n", timeDelta);
+
+    updateSize(timeDelta);
+    m_frameTimeDelta = timeDelta;
 
-    if (!s_servo) {
-        SERVOUNITYLOGi("initing servo.\n");
+    if (m_instance < 0) {
+        if (m_removed) return false;
+        // Bind before starting Servo, so that callbacks made during startup reach this window.
+        if (!bindInstance()) {
+            if (!m_instanceUnavailableLogged) {
+                SERVOUNITYLOGw("Window %d can't start Servo; all %d Servo instance(s) are in use.\n", m_uid, kInstancesSupported);
+                m_instanceUnavailableLogged = true;
+            }
+            return false;
+        }
+        m_instanceUnavailableLogged = false;
+        m_gestureRecognizer.reset(); // Touches sent to a previous instance are gone with it.
+        SERVOUNITYLOGi("initing servo instance %d for window %d.\n", m_instance.load(), m_uid);
         
+        ServoUnityStartupTimeline::begin(ServoUnityStartupPhase_Prefs);
+
         // Note about logs:
         // By default: all modules are enabled.
         // To only print logs from specific modules, add their names to pfilters.
@@ -120,6 +391,14 @@ void ServoUnityWindow::requestUpdate(float timeDelta) {
             memBool.push_back(std::move(val));
             cprefs.push_back(cpref);
         }
+        ServoUnityPerformanceProfile::addInitPrefs(s_param_PerformanceProfile, cprefs);
+        // Overrides from the resource archive, which take precedence over the above.
+        std::shared_ptr<const ServoUnityResourceArchive> archive = servoUnityGetResourceArchive();
+        const uint8_t *prefsData;
+        size_t prefsLength;
+        if (archive && archive->find("prefs_overrides.txt", &prefsData, &prefsLength)) {
+            addPrefOverrides((const char *)prefsData, prefsLength, cprefs, memChar, memBool, memInt, memDouble);
+        }
         CPrefList prefsList = {cprefs.size(), cprefs.data()};
 
         CInitOptions cio {
@@ -133,40 +412,25 @@ void ServoUnityWindow::requestUpdate(float timeDelta) {
             /*.prefs =*/ &prefsList,
             /*.user_agent =*/ m_userAgent.c_str()
         };
-        CHostCallbacks chc {
-            /*.on_load_started =*/ on_load_started,
-            /*.on_load_ended =*/ on_load_ended,
-            /*.on_title_changed =*/ on_title_changed,
-            /*.on_allow_navigation =*/ on_allow_navigation,
-            /*.on_url_changed =*/ on_url_changed,
-            /*.on_history_changed =*/ on_history_changed,
-            /*.on_animating_changed =*/ on_animating_changed,
-            /*.on_shutdown_complete =*/ on_shutdown_complete,
-            /*.on_ime_show =*/ on_ime_show,
-            /*.on_ime_hide =*/ on_ime_hide,
-            /*.get_clipboard_contents =*/ get_clipboard_contents,
-            /*.set_clipboard_contents =*/ set_clipboard_contents,
-            /*.on_media_session_metadata =*/ on_media_session_metadata,
-            /*.on_media_session_playback_state_change =*/ on_media_session_playback_state_change,
-            /*.on_media_session_set_position_state =*/ on_media_session_set_position_state,
-            /*.prompt_alert =*/ prompt_alert,
-            /*.prompt_ok_cancel =*/ prompt_ok_cancel,
-            /*.prompt_yes_no =*/ prompt_yes_no,
-            /*.prompt_input =*/ prompt_input,
-            /*.on_devtools_started =*/ on_devtools_started,
-            /*.show_context_menu =*/ show_context_menu,
-            /*.on_log_output =*/ on_log_output
-        };
-        
-        if (!this->initRenderer(cio, wakeup, chc)) {
-            SERVOUNITYLOGe("ServoUnityWindow::requestUpdate(): Failed to init renderer.\n");
-            return;
+        const InstanceCallbacks& callbacks = instanceCallbacks(m_instance);
+        ServoUnityStartupTimeline::end(ServoUnityStartupPhase_Prefs);
+        bool ok;
+        {
+            ServoUnityStartupPhaseScope phase(ServoUnityStartupPhase_EngineInit);
+            ok = this->initRenderer(cio, callbacks.wakeup, callbacks.hostCallbacks());
+        }
+        if (!ok) {
+            SERVOUNITYLOGe("ServoUnityWindow::prepareUpdate(): Failed to init renderer.\n");
+            unbindInstance();
+            return false;
         }
-
-        s_servo = this;
     }
 
-    // Updates first.
+    return true;
+}
+
+void ServoUnityWindow::performUpdates(void) {
+    if (m_instance < 0) return;
     bool update;
     {
         std::lock_guard<std::mutex> lock(m_updateLock);
@@ -177,9 +441,79 @@ void ServoUnityWindow::requestUpdate(float timeDelta) {
             update = false;
         }
     }
-    if (update) perform_updates();
+    if (update) {
+        ServoUnityStartupPhaseScope phase(ServoUnityStartupPhase_FirstPerformUpdates);
+        perform_updates();
+    }
+}
 
-    // Service task queue.
+void ServoUnityWindow::snapshotTextureCleared(void) {
+    // A new texture, e.g. for a new window, or one taken over from a previous scene. Fill it from the
+    // snapshot of the page Servo has, or is about to load, rather than leaving it black until Servo draws.
+    if (m_snapshotURL.empty()) m_snapshotURL = s_param_Homepage;
+    m_snapshotFrameShown = false;
+    m_snapshotPresentPending = true;
+}
+
+bool ServoUnityWindow::snapshotBeginFrame(void) {
+    if (!s_param_Snapshots) {
+        m_snapshotPresentPending = m_snapshotHeld = false;
+        if (!m_snapshotReadbackURL.empty()) {
+            cancelReadTexture();
+            m_snapshotReadbackURL.clear();
+        }
+        return true;
+    }
+    snapshotCollect(false);
+    // A snapshot still being read from disk is of no use once Servo has drawn the page.
+    if (m_snapshotPresentPending && m_snapshotFrameShown) m_snapshotPresentPending = false;
+    if (m_snapshotPresentPending) {
+        std::vector<uint8_t> rgba;
+        int w, h;
+        ServoUnitySnapshotCache::FetchResult result = ServoUnitySnapshotCache::fetch(m_snapshotURL, rgba, &w, &h);
+        if (result != ServoUnitySnapshotCache::FetchResult::Pending) m_snapshotPresentPending = false;
+        if (result == ServoUnitySnapshotCache::FetchResult::Found && drawTexture(rgba.data(), w, h)) {
+            SERVOUNITYLOGd("Showing snapshot of %s.\n", m_snapshotURL.c_str());
+            m_snapshotHeld = true;
+            m_snapshotHeldTime = 0.0f;
+        }
+    }
+    if (m_snapshotHeld && m_snapshotLoading) {
+        // Don't hide a slow load's progress for too long.
+        m_snapshotHeldTime += m_frameTimeDelta;
+        if (m_snapshotHeldTime > kSnapshotHoldMax) m_snapshotHeld = false;
+    }
+    return !m_snapshotHeld;
+}
+
+void ServoUnityWindow::snapshotEndFrame(bool newFrame) {
+    if (newFrame) m_snapshotFrameShown = true;
+    if (m_snapshotCapturePending && m_snapshotFrameShown) {
+        snapshotCapture();
+        m_snapshotCapturePending = false;
+    }
+}
+
+void ServoUnityWindow::snapshotCapture(void) {
+    if (!s_param_Snapshots || m_snapshotHeld || !m_snapshotFrameShown || m_snapshotURL.empty()) return;
+    // Only one read can be in progress. Rarely, e.g. when navigating just as a page finishes loading, the
+    // previous one is still going, and must be waited for.
+    snapshotCollect(true);
+    if (beginReadTexture(ServoUnitySnapshotCache::kMaxDimension)) m_snapshotReadbackURL = m_snapshotURL;
+}
+
+void ServoUnityWindow::snapshotCollect(bool wait) {
+    if (m_snapshotReadbackURL.empty()) return;
+    std::vector<uint8_t> rgba;
+    int w, h;
+    ReadbackStatus status = finishReadTexture(wait, rgba, &w, &h);
+    if (status == ReadbackStatus::Pending) return;
+    if (status == ReadbackStatus::Ready) ServoUnitySnapshotCache::store(m_snapshotReadbackURL, rgba.data(), w, h);
+    m_snapshotReadbackURL.clear();
+}
+
+int ServoUnityWindow::runServoTasks(void) {
+    int count = 0;
     while (true) {
         std::function<void()> task;
         {
@@ -192,19 +526,119 @@ void ServoUnityWindow::requestUpdate(float timeDelta) {
             }
         }
         task();
+        count++;
     }
+    return count;
+}
+
+int ServoUnityWindow::serviceServo(void) {
+    if (m_suspended) return 0; // Tasks wait until the window is restored.
+    bool pending;
+    {
+        std::lock_guard<std::mutex> lock(m_servoTasksLock);
+        pending = !m_servoTasks.empty();
+    }
+    // Only enter batch mode when this frame has input to deliver. Tasks queued after this check
+    // simply run unbatched.
+    bool batch = s_param_BatchInput && m_instance >= 0 && (pending || m_scrollIntegrator.active());
+    if (!batch) performUpdates();
+    else set_batch_mode(true);
+
+    int count = runServoTasks();
+    bool scrolled = (m_instance >= 0 && ServoUnityScrollIntegrator::send(m_scrollIntegrator.step(m_frameTimeDelta)));
+
+    if (!batch) return count;
+    if (m_instance >= 0) set_batch_mode(false); // A task may have shut Servo down.
+    if (count > 0 || scrolled) {
+        // Batched events are only processed by perform_updates().
+        std::lock_guard<std::mutex> lock(m_updateLock);
+        m_updateOnce = true;
+    }
+    performUpdates();
+    return count;
+}
+
+void ServoUnityWindow::clearEngineCache(void) {
+    if (m_instance < 0) return;
+    runOnServoThread([] {clear_cache();});
+}
+
+int ServoUnityWindow::applyMemoryPressure(int level) {
+    if (m_visible) {
+        if (m_suspended) {
+            SERVOUNITYLOGi("Resuming window %d.\n", m_uid);
+            m_suspended = false;
+            if (m_instance >= 0) change_visibility(true);
+        }
+        if (m_shrunk) {
+            SERVOUNITYLOGi("Restoring size of window %d.\n", m_uid);
+            m_shrunk = false;
+            m_resizeImmediately = true;
+        }
+        return ServoUnityMemoryPressureAction_None;
+    }
+
+    // Once shrunk or suspended, a hidden window stays so until it is shown, even if pressure falls.
+    if (level >= ServoUnityMemoryPressure_High && !m_shrunk) {
+        SERVOUNITYLOGi("Shrinking hidden window %d under memory pressure.\n", m_uid);
+        m_shrunk = true;
+        m_resizeImmediately = true;
+        updateSize(0.0f); // Hidden windows may not be updated, e.g. when detached.
+        queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_MemoryPressure, level, ServoUnityMemoryPressureAction_ShrinkHiddenWindow, NULL);
+        return ServoUnityMemoryPressureAction_ShrinkHiddenWindow;
+    }
+    if (level >= ServoUnityMemoryPressure_Critical && !m_suspended && m_instance >= 0) {
+        SERVOUNITYLOGi("Suspending hidden window %d under memory pressure.\n", m_uid);
+        m_suspended = true;
+        change_visibility(false);
+        queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_MemoryPressure, level, ServoUnityMemoryPressureAction_SuspendHiddenWindow, NULL);
+        return ServoUnityMemoryPressureAction_SuspendHiddenWindow;
+    }
+    return ServoUnityMemoryPressureAction_None;
+}
+
+void ServoUnityWindow::noteVisibility(uint64_t frame) {
+    if (!m_visible) return;
+    m_lastVisibleFrame = frame;
+    if (m_evicted) {
+        // The full-size textures are recreated by the resize, and Unity's when it is told of it.
+        SERVOUNITYLOGi("Restoring textures of window %d.\n", m_uid);
+        m_evicted = false;
+        m_resizeImmediately = true;
+        queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_TexturesEvicted, 0, 0, NULL);
+    }
+}
+
+void ServoUnityWindow::evictTextures(void) {
+    if (m_evicted) return;
+    SERVOUNITYLOGi("Evicting textures of hidden window %d.\n", m_uid);
+    m_evicted = true;
+    m_resizeImmediately = true;
+    updateSize(0.0f); // Hidden windows may not be updated, e.g. when detached.
+    releaseCaches();
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_TexturesEvicted, 1, 0, NULL);
+}
+
+uint64_t ServoUnityWindow::textureBytes(void) {
+    Size s = size();
+    uint64_t frameBytes = servoUnityGetBufferSizeForTextureFormat(s.w, s.h, format());
+    return (nativePtr() ? frameBytes : 0) + (m_instance >= 0 ? frameBytes : 0);
 }
 
 void ServoUnityWindow::cleanupRenderer(void) {
-    if (!s_servo) {
+    if (m_instance < 0) {
         SERVOUNITYLOGw("Cleanup renderer called with no renderer active.\n");
         return;
     }
     SERVOUNITYLOGd("Cleaning up renderer...\n");
 
-    // First, clear waiting tasks and ensure no new tasks are queued while shutting down.
-    std::lock_guard<std::mutex> tasksLock(m_servoTasksLock);
-    m_servoTasks.clear();
+    // First, clear waiting tasks and ensure no new tasks are queued while shutting down. The lock isn't
+    // held while waiting, because Servo's callbacks (e.g. a policy redirect) may themselves queue tasks.
+    {
+        std::lock_guard<std::mutex> tasksLock(m_servoTasksLock);
+        m_servoTasks.clear();
+        m_servoShuttingDown = true;
+    }
 
     // Next, we'll request shutdown and wait on callback on_shutdown_complete before
     // finishing with deinit().
@@ -220,7 +654,13 @@ void ServoUnityWindow::cleanupRenderer(void) {
     }
 
     deinit();
-    s_servo = nullptr;
+    unbindInstance();
+    cancelReadTexture();
+    m_snapshotReadbackURL.clear();
+    {
+        std::lock_guard<std::mutex> tasksLock(m_servoTasksLock);
+        m_servoShuttingDown = false;
+    }
 
     queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_Shutdown, 0, 0, NULL);
     SERVOUNITYLOGd("Cleaning up renderer... DONE.\n");
@@ -228,6 +668,7 @@ void ServoUnityWindow::cleanupRenderer(void) {
 
 void ServoUnityWindow::runOnServoThread(std::function<void()> task) {
     std::lock_guard<std::mutex> lock(m_servoTasksLock);
+    if (m_servoShuttingDown) return;
     m_servoTasks.push_back(task);
 }
 
@@ -239,6 +680,33 @@ void ServoUnityWindow::queueBrowserEventCallbackTask(int uidExt, int eventType,
 }
 
 void ServoUnityWindow::serviceWindowEvents() {
+    bool resized;
+    {
+        std::lock_guard<std::mutex> lock(m_sizeLock);
+        resized = m_resizedPending;
+        m_resizedPending = false;
+    }
+    if (resized && m_windowResizedCallback) {
+        Size s = size();
+        (*m_windowResizedCallback)(m_uidExt, s.w, s.h);
+    }
+
+    if (!m_browserEventCallback) {
+        // Detached, or not yet adopted. Events are held until there's a callback, except for Shutdown,
+        // which is delivered as a plugin event so that teardown of a detached window can be waited on.
+        std::lock_guard<std::mutex> lock(m_browserEventCallbackTasksLock);
+        for (std::deque<BROWSEREVENTCALLBACKTASK>::iterator it = m_browserEventCallbackTasks.begin(); it != m_browserEventCallbackTasks.end(); ) {
+            if (it->eventType != ServoUnityBrowserEvent_Shutdown) {
+                ++it;
+                continue;
+            }
+            servoUnityQueuePluginEvent(ServoUnityBrowserEvent_Shutdown, 0, 0);
+            free(it->eventDataS);
+            it = m_browserEventCallbackTasks.erase(it);
+        }
+        return;
+    }
+
     // Service task queue.
     while (true) {
         BROWSEREVENTCALLBACKTASK task;
@@ -251,19 +719,21 @@ void ServoUnityWindow::serviceWindowEvents() {
                 m_browserEventCallbackTasks.pop_front();
             }
         }
-        if (m_browserEventCallback) (*m_browserEventCallback)(task.uidExt, task.eventType, task.eventData1, task.eventData2, task.eventDataS);
+        // Use the current uidExt, since events queued while a prewarmed window was hidden belong to the window that adopted it.
+        if (m_browserEventCallback) (*m_browserEventCallback)(m_uidExt, task.eventType, task.eventData1, task.eventData2, task.eventDataS);
         free(task.eventDataS);
     }
 }
 
-std::string ServoUnityWindow::windowTitle(void)
-{
-    return m_title;
-}
-
-std::string ServoUnityWindow::windowURL(void)
+void ServoUnityWindow::publishMetadata(std::function<void(Metadata&)> change)
 {
-    return m_URL;
+    std::lock_guard<std::mutex> lock(m_metadataLock);
+    const Metadata *old = m_metadata.load();
+    Metadata *next = new Metadata(*old);
+    change(*next);
+    next->version = (old->version == INT_MAX ? 1 : old->version + 1);
+    m_metadata.store(next, std::memory_order_release);
+    ServoUnityEpoch::retire([old] { delete old; });
 }
 
 void ServoUnityWindow::pointerEnter() {
@@ -276,7 +746,7 @@ void ServoUnityWindow::pointerExit() {
 
 void ServoUnityWindow::pointerOver(int x, int y) {
 	SERVOUNITYLOGd("ServoUnityWindow::pointerOver(%d, %d)\n", x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
 
     runOnServoThread([=] {mouse_move((float)x, (float)y);});
 }
@@ -301,176 +771,188 @@ static CMouseButton getServoButton(int button) {
 
 void ServoUnityWindow::pointerPress(int button, int x, int y) {
 	SERVOUNITYLOGd("ServoUnityWindow::pointerPress(%d, %d, %d)\n", button, x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     runOnServoThread([=] {mouse_down((float)x, (float)y, getServoButton(button));});
 }
 
 void ServoUnityWindow::pointerRelease(int button, int x, int y) {
 	SERVOUNITYLOGd("ServoUnityWindow::pointerRelease(%d, %d, %d)\n", button, x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     runOnServoThread([=] {mouse_up((float)x, (float)y, getServoButton(button));});
 }
 
 void ServoUnityWindow::pointerClick(int button, int x, int y) {
     SERVOUNITYLOGd("ServoUnityWindow::pointerClick(%d, %d, %d)\n", button, x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     if (button != 0) return; // Servo assumes that "clicks" arise only from the primary button.
     runOnServoThread([=] {click((float)x, (float)y);});
 }
 
 void ServoUnityWindow::pointerScrollDiscrete(int x_scroll, int y_scroll, int x, int y) {
 	SERVOUNITYLOGd("ServoUnityWindow::pointerScrollDiscrete(%d, %d, %d, %d)\n", x_scroll, y_scroll, x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     runOnServoThread([=] {scroll(x_scroll, y_scroll, x, y);});
 }
 
+void ServoUnityWindow::scrollGestureBegin(int x, int y) {
+    SERVOUNITYLOGd("ServoUnityWindow::scrollGestureBegin(%d, %d)\n", x, y);
+    if (m_instance < 0) return;
+    runOnServoThread([=] {ServoUnityScrollIntegrator::send(m_scrollIntegrator.begin(x, y));});
+}
+
+void ServoUnityWindow::scrollGestureUpdate(int dx, int dy, int x, int y) {
+    SERVOUNITYLOGd("ServoUnityWindow::scrollGestureUpdate(%d, %d, %d, %d)\n", dx, dy, x, y);
+    if (m_instance < 0) return;
+    runOnServoThread([=] {ServoUnityScrollIntegrator::send(m_scrollIntegrator.update(dx, dy, x, y));});
+}
+
+void ServoUnityWindow::scrollGestureEnd(int vx, int vy, int x, int y) {
+    SERVOUNITYLOGd("ServoUnityWindow::scrollGestureEnd(%d, %d, %d, %d)\n", vx, vy, x, y);
+    if (m_instance < 0) return;
+    float friction = s_param_KineticScrollFriction;
+    runOnServoThread([=] {
+        ServoUnityScrollIntegrator::send(m_scrollIntegrator.update(0, 0, x, y));
+        ServoUnityScrollIntegrator::send(m_scrollIntegrator.end((float)vx, (float)vy, friction));
+    });
+}
+
+void ServoUnityWindow::applyPerformanceProfile(int profile) {
+    SERVOUNITYLOGd("ServoUnityWindow::applyPerformanceProfile(%d)\n", profile);
+    if (m_instance < 0) return;
+    runOnServoThread([=] {ServoUnityPerformanceProfile::apply(profile);});
+}
+
 void ServoUnityWindow::keyEvent(int upDown, int keyCode, int character) {
 	SERVOUNITYLOGd("ServoUnityWindow::keyEvent(%d, %d, %d)\n", upDown, keyCode, character);
-    if (!s_servo) return;
-    int kc = character;
-    CKeyType kt;
-    switch (keyCode) {
-        //case ServoUnityKeyCode_Null: kt = CKeyType::kNull; break;
-        case ServoUnityKeyCode_Character: kt = CKeyType::kCharacter; break;
-        case ServoUnityKeyCode_Backspace: kt = CKeyType::kBackspace; break;
-        case ServoUnityKeyCode_Delete: kt = CKeyType::kDelete; break;
-        case ServoUnityKeyCode_Tab: kt = CKeyType::kTab; break;
-        //case ServoUnityKeyCode_Clear: kt = CKeyType::kClear; break;
-        case ServoUnityKeyCode_Return: kt = CKeyType::kEnter; break;
-        case ServoUnityKeyCode_Pause: kt = CKeyType::kPause; break;
-        case ServoUnityKeyCode_Escape: kt = CKeyType::kEscape; break;
-        case ServoUnityKeyCode_Space: kt = CKeyType::kCharacter; kc = ' '; break;
-        case ServoUnityKeyCode_UpArrow: kt = CKeyType::kUpArrow; break;
-        case ServoUnityKeyCode_DownArrow: kt = CKeyType::kDownArrow; break;
-        case ServoUnityKeyCode_RightArrow: kt = CKeyType::kRightArrow; break;
-        case ServoUnityKeyCode_LeftArrow: kt = CKeyType::kLeftArrow; break;
-        case ServoUnityKeyCode_Insert: kt = CKeyType::kInsert; break;
-        case ServoUnityKeyCode_Home: kt = CKeyType::kHome; break;
-        case ServoUnityKeyCode_End: kt = CKeyType::kEnd; break;
-        case ServoUnityKeyCode_PageUp: kt = CKeyType::kPageUp; break;
-        case ServoUnityKeyCode_PageDown: kt = CKeyType::kPageDown; break;
-        case ServoUnityKeyCode_F1: kt = CKeyType::kF1; break;
-        case ServoUnityKeyCode_F2: kt = CKeyType::kF2; break;
-        case ServoUnityKeyCode_F3: kt = CKeyType::kF3; break;
-        case ServoUnityKeyCode_F4: kt = CKeyType::kF4; break;
-        case ServoUnityKeyCode_F5: kt = CKeyType::kF5; break;
-        case ServoUnityKeyCode_F6: kt = CKeyType::kF6; break;
-        case ServoUnityKeyCode_F7: kt = CKeyType::kF7; break;
-        case ServoUnityKeyCode_F8: kt = CKeyType::kF8; break;
-        case ServoUnityKeyCode_F9: kt = CKeyType::kF9; break;
-        case ServoUnityKeyCode_F10: kt = CKeyType::kF10; break;
-        case ServoUnityKeyCode_F11: kt = CKeyType::kF11; break;
-        case ServoUnityKeyCode_F12: kt = CKeyType::kF12; break;
-        //case ServoUnityKeyCode_F13: kt = CKeyType::kF13; break;
-        //case ServoUnityKeyCode_F14: kt = CKeyType::kF14; break;
-        //case ServoUnityKeyCode_F15: kt = CKeyType::kF15; break;
-        //case ServoUnityKeyCode_F16: kt = CKeyType::kF16; break;
-        //case ServoUnityKeyCode_F17: kt = CKeyType::kF17; break;
-        //case ServoUnityKeyCode_F18: kt = CKeyType::kF18; break;
-        //case ServoUnityKeyCode_F19: kt = CKeyType::kF19; break;
-        case ServoUnityKeyCode_Numlock: kt = CKeyType::kNumLock; break;
-        case ServoUnityKeyCode_CapsLock: kt = CKeyType::kCapsLock; break;
-        case ServoUnityKeyCode_ScrollLock: kt = CKeyType::kScrollLock; break;
-        case ServoUnityKeyCode_RightShift: kt = CKeyType::kShift; break;
-        case ServoUnityKeyCode_LeftShift: kt = CKeyType::kShift; break;
-        case ServoUnityKeyCode_RightControl: kt = CKeyType::kControl; break;
-        case ServoUnityKeyCode_LeftControl: kt = CKeyType::kControl; break;
-        case ServoUnityKeyCode_RightAlt: kt = CKeyType::kOptionAlt; break;
-        case ServoUnityKeyCode_LeftAlt: kt = CKeyType::kOptionAlt; break;
-        case ServoUnityKeyCode_LeftCommand: kt = CKeyType::kCommandWindows; break;
-        case ServoUnityKeyCode_LeftWindows: kt = CKeyType::kCommandWindows; break;
-        case ServoUnityKeyCode_RightCommand: kt = CKeyType::kCommandWindows; break;
-        case ServoUnityKeyCode_RightWindows: kt = CKeyType::kCommandWindows; break;
-        case ServoUnityKeyCode_AltGr: kt = CKeyType::kAltGr; break;
-        case ServoUnityKeyCode_Help: kt = CKeyType::kHelp; break;
-        case ServoUnityKeyCode_Print: kt = CKeyType::kPrint; break;
-        //case ServoUnityKeyCode_SysReq: kt = CKeyType::kSysReq; break;
-        //case ServoUnityKeyCode_Break: kt = CKeyType::kBreak; break;
-        //case ServoUnityKeyCode_Menu: kt = CKeyType::kMenu; break;
-        case ServoUnityKeyCode_Keypad0: kt = CKeyType::kCharacter; kc = '0'; break;
-        case ServoUnityKeyCode_Keypad1: kt = CKeyType::kCharacter; kc = '1'; break;
-        case ServoUnityKeyCode_Keypad2: kt = CKeyType::kCharacter; kc = '2'; break;
-        case ServoUnityKeyCode_Keypad3: kt = CKeyType::kCharacter; kc = '3'; break;
-        case ServoUnityKeyCode_Keypad4: kt = CKeyType::kCharacter; kc = '4'; break;
-        case ServoUnityKeyCode_Keypad5: kt = CKeyType::kCharacter; kc = '5'; break;
-        case ServoUnityKeyCode_Keypad6: kt = CKeyType::kCharacter; kc = '6'; break;
-        case ServoUnityKeyCode_Keypad7: kt = CKeyType::kCharacter; kc = '7'; break;
-        case ServoUnityKeyCode_Keypad8: kt = CKeyType::kCharacter; kc = '8'; break;
-        case ServoUnityKeyCode_Keypad9: kt = CKeyType::kCharacter; kc = '9'; break;
-        case ServoUnityKeyCode_KeypadPeriod: kt = CKeyType::kCharacter; kc = '.'; break;
-        case ServoUnityKeyCode_KeypadDivide: kt = CKeyType::kCharacter; kc = '/'; break;
-        case ServoUnityKeyCode_KeypadMultiply: kt = CKeyType::kCharacter; kc = '*'; break;
-        case ServoUnityKeyCode_KeypadMinus: kt = CKeyType::kCharacter; kc = '-'; break;
-        case ServoUnityKeyCode_KeypadPlus: kt = CKeyType::kCharacter; kc = '+'; break;
-        case ServoUnityKeyCode_KeypadEnter: kt = CKeyType::kEnter; break;
-        case ServoUnityKeyCode_KeypadEquals: kt = CKeyType::kCharacter; kc = '='; break;
-        default: return;
-    }
+    if (m_instance < 0) return;
+    const ServoUnityKeyMapping *m = servoUnityKeyMapping(keyCode);
+    if (!m) return;
+    uint32_t kc = (m->character ? m->character : (uint32_t)character);
+    CKeyType kt = m->type;
 
     if (upDown == 1) runOnServoThread([=] {key_down(kc, kt);});
     else runOnServoThread([=] {key_up(kc, kt);});
 }
 
+// Decode UTF-8 to code points, replacing malformed sequences with U+FFFD.
+static void decodeUTF8(const unsigned char *s, size_t len, std::vector<uint32_t>& out)
+{
+    size_t i = 0;
+    while (i < len) {
+        unsigned char c = s[i];
+        uint32_t cp;
+        int extra;
+        uint32_t min;
+        if (c < 0x80) { cp = c; extra = 0; min = 0; }
+        else if ((c & 0xE0) == 0xC0) { cp = c & 0x1F; extra = 1; min = 0x80; }
+        else if ((c & 0xF0) == 0xE0) { cp = c & 0x0F; extra = 2; min = 0x800; }
+        else if ((c & 0xF8) == 0xF0) { cp = c & 0x07; extra = 3; min = 0x10000; }
+        else { out.push_back(0xFFFD); i++; continue; }
+        i++;
+        int n = 0;
+        while (n < extra && i < len && (s[i] & 0xC0) == 0x80) {
+            cp = (cp << 6) | (s[i] & 0x3F);
+            i++;
+            n++;
+        }
+        if (n < extra || cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) cp = 0xFFFD;
+        out.push_back(cp);
+    }
+}
+
+void ServoUnityWindow::textInput(const char *utf8, size_t len) {
+    SERVOUNITYLOGd("ServoUnityWindow::textInput(%zu bytes)\n", len);
+    if (m_instance < 0 || len == 0) return;
+    std::vector<uint32_t> text;
+    text.reserve(len);
+    decodeUTF8((const unsigned char *)utf8, len, text);
+    // One task for the whole run, so it is delivered to Servo in one go.
+    runOnServoThread([text] {
+        for (size_t i = 0; i < text.size(); i++) {
+            uint32_t cp = text[i];
+            CKeyType kt = CKeyType::kCharacter;
+            if (cp == '\r') {
+                if (i + 1 < text.size() && text[i + 1] == '\n') continue; // CR LF is one line break.
+                kt = CKeyType::kEnter;
+            } else if (cp == '\n') kt = CKeyType::kEnter;
+            else if (cp == '\t') kt = CKeyType::kTab;
+            else if (cp < 0x20 || cp == 0x7F) continue; // Other control characters have no key.
+            if (kt != CKeyType::kCharacter) cp = 0;
+            key_down(cp, kt);
+            key_up(cp, kt);
+        }
+    });
+}
+
 void ServoUnityWindow::touchBegin(int touchID, int x, int y) {
     SERVOUNITYLOGd("ServoUnityWindow::touchBegin(%d, %d, %d)\n", touchID, x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     if (touchID < 0) return;
     runOnServoThread([=] {touch_down((float)x, (float)y, touchID); });
 }
 void ServoUnityWindow::touchMove(int touchID, int x, int y) {
     SERVOUNITYLOGd("ServoUnityWindow::touchMove(%d, %d, %d)\n", touchID, x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     if (touchID < 0) return;
     runOnServoThread([=] {touch_move((float)x, (float)y, touchID); });
 }
 void ServoUnityWindow::touchEnd(int touchID, int x, int y) {
     SERVOUNITYLOGd("ServoUnityWindow::touchEnd(%d, %d, %d)\n", touchID, x, y);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     if (touchID < 0) return;
     runOnServoThread([=] {touch_up((float)x, (float)y, touchID); });
 }
 void ServoUnityWindow::touchCancel(int touchID, int x, int y) {
     SERVOUNITYLOGd("ServoUnityWindow::touchCancel(%d)\n", touchID);
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     if (touchID < 0) return;
     runOnServoThread([=] {touch_cancel((float)x, (float)y, touchID); });
 }
 
+void ServoUnityWindow::touchEvents(const ServoUnityTouch *touches, int count) {
+    SERVOUNITYLOGd("ServoUnityWindow::touchEvents(%d)\n", count);
+    if (m_instance < 0) return;
+    std::vector<ServoUnityTouch> batch(touches, touches + count);
+    ServoUnityGestureRecognizer::Config config = {s_param_TouchGestures, s_param_PinchThreshold, s_param_PanThreshold, s_param_KineticScrollFriction};
+    runOnServoThread([=] {m_gestureRecognizer.process(batch.data(), (int)batch.size(), config);});
+}
+
 void ServoUnityWindow::refresh()
 {
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     runOnServoThread([=] {::refresh();});
 }
 
 void ServoUnityWindow::reload()
 {
-    if (!s_servo) return;
-    runOnServoThread([=] {::reload();});
+    if (m_instance < 0) return;
+    runOnServoThread([=] {snapshotCapture(); ::reload();});
 }
 
 void ServoUnityWindow::stop()
 {
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     runOnServoThread([=] {::stop();});
 }
 
 void ServoUnityWindow::goBack()
 {
-    if (!s_servo) return;
-    runOnServoThread([=] {go_back();});
+    if (m_instance < 0) return;
+    runOnServoThread([=] {snapshotCapture(); go_back();});
 }
 
 void ServoUnityWindow::goForward()
 {
-    if (!s_servo) return;
-    runOnServoThread([=] {go_forward();});
+    if (m_instance < 0) return;
+    runOnServoThread([=] {snapshotCapture(); go_forward();});
 }
 
 void ServoUnityWindow::goHome()
 {
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     // TODO: fetch the homepage from prefs.
     runOnServoThread([=] {
+        snapshotCapture();
         if (is_uri_valid(s_param_Homepage.c_str())) {
             load_uri(s_param_Homepage.c_str());
         };
@@ -479,12 +961,16 @@ void ServoUnityWindow::goHome()
 
 void ServoUnityWindow::navigate(const std::string& urlOrSearchString)
 {
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     runOnServoThread([=] {
+        snapshotCapture();
+        std::string uri;
         if (is_uri_valid(urlOrSearchString.c_str())) {
             load_uri(urlOrSearchString.c_str());
+        } else if (ServoUnityHistory::resolve(urlOrSearchString, &uri)) {
+            // A visited page typed without its scheme, e.g. an accepted completion.
+            load_uri(uri.c_str());
         } else {
-            std::string uri;
             // It's not a valid URI, but might be a domain name without method.
             // Look for bare minimum of a '.'' before any '/'.
             size_t dotPos = urlOrSearchString.find('.');
@@ -510,15 +996,15 @@ void ServoUnityWindow::navigate(const std::string& urlOrSearchString)
 
 void ServoUnityWindow::imeDismissed()
 {
-    if (!s_servo) return;
+    if (m_instance < 0) return;
     runOnServoThread([=] {
         ime_dismissed();
     });
 }
 
 //
-// Callback implementations. These are all necesarily static, so have to fetch the active instance
-// via the static instance pointer s_servo.
+// Callback implementations. Servo calls the static functions in ServoUnityWindowInstanceCallbacks<Slot>,
+// which forward to the window currently bound to instance slot Slot, if any.
 //
 // Callbacks can come from any Servo thread (and there are many) so care must be taken
 // to ensure that any call back into Unity is on the Unity thread, or any work done
@@ -528,73 +1014,96 @@ void ServoUnityWindow::imeDismissed()
 void ServoUnityWindow::on_load_started(void)
 {
     SERVOUNITYLOGd("servo callback on_load_started\n");
-    if (!s_servo) return;
-    s_servo->queueBrowserEventCallbackTask(s_servo->uidExt(), ServoUnityBrowserEvent_LoadStateChanged, 1, 0, NULL);
+    ServoUnityStartupTimeline::mark(ServoUnityStartupPhase_FirstLoadStarted);
+    m_snapshotLoading = true;
+    publishMetadata([](Metadata& m) { m.loading = true; });
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_LoadStateChanged, 1, 0, NULL);
 }
 
 void ServoUnityWindow::on_load_ended(void)
 {
     SERVOUNITYLOGd("servo callback on_load_ended\n");
-    if (!s_servo) return;
-    s_servo->queueBrowserEventCallbackTask(s_servo->uidExt(), ServoUnityBrowserEvent_LoadStateChanged, 0, 0, NULL);
+    ServoUnityStartupTimeline::mark(ServoUnityStartupPhase_FirstLoadEnded);
+    m_snapshotLoading = false;
+    m_snapshotHeld = false;
+    m_snapshotCapturePending = true;
+    publishMetadata([](Metadata& m) { m.loading = false; });
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_LoadStateChanged, 0, 0, NULL);
 }
 
 void ServoUnityWindow::on_title_changed(const char *title)
 {
     SERVOUNITYLOGd("servo callback on_title_changed: %s\n", title);
-    if (!s_servo) return;
-    s_servo->m_title = std::string(title);
-    s_servo->queueBrowserEventCallbackTask(s_servo->uidExt(), ServoUnityBrowserEvent_TitleChanged, 0, 0, NULL);
+    if (title) ServoUnityHistory::setTitle(m_snapshotURL, title);
+    publishMetadata([=](Metadata& m) { m.title = std::string(title); });
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_TitleChanged, 0, 0, NULL);
 }
 
 bool ServoUnityWindow::on_allow_navigation(const char *url)
 {
     SERVOUNITYLOGd("servo callback on_allow_navigation: %s\n", url);
-    return true;
+    std::shared_ptr<const ServoUnityNavigationPolicy> policy = servoUnityGetNavigationPolicy();
+    if (!policy) return true;
+    std::string redirect;
+    switch (policy->decide(url, &redirect)) {
+        case ServoUnityNavigationPolicyAction_Block:
+            SERVOUNITYLOGi("Navigation to '%s' blocked by policy.\n", url);
+            return false;
+        case ServoUnityNavigationPolicyAction_Redirect:
+            // Not from within the callback; Servo is mid-navigation. Dropped if Servo is shutting down.
+            SERVOUNITYLOGi("Navigation to '%s' redirected by policy to '%s'.\n", url, redirect.c_str());
+            runOnServoThread([redirect] {load_uri(redirect.c_str());});
+            return false;
+        default:
+            return true;
+    }
 }
 
 void ServoUnityWindow::on_url_changed(const char *url)
 {
     SERVOUNITYLOGd("servo callback on_url_changed: %s\n", url);
-    if (!s_servo) return;
-    s_servo->m_URL = std::string(url);
-    s_servo->queueBrowserEventCallbackTask(s_servo->uidExt(), ServoUnityBrowserEvent_URLChanged, 0, 0, NULL);
+    if (m_snapshotURL != url) {
+        // Show the new page's snapshot, if there is one, until Servo has drawn it.
+        m_snapshotURL = url;
+        m_snapshotFrameShown = false;
+        m_snapshotCapturePending = false;
+        m_snapshotPresentPending = true;
+        ServoUnityHistory::visit(m_snapshotURL);
+    }
+    publishMetadata([=](Metadata& m) { m.URL = std::string(url); });
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_URLChanged, 0, 0, NULL);
 }
 
 void ServoUnityWindow::on_history_changed(bool can_go_back, bool can_go_forward)
 {
     SERVOUNITYLOGd("servo callback on_history_changed: can_go_back:%s, can_go_forward:%s\n", can_go_back ? "true" : "false", can_go_forward ? "true" : "false");
-    if (!s_servo) return;
-    s_servo->queueBrowserEventCallbackTask(s_servo->uidExt(), ServoUnityBrowserEvent_HistoryChanged, can_go_back ? 1 : 0, can_go_forward ? 1 : 0, NULL);
+    publishMetadata([=](Metadata& m) { m.canGoBack = can_go_back; m.canGoForward = can_go_forward; });
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_HistoryChanged, can_go_back ? 1 : 0, can_go_forward ? 1 : 0, NULL);
 }
 
 void ServoUnityWindow::on_animating_changed(bool animating)
 {
     SERVOUNITYLOGd("servo callback on_animating_changed(%s)\n", animating ? "true" : "false");
-    if (!s_servo) return;
-    std::lock_guard<std::mutex> lock(s_servo->m_updateLock);
-    s_servo->m_updateContinuously = animating;
+    std::lock_guard<std::mutex> lock(m_updateLock);
+    m_updateContinuously = animating;
 }
 
 void ServoUnityWindow::on_shutdown_complete(void)
 {
     SERVOUNITYLOGd("servo callback on_shutdown_complete\n");
-    if (!s_servo) return;
-    s_servo->m_waitingForShutdown = false;
+    m_waitingForShutdown = false;
 }
 
 void ServoUnityWindow::on_ime_show(const char *text, int32_t text_index, bool multiline, int32_t x, int32_t y, int32_t width, int32_t height)
 {
     SERVOUNITYLOGd("servo callback on_ime_show(text:%s, text_index:%d, multiline:%s, x:%d, y:%d, width:%d, height:%d)\n", text, text_index, multiline ? "true" : "false", x, y, width, height);
-    if (!s_servo) return;
-    s_servo->queueBrowserEventCallbackTask(s_servo->uidExt(), ServoUnityBrowserEvent_IMEStateChanged, multiline ? 2 : 1, text_index, text);
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_IMEStateChanged, multiline ? 2 : 1, text_index, text);
 }
 
 void ServoUnityWindow::on_ime_hide(void)
 {
     SERVOUNITYLOGi("servo callback on_ime_hide\n");
-    if (!s_servo) return;
-    s_servo->queueBrowserEventCallbackTask(s_servo->uidExt(), ServoUnityBrowserEvent_IMEStateChanged, 0, 0, NULL);
+    queueBrowserEventCallbackTask(uidExt(), ServoUnityBrowserEvent_IMEStateChanged, 0, 0, NULL);
 }
 
 const char *ServoUnityWindow::get_clipboard_contents(void)
@@ -706,8 +1215,87 @@ void ServoUnityWindow::on_log_output(const char *buffer, uint32_t buffer_length)
 void ServoUnityWindow::wakeup(void)
 {
     SERVOUNITYLOGd("servo callback wakeup on thread %" PRIu64 "\n", getThreadID());
-    if (!s_servo) return;
-    std::lock_guard<std::mutex> lock(s_servo->m_updateLock);
-    s_servo->m_updateOnce = true;
+    std::lock_guard<std::mutex> lock(m_updateLock);
+    m_updateOnce = true;
 }
 
+
+//
+// Per-slot callback trampolines.
+//
+
+template <int Slot>
+struct ServoUnityWindowInstanceCallbacks
+{
+    // Callers must hold a ServoUnityEpochGuard for as long as they use the window, as it may be
+    // removed from the window table, and so unbound, at any time.
+    static ServoUnityWindow *window(void) { return ServoUnityWindow::s_instances[Slot].load(); }
+
+    static void on_load_started(void) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_load_started(); }
+    static void on_load_ended(void) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_load_ended(); }
+    static void on_title_changed(const char *title) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_title_changed(title); }
+    static bool on_allow_navigation(const char *url) { ServoUnityEpochGuard epoch; ServoUnityWindow *w = window(); return w ? w->on_allow_navigation(url) : true; }
+    static void on_url_changed(const char *url) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_url_changed(url); }
+    static void on_history_changed(bool can_go_back, bool can_go_forward) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_history_changed(can_go_back, can_go_forward); }
+    static void on_animating_changed(bool animating) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_animating_changed(animating); }
+    static void on_shutdown_complete(void) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_shutdown_complete(); }
+    static void on_ime_show(const char *text, int32_t text_index, bool multiline, int32_t x, int32_t y, int32_t width, int32_t height) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_ime_show(text, text_index, multiline, x, y, width, height); }
+    static void on_ime_hide(void) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_ime_hide(); }
+    static const char *get_clipboard_contents(void) { ServoUnityEpochGuard epoch; ServoUnityWindow *w = window(); return w ? w->get_clipboard_contents() : nullptr; }
+    static void set_clipboard_contents(const char *contents) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->set_clipboard_contents(contents); }
+    static void on_media_session_metadata(const char *title, const char *album, const char *artist) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_media_session_metadata(title, album, artist); }
+    static void on_media_session_playback_state_change(CMediaSessionPlaybackState state) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_media_session_playback_state_change(state); }
+    static void on_media_session_set_position_state(double duration, double position, double playback_rate) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_media_session_set_position_state(duration, position, playback_rate); }
+    static void prompt_alert(const char *message, bool trusted) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->prompt_alert(message, trusted); }
+    static CPromptResult prompt_ok_cancel(const char *message, bool trusted) { ServoUnityEpochGuard epoch; ServoUnityWindow *w = window(); return w ? w->prompt_ok_cancel(message, trusted) : CPromptResult::Dismissed; }
+    static CPromptResult prompt_yes_no(const char *message, bool trusted) { ServoUnityEpochGuard epoch; ServoUnityWindow *w = window(); return w ? w->prompt_yes_no(message, trusted) : CPromptResult::Dismissed; }
+    static const char *prompt_input(const char *message, const char *def, bool trusted) { ServoUnityEpochGuard epoch; ServoUnityWindow *w = window(); return w ? w->prompt_input(message, def, trusted) : def; }
+    static void on_devtools_started(CDevtoolsServerState result, unsigned int port, const char *token) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_devtools_started(result, port, token); }
+    static void show_context_menu(const char *title, const char *const *items_list, uint32_t items_size) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->show_context_menu(title, items_list, items_size); }
+    static void on_log_output(const char *buffer, uint32_t buffer_length) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->on_log_output(buffer, buffer_length); }
+    static void wakeup(void) { ServoUnityEpochGuard epoch; if (ServoUnityWindow *w = window()) w->wakeup(); }
+
+    static CHostCallbacks hostCallbacks(void)
+    {
+        CHostCallbacks chc {
+            /*.on_load_started =*/ on_load_started,
+            /*.on_load_ended =*/ on_load_ended,
+            /*.on_title_changed =*/ on_title_changed,
+            /*.on_allow_navigation =*/ on_allow_navigation,
+            /*.on_url_changed =*/ on_url_changed,
+            /*.on_history_changed =*/ on_history_changed,
+            /*.on_animating_changed =*/ on_animating_changed,
+            /*.on_shutdown_complete =*/ on_shutdown_complete,
+            /*.on_ime_show =*/ on_ime_show,
+            /*.on_ime_hide =*/ on_ime_hide,
+            /*.get_clipboard_contents =*/ get_clipboard_contents,
+            /*.set_clipboard_contents =*/ set_clipboard_contents,
+            /*.on_media_session_metadata =*/ on_media_session_metadata,
+            /*.on_media_session_playback_state_change =*/ on_media_session_playback_state_change,
+            /*.on_media_session_set_position_state =*/ on_media_session_set_position_state,
+            /*.prompt_alert =*/ prompt_alert,
+            /*.prompt_ok_cancel =*/ prompt_ok_cancel,
+            /*.prompt_yes_no =*/ prompt_yes_no,
+            /*.prompt_input =*/ prompt_input,
+            /*.on_devtools_started =*/ on_devtools_started,
+            /*.show_context_menu =*/ show_context_menu,
+            /*.on_log_output =*/ on_log_output
+        };
+        return chc;
+    }
+};
+
+template <int... Slots>
+static const InstanceCallbacks *instanceCallbacksTable(std::integer_sequence<int, Slots...>)
+{
+    static const InstanceCallbacks table[] = {
+        {ServoUnityWindowInstanceCallbacks<Slots>::wakeup, ServoUnityWindowInstanceCallbacks<Slots>::hostCallbacks}...
+    };
+    return table;
+}
+
+static const InstanceCallbacks& instanceCallbacks(int slot)
+{
+    static const InstanceCallbacks *table = instanceCallbacksTable(std::make_integer_sequence<int, kInstancesSupported>());
+    return table[slot];
+}
@@ -14,12 +14,17 @@
 
 #include "servo_unity_c.h"
 #include "simpleservo2.h"
+#include "ServoUnityDynamicResolution.h"
+#include "ServoUnityScrollIntegrator.h"
+#include "ServoUnityGestureRecognizer.h"
 #include <string>
 #include <cstdint>
 #include <string>
 #include <deque>
 #include <functional>
 #include <mutex>
+#include <atomic>
+#include <vector>
 
 class ServoUnityWindow
 {
@@ -34,50 +39,107 @@ protected:
 
 	virtual bool initRenderer(CInitOptions opts, void (*wakeup)(void), CHostCallbacks callbacks) = 0;
 
+    enum class ReadbackStatus { Pending, Ready, Failed };
+    /// Start reading back the Unity texture's contents, downscaled to at most maxDimension pixels on its longest
+    /// side, without waiting for the GPU. Collect them with finishReadTexture(). Only one read may be in progress.
+    /// Must be called from render thread. Returns false if unsupported or unavailable.
+    virtual bool beginReadTexture(int /*maxDimension*/) { return false; }
+    /// Collect the read started by beginReadTexture() as RGBA, top row first. Returns Pending if the GPU hasn't
+    /// finished it yet, unless wait is set. Returns Failed if there is no read in progress. Must be called from render thread.
+    virtual ReadbackStatus finishReadTexture(bool /*wait*/, std::vector<uint8_t>& /*rgba*/, int * /*width*/, int * /*height*/) { return ReadbackStatus::Failed; }
+    /// Abandon any read in progress. Must be called from render thread.
+    virtual void cancelReadTexture(void) {}
+    /// Draw RGBA pixels, top row first, into the Unity texture, scaled to fill it. Must be called from render thread.
+    virtual bool drawTexture(const uint8_t * /*rgba*/, int /*width*/, int /*height*/) { return false; }
+    /// To be called by updateTexture() when the Unity texture has been cleared, e.g. because it is new.
+    void snapshotTextureCleared(void);
+    /// To be called by updateTexture() before it takes a frame from Servo. Shows any pending snapshot.
+    /// Returns false while a snapshot is being shown in place of Servo's frames.
+    bool snapshotBeginFrame(void);
+    /// To be called by updateTexture() when done. newFrame is true if a frame from Servo was copied into the Unity texture.
+    void snapshotEndFrame(bool newFrame);
+
 private:
-	static void on_load_started(void);
-    static void on_load_ended(void);
-    static void on_title_changed(const char *title);
-    static bool on_allow_navigation(const char *url);
-    static void on_url_changed(const char *url);
-    static void on_history_changed(bool can_go_back, bool can_go_forward);
-    static void on_animating_changed(bool animating);
-    static void on_shutdown_complete(void);
-    static void on_ime_show(const char *text, int32_t text_index, bool multiline, int32_t x, int32_t y, int32_t width, int32_t height);
-    static void on_ime_hide(void);
-    static const char *get_clipboard_contents(void);
-    static void set_clipboard_contents(const char *contents);
-    static void on_media_session_metadata(const char *title, const char *album, const char *artist);
-    static void on_media_session_playback_state_change(CMediaSessionPlaybackState state);
-    static void on_media_session_set_position_state(double duration, double position, double playback_rate);
-    static void prompt_alert(const char *message, bool trusted);
-    static CPromptResult prompt_ok_cancel(const char *message, bool trusted);
-    static CPromptResult prompt_yes_no(const char *message, bool trusted);
-    static const char *prompt_input(const char *message, const char *def, bool trusted);
-    static void on_devtools_started(CDevtoolsServerState result, unsigned int port, const char *token);
-    static void show_context_menu(const char *title, const char *const *items_list, uint32_t items_size);
-    static void on_log_output(const char *buffer, uint32_t buffer_length);
-    static void wakeup(void);
+    // Servo's callbacks carry no userdata, so each Servo instance is given its own set of
+    // callback functions (see ServoUnityWindowInstanceCallbacks in ServoUnityWindow.cpp),
+    // which look up the window bound to the instance's slot and forward to it.
+    static const int kInstancesMax = 8;
+    static std::atomic<ServoUnityWindow *> s_instances[kInstancesMax];
+    template <int Slot> friend struct ServoUnityWindowInstanceCallbacks;
+    std::atomic<int> m_instance; // Slot in s_instances, or -1 if this window has no Servo instance. Set on the render thread.
+    std::atomic<bool> m_removed; // Set by markRemoved().
+    bool m_instanceUnavailableLogged;
+    bool bindInstance(void);
+
+	void on_load_started(void);
+    void on_load_ended(void);
+    void on_title_changed(const char *title);
+    bool on_allow_navigation(const char *url);
+    void on_url_changed(const char *url);
+    void on_history_changed(bool can_go_back, bool can_go_forward);
+    void on_animating_changed(bool animating);
+    void on_shutdown_complete(void);
+    void on_ime_show(const char *text, int32_t text_index, bool multiline, int32_t x, int32_t y, int32_t width, int32_t height);
+    void on_ime_hide(void);
+    const char *get_clipboard_contents(void);
+    void set_clipboard_contents(const char *contents);
+    void on_media_session_metadata(const char *title, const char *album, const char *artist);
+    void on_media_session_playback_state_change(CMediaSessionPlaybackState state);
+    void on_media_session_set_position_state(double duration, double position, double playback_rate);
+    void prompt_alert(const char *message, bool trusted);
+    CPromptResult prompt_ok_cancel(const char *message, bool trusted);
+    CPromptResult prompt_yes_no(const char *message, bool trusted);
+    const char *prompt_input(const char *message, const char *def, bool trusted);
+    void on_devtools_started(CDevtoolsServerState result, unsigned int port, const char *token);
+    void show_context_menu(const char *title, const char *const *items_list, uint32_t items_size);
+    void on_log_output(const char *buffer, uint32_t buffer_length);
+    void wakeup(void);
 
     bool m_updateContinuously;
     bool m_updateOnce;
     std::mutex m_updateLock;
-    std::string m_title;
-    std::string m_URL;
     std::string m_userAgent;
     std::deque< std::function<void()> > m_servoTasks;
     std::mutex m_servoTasksLock;
+    bool m_servoShuttingDown; // While set, runOnServoThread drops tasks. Guarded by m_servoTasksLock.
     typedef struct { int uidExt; int eventType; int eventData1; int eventData2; char* eventDataS; } BROWSEREVENTCALLBACKTASK;
     std::deque< BROWSEREVENTCALLBACKTASK > m_browserEventCallbackTasks;
     std::mutex m_browserEventCallbackTasksLock;
     void runOnServoThread(std::function<void()> task);
     void queueBrowserEventCallbackTask(int uidExt, int eventType, int eventData1, int eventData2, const char *eventDataS); // eventDataS will be copied, so does not need to be kept once the task has been queued.
     bool m_waitingForShutdown;
+    ServoUnityDynamicResolution m_dynamicResolution;
+    std::mutex m_sizeLock; // Guards m_dynamicResolution and m_resizedPending.
+    bool m_resizedPending;
+    int m_resizeSettlingWidth; // Size we are waiting to settle before resizing.
+    int m_resizeSettlingHeight;
+    float m_resizeSettlingTime; // Milliseconds for which m_resizeSettlingSize has been unchanged.
+    void updateSize(float timeDelta);
+    ServoUnityScrollIntegrator m_scrollIntegrator; // Only used on the render thread.
+    float m_frameTimeDelta; // Seconds, from the last prepareUpdate().
+    ServoUnityGestureRecognizer m_gestureRecognizer; // Only used on the render thread.
+    // Memory pressure response. Only used on the render thread, except m_visible.
+    std::atomic<bool> m_visible;
+    bool m_shrunk; // Rendering at kShrunkScale of its size while hidden.
+    bool m_suspended; // Servo told the window is hidden, and not serviced.
+    bool m_resizeImmediately; // The next size change skips s_param_ResizeSettleTime.
+    // Texture budget. Only used on the render thread.
+    bool m_evicted; // Rendering at kEvictedDimension while hidden.
+    uint64_t m_lastVisibleFrame;
+    // Page snapshots. Only used on the render thread.
+    std::string m_snapshotURL; // URL of the page currently in Servo.
+    bool m_snapshotLoading;
+    bool m_snapshotFrameShown; // The Unity texture holds a frame of m_snapshotURL from Servo.
+    bool m_snapshotCapturePending;
+    bool m_snapshotPresentPending;
+    bool m_snapshotHeld; // A snapshot is showing, and Servo's frames are being held back.
+    float m_snapshotHeldTime; // Seconds the snapshot has been held while the page was loading.
+    std::string m_snapshotReadbackURL; // URL of the page being read back from the texture, if any.
+    void snapshotCapture(void);
+    void snapshotCollect(bool wait);
 
 public:
-    static ServoUnityWindow *s_servo;
-
-	virtual ~ServoUnityWindow() {};
+	virtual ~ServoUnityWindow();
 
 	enum RendererAPI {
 		None = 0,
@@ -97,20 +159,88 @@ public:
 		int h;
 	};
 
+	/// Snapshot of the window's browser state. Snapshots are immutable; whenever any field
+	/// changes, a new snapshot with a higher version is published in place of the old one.
+	struct Metadata {
+		std::string title;
+		std::string URL;
+		bool loading;
+		bool canGoBack;
+		bool canGoForward;
+		int version;
+	};
+
 	int uid() { return m_uid; }
 	int uidExt() { return m_uidExt; }
 	void setUidExt(int uidExt) { m_uidExt = uidExt; }
+	/// Hand a window created by servoUnityPrewarm, or detached, over to Unity. Call init() afterwards to notify Unity. Must be called from main thread.
+	void adopt(int uidExt, Size size);
+	/// Disconnect the window from Unity, leaving Servo running, until it is adopted again. Must be called from main thread.
+	void detach(void);
 	virtual bool init(PFN_WINDOWCREATEDCALLBACK windowCreatedCallback, PFN_WINDOWRESIZEDCALLBACK windowResizedCallback, PFN_BROWSEREVENTCALLBACK browserEventCallback, const std::string& userAgent);
 	
 	virtual RendererAPI rendererAPI() = 0;
 	virtual Size size() = 0;
+	/// Change the size of the window's render target. Must be called from render thread.
+	/// Other callers should use requestSize().
 	virtual void setSize(Size size) = 0;
+	/// Request a change in the window size. Must be called from main thread.
+	/// The new size takes effect at the next update. When dynamic resolution is enabled, this sets
+	/// the largest size the window will render at.
+	void requestSize(Size size);
+	/// Set the size the window currently occupies on screen, for use by dynamic resolution. Must be called from main thread.
+	void setProjectedSize(Size size);
+	/// Set whether the window can be seen, for the memory pressure response. Must be called from main thread.
+	void setVisible(bool visible) { m_visible = visible; }
+	/// Clear Servo's caches. Has no effect if Servo isn't running.
+	void clearEngineCache(void);
+	/// Release memory the window keeps only for reuse, e.g. pooled textures. Must be called from render thread.
+	virtual void releaseCaches(void) {}
+	/// Shrink or suspend the window if it is hidden and level (one of ServoUnityMemoryPressure_*) calls for it,
+	/// or restore it if it is visible again. Must be called from render thread, once per frame, before serviceServo().
+	/// Returns the ServoUnityMemoryPressureAction_* taken, if any.
+	int applyMemoryPressure(int level);
+	bool visible(void) { return m_visible; }
+	/// Record that the window is visible in frame, restoring its textures if they were evicted. Must be called from render thread, once per frame.
+	void noteVisibility(uint64_t frame);
+	/// Frame the window was last visible in, as passed to noteVisibility().
+	uint64_t lastVisibleFrame(void) { return m_lastVisibleFrame; }
+	/// Reduce the window's textures to a token size until it is visible again. Must be called from render thread.
+	void evictTextures(void);
+	bool texturesEvicted(void) { return m_evicted; }
+	/// Bytes of GPU memory held for the window: the Unity texture, and the surface Servo renders into. Must be called from render thread.
+	virtual uint64_t textureBytes(void);
+	/// Switch this window's running Servo instance to a ServoUnityPerformanceProfile_*. Has no effect if Servo isn't running,
+	/// as the profile in s_param_PerformanceProfile is applied at startup.
+	void applyPerformanceProfile(int profile);
 	virtual int format() = 0;
 	virtual void setNativePtr(void* texPtr) = 0;
 	virtual void* nativePtr() = 0;
 	
-	/// Request an update to the window texture. Must be called from render thread.
-	virtual void requestUpdate(float timeDelta);
+	/// Apply any pending size change, and start this window's Servo instance if it is not already running.
+	/// Must be called from render thread. Returns false if Servo could not be started, e.g. because
+	/// all available instances are in use by other windows.
+	bool prepareUpdate(float timeDelta);
+	/// True if this window has a running Servo instance.
+	bool hasInstance(void) { return m_instance >= 0; }
+	/// Stop Servo's callbacks reaching this window, and free its instance slot for another window. Called once
+	/// its Servo instance has been deinitialised, as libsimpleservo2's engine lives until then.
+	void unbindInstance(void);
+	/// Called when this window is removed from the window table. No Servo instance is started for it after this.
+	/// Returns true if it has one running, which must be cleaned up on the render thread before it is deleted.
+	bool markRemoved(void);
+	/// How many windows can have a Servo instance at once.
+	static int instancesSupported(void);
+	/// If this window's Servo instance has asked to be woken, let it process pending events.
+	/// Must be called from render thread, once per frame.
+	virtual void performUpdates(void);
+	/// Run tasks this window has queued for Servo. Must be called from render thread. Returns the number of tasks run.
+	int runServoTasks(void);
+	/// Deliver queued tasks and any scroll momentum and let Servo process them, once per frame, batching input if
+	/// s_param_BatchInput is set. Must be called from render thread. Returns the number of tasks run.
+	int serviceServo(void);
+	/// Copy Servo's latest frame, if one is pending, into the Unity texture. Must be called from render thread.
+	virtual void updateTexture(void) = 0;
 	
     /// Notify that the renderer is going away and should be cleaned up. Must be called from render thread.
     virtual void cleanupRenderer(void);
@@ -118,8 +248,9 @@ public:
 	void CloseServoWindow() {}
 	
     void serviceWindowEvents(void);
-    std::string windowTitle(void);
-    std::string windowURL(void);
+    /// Current metadata snapshot. May be called from any thread. The caller must hold a
+    /// ServoUnityEpochGuard for as long as it uses the snapshot.
+    const Metadata *metadata(void) { return m_metadata.load(std::memory_order_acquire); }
     
 	void pointerEnter();
 	void pointerExit();
@@ -128,11 +259,16 @@ public:
 	void pointerRelease(int button, int x, int y);
 	void pointerClick(int button, int x, int y);
     void pointerScrollDiscrete(int x_scroll, int y_scroll, int x, int y); // x and y are a discrete scroll count, e.g. count of mousewheel "clicks".
+    void scrollGestureBegin(int x, int y);
+    void scrollGestureUpdate(int dx, int dy, int x, int y); // dx and dy are in pixels.
+    void scrollGestureEnd(int vx, int vy, int x, int y); // vx and vy are the release velocity in pixels per second.
 	void keyEvent(int upDown, int keyCode, int character);
+    void textInput(const char *utf8, size_t len);
     void touchBegin(int touchID, int x, int y);
     void touchMove(int touchID, int x, int y);
     void touchEnd(int touchID, int x, int y);
     void touchCancel(int touchID, int x, int y);
+    void touchEvents(const ServoUnityTouch *touches, int count); // Copies touches.
 
     void refresh();
     void reload();
@@ -142,5 +278,10 @@ public:
     void goHome();
     void navigate(const std::string& urlOrSearchString);
     void imeDismissed();
+
+private:
+    std::atomic<const Metadata *> m_metadata;
+    std::mutex m_metadataLock; // Serialises publishers of m_metadata.
+    void publishMetadata(std::function<void(Metadata&)> change);
 };
 
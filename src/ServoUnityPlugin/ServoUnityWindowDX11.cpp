@@ -15,18 +15,32 @@
 #if SUPPORT_D3D11
 #include "IUnityGraphicsD3D11.h"
 #include "servo_unity_log.h"
+#include "ServoUnityStartupTimeline.h"
+#include "ServoUnitySnapshotCache.h"
 
 #include <assert.h>
 #include <stdio.h>
+#include <algorithm>
+#include <vector>
 
 static ID3D11Device* s_D3D11Device = nullptr;
 
+static const size_t kServoTexturePoolMax = 2;
+
+// A small opaque black texture, tiled to clear Unity's textures on the GPU.
+static ID3D11Texture2D* s_blackTile = nullptr;
+static const UINT kBlackTileSize = 256;
+
 void ServoUnityWindowDX11::initDevice(IUnityInterfaces* unityInterfaces) {
 	IUnityGraphicsD3D11* ud3d = unityInterfaces->Get<IUnityGraphicsD3D11>();
 	s_D3D11Device = ud3d->GetDevice();
 }
 
 void ServoUnityWindowDX11::finalizeDevice() {
+	if (s_blackTile) {
+		s_blackTile->Release();
+		s_blackTile = nullptr;
+	}
 	s_D3D11Device = nullptr; // The object itself being owned by Unity will go away without our help, but we should clear our weak reference.
 }
 
@@ -39,11 +53,16 @@ ServoUnityWindowDX11::ServoUnityWindowDX11(int uid, int uidExt, Size size) :
 	m_format(ServoUnityTextureFormat_Invalid),
 	m_EGLSurface(EGL_NO_SURFACE),
 	m_texID(0),
-    m_unityTexPtr(nullptr)
+    m_unityTexPtr(nullptr),
+	m_unityTexClearPending(false),
+	m_readbackStaging(nullptr),
+	m_readbackFormat(ServoUnityTextureFormat_Invalid),
+	m_readbackMaxDimension(0)
 {
 }
 
 ServoUnityWindowDX11::~ServoUnityWindowDX11() {
+	cancelReadTexture();
 }
 
 static int getServoUnityTextureFormatForDXGIFormat(DXGI_FORMAT format)
@@ -94,21 +113,59 @@ ServoUnityWindow::Size ServoUnityWindowDX11::size() {
 }
 
 void ServoUnityWindowDX11::setSize(ServoUnityWindow::Size size) {
-	// TODO: request change in the Servo window size.
+	m_size = size;
+
+	// If the renderer is already running, the texture Servo renders into must be replaced.
+	if (m_servoTexPtr) {
+		releaseServoTexture();
+		if (!acquireServoTexture()) {
+			SERVOUNITYLOGe("Unable to recreate Servo texture at size %dx%d.\n", m_size.w, m_size.h);
+		}
+	}
+}
 
-    if (m_windowResizedCallback) (*m_windowResizedCallback)(m_uidExt, m_size.w, m_size.h);
+bool ServoUnityWindowDX11::acquireServoTexture() {
+	for (auto it = m_servoTexturePool.begin(); it != m_servoTexturePool.end(); it++) {
+		if (it->size.w == m_size.w && it->size.h == m_size.h) {
+			SERVOUNITYLOGd("Reusing pooled Servo texture of size %dx%d.\n", m_size.w, m_size.h);
+			m_servoTexPtr = it->tex;
+			m_EGLSurface = it->surface;
+			m_texID = it->texID;
+			m_servoTexturePool.erase(it);
+			m_GLES.MakeCurrent(m_EGLSurface);
+			return true;
+		}
+	}
+	return createServoTexture();
 }
 
-void ServoUnityWindowDX11::setNativePtr(void* texPtr) {
-	m_unityTexPtr = texPtr;
+void ServoUnityWindowDX11::releaseServoTexture() {
+	if (!m_servoTexPtr) return;
+	D3D11_TEXTURE2D_DESC desc = { 0 };
+	m_servoTexPtr->GetDesc(&desc);
+	m_servoTexturePool.push_front({m_servoTexPtr, m_EGLSurface, m_texID, {(int)desc.Width, (int)desc.Height}});
+	m_servoTexPtr = nullptr;
+	m_EGLSurface = EGL_NO_SURFACE;
+	m_texID = 0;
+	while (m_servoTexturePool.size() > kServoTexturePoolMax) {
+		destroyServoTexture(m_servoTexturePool.back());
+		m_servoTexturePool.pop_back();
+	}
 }
 
-void* ServoUnityWindowDX11::nativePtr() {
-	return m_unityTexPtr;
+void ServoUnityWindowDX11::flushServoTexturePool() {
+	for (auto& st : m_servoTexturePool) destroyServoTexture(st);
+	m_servoTexturePool.clear();
 }
 
-bool ServoUnityWindowDX11::initRenderer(CInitOptions cio, void (*wakeup)(void), CHostCallbacks chc) {
+uint64_t ServoUnityWindowDX11::textureBytes() {
+	uint64_t bytes = (m_unityTexPtr ? servoUnityGetBufferSizeForTextureFormat(m_size.w, m_size.h, m_format) : 0);
+	if (m_servoTexPtr) bytes += servoUnityGetBufferSizeForTextureFormat(m_size.w, m_size.h, m_format);
+	for (auto& st : m_servoTexturePool) bytes += servoUnityGetBufferSizeForTextureFormat(st.size.w, st.size.h, m_format);
+	return bytes;
+}
 
+bool ServoUnityWindowDX11::createServoTexture() {
 	// Create the texture that will receive buffers from surfman (via ANGLE's DirectX interop).
 	D3D11_TEXTURE2D_DESC descServo = { 0 };
 	descServo.Width = m_size.w;
@@ -125,19 +182,14 @@ bool ServoUnityWindowDX11::initRenderer(CInitOptions cio, void (*wakeup)(void),
 	HRESULT hr = s_D3D11Device->CreateTexture2D(&descServo, nullptr, &m_servoTexPtr);
 	if FAILED(hr) {
 		SERVOUNITYLOGe("Error: Unable to create texture.\n");
+		m_servoTexPtr = nullptr;
 		return false;
 	}
 
-	// Set up EGL context.
-	if (!m_GLES.Initialize()) {
-		SERVOUNITYLOGe("Unable to initialise EGL.\n");
-		m_servoTexPtr->Release();
-		return false;
-	}
 	if ((m_EGLSurface = m_GLES.CreateSurface(m_servoTexPtr)) == EGL_NO_SURFACE) {
 		SERVOUNITYLOGe("Unable to create EGL surface.\n");
-		m_GLES.Cleanup();
 		m_servoTexPtr->Release();
+		m_servoTexPtr = nullptr;
 		return false;
 	}
 	m_GLES.MakeCurrent(m_EGLSurface);
@@ -145,11 +197,92 @@ bool ServoUnityWindowDX11::initRenderer(CInitOptions cio, void (*wakeup)(void),
 	if ((m_texID = m_GLES.CreateSurfaceTexture(m_EGLSurface)) == 0) {
 		SERVOUNITYLOGe("Unable to create surface texture.\n");
 		m_GLES.DestroySurface(&m_EGLSurface);
-		m_GLES.Cleanup();
 		m_servoTexPtr->Release();
+		m_servoTexPtr = nullptr;
 		return false;
 	};
 
+	return true;
+}
+
+void ServoUnityWindowDX11::destroyServoTexture(ServoTexture& st) {
+	if (st.texID) m_GLES.DestroySurfaceTexture(&st.texID, st.surface);
+	if (st.surface != EGL_NO_SURFACE) m_GLES.DestroySurface(&st.surface);
+	if (st.tex) {
+		st.tex->Release();
+		st.tex = nullptr;
+	}
+}
+
+void ServoUnityWindowDX11::setNativePtr(void* texPtr) {
+	m_unityTexPtr = texPtr;
+	m_unityTexClearPending = (texPtr != nullptr); // Unity doesn't initialise texture contents, so clear it on the render thread.
+}
+
+void ServoUnityWindowDX11::clearUnityTexture() {
+	D3D11_TEXTURE2D_DESC desc = { 0 };
+	((ID3D11Texture2D*)m_unityTexPtr)->GetDesc(&desc);
+	int format = getServoUnityTextureFormatForDXGIFormat(desc.Format);
+	if (format != ServoUnityTextureFormat_BGRA32 && format != ServoUnityTextureFormat_RGBA32) {
+		SERVOUNITYLOGw("Unable to clear Unity texture with DXGI_FORMAT=%d.\n", desc.Format);
+		return;
+	}
+
+	if (s_blackTile) {
+		D3D11_TEXTURE2D_DESC descTile = { 0 };
+		s_blackTile->GetDesc(&descTile);
+		if (descTile.Format != desc.Format) {
+			s_blackTile->Release();
+			s_blackTile = nullptr;
+		}
+	}
+	if (!s_blackTile) {
+		std::vector<uint32_t> pixels(kBlackTileSize * kBlackTileSize, 0xFF000000); // Opaque black in both RGBA and BGRA byte order.
+		D3D11_TEXTURE2D_DESC descTile = { 0 };
+		descTile.Width = kBlackTileSize;
+		descTile.Height = kBlackTileSize;
+		descTile.Format = desc.Format;
+		descTile.MipLevels = 1;
+		descTile.ArraySize = 1;
+		descTile.SampleDesc.Count = 1;
+		descTile.Usage = D3D11_USAGE_IMMUTABLE;
+		descTile.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		D3D11_SUBRESOURCE_DATA data = { pixels.data(), kBlackTileSize * 4, 0 };
+		HRESULT hr = s_D3D11Device->CreateTexture2D(&descTile, &data, &s_blackTile);
+		if FAILED(hr) {
+			SERVOUNITYLOGe("Error: Unable to create texture.\n");
+			s_blackTile = nullptr;
+			return;
+		}
+	}
+
+	ID3D11DeviceContext* ctx = NULL;
+	s_D3D11Device->GetImmediateContext(&ctx);
+	for (UINT y = 0; y < desc.Height; y += kBlackTileSize) {
+		for (UINT x = 0; x < desc.Width; x += kBlackTileSize) {
+			D3D11_BOX box = { 0, 0, 0, std::min(kBlackTileSize, desc.Width - x), std::min(kBlackTileSize, desc.Height - y), 1 };
+			ctx->CopySubresourceRegion((ID3D11Texture2D*)m_unityTexPtr, 0, x, y, 0, s_blackTile, 0, &box);
+		}
+	}
+	ctx->Release();
+}
+
+void* ServoUnityWindowDX11::nativePtr() {
+	return m_unityTexPtr;
+}
+
+bool ServoUnityWindowDX11::initRenderer(CInitOptions cio, void (*wakeup)(void), CHostCallbacks chc) {
+
+	// Set up EGL context.
+	if (!m_GLES.Initialize()) {
+		SERVOUNITYLOGe("Unable to initialise EGL.\n");
+		return false;
+	}
+	if (!acquireServoTexture()) {
+		m_GLES.Cleanup();
+		return false;
+	}
+
     // init_with_egl will capture the active EGL context for later use by fill_gl_texture.
     // This will be the Unity EGL context.
     init_with_egl(cio, wakeup, chc);
@@ -158,37 +291,56 @@ bool ServoUnityWindowDX11::initRenderer(CInitOptions cio, void (*wakeup)(void),
 
 void ServoUnityWindowDX11::cleanupRenderer()
 {
-	m_GLES.DestroySurfaceTexture(&m_texID, m_EGLSurface);
-	m_GLES.DestroySurface(&m_EGLSurface);
+	releaseServoTexture();
+	flushServoTexturePool();
 	m_GLES.Cleanup();
-	m_servoTexPtr->Release();
 
 	ServoUnityWindow::cleanupRenderer();
 }
 
-void ServoUnityWindowDX11::requestUpdate(float timeDelta) {
-    SERVOUNITYLOGd("ServoUnityWindowDX11::requestUpdate(%f)\n", timeDelta);
+void ServoUnityWindowDX11::performUpdates() {
+	// Servo renders with the EGL context that was current when it was initialised, but other windows'
+	// updates may since have made their own contexts current.
+	if (m_EGLSurface != EGL_NO_SURFACE) m_GLES.MakeCurrent(m_EGLSurface);
+
+	ServoUnityWindow::performUpdates();
+}
+
+void ServoUnityWindowDX11::updateTexture() {
+    SERVOUNITYLOGd("ServoUnityWindowDX11::updateTexture()\n");
+
+	if (m_unityTexClearPending && m_unityTexPtr) {
+		clearUnityTexture();
+		m_unityTexClearPending = false;
+		snapshotTextureCleared();
+	}
 
-    ServoUnityWindow::requestUpdate(timeDelta);
+	if (!snapshotBeginFrame()) return;
+
+	if (!m_servoTexPtr) {
+		SERVOUNITYLOGi("ServoUnityWindowDX11::updateTexture() null m_servoTexPtr.\n");
+		snapshotEndFrame(false);
+		return;
+	}
 
 	m_GLES.MakeCurrent(m_EGLSurface);
 
 	if (!fill_gl_texture(m_texID, m_size.w, m_size.h)) {
-		SERVOUNITYLOGd("ServoUnityWindowDX11::requestUpdate no buffer pending.\n");
+		SERVOUNITYLOGd("ServoUnityWindowDX11::updateTexture no buffer pending.\n");
+		snapshotEndFrame(false);
 		return;
 	}
+	ServoUnityStartupTimeline::mark(ServoUnityStartupPhase_FirstFrame);
 
 	// Need to flush here to ensure writes have finished before we use in DirectX.
 	glFlush();
 
-	if (!m_servoTexPtr) {
-		SERVOUNITYLOGi("ServoUnityWindowDX11::requestUpdate() null m_servoTexPtr.\n");
-		return;
-	}
 	if (!m_unityTexPtr) {
-		SERVOUNITYLOGi("ServoUnityWindowDX11::requestUpdate() null m_unityTexPtr.\n");
+		SERVOUNITYLOGi("ServoUnityWindowDX11::updateTexture() null m_unityTexPtr.\n");
+		snapshotEndFrame(false);
 		return;
 	}
+	bool copied = false;
 
 	ID3D11DeviceContext* ctx = NULL;
 	s_D3D11Device->GetImmediateContext(&ctx);
@@ -199,13 +351,104 @@ void ServoUnityWindowDX11::requestUpdate(float timeDelta) {
 
 	D3D11_TEXTURE2D_DESC descServo = { 0 };
 	m_servoTexPtr->GetDesc(&descServo);
-	if (descServo.Width != descUnity.Width || descServo.Height != descServo.Height) {
-		SERVOUNITYLOGe("Error: Unity texture size %dx%d does not match Servo texture size %dx%d.\n", descUnity.Width, descUnity.Height, descServo.Width, descServo.Height);
+	if (descServo.Width != descUnity.Width || descServo.Height != descUnity.Height) {
+		// Expected briefly after a resize, until Unity has supplied a texture of the new size.
+		SERVOUNITYLOGd("Unity texture size %dx%d does not match Servo texture size %dx%d.\n", descUnity.Width, descUnity.Height, descServo.Width, descServo.Height);
 	} else {
 		ctx->CopyResource((ID3D11Texture2D*)m_unityTexPtr, m_servoTexPtr);
+		copied = true;
 	}
 
 	ctx->Release();
+	snapshotEndFrame(copied);
+}
+
+// Snapshots are RGBA; swap red and blue for BGRA textures.
+static void swizzleRB(uint8_t *pixels, size_t pixelCount)
+{
+	for (size_t i = 0; i < pixelCount; i++, pixels += 4) std::swap(pixels[0], pixels[2]);
+}
+
+bool ServoUnityWindowDX11::beginReadTexture(int maxDimension) {
+	if (!m_unityTexPtr || !s_D3D11Device || m_readbackStaging) return false;
+	D3D11_TEXTURE2D_DESC desc = { 0 };
+	((ID3D11Texture2D*)m_unityTexPtr)->GetDesc(&desc);
+	int format = getServoUnityTextureFormatForDXGIFormat(desc.Format);
+	if (format != ServoUnityTextureFormat_BGRA32 && format != ServoUnityTextureFormat_RGBA32) return false;
+
+	D3D11_TEXTURE2D_DESC descStaging = desc;
+	descStaging.MipLevels = 1;
+	descStaging.Usage = D3D11_USAGE_STAGING;
+	descStaging.BindFlags = 0;
+	descStaging.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+	descStaging.MiscFlags = 0;
+	if FAILED(s_D3D11Device->CreateTexture2D(&descStaging, nullptr, &m_readbackStaging)) {
+		SERVOUNITYLOGe("Error: Unable to create staging texture.\n");
+		m_readbackStaging = nullptr;
+		return false;
+	}
+	// The copy is queued; finishReadTexture() maps the staging texture once the GPU has done it.
+	ID3D11DeviceContext* ctx = NULL;
+	s_D3D11Device->GetImmediateContext(&ctx);
+	ctx->CopySubresourceRegion(m_readbackStaging, 0, 0, 0, 0, (ID3D11Texture2D*)m_unityTexPtr, 0, nullptr);
+	ctx->Release();
+	m_readbackFormat = format;
+	m_readbackMaxDimension = maxDimension;
+	return true;
+}
+
+ServoUnityWindow::ReadbackStatus ServoUnityWindowDX11::finishReadTexture(bool wait, std::vector<uint8_t>& rgba, int *width, int *height) {
+	if (!m_readbackStaging || !s_D3D11Device) return ReadbackStatus::Failed;
+	ID3D11DeviceContext* ctx = NULL;
+	s_D3D11Device->GetImmediateContext(&ctx);
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = ctx->Map(m_readbackStaging, 0, D3D11_MAP_READ, wait ? 0 : D3D11_MAP_FLAG_DO_NOT_WAIT, &mapped);
+	if (hr == DXGI_ERROR_WAS_STILL_DRAWING) {
+		ctx->Release();
+		return ReadbackStatus::Pending;
+	}
+	bool ok = SUCCEEDED(hr);
+	if (ok) {
+		D3D11_TEXTURE2D_DESC desc = { 0 };
+		m_readbackStaging->GetDesc(&desc);
+		int w, h;
+		ServoUnitySnapshotCache::fitSize((int)desc.Width, (int)desc.Height, m_readbackMaxDimension, &w, &h);
+		rgba.resize((size_t)w * h * 4);
+		ServoUnitySnapshotCache::downsample((const uint8_t *)mapped.pData, (int)desc.Width, (int)desc.Height, mapped.RowPitch, rgba.data(), w, h);
+		ctx->Unmap(m_readbackStaging, 0);
+		if (m_readbackFormat == ServoUnityTextureFormat_BGRA32) swizzleRB(rgba.data(), (size_t)w * h);
+		*width = w;
+		*height = h;
+	}
+	ctx->Release();
+	cancelReadTexture();
+	return ok ? ReadbackStatus::Ready : ReadbackStatus::Failed;
+}
+
+void ServoUnityWindowDX11::cancelReadTexture() {
+	if (m_readbackStaging) {
+		m_readbackStaging->Release();
+		m_readbackStaging = nullptr;
+	}
+}
+
+bool ServoUnityWindowDX11::drawTexture(const uint8_t *rgba, int width, int height) {
+	if (!m_unityTexPtr || !s_D3D11Device || width <= 0 || height <= 0) return false;
+	D3D11_TEXTURE2D_DESC desc = { 0 };
+	((ID3D11Texture2D*)m_unityTexPtr)->GetDesc(&desc);
+	int format = getServoUnityTextureFormatForDXGIFormat(desc.Format);
+	if (format != ServoUnityTextureFormat_BGRA32 && format != ServoUnityTextureFormat_RGBA32) return false;
+
+	size_t rowBytes = (size_t)desc.Width * 4;
+	std::vector<uint8_t> pixels(rowBytes * desc.Height);
+	ServoUnitySnapshotCache::upsample(rgba, width, height, pixels.data(), (int)desc.Width, (int)desc.Height, rowBytes);
+	if (format == ServoUnityTextureFormat_BGRA32) swizzleRB(pixels.data(), (size_t)desc.Width * desc.Height);
+
+	ID3D11DeviceContext* ctx = NULL;
+	s_D3D11Device->GetImmediateContext(&ctx);
+	ctx->UpdateSubresource((ID3D11Texture2D*)m_unityTexPtr, 0, nullptr, pixels.data(), (UINT)rowBytes, 0);
+	ctx->Release();
+	return true;
 }
 
 #endif // SUPPORT_D3D11
@@ -17,6 +17,7 @@
 #if SUPPORT_D3D11
 #include <cstdint>
 #include <string>
+#include <deque>
 #include <d3d11.h>
 #include "IUnityInterface.h"
 #include "OpenGLES.h"
@@ -33,6 +34,28 @@ private:
 	EGLSurface m_EGLSurface;
 	GLuint m_texID; // For DX11, the GL texID is generated by ANGLE, not from Unity...
 	void *m_unityTexPtr; // ... so we need a separate variable to hold the native pointer from Unity.
+	bool m_unityTexClearPending;
+	ID3D11Texture2D* m_readbackStaging; // Copy of the Unity texture for a read in progress.
+	int m_readbackFormat;
+	int m_readbackMaxDimension;
+
+	void clearUnityTexture();
+
+	// Textures (and their EGL surfaces) no longer in use are kept for reuse
+	// by a later resize to the same size, up to a small limit.
+	struct ServoTexture {
+		ID3D11Texture2D* tex;
+		EGLSurface surface;
+		GLuint texID;
+		Size size;
+	};
+	std::deque<ServoTexture> m_servoTexturePool; // Most recently used first.
+
+	bool createServoTexture();
+	bool acquireServoTexture();
+	void releaseServoTexture();
+	void destroyServoTexture(ServoTexture& st);
+	void flushServoTexturePool();
 
 public:
 	static void initDevice(IUnityInterfaces* unityInterfaces);
@@ -51,9 +74,18 @@ public:
 	void setNativePtr(void* texPtr) override;
 	void* nativePtr() override;
 
-	void requestUpdate(float timeDelta) override;
+	void performUpdates() override;
+	void updateTexture() override;
     bool initRenderer(CInitOptions cio, void (*wakeup)(void), CHostCallbacks chc) override;
 	void cleanupRenderer() override;
+	void releaseCaches() override { flushServoTexturePool(); }
+	uint64_t textureBytes() override;
+
+protected:
+	bool beginReadTexture(int maxDimension) override;
+	ReadbackStatus finishReadTexture(bool wait, std::vector<uint8_t>& rgba, int *width, int *height) override;
+	void cancelReadTexture() override;
+	bool drawTexture(const uint8_t *rgba, int width, int height) override;
 };
 
 #endif // SUPPORT_D3D11
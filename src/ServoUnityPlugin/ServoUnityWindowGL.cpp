@@ -23,10 +23,35 @@
 #  include <GL/glcorearb.h>
 #endif
 #include <stdlib.h>
+#include <string.h>
+#include <mutex>
+#include <utility>
+#include <vector>
 #include "servo_unity_internal.h"
 #include "servo_unity_log.h"
+#include "ServoUnityStartupTimeline.h"
+#include "ServoUnitySnapshotCache.h"
 #include "utils.h"
 
+static const GLuint64 kReadbackWaitMax = 100000000ull; // Nanoseconds.
+
+// Readback buffers and fences of windows deleted off the render thread, where GL can't be called.
+// They are deleted by the next render-thread call to deleteOrphanedReadbacks().
+static std::mutex s_orphanedReadbacksLock;
+static std::vector<std::pair<GLuint, GLsync>> s_orphanedReadbacks;
+
+static void deleteOrphanedReadbacks() {
+    std::vector<std::pair<GLuint, GLsync>> orphans;
+    {
+        std::lock_guard<std::mutex> lock(s_orphanedReadbacksLock);
+        if (s_orphanedReadbacks.empty()) return;
+        orphans.swap(s_orphanedReadbacks);
+    }
+    for (auto& orphan : orphans) {
+        if (orphan.second) glDeleteSync(orphan.second);
+        if (orphan.first) glDeleteBuffers(1, &orphan.first);
+    }
+}
 
 void ServoUnityWindowGL::initDevice() {
 #ifdef _WIN32
@@ -35,17 +60,28 @@ void ServoUnityWindowGL::initDevice() {
 }
 
 void ServoUnityWindowGL::finalizeDevice() {
+	deleteOrphanedReadbacks();
 }
 
 ServoUnityWindowGL::ServoUnityWindowGL(int uid, int uidExt, Size size) :
 	ServoUnityWindow(uid, uidExt),
 	m_size(size),
 	m_texID(0),
-	m_format(ServoUnityTextureFormat_RGBA32) // Servo's default.
+	m_texSize({0, 0}),
+	m_texSizeValid(false),
+	m_format(ServoUnityTextureFormat_RGBA32), // Servo's default.
+	m_readbackBuffer(0),
+	m_readbackFence(nullptr),
+	m_readbackSize({0, 0})
 {
 }
 
 ServoUnityWindowGL::~ServoUnityWindowGL() {
+    // Windows are deleted on the main thread, so hand any read in progress to the render thread to delete.
+    if (m_readbackBuffer || m_readbackFence) {
+        std::lock_guard<std::mutex> lock(s_orphanedReadbacksLock);
+        s_orphanedReadbacks.emplace_back(m_readbackBuffer, (GLsync)m_readbackFence);
+    }
 }
 
 bool ServoUnityWindowGL::init(PFN_WINDOWCREATEDCALLBACK windowCreatedCallback, PFN_WINDOWRESIZEDCALLBACK windowResizedCallback, PFN_BROWSEREVENTCALLBACK browserEventCallback, const std::string& userAgent)
@@ -63,12 +99,11 @@ ServoUnityWindow::Size ServoUnityWindowGL::size() {
 
 void ServoUnityWindowGL::setSize(ServoUnityWindow::Size size) {
 	m_size = size;
-
-    if (m_windowResizedCallback) (*m_windowResizedCallback)(m_uidExt, m_size.w, m_size.h);
 }
 
 void ServoUnityWindowGL::setNativePtr(void* texPtr) {
 	m_texID = (uint32_t)((uintptr_t)texPtr); // Truncation to 32-bits is the desired behaviour.
+	m_texSizeValid = false; // New texture will be inspected and cleared on the render thread.
 }
 
 void* ServoUnityWindowGL::nativePtr() {
@@ -82,16 +117,203 @@ bool ServoUnityWindowGL::initRenderer(CInitOptions cio, void (*wakeup)(void), CH
 	return true;
 }
 
-void ServoUnityWindowGL::requestUpdate(float timeDelta) {
-    SERVOUNITYLOGd("ServoUnityWindowGL::requestUpdate(%f)\n", timeDelta);
+void ServoUnityWindowGL::clearTexture() {
+    GLint fboPrev, viewportPrev[4];
+    GLfloat clearColorPrev[4];
+    GLuint fbo;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &fboPrev);
+    glGetIntegerv(GL_VIEWPORT, viewportPrev);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColorPrev);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texID, 0);
+    if (glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+        glViewport(0, 0, m_texSize.w, m_texSize.h);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glClearColor(clearColorPrev[0], clearColorPrev[1], clearColorPrev[2], clearColorPrev[3]);
+        glViewport(viewportPrev[0], viewportPrev[1], viewportPrev[2], viewportPrev[3]);
+    } else {
+        SERVOUNITYLOGw("Unable to clear texture %u.\n", m_texID);
+    }
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)fboPrev);
+    glDeleteFramebuffers(1, &fbo);
+}
+
+void ServoUnityWindowGL::updateTexture() {
+    SERVOUNITYLOGd("ServoUnityWindowGL::updateTexture()\n");
+
+    deleteOrphanedReadbacks();
+    if (!m_texID) return;
+
+    // Unity doesn't initialise the contents of the textures it gives us, so clear each new one
+    // to opaque black on the GPU.
+    if (!m_texSizeValid) {
+        GLint w, h;
+        glBindTexture(GL_TEXTURE_2D, m_texID);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        m_texSize = {w, h};
+        m_texSizeValid = true;
+        clearTexture();
+        snapshotTextureCleared();
+    }
+
+    if (!snapshotBeginFrame()) return;
+
+    // After a resize, Unity's texture won't match the Servo size until Unity has been notified
+    // and supplied a new texture. Until then, leave the old texture contents in place.
+    if (m_texSize.w != m_size.w || m_texSize.h != m_size.h) {
+        SERVOUNITYLOGd("ServoUnityWindowGL::updateTexture Unity texture size %dx%d does not match Servo size %dx%d.\n", m_texSize.w, m_texSize.h, m_size.w, m_size.h);
+        snapshotEndFrame(false);
+        return;
+    }
 
-    ServoUnityWindow::requestUpdate(timeDelta);
-        
     // fill_gl_texture sets the GL context to the same Unity GL context.
 	if (!fill_gl_texture(m_texID, m_size.w, m_size.h)) {
-		SERVOUNITYLOGd("ServoUnityWindowGL::requestUpdate no buffer pending.\n");
+		SERVOUNITYLOGd("ServoUnityWindowGL::updateTexture no buffer pending.\n");
+		snapshotEndFrame(false);
 		return;
 	}
+	ServoUnityStartupTimeline::mark(ServoUnityStartupPhase_FirstFrame);
+	snapshotEndFrame(true);
+}
+
+// GL rows run bottom to top; snapshots' run top to bottom.
+static void flipRows(std::vector<uint8_t>& rgba, int width, int height)
+{
+    size_t rowBytes = (size_t)width * 4;
+    std::vector<uint8_t> row(rowBytes);
+    for (int y = 0; y < height / 2; y++) {
+        uint8_t *a = &rgba[y * rowBytes];
+        uint8_t *b = &rgba[(height - 1 - y) * rowBytes];
+        memcpy(row.data(), a, rowBytes);
+        memcpy(a, b, rowBytes);
+        memcpy(b, row.data(), rowBytes);
+    }
+}
+
+bool ServoUnityWindowGL::beginReadTexture(int maxDimension) {
+    if (!m_texID || !m_texSizeValid || m_texSize.w <= 0 || m_texSize.h <= 0 || m_readbackFence) return false;
+    int w, h;
+    ServoUnitySnapshotCache::fitSize(m_texSize.w, m_texSize.h, maxDimension, &w, &h);
+
+    // Downscale on the GPU, so that only the small image is read back, and read it into a pixel buffer,
+    // which finishReadTexture() maps once the GPU is done, rather than stalling here in glReadPixels.
+    GLint readPrev, drawPrev, rbPrev, packPrev, packBufferPrev;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readPrev);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawPrev);
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &rbPrev);
+    glGetIntegerv(GL_PACK_ALIGNMENT, &packPrev);
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBufferPrev);
+    GLuint fbo[2], rb;
+    glGenFramebuffers(2, fbo);
+    glGenRenderbuffers(1, &rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, rb);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[0]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texID, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[1]);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rb);
+    bool ok = (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE && glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    if (ok) {
+        glBlitFramebuffer(0, 0, m_texSize.w, m_texSize.h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[1]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glGenBuffers(1, &m_readbackBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)w * h * 4, nullptr, GL_STREAM_READ);
+        glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        m_readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_readbackSize = {w, h};
+    } else {
+        SERVOUNITYLOGw("Unable to read back texture %u.\n", m_texID);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, (GLuint)packBufferPrev);
+    glPixelStorei(GL_PACK_ALIGNMENT, packPrev);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)readPrev);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)drawPrev);
+    glBindRenderbuffer(GL_RENDERBUFFER, (GLuint)rbPrev);
+    glDeleteRenderbuffers(1, &rb);
+    glDeleteFramebuffers(2, fbo);
+    return ok;
+}
+
+ServoUnityWindow::ReadbackStatus ServoUnityWindowGL::finishReadTexture(bool wait, std::vector<uint8_t>& rgba, int *width, int *height) {
+    if (!m_readbackFence) return ReadbackStatus::Failed;
+    GLenum result = glClientWaitSync((GLsync)m_readbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? kReadbackWaitMax : 0);
+    if (result == GL_TIMEOUT_EXPIRED && !wait) return ReadbackStatus::Pending;
+
+    bool ok = (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED);
+    if (ok) {
+        int w = m_readbackSize.w, h = m_readbackSize.h;
+        GLint packBufferPrev;
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBufferPrev);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffer);
+        const void *pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)w * h * 4, GL_MAP_READ_BIT);
+        ok = (pixels != nullptr);
+        if (ok) {
+            rgba.assign((const uint8_t *)pixels, (const uint8_t *)pixels + (size_t)w * h * 4);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            flipRows(rgba, w, h);
+            *width = w;
+            *height = h;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, (GLuint)packBufferPrev);
+    }
+    if (!ok) SERVOUNITYLOGw("Unable to read back texture %u.\n", m_texID);
+    cancelReadTexture();
+    return ok ? ReadbackStatus::Ready : ReadbackStatus::Failed;
+}
+
+void ServoUnityWindowGL::cancelReadTexture() {
+    if (m_readbackFence) {
+        glDeleteSync((GLsync)m_readbackFence);
+        m_readbackFence = nullptr;
+    }
+    if (m_readbackBuffer) {
+        glDeleteBuffers(1, &m_readbackBuffer);
+        m_readbackBuffer = 0;
+    }
+}
+
+bool ServoUnityWindowGL::drawTexture(const uint8_t *rgba, int width, int height) {
+    if (!m_texID || !m_texSizeValid || width <= 0 || height <= 0) return false;
+    std::vector<uint8_t> flipped(rgba, rgba + (size_t)width * height * 4);
+    flipRows(flipped, width, height);
+
+    // Upload at snapshot size, and let the GPU scale it up.
+    GLint texPrev, readPrev, drawPrev, unpackPrev;
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &texPrev);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readPrev);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawPrev);
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpackPrev);
+    GLuint tex, fbo[2];
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, flipped.data());
+    glGenFramebuffers(2, fbo);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo[0]);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[1]);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_texID, 0);
+    bool ok = (glCheckFramebufferStatus(GL_READ_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE && glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+    if (ok) {
+        glBlitFramebuffer(0, 0, width, height, 0, 0, m_texSize.w, m_texSize.h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    } else {
+        SERVOUNITYLOGw("Unable to draw snapshot into texture %u.\n", m_texID);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpackPrev);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, (GLuint)readPrev);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, (GLuint)drawPrev);
+    glBindTexture(GL_TEXTURE_2D, (GLuint)texPrev);
+    glDeleteFramebuffers(2, fbo);
+    glDeleteTextures(1, &tex);
+    return ok;
 }
 
 #endif // SUPPORT_OPENGL_CORE
@@ -21,7 +21,15 @@ class ServoUnityWindowGL : public ServoUnityWindow
 private:
 	Size m_size;
 	uint32_t m_texID; // For OpenGL, the GL texID and Unity's native texture pointer are one and the same.
+	Size m_texSize; // Size of the Unity texture m_texID.
+	bool m_texSizeValid;
+
 	int m_format;
+	uint32_t m_readbackBuffer; // GL pixel pack buffer of a read in progress.
+	void *m_readbackFence; // GLsync, signalled when m_readbackBuffer has been filled.
+	Size m_readbackSize;
+
+	void clearTexture();
 
 public:
 	static void initDevice(IUnityInterfaces* unityInterfaces);
@@ -40,8 +48,14 @@ public:
 	void setNativePtr(void* texPtr) override;
 	void* nativePtr() override;
 
-	void requestUpdate(float timeDelta) override;
+	void updateTexture() override;
 	bool initRenderer(CInitOptions cio, void (*wakeup)(void), CHostCallbacks chc) override;
+
+protected:
+	bool beginReadTexture(int maxDimension) override;
+	ReadbackStatus finishReadTexture(bool wait, std::vector<uint8_t>& rgba, int *width, int *height) override;
+	void cancelReadTexture() override;
+	bool drawTexture(const uint8_t *rgba, int width, int height) override;
 	//void cleanupRenderer() override;
 };
 
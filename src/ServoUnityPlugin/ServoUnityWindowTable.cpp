@@ -0,0 +1,119 @@
+//
+// ServoUnityWindowTable.cpp
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+
+#include "ServoUnityWindowTable.h"
+#include "ServoUnityWindow.h"
+#include "ServoUnityEpoch.h"
+#include "servo_unity_log.h"
+#include <climits>
+
+static const uint32_t kGenerationMax = (uint32_t)(INT_MAX >> ServoUnityWindowTable::kSlotBits); // Keeps indices positive.
+
+ServoUnityWindowTable::ServoUnityWindowTable() :
+    m_slotsUsed(0),
+    m_count(0)
+{
+    for (int i = 0; i < kCapacity; i++) {
+        m_slots[i].store(nullptr);
+        m_generations[i] = 0;
+    }
+}
+
+ServoUnityWindowTable::~ServoUnityWindowTable()
+{
+    // No readers remain at this point, so delete directly.
+    for (int i = 0; i < kCapacity; i++) delete m_slots[i].exchange(nullptr);
+    for (ServoUnityWindow *window : m_removedRunning) delete window;
+}
+
+int ServoUnityWindowTable::insert(std::function<std::unique_ptr<ServoUnityWindow>(int index)> make)
+{
+    std::lock_guard<std::mutex> lock(m_writeLock);
+
+    int slot = 0;
+    while (slot < kCapacity && m_slots[slot].load()) slot++;
+    if (slot == kCapacity) {
+        SERVOUNITYLOGe("Cannot create window. Maximum of %d windows are already open.\n", kCapacity);
+        return 0;
+    }
+
+    uint32_t generation = m_generations[slot] + 1;
+    if (generation > kGenerationMax) generation = 1;
+    int index = (int)(generation << kSlotBits) | slot;
+
+    std::unique_ptr<ServoUnityWindow> window = make(index);
+    if (!window) return 0;
+
+    m_generations[slot] = generation;
+    m_slots[slot].store(window.release(), std::memory_order_release);
+    if (slot >= m_slotsUsed.load()) m_slotsUsed.store(slot + 1);
+    m_count++;
+    return index;
+}
+
+bool ServoUnityWindowTable::remove(int index)
+{
+    if (index <= 0) return false;
+    std::lock_guard<std::mutex> lock(m_writeLock);
+
+    int slot = index & (kCapacity - 1);
+    ServoUnityWindow *window = m_slots[slot].load();
+    if (!window || window->uid() != index) return false;
+    retire(slot);
+    return true;
+}
+
+void ServoUnityWindowTable::removeAll(void)
+{
+    std::lock_guard<std::mutex> lock(m_writeLock);
+
+    int slotsUsed = m_slotsUsed.load();
+    for (int i = 0; i < slotsUsed; i++) {
+        if (m_slots[i].load()) retire(i);
+    }
+}
+
+void ServoUnityWindowTable::retire(int slot)
+{
+    ServoUnityWindow *window = m_slots[slot].exchange(nullptr);
+    m_count--;
+    if (window->markRemoved()) {
+        // Its instance slot must stay taken until Servo's engine is deinitialised, and Servo's callbacks,
+        // including the one cleanupRenderer() waits for, must still reach the window until then.
+        m_removedRunning.push_back(window);
+        return;
+    }
+    ServoUnityEpoch::retire([window] { delete window; });
+}
+
+void ServoUnityWindowTable::cleanupRemoved(void)
+{
+    std::vector<ServoUnityWindow *> windows;
+    {
+        std::lock_guard<std::mutex> lock(m_writeLock);
+        if (m_removedRunning.empty()) return;
+        windows.swap(m_removedRunning);
+    }
+    for (ServoUnityWindow *window : windows) {
+        SERVOUNITYLOGi("Window %d was closed with Servo running. Shutting Servo down.\n", window->uid());
+        if (window->hasInstance()) window->cleanupRenderer();
+        ServoUnityEpoch::retire([window] { delete window; });
+    }
+}
+
+ServoUnityWindow *ServoUnityWindowTable::get(int index) const
+{
+    if (index <= 0) return nullptr;
+    ServoUnityWindow *window = m_slots[index & (kCapacity - 1)].load(std::memory_order_acquire);
+    // The slot may have been reused by a later window.
+    return (window && window->uid() == index) ? window : nullptr;
+}
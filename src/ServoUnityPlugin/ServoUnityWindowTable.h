@@ -0,0 +1,78 @@
+//
+// ServoUnityWindowTable.h
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0.If a copy of the MPL was not distributed with this
+// file, You can obtain one at https ://mozilla.org/MPL/2.0/.
+//
+// Copyright (c) 2019-2020 Mozilla, Inc.
+//
+// Author(s): Philip Lamb
+//
+// Table of open windows, readable from any thread without locking.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class ServoUnityWindow;
+
+//
+// Windows live in a fixed array of slots. A window's index encodes its slot
+// in the low kSlotBits bits and the slot's generation above that, so lookup
+// is a single array access, and an index held after its window has closed
+// will not find a later window reusing the same slot.
+//
+// Lookups are lock-free, but must be made inside a ServoUnityEpochGuard, which
+// must be held for as long as the returned window is used. Removed windows
+// are deleted by ServoUnityEpoch::collect() once no reader can still see them.
+// A window removed with its Servo instance still running is first handed to
+// the render thread, which shuts Servo down in cleanupRemoved().
+//
+class ServoUnityWindowTable
+{
+public:
+    static const int kSlotBits = 8;
+    static const int kCapacity = 1 << kSlotBits;
+
+    ServoUnityWindowTable();
+    ~ServoUnityWindowTable();
+
+    /// Allocate an index and insert the window make() creates for it. Must be called from main thread.
+    /// Returns the new window's index, or 0 if the table is full or make() returned nullptr.
+    int insert(std::function<std::unique_ptr<ServoUnityWindow>(int index)> make);
+    /// Remove a window, and retire it for deletion. Must be called from main thread.
+    bool remove(int index);
+    void removeAll(void);
+    /// Shut down the Servo instances of windows removed while still running, and retire them for deletion.
+    /// Must be called from render thread.
+    void cleanupRemoved(void);
+
+    /// Returns nullptr if no window with this index is open.
+    ServoUnityWindow *get(int index) const;
+    int count(void) const { return m_count.load(); }
+
+    /// Call f for each open window, in slot order.
+    template <typename F> void forEach(F f) const {
+        int slotsUsed = m_slotsUsed.load();
+        for (int i = 0; i < slotsUsed; i++) {
+            ServoUnityWindow *window = m_slots[i].load(std::memory_order_acquire);
+            if (window) f(window);
+        }
+    }
+
+private:
+    std::atomic<ServoUnityWindow *> m_slots[kCapacity];
+    uint32_t m_generations[kCapacity]; // Guarded by m_writeLock.
+    std::atomic<int> m_slotsUsed; // One past the highest slot ever used.
+    std::atomic<int> m_count;
+    std::mutex m_writeLock;
+    std::vector<ServoUnityWindow *> m_removedRunning; // Awaiting cleanupRemoved(). Guarded by m_writeLock.
+    void retire(int slot);
+};
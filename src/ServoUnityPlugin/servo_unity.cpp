@@ -18,9 +18,26 @@
 
 #include "ServoUnityWindowDX11.h"
 #include "ServoUnityWindowGL.h"
+#include "ServoUnityWindowTable.h"
+#include "ServoUnityEpoch.h"
+#include "ServoUnityStartupTimeline.h"
+#include "ServoUnityGStreamerRegistry.h"
+#include "ServoUnityResourceArchive.h"
+#include "ServoUnityNavigationPolicy.h"
+#include "ServoUnityPerformanceProfile.h"
+#include "ServoUnitySnapshotCache.h"
+#include "ServoUnityHTTPProxy.h"
+#include "ServoUnityHistory.h"
+#include "ServoUnityMemoryPressure.h"
 #include <memory>
 #include <assert.h>
-#include <map>
+#include <algorithm>
+#include <set>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include "simpleservo2.h"
 #include "utils.h"
 
@@ -38,6 +55,8 @@ static IUnityInterfaces* s_UnityInterfaces = NULL;
 static IUnityGraphics* s_Graphics = NULL;
 static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType eventType);
 static char *s_ResourcesPath = NULL;
+static std::shared_ptr<const ServoUnityResourceArchive> s_resourceArchive; // Access only via std::atomic_load/store.
+static std::shared_ptr<const ServoUnityNavigationPolicy> s_navigationPolicy; // Access only via std::atomic_load/store.
 
 // --------------------------------------------------------------------------
 
@@ -46,8 +65,23 @@ static PFN_WINDOWRESIZEDCALLBACK m_windowResizedCallback = nullptr;
 static PFN_BROWSEREVENTCALLBACK m_browserEventCallback = nullptr;
 static char* m_userAgent = nullptr;
 
-static std::map<int, std::unique_ptr<ServoUnityWindow>> s_windows;
-static int s_windowIndexNext = 1;
+// Read from the render thread as well as the main thread. See ServoUnityWindowTable.h.
+static ServoUnityWindowTable s_windows;
+
+static int s_prewarmWindowIndex = 0; // Hidden window awaiting adoption by servoUnityRequestNewWindow. Main thread only.
+static std::atomic<int> s_prewarmRendererWindowIndex(0); // Prewarm window whose Servo a prewarm render event has yet to start.
+static std::set<int> s_detachedWindowIndices; // Windows detached from Unity by servoUnityDetachWindow. Main thread only.
+
+// Events not specific to a window, delivered by servoUnityServicePluginEvents.
+typedef struct { int eventType; int eventData1; int eventData2; } PLUGINEVENT;
+static std::deque<PLUGINEVENT> s_pluginEvents;
+static std::mutex s_pluginEventsLock;
+
+void servoUnityQueuePluginEvent(int eventType, int eventData1, int eventData2)
+{
+    std::lock_guard<std::mutex> lock(s_pluginEventsLock);
+    s_pluginEvents.push_back({eventType, eventData1, eventData2});
+}
 
 static const char *s_servoVersion = nullptr; // To avoid repeated leaking of servo's version string, we'll stash it here.
 
@@ -57,6 +91,23 @@ static const char *s_servoVersion = nullptr; // To avoid repeated leaking of ser
 bool s_param_CloseNativeWindowOnClose = true;
 std::string s_param_SearchURI = SEARCH_URI_DEFAULT;
 std::string s_param_Homepage = HOMEPAGE_DEFAULT;
+bool s_param_DynamicResolution = false;
+float s_param_FrameTimeBudget = 1000.0f / 60.0f;
+float s_param_DynamicResolutionMinScale = 0.25f;
+float s_param_ResizeSettleTime = 250.0f;
+int s_param_PerformanceProfile = ServoUnityPerformanceProfile_Default;
+bool s_param_BatchInput = true;
+float s_param_KineticScrollFriction = 0.135f;
+bool s_param_TouchGestures = true;
+float s_param_PinchThreshold = 24.0f;
+float s_param_PanThreshold = 12.0f;
+bool s_param_Snapshots = true;
+std::string s_param_CachePath;
+std::string s_param_HTTPCachePath;
+int s_param_HTTPCacheSize = 256;
+std::string s_param_HistoryPath;
+bool s_param_MemoryPressureResponse = true;
+int s_param_TextureBudgetMB = 0;
 
 // --------------------------------------------------------------------------
 
@@ -135,20 +186,15 @@ static void UNITY_INTERFACE_API OnGraphicsDeviceEvent(UnityGfxDeviceEventType ev
 	};
 }
 
-static int s_RenderEventFunc12Param_windowIndex = 0;
+static int s_RenderEventFunc1Param_windowIndex = 0;
 static float s_RenderEventFunc1Param_timeDelta = 0.0f;
 
 void servoUnitySetRenderEventFunc1Params(int windowIndex, float timeDelta)
 {
-	s_RenderEventFunc12Param_windowIndex = windowIndex;
+	s_RenderEventFunc1Param_windowIndex = windowIndex;
 	s_RenderEventFunc1Param_timeDelta = timeDelta;
 }
 
-void servoUnitySetRenderEventFunc2Param(int windowIndex)
-{
-    s_RenderEventFunc12Param_windowIndex = windowIndex;
-}
-
 static void UNITY_INTERFACE_API OnRenderEvent(int eventID)
 {
 	// Unknown / unsupported graphics device type? Do nothing
@@ -162,25 +208,65 @@ static void UNITY_INTERFACE_API OnRenderEvent(int eventID)
 		return;
 	}
 
+	s_windows.cleanupRemoved();
+
 	switch (eventID) {
-	case 1:
-		servoUnityRequestWindowUpdate(s_RenderEventFunc12Param_windowIndex, s_RenderEventFunc1Param_timeDelta);
+	case ServoUnityRenderEventID_UpdateWindow:
+		servoUnityRequestWindowUpdate(s_RenderEventFunc1Param_windowIndex, s_RenderEventFunc1Param_timeDelta);
 		break;
-    case 2:
-        servoUnityCleanupRenderer(s_RenderEventFunc12Param_windowIndex);
-        break;
 	default:
 		break;
 	}
 }
 
 
+static void UNITY_INTERFACE_API OnRenderEventAndData(int eventID, void *data)
+{
+	switch (s_RendererType) {
+	case kUnityGfxRendererD3D11:
+		break;
+	case kUnityGfxRendererOpenGLCore:
+		break;
+	default:
+		SERVOUNITYLOGe("Unsupported renderer.\n");
+		return;
+	}
+	s_windows.cleanupRemoved();
+	if (!data) return;
+
+	switch (eventID) {
+	case ServoUnityRenderEventID_UpdateWindows:
+		{
+			const ServoUnityRenderEventUpdateWindowsData *params = (const ServoUnityRenderEventUpdateWindowsData *)data;
+			int count = params->windowCount;
+			if (count > SERVO_UNITY_RENDER_EVENT_WINDOWS_MAX) count = SERVO_UNITY_RENDER_EVENT_WINDOWS_MAX;
+			servoUnityRequestWindowsUpdate(params->windowIndices, count, params->timeDelta);
+		}
+		break;
+	case ServoUnityRenderEventID_CleanupRenderer:
+		servoUnityCleanupRenderer(((const ServoUnityRenderEventWindowData *)data)->windowIndex);
+		break;
+	case ServoUnityRenderEventID_Prewarm:
+		servoUnityPrewarmRenderer(((const ServoUnityRenderEventWindowData *)data)->windowIndex);
+		break;
+	default:
+		break;
+	}
+}
+
 // GetRenderEventFunc, a function we export which is used to get a rendering event callback function.
 extern "C" UnityRenderingEvent UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetRenderEventFunc()
 {
 	return OnRenderEvent;
 }
 
+// GetRenderEventAndDataFunc, a function we export which is used to get a rendering event callback function
+// which takes a data payload.
+extern "C" UnityRenderingEventAndData UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API GetRenderEventAndDataFunc()
+{
+	return OnRenderEventAndData;
+}
+
 //
 // ServoUnity plugin implementation.
 //
@@ -225,26 +311,69 @@ void servoUnitySetResourcesPath(const char *path)
 		s_ResourcesPath = strdup(path);
 		SERVOUNITYLOGi("Resources path is '%s'.\n", s_ResourcesPath);
 	}
+
+	// Map the resource archive, if present. Readers already holding the previous one keep it alive.
+	std::shared_ptr<const ServoUnityResourceArchive> archive;
+	if (s_ResourcesPath) archive = ServoUnityResourceArchive::open(std::string(s_ResourcesPath) + "/" SERVO_UNITY_RESOURCE_ARCHIVE_NAME);
+	std::atomic_store(&s_resourceArchive, archive);
+	std::shared_ptr<const ServoUnityNavigationPolicy> policy = ServoUnityNavigationPolicy::load(archive);
+	std::atomic_store(&s_navigationPolicy, policy);
+}
+
+std::shared_ptr<const ServoUnityResourceArchive> servoUnityGetResourceArchive(void)
+{
+	return std::atomic_load(&s_resourceArchive);
+}
+
+std::shared_ptr<const ServoUnityNavigationPolicy> servoUnityGetNavigationPolicy(void)
+{
+	return std::atomic_load(&s_navigationPolicy);
 }
 
 void servoUnityInit(PFN_WINDOWCREATEDCALLBACK windowCreatedCallback, PFN_WINDOWRESIZEDCALLBACK windowResizedCallback, PFN_BROWSEREVENTCALLBACK browserEventCallback, const char *userAgent, const char *pluginPathOverride)
 {
+    // Re-initialising with windows still open (e.g. detached across a scene change) isn't a new startup.
+    if (s_windows.count() == 0) ServoUnityStartupTimeline::reset();
+    ServoUnityStartupPhaseScope phase(ServoUnityStartupPhase_Init);
     SERVOUNITYLOGi("servoUnityInit called on thread %" PRIu64 ".\n", getThreadID());
 	m_windowCreatedCallback = windowCreatedCallback;
 	m_windowResizedCallback = windowResizedCallback;
 	m_browserEventCallback = browserEventCallback;
+	free(m_userAgent);
 	m_userAgent = userAgent && userAgent[0] ? strdup(userAgent) : nullptr;
 
     // If a plugin path was passed in, set GStreamer plugins path to this path, and system path to empty.
     if (pluginPathOverride) {
+        ServoUnityStartupPhaseScope phaseGst(ServoUnityStartupPhase_GStreamerEnv);
         SERVOUNITYLOGi("Setting GST_PLUGIN_PATH to '%s', GST_PLUGIN_SYSTEM_PATH to ''.\n", pluginPathOverride);
         setEnvVar("GST_PLUGIN_PATH", pluginPathOverride);
         setEnvVar("GST_PLUGIN_SYSTEM_PATH", "");
+
+        // The registry's contents depend on the GStreamer version as well as the plugins, so salt with Servo's version.
+        if (!s_servoVersion) s_servoVersion = servo_version();
+        ServoUnityGStreamerRegistry::configure(s_ResourcesPath, pluginPathOverride, s_servoVersion);
     }
+
+    // The proxy must be listening before Servo starts, as the environment is read then.
+    if (!s_param_HTTPCachePath.empty() && ServoUnityHTTPProxy::start(s_param_HTTPCachePath, (uint64_t)s_param_HTTPCacheSize * 1024 * 1024)) {
+        std::string proxy = "http://127.0.0.1:" + std::to_string(ServoUnityHTTPProxy::port());
+        setEnvVar("http_proxy", proxy.c_str());
+        setEnvVar("HTTP_PROXY", proxy.c_str());
+    }
+
+    if (s_param_MemoryPressureResponse) ServoUnityMemoryPressure::start();
 }
 
 void servoUnityFinalise(void)
 {
+	ServoUnityMemoryPressure::stop();
+	ServoUnityHistory::stop();
+	ServoUnitySnapshotCache::stop();
+	if (ServoUnityHTTPProxy::port()) {
+		ServoUnityHTTPProxy::stop();
+		setEnvVar("http_proxy", "");
+		setEnvVar("HTTP_PROXY", "");
+	}
 	free(m_userAgent);
 	m_userAgent = nullptr;
 	m_windowCreatedCallback = nullptr;
@@ -252,45 +381,257 @@ void servoUnityFinalise(void)
 	m_browserEventCallback = nullptr;
 }
 
+int servoUnityGetStartupTimeline(double *startMs, double *durationMs, int count)
+{
+	return ServoUnityStartupTimeline::get(startMs, durationMs, count);
+}
+
+uint64_t servoUnityGetNavigationPolicyCounter(int counter)
+{
+	static_assert((int)ServoUnityNavigationPolicy::Counter_Max == ServoUnityNavigationPolicyCounter_Max, "Navigation policy counters must match");
+	std::shared_ptr<const ServoUnityNavigationPolicy> policy = servoUnityGetNavigationPolicy();
+	if (!policy || counter < 0 || counter >= ServoUnityNavigationPolicyCounter_Max) return 0;
+	return policy->counter((ServoUnityNavigationPolicy::Counter)counter);
+}
+
+int servoUnityGetNavigationPolicyRuleCount(void)
+{
+	std::shared_ptr<const ServoUnityNavigationPolicy> policy = servoUnityGetNavigationPolicy();
+	return policy ? policy->ruleCount() : 0;
+}
+
+uint64_t servoUnityGetNavigationPolicyRuleHits(int rule, char *domainBuf, int domainBufLen)
+{
+	std::shared_ptr<const ServoUnityNavigationPolicy> policy = servoUnityGetNavigationPolicy();
+	std::string domain;
+	uint64_t hits = policy ? policy->ruleHits(rule, domainBuf ? &domain : nullptr) : 0;
+	if (domainBuf && domainBufLen > 0) {
+		strncpy(domainBuf, domain.c_str(), domainBufLen - 1);
+		domainBuf[domainBufLen - 1] = '\0';
+	}
+	return hits;
+}
+
+int servoUnityQuerySuggestions(const char *query, int maxResults, char *buf, int bufLen)
+{
+	if (!buf || bufLen <= 0) return 0;
+	buf[0] = '\0';
+	if (!query) return 0;
+	std::vector<ServoUnityHistory::Suggestion> suggestions;
+	ServoUnityHistory::query(query, maxResults, suggestions);
+	int count = 0;
+	size_t used = 0;
+	for (const ServoUnityHistory::Suggestion& s : suggestions) {
+		size_t length = s.URL.size() + 1 + s.title.size() + 1;
+		if (used + length >= (size_t)bufLen) continue; // A shorter one may still fit.
+		used += snprintf(buf + used, bufLen - used, "%s\t%s\n", s.URL.c_str(), s.title.c_str());
+		count++;
+	}
+	return count;
+}
+
+void servoUnityClearHistory(void)
+{
+	ServoUnityHistory::clear();
+}
+
+int servoUnityGetGStreamerRegistryCacheState(double *savedMs)
+{
+	if (savedMs) *savedMs = ServoUnityGStreamerRegistry::savedMs();
+	return ServoUnityGStreamerRegistry::state();
+}
+
 void servoUnityKeyEvent(int windowIndex, int upDown, int keyCode, int character)
 {
-	auto window_iter = s_windows.find(windowIndex);
-	if (window_iter != s_windows.end()) {
-        window_iter->second->keyEvent(upDown, keyCode, character);
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (window) {
+        window->keyEvent(upDown, keyCode, character);
+	}
+}
+
+void servoUnityWindowTextInput(int windowIndex, const char *utf8, int len)
+{
+	if (!utf8) return;
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (window) {
+		window->textInput(utf8, len < 0 ? strlen(utf8) : (size_t)len);
 	}
 }
 
 int servoUnityGetWindowCount(void)
 {
-	return (int)s_windows.size();
+	return s_windows.count() - (s_prewarmWindowIndex ? 1 : 0) - (int)s_detachedWindowIndices.size();
+}
+
+int servoUnityGetWindowCountMax(void)
+{
+	return ServoUnityWindow::instancesSupported();
+}
+
+// Windows beyond the number of Servo instances could never start Servo, so are refused.
+static bool windowAvailable(void)
+{
+	if (s_windows.count() < ServoUnityWindow::instancesSupported()) return true;
+	SERVOUNITYLOGe("Cannot create window. This Servo build can run only %d window(s) at once, including prewarmed and detached windows.\n", ServoUnityWindow::instancesSupported());
+	return false;
 }
 
 bool servoUnityRequestNewWindow(int uidExt, int widthPixelsRequested, int heightPixelsRequested)
 {
-	std::unique_ptr<ServoUnityWindow> window;
+	ServoUnityEpoch::collect();
+
+	if (s_prewarmWindowIndex) {
+		int windowIndex = s_prewarmWindowIndex;
+		s_prewarmWindowIndex = 0;
+		ServoUnityEpochGuard epoch;
+		ServoUnityWindow *window = s_windows.get(windowIndex);
+		if (window) {
+			SERVOUNITYLOGi("Using prewarmed window %d.\n", windowIndex);
+			window->adopt(uidExt, { widthPixelsRequested, heightPixelsRequested });
+			window->setVisible(true);
+			ServoUnityStartupPhaseScope phase(ServoUnityStartupPhase_WindowCreated);
+			if (window->init(m_windowCreatedCallback, m_windowResizedCallback, m_browserEventCallback, m_userAgent ? std::string(m_userAgent) : std::string())) return true;
+			SERVOUNITYLOGe("Error initing prewarmed window.\n");
+			s_windows.remove(windowIndex);
+			return false;
+		}
+	}
+	if (!windowAvailable()) return false;
+
+	int windowIndex = s_windows.insert([=](int index) -> std::unique_ptr<ServoUnityWindow> {
 #if SUPPORT_D3D11
-    if (s_RendererType == kUnityGfxRendererD3D11) {
-        SERVOUNITYLOGi("Servo window requested with DirectX 11 renderer.\n");
-		window = std::make_unique<ServoUnityWindowDX11>(s_windowIndexNext++, uidExt, ServoUnityWindow::Size({ widthPixelsRequested, heightPixelsRequested }));
-	} else
+		if (s_RendererType == kUnityGfxRendererD3D11) {
+			SERVOUNITYLOGi("Servo window requested with DirectX 11 renderer.\n");
+			return std::make_unique<ServoUnityWindowDX11>(index, uidExt, ServoUnityWindow::Size({ widthPixelsRequested, heightPixelsRequested }));
+		}
 #endif // SUPPORT_D3D11
 #if SUPPORT_OPENGL_CORE
-    if (s_RendererType == kUnityGfxRendererOpenGLCore) {
-        SERVOUNITYLOGi("Servo window requested with OpenGL renderer.\n");
-		window = std::make_unique<ServoUnityWindowGL>(s_windowIndexNext++, uidExt, ServoUnityWindow::Size({ widthPixelsRequested, heightPixelsRequested }));
-	} else
+		if (s_RendererType == kUnityGfxRendererOpenGLCore) {
+			SERVOUNITYLOGi("Servo window requested with OpenGL renderer.\n");
+			return std::make_unique<ServoUnityWindowGL>(index, uidExt, ServoUnityWindow::Size({ widthPixelsRequested, heightPixelsRequested }));
+		}
 #endif // SUPPORT_OPENGL_CORE
-    {
 		SERVOUNITYLOGe("Cannot create window. Unknown/unsupported render type detected.\n");
-	}
-	auto inserted = s_windows.emplace(window->uid(), move(window));
-	if (!inserted.second || !inserted.first->second->init(m_windowCreatedCallback, m_windowResizedCallback, m_browserEventCallback, m_userAgent ? std::string(m_userAgent) : std::string())) {
+		return nullptr;
+	});
+	if (!windowIndex) return false;
+
+	// The window must already be in the table, as Unity may call back in from the window-created callback.
+	ServoUnityEpochGuard epoch;
+	ServoUnityStartupPhaseScope phase(ServoUnityStartupPhase_WindowCreated);
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window->init(m_windowCreatedCallback, m_windowResizedCallback, m_browserEventCallback, m_userAgent ? std::string(m_userAgent) : std::string())) {
 		SERVOUNITYLOGe("Error initing window.\n");
+		s_windows.remove(windowIndex);
+		return false;
+	}
+	return true;
+}
+
+bool servoUnityDetachWindow(int windowIndex)
+{
+	if (windowIndex == s_prewarmWindowIndex) return false;
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return false;
+	window->detach();
+	window->setVisible(false);
+	s_detachedWindowIndices.insert(windowIndex);
+	SERVOUNITYLOGi("Detached window %d.\n", windowIndex);
+	return true;
+}
+
+bool servoUnityAttachWindow(int windowIndex, int uidExt, int widthPixelsRequested, int heightPixelsRequested)
+{
+	if (!s_detachedWindowIndices.erase(windowIndex)) {
+		SERVOUNITYLOGe("Window %d is not detached.\n", windowIndex);
+		return false;
+	}
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return false;
+	SERVOUNITYLOGi("Attaching detached window %d.\n", windowIndex);
+	window->adopt(uidExt, { widthPixelsRequested, heightPixelsRequested });
+	window->setVisible(true);
+	if (!window->init(m_windowCreatedCallback, m_windowResizedCallback, m_browserEventCallback, m_userAgent ? std::string(m_userAgent) : std::string())) {
+		SERVOUNITYLOGe("Error initing detached window.\n");
+		// Leave it detached, so that the caller can still tear it down.
+		window->detach();
+		window->setVisible(false);
+		s_detachedWindowIndices.insert(windowIndex);
 		return false;
 	}
 	return true;
 }
 
+int servoUnityPrewarm(int widthPixels, int heightPixels)
+{
+	if (s_prewarmWindowIndex) return s_prewarmWindowIndex;
+	if (widthPixels <= 0 || heightPixels <= 0) {
+		SERVOUNITYLOGe("Requested invalid prewarm size %dx%d.\n", widthPixels, heightPixels);
+		return 0;
+	}
+	if (!windowAvailable()) return 0;
+
+	// A hidden window; with no callbacks set, Unity is not told about it until it is adopted.
+	int windowIndex = s_windows.insert([=](int index) -> std::unique_ptr<ServoUnityWindow> {
+#if SUPPORT_D3D11
+		if (s_RendererType == kUnityGfxRendererD3D11) return std::make_unique<ServoUnityWindowDX11>(index, 0, ServoUnityWindow::Size({ widthPixels, heightPixels }));
+#endif // SUPPORT_D3D11
+#if SUPPORT_OPENGL_CORE
+		if (s_RendererType == kUnityGfxRendererOpenGLCore) return std::make_unique<ServoUnityWindowGL>(index, 0, ServoUnityWindow::Size({ widthPixels, heightPixels }));
+#endif // SUPPORT_OPENGL_CORE
+		SERVOUNITYLOGe("Cannot prewarm. Unknown/unsupported render type detected.\n");
+		return nullptr;
+	});
+	if (!windowIndex) return 0;
+
+	ServoUnityEpochGuard epoch;
+	if (!s_windows.get(windowIndex)->init(nullptr, nullptr, nullptr, m_userAgent ? std::string(m_userAgent) : std::string())) {
+		SERVOUNITYLOGe("Error initing prewarm window.\n");
+		s_windows.remove(windowIndex);
+		return 0;
+	}
+	s_windows.get(windowIndex)->setVisible(false);
+	s_prewarmWindowIndex = windowIndex;
+	s_prewarmRendererWindowIndex = windowIndex;
+	SERVOUNITYLOGi("Created prewarm window %d at %dx%d.\n", windowIndex, widthPixels, heightPixels);
+	return windowIndex;
+}
+
+void servoUnityPrewarmRenderer(int windowIndex)
+{
+	// Only the first event for the current prewarm window does anything.
+	int expected = windowIndex;
+	if (!windowIndex || !s_prewarmRendererWindowIndex.compare_exchange_strong(expected, 0)) return;
+
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return; // Closed already.
+
+	// The window may already have been adopted and updated, in which case Servo is already running.
+	bool ok = window->prepareUpdate(0.0f);
+	if (ok) window->serviceServo();
+	SERVOUNITYLOGi("Prewarm %s.\n", ok ? "complete" : "failed");
+	servoUnityQueuePluginEvent(ServoUnityBrowserEvent_EngineReady, ok ? 1 : 0, 0);
+}
+
+void servoUnityServicePluginEvents(void)
+{
+	while (true) {
+		PLUGINEVENT event;
+		{
+			std::lock_guard<std::mutex> lock(s_pluginEventsLock);
+			if (s_pluginEvents.empty()) break;
+			event = s_pluginEvents.front();
+			s_pluginEvents.pop_front();
+		}
+		if (m_browserEventCallback) (*m_browserEventCallback)(0, event.eventType, event.eventData1, event.eventData2, NULL);
+	}
+}
+
 bool servoUnitySetWindowUnityTextureID(int windowIndex, void *nativeTexturePtr)
 {
     if (s_RendererType != kUnityGfxRendererD3D11 && s_RendererType != kUnityGfxRendererOpenGLCore) {
@@ -298,13 +639,14 @@ bool servoUnitySetWindowUnityTextureID(int windowIndex, void *nativeTexturePtr)
         return false;
     }
    
-	auto window_iter = s_windows.find(windowIndex);
-	if (window_iter == s_windows.end()) {
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) {
 		SERVOUNITYLOGe("Requested to set unity texture ID for non-existent window with index %d.\n", windowIndex);
 		return false;
 	}
 
-	window_iter->second->setNativePtr(nativeTexturePtr);
+	window->setNativePtr(nativeTexturePtr);
 	SERVOUNITYLOGi("servoUnitySetWindowUnityTextureID set texturePtr %p.\n", nativeTexturePtr);
 	return true;
 }
@@ -315,6 +657,22 @@ void servoUnitySetParamBool(int param, bool flag)
 		case ServoUnityParam_b_CloseNativeWindowOnClose:
 			s_param_CloseNativeWindowOnClose = flag;
 			break;
+		case ServoUnityParam_b_DynamicResolution:
+			s_param_DynamicResolution = flag;
+			break;
+		case ServoUnityParam_b_BatchInput:
+			s_param_BatchInput = flag;
+			break;
+		case ServoUnityParam_b_TouchGestures:
+			s_param_TouchGestures = flag;
+			break;
+		case ServoUnityParam_b_Snapshots:
+			s_param_Snapshots = flag;
+			if (!flag) ServoUnitySnapshotCache::clear();
+			break;
+		case ServoUnityParam_b_MemoryPressureResponse:
+			s_param_MemoryPressureResponse = flag;
+			break;
 		default:
 			break;
 	}
@@ -322,7 +680,30 @@ void servoUnitySetParamBool(int param, bool flag)
 
 void servoUnitySetParamInt(int param, int val)
 {
-    // No parameters to set yet.
+    switch (param) {
+        case ServoUnityParam_i_PerformanceProfile:
+            if (!ServoUnityPerformanceProfile::isValid(val)) {
+                SERVOUNITYLOGe("Invalid performance profile %d.\n", val);
+                break;
+            }
+            if (val == s_param_PerformanceProfile) break;
+            s_param_PerformanceProfile = val;
+            {
+                ServoUnityEpochGuard epoch;
+                s_windows.forEach([val](ServoUnityWindow *window) { window->applyPerformanceProfile(val); });
+            }
+            break;
+        case ServoUnityParam_i_HTTPCacheSize:
+            if (val <= 0) break;
+            s_param_HTTPCacheSize = val;
+            ServoUnityHTTPProxy::setBudget((uint64_t)val * 1024 * 1024);
+            break;
+        case ServoUnityParam_i_TextureBudgetMB:
+            if (val >= 0) s_param_TextureBudgetMB = val;
+            break;
+        default:
+            break;
+    }
 }
 
 void servoUnitySetParamString(int param, const char *s)
@@ -334,6 +715,17 @@ void servoUnitySetParamString(int param, const char *s)
         case ServoUnityParam_s_Homepage:
             s_param_Homepage = std::string(s);
             break;
+        case ServoUnityParam_s_CachePath:
+            s_param_CachePath = std::string(s ? s : "");
+            ServoUnitySnapshotCache::setDiskPath(s_param_CachePath.c_str());
+            break;
+        case ServoUnityParam_s_HTTPCachePath:
+            s_param_HTTPCachePath = std::string(s ? s : "");
+            break;
+        case ServoUnityParam_s_HistoryPath:
+            s_param_HistoryPath = std::string(s ? s : "");
+            ServoUnityHistory::setDiskPath(s_param_HistoryPath.c_str());
+            break;
         default:
             break;
     }
@@ -341,7 +733,28 @@ void servoUnitySetParamString(int param, const char *s)
 
 void servoUnitySetParamFloat(int param, float val)
 {
-    // No parameters to set yet.
+    switch (param) {
+        case ServoUnityParam_f_FrameTimeBudget:
+            if (val > 0.0f) s_param_FrameTimeBudget = val;
+            break;
+        case ServoUnityParam_f_DynamicResolutionMinScale:
+            if (val > 0.0f && val <= 1.0f) s_param_DynamicResolutionMinScale = val;
+            break;
+        case ServoUnityParam_f_ResizeSettleTime:
+            if (val >= 0.0f) s_param_ResizeSettleTime = val;
+            break;
+        case ServoUnityParam_f_KineticScrollFriction:
+            if (val >= 0.0f && val < 1.0f) s_param_KineticScrollFriction = val;
+            break;
+        case ServoUnityParam_f_PinchThreshold:
+            if (val >= 0.0f) s_param_PinchThreshold = val;
+            break;
+        case ServoUnityParam_f_PanThreshold:
+            if (val >= 0.0f) s_param_PanThreshold = val;
+            break;
+        default:
+            break;
+    }
 }
 
 bool servoUnityGetParamBool(int param)
@@ -350,6 +763,20 @@ bool servoUnityGetParamBool(int param)
 		case ServoUnityParam_b_CloseNativeWindowOnClose:
 			return s_param_CloseNativeWindowOnClose;
 			break;
+		case ServoUnityParam_b_DynamicResolution:
+			return s_param_DynamicResolution;
+			break;
+		case ServoUnityParam_b_BatchInput:
+			return s_param_BatchInput;
+			break;
+		case ServoUnityParam_b_TouchGestures:
+			return s_param_TouchGestures;
+			break;
+		case ServoUnityParam_b_Snapshots:
+			return s_param_Snapshots;
+		case ServoUnityParam_b_MemoryPressureResponse:
+			return s_param_MemoryPressureResponse;
+			break;
 		default:
 			break;
 	}
@@ -358,13 +785,43 @@ bool servoUnityGetParamBool(int param)
 
 int servoUnityGetParamInt(int param)
 {
-    // No parameters to query yet.
+    switch (param) {
+        case ServoUnityParam_i_PerformanceProfile:
+            return s_param_PerformanceProfile;
+        case ServoUnityParam_i_HTTPCacheSize:
+            return s_param_HTTPCacheSize;
+        case ServoUnityParam_i_TextureBudgetMB:
+            return s_param_TextureBudgetMB;
+        default:
+            break;
+    }
 	return 0;
 }
 
 float servoUnityGetParamFloat(int param)
 {
-    // No parameters to query yet.
+    switch (param) {
+        case ServoUnityParam_f_FrameTimeBudget:
+            return s_param_FrameTimeBudget;
+            break;
+        case ServoUnityParam_f_DynamicResolutionMinScale:
+            return s_param_DynamicResolutionMinScale;
+            break;
+        case ServoUnityParam_f_ResizeSettleTime:
+            return s_param_ResizeSettleTime;
+            break;
+        case ServoUnityParam_f_KineticScrollFriction:
+            return s_param_KineticScrollFriction;
+            break;
+        case ServoUnityParam_f_PinchThreshold:
+            return s_param_PinchThreshold;
+            break;
+        case ServoUnityParam_f_PanThreshold:
+            return s_param_PanThreshold;
+            break;
+        default:
+            break;
+    }
 	return 0.0f;
 }
 
@@ -378,6 +835,15 @@ void servoUnityGetParamString(int param, char *sbuf, int sbufLen)
         case ServoUnityParam_s_Homepage:
             strncpy(sbuf, s_param_Homepage.c_str(), sbufLen - 1);
             break;
+        case ServoUnityParam_s_CachePath:
+            strncpy(sbuf, s_param_CachePath.c_str(), sbufLen - 1);
+            break;
+        case ServoUnityParam_s_HTTPCachePath:
+            strncpy(sbuf, s_param_HTTPCachePath.c_str(), sbufLen - 1);
+            break;
+        case ServoUnityParam_s_HistoryPath:
+            strncpy(sbuf, s_param_HistoryPath.c_str(), sbufLen - 1);
+            break;
         default:
             break;
     }
@@ -386,32 +852,42 @@ void servoUnityGetParamString(int param, char *sbuf, int sbufLen)
 
 bool servoUnityCloseWindow(int windowIndex)
 {
-	auto window_iter = s_windows.find(windowIndex);
-	if (window_iter == s_windows.end()) return false;
-	
-	window_iter->second->CloseServoWindow();	
-	s_windows.erase(window_iter);
+	if (windowIndex == s_prewarmWindowIndex) s_prewarmWindowIndex = 0;
+	s_detachedWindowIndices.erase(windowIndex);
+	{
+		ServoUnityEpochGuard epoch;
+		ServoUnityWindow *window = s_windows.get(windowIndex);
+		if (!window) return false;
+		window->CloseServoWindow();
+	}
+	// The render thread may still be using the window, so it is deleted by a later collect.
+	s_windows.remove(windowIndex);
+	ServoUnityEpoch::collect();
 	return true;
 }
 
 bool servoUnityCloseAllWindows(void)
 {
-	s_windows.clear();
+	s_prewarmWindowIndex = 0;
+	s_detachedWindowIndices.clear();
+	s_windows.removeAll();
+	ServoUnityEpoch::collect();
 	return true;
 }
 
 bool servoUnityGetWindowTextureFormat(int windowIndex, int *width, int *height, int *format, bool *mipChain, bool *linear, void **nativeTextureID_p)
 {
-	auto window_iter = s_windows.find(windowIndex);
-	if (window_iter == s_windows.end()) return false;
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return false;
 
-	ServoUnityWindow::Size size = window_iter->second->size();
+	ServoUnityWindow::Size size = window->size();
 	if (width) *width = size.w;
 	if (height) *height = size.h;
-	if (format) *format = window_iter->second->format();
+	if (format) *format = window->format();
 	if (mipChain) *mipChain = false;
 	if (linear) *linear = true;
-	if (nativeTextureID_p) *nativeTextureID_p = window_iter->second->nativePtr();
+	if (nativeTextureID_p) *nativeTextureID_p = window->nativePtr();
 	return true;
 }
 
@@ -443,136 +919,387 @@ uint64_t servoUnityGetBufferSizeForTextureFormat(int width, int height, int form
 
 bool servoUnityRequestWindowSizeChange(int windowIndex, int width, int height)
 {
-	auto window_iter = s_windows.find(windowIndex);
-	if (window_iter == s_windows.end()) return false;
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return false;
 	
-	window_iter->second->setSize({ width, height });
+	if (width <= 0 || height <= 0) {
+		SERVOUNITYLOGe("Requested invalid window size %dx%d.\n", width, height);
+		return false;
+	}
+	window->requestSize({ width, height });
 
     return true;
 }
 
+void servoUnitySetWindowProjectedSize(int windowIndex, int width, int height)
+{
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return;
+
+	window->setProjectedSize({ width, height });
+}
+
+void servoUnitySetWindowVisible(int windowIndex, bool visible)
+{
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return;
+
+	window->setVisible(visible);
+}
+
 void servoUnityServiceWindowEvents(int windowIndex)
 {
-    auto window_iter = s_windows.find(windowIndex);
-    if (window_iter == s_windows.end()) {
+    // Unity calls this every frame on the main thread, so it's a good place to delete closed windows.
+    ServoUnityEpoch::collect();
+
+    ServoUnityEpochGuard epoch;
+    ServoUnityWindow *window = s_windows.get(windowIndex);
+    if (!window) {
         SERVOUNITYLOGe("Requested event service for non-existent window with index %d.\n", windowIndex);
         return;
     }
-    window_iter->second->serviceWindowEvents();
+    window->serviceWindowEvents();
 }
 
-void servoUnityGetWindowMetadata(int windowIndex, char *titleBuf, int titleBufLen, char *urlBuf, int urlBufLen)
+int servoUnityGetWindowMetadataVersion(int windowIndex)
 {
-    auto window_iter = s_windows.find(windowIndex);
-    if (window_iter == s_windows.end()) {
+    ServoUnityEpochGuard epoch;
+    ServoUnityWindow *window = s_windows.get(windowIndex);
+    if (!window) return 0;
+    return window->metadata()->version;
+}
+
+int servoUnityGetWindowMetadata(int windowIndex, char *titleBuf, int titleBufLen, char *urlBuf, int urlBufLen)
+{
+    ServoUnityEpochGuard epoch;
+    ServoUnityWindow *window = s_windows.get(windowIndex);
+    if (!window) {
         SERVOUNITYLOGe("Requested window metadata for non-existent window with index %d.\n", windowIndex);
-        return;
+        return 0;
     }
+    const ServoUnityWindow::Metadata *metadata = window->metadata();
     if (titleBuf && titleBufLen > 0) {
-        std::string title = window_iter->second->windowTitle();
-        strncpy(titleBuf, title.c_str(), titleBufLen - 1);
+        strncpy(titleBuf, metadata->title.c_str(), titleBufLen - 1);
         titleBuf[titleBufLen - 1] = '\0';  // Guarantee nul-termination, even if truncated.
     }
     if (urlBuf && urlBufLen > 0) {
-        std::string URL = window_iter->second->windowURL();
-        strncpy(urlBuf, URL.c_str(), urlBufLen - 1);
+        strncpy(urlBuf, metadata->URL.c_str(), urlBufLen - 1);
         urlBuf[urlBufLen - 1] = '\0';  // Guarantee nul-termination, even if truncated.
     }
+    return metadata->version;
+}
+
+int servoUnityGetWindowNavigationState(int windowIndex, bool *loading_p, bool *canGoBack_p, bool *canGoForward_p)
+{
+    ServoUnityEpochGuard epoch;
+    ServoUnityWindow *window = s_windows.get(windowIndex);
+    if (!window) return 0;
+    const ServoUnityWindow::Metadata *metadata = window->metadata();
+    if (loading_p) *loading_p = metadata->loading;
+    if (canGoBack_p) *canGoBack_p = metadata->canGoBack;
+    if (canGoForward_p) *canGoForward_p = metadata->canGoForward;
+    return metadata->version;
+}
+
+//
+// Frame scheduler.
+// Each window's Servo instance is serviced once per frame, before any texture fills, so that
+// every window's frame is taken from the same point in time.
+//
+
+static std::set<int> s_windowsUpdatedThisFrame; // Detects frame boundaries when windows are updated one at a time.
+
+// Written only on the render thread.
+static std::atomic<uint64_t> s_statFrames(0);
+static std::atomic<uint64_t> s_statTasksDelivered(0);
+static std::atomic<uint64_t> s_statFramesWithTasks(0);
+static std::atomic<uint64_t> s_statServiceTimeUs(0);
+static std::atomic<uint64_t> s_statEngineCacheClears(0);
+static std::atomic<uint64_t> s_statPluginCacheDrops(0);
+static std::atomic<uint64_t> s_statWindowsShrunk(0);
+static std::atomic<uint64_t> s_statWindowsSuspended(0);
+static std::atomic<uint64_t> s_statTextureBytes(0);
+static std::atomic<uint64_t> s_statTextureEvictions(0);
+static std::atomic<uint64_t> s_statWindowsEvicted(0);
+
+static uint64_t s_frame = 0; // Render thread only.
+
+static int s_memoryPressureLevel = ServoUnityMemoryPressure_None; // Level last responded to. Render thread only.
+
+// Each stage's caches are dropped once, on entering it; hidden windows are shrunk and suspended
+// (and restored when shown) as they're serviced. Caller must hold a ServoUnityEpochGuard.
+static void respondToMemoryPressure(void)
+{
+    int level = ServoUnityMemoryPressure::level();
+    if (level != s_memoryPressureLevel) {
+        SERVOUNITYLOGi("Memory pressure level changed from %d to %d.\n", s_memoryPressureLevel, level);
+        servoUnityQueuePluginEvent(ServoUnityBrowserEvent_MemoryPressure, level, ServoUnityMemoryPressureAction_None);
+        if (level >= ServoUnityMemoryPressure_Low && s_memoryPressureLevel < ServoUnityMemoryPressure_Low) {
+            s_windows.forEach([](ServoUnityWindow *window) { window->clearEngineCache(); });
+            s_statEngineCacheClears++;
+            servoUnityQueuePluginEvent(ServoUnityBrowserEvent_MemoryPressure, level, ServoUnityMemoryPressureAction_ClearEngineCaches);
+        }
+        if (level >= ServoUnityMemoryPressure_Moderate && s_memoryPressureLevel < ServoUnityMemoryPressure_Moderate) {
+            ServoUnitySnapshotCache::clear();
+            s_windows.forEach([](ServoUnityWindow *window) { window->releaseCaches(); });
+            s_statPluginCacheDrops++;
+            servoUnityQueuePluginEvent(ServoUnityBrowserEvent_MemoryPressure, level, ServoUnityMemoryPressureAction_DropPluginCaches);
+        }
+        s_memoryPressureLevel = level;
+    }
+    s_windows.forEach([level](ServoUnityWindow *window) {
+        switch (window->applyMemoryPressure(level)) {
+            case ServoUnityMemoryPressureAction_ShrinkHiddenWindow: s_statWindowsShrunk++; break;
+            case ServoUnityMemoryPressureAction_SuspendHiddenWindow: s_statWindowsSuspended++; break;
+            default: break;
+        }
+    });
+}
+
+// Totals windows' textures, and if over budget evicts those of the hidden windows least recently
+// visible. Textures are restored, possibly going over budget, as soon as a window is visible again.
+// Caller must hold a ServoUnityEpochGuard.
+static void enforceTextureBudget(void)
+{
+    static std::vector<ServoUnityWindow *> hidden; // Only used on the render thread.
+    hidden.clear();
+    uint64_t used = 0;
+    uint64_t evicted = 0;
+    s_frame++;
+    s_windows.forEach([&](ServoUnityWindow *window) {
+        window->noteVisibility(s_frame);
+        used += window->textureBytes();
+        if (window->texturesEvicted()) evicted++;
+        else if (!window->visible()) hidden.push_back(window);
+    });
+
+    uint64_t budget = (uint64_t)s_param_TextureBudgetMB * 1024 * 1024;
+    if (budget > 0 && used > budget && !hidden.empty()) {
+        std::sort(hidden.begin(), hidden.end(), [](ServoUnityWindow *a, ServoUnityWindow *b) { return a->lastVisibleFrame() < b->lastVisibleFrame(); });
+        for (ServoUnityWindow *window : hidden) {
+            if (used <= budget) break;
+            uint64_t before = window->textureBytes();
+            window->evictTextures();
+            uint64_t after = window->textureBytes();
+            if (before > after) used -= std::min(used, before - after);
+            evicted++;
+            s_statTextureEvictions++;
+        }
+        if (used > budget) SERVOUNITYLOGw("Visible windows' textures exceed the texture budget.\n");
+    }
+    s_statTextureBytes = used;
+    s_statWindowsEvicted = evicted;
+}
+
+// Caller must hold a ServoUnityEpochGuard.
+static void serviceEngine(void)
+{
+    respondToMemoryPressure();
+    enforceTextureBudget();
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    int tasks = 0;
+    s_windows.forEach([&tasks](ServoUnityWindow *window) {
+        tasks += window->serviceServo();
+    });
+    s_statServiceTimeUs += (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count();
+    s_statFrames++;
+    if (tasks > 0) {
+        s_statTasksDelivered += tasks;
+        s_statFramesWithTasks++;
+    }
+}
+
+double servoUnityGetStat(int stat)
+{
+    switch (stat) {
+        case ServoUnityStat_Frames: return (double)s_statFrames.load();
+        case ServoUnityStat_TasksDelivered: return (double)s_statTasksDelivered.load();
+        case ServoUnityStat_FramesWithTasks: return (double)s_statFramesWithTasks.load();
+        case ServoUnityStat_ServiceTimeMs: return (double)s_statServiceTimeUs.load() / 1000.0;
+        case ServoUnityStat_EngineCacheClears: return (double)s_statEngineCacheClears.load();
+        case ServoUnityStat_PluginCacheDrops: return (double)s_statPluginCacheDrops.load();
+        case ServoUnityStat_WindowsShrunk: return (double)s_statWindowsShrunk.load();
+        case ServoUnityStat_WindowsSuspended: return (double)s_statWindowsSuspended.load();
+        case ServoUnityStat_TextureBytes: return (double)s_statTextureBytes.load();
+        case ServoUnityStat_TextureBudgetBytes: return (double)s_param_TextureBudgetMB * 1024.0 * 1024.0;
+        case ServoUnityStat_TextureEvictions: return (double)s_statTextureEvictions.load();
+        case ServoUnityStat_WindowsEvicted: return (double)s_statWindowsEvicted.load();
+        default: return 0.0;
+    }
+}
+
+void servoUnityResetStats(void)
+{
+    s_statFrames = 0;
+    s_statTasksDelivered = 0;
+    s_statFramesWithTasks = 0;
+    s_statServiceTimeUs = 0;
+    s_statEngineCacheClears = 0;
+    s_statPluginCacheDrops = 0;
+    s_statWindowsShrunk = 0;
+    s_statWindowsSuspended = 0;
+    s_statTextureEvictions = 0;
+}
+
+int servoUnityGetMemoryPressureLevel(void)
+{
+    return ServoUnityMemoryPressure::level();
+}
+
+void servoUnityInjectMemoryPressure(int level)
+{
+    ServoUnityMemoryPressure::inject(level);
 }
 
 void servoUnityRequestWindowUpdate(int windowIndex, float timeDelta)
 {
-	auto window_iter = s_windows.find(windowIndex);
-	if (window_iter == s_windows.end()) {
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) {
 		SERVOUNITYLOGe("Requested update for non-existent window with index %d.\n", windowIndex);
 		return;
 	}
-	window_iter->second->requestUpdate(timeDelta);
+
+    // A window being updated a second time means a new frame has begun.
+    if (s_windowsUpdatedThisFrame.count(windowIndex)) s_windowsUpdatedThisFrame.clear();
+    bool firstThisFrame = s_windowsUpdatedThisFrame.empty();
+    s_windowsUpdatedThisFrame.insert(windowIndex);
+
+    // The engine is pumped once per frame even if this window can't be updated, e.g. because it has
+    // no Servo instance, so that the other windows don't stall.
+    bool prepared = window->prepareUpdate(timeDelta);
+    if (firstThisFrame) serviceEngine();
+    if (prepared) window->updateTexture();
+}
+
+void servoUnityRequestWindowsUpdate(const int32_t *windowIndices, int count, float timeDelta)
+{
+    static std::vector<ServoUnityWindow *> windows; // Only used on the render thread.
+    if (!windowIndices || count <= 0) return;
+
+    ServoUnityEpochGuard epoch; // Keeps the windows alive until we're done with them, even if closed meanwhile.
+    windows.clear();
+    for (int i = 0; i < count; i++) {
+        ServoUnityWindow *window = s_windows.get(windowIndices[i]);
+        if (!window) {
+            SERVOUNITYLOGe("Requested update for non-existent window with index %d.\n", windowIndices[i]);
+            continue;
+        }
+        if (window->prepareUpdate(timeDelta)) windows.push_back(window);
+    }
+    serviceEngine();
+    for (ServoUnityWindow *window : windows) window->updateTexture();
+    s_windowsUpdatedThisFrame.clear();
 }
 
 void servoUnityCleanupRenderer(int windowIndex)
 {
-    auto window_iter = s_windows.find(windowIndex);
-    if (window_iter == s_windows.end()) {
+    ServoUnityEpochGuard epoch;
+    ServoUnityWindow *window = s_windows.get(windowIndex);
+    if (!window) {
         SERVOUNITYLOGe("Requested cleanup for non-existent window with index %d.\n", windowIndex);
         return;
     }
-    window_iter->second->cleanupRenderer();
+    window->cleanupRenderer();
 }
 
 void servoUnityWindowPointerEvent(int windowIndex, int eventID, int eventParam0, int eventParam1, int windowX, int windowY)
 {
-	auto window_iter = s_windows.find(windowIndex);
-	if (window_iter == s_windows.end()) return;
+	ServoUnityEpochGuard epoch;
+	ServoUnityWindow *window = s_windows.get(windowIndex);
+	if (!window) return;
 
 	switch (eventID) {
 	case ServoUnityPointerEventID_Enter:
-		window_iter->second->pointerEnter();
+		window->pointerEnter();
 		break;
 	case ServoUnityPointerEventID_Exit:
-		window_iter->second->pointerExit();
+		window->pointerExit();
 		break;
 	case ServoUnityPointerEventID_Over:
-		window_iter->second->pointerOver(windowX, windowY);
+		window->pointerOver(windowX, windowY);
 		break;
 	case ServoUnityPointerEventID_Press:
-		window_iter->second->pointerPress(eventParam0, windowX, windowY);
+		window->pointerPress(eventParam0, windowX, windowY);
 		break;
 	case ServoUnityPointerEventID_Release:
-		window_iter->second->pointerRelease(eventParam0, windowX, windowY);
+		window->pointerRelease(eventParam0, windowX, windowY);
 		break;
     case ServoUnityPointerEventID_Click:
-        window_iter->second->pointerClick(eventParam0, windowX, windowY);
+        window->pointerClick(eventParam0, windowX, windowY);
         break;
 	case ServoUnityPointerEventID_ScrollDiscrete:
-		window_iter->second->pointerScrollDiscrete(eventParam0, eventParam1, windowX, windowY);
+		window->pointerScrollDiscrete(eventParam0, eventParam1, windowX, windowY);
 		break;
 	case ServoUnityPointerEventID_TouchBegin:
-		window_iter->second->touchBegin(eventParam0, windowX, windowY);
+		window->touchBegin(eventParam0, windowX, windowY);
 		break;
 	case ServoUnityPointerEventID_TouchMove:
-		window_iter->second->touchMove(eventParam0, windowX, windowY);
+		window->touchMove(eventParam0, windowX, windowY);
 		break;
 	case ServoUnityPointerEventID_TouchEnd:
-		window_iter->second->touchEnd(eventParam0, windowX, windowY);
+		window->touchEnd(eventParam0, windowX, windowY);
 		break;
 	case ServoUnityPointerEventID_TouchCancel:
-		window_iter->second->touchCancel(eventParam0, windowX, windowY);
+		window->touchCancel(eventParam0, windowX, windowY);
+		break;
+	case ServoUnityPointerEventID_ScrollGestureBegin:
+		window->scrollGestureBegin(windowX, windowY);
+		break;
+	case ServoUnityPointerEventID_ScrollGestureUpdate:
+		window->scrollGestureUpdate(eventParam0, eventParam1, windowX, windowY);
+		break;
+	case ServoUnityPointerEventID_ScrollGestureEnd:
+		window->scrollGestureEnd(eventParam0, eventParam1, windowX, windowY);
 		break;
 	default:
 		break;
 	}
 }
 
+void servoUnityWindowTouchEvents(int windowIndex, const ServoUnityTouch *touches, int count)
+{
+    if (!touches || count <= 0) return;
+    ServoUnityEpochGuard epoch;
+    ServoUnityWindow *window = s_windows.get(windowIndex);
+    if (!window) return;
+
+    window->touchEvents(touches, count);
+}
+
 void servoUnityWindowBrowserControlEvent(int windowIndex, int eventID, int eventParam0, int eventParam1, const char *eventParamS)
 {
-    auto window_iter = s_windows.find(windowIndex);
-    if (window_iter == s_windows.end()) return;
+    ServoUnityEpochGuard epoch;
+    ServoUnityWindow *window = s_windows.get(windowIndex);
+    if (!window) return;
 
     switch (eventID) {
     case ServoUnityWindowBrowserControlEventID_Refresh:
-        window_iter->second->refresh();
+        window->refresh();
         break;
     case ServoUnityWindowBrowserControlEventID_Reload:
-        window_iter->second->reload();
+        window->reload();
         break;
     case ServoUnityWindowBrowserControlEventID_Stop:
-        window_iter->second->stop();
+        window->stop();
         break;
     case ServoUnityWindowBrowserControlEventID_GoBack:
-        window_iter->second->goBack();
+        window->goBack();
         break;
     case ServoUnityWindowBrowserControlEventID_GoForward:
-        window_iter->second->goForward();
+        window->goForward();
         break;
     case ServoUnityWindowBrowserControlEventID_GoHome:
-        window_iter->second->goHome();
+        window->goHome();
         break;
     case ServoUnityWindowBrowserControlEventID_Navigate:
-        window_iter->second->navigate(std::string(eventParamS));
+        window->navigate(std::string(eventParamS));
         break;
 	case ServoUnityWindowBrowserControlEventID_IMEDismissed:
-		window_iter->second->imeDismissed();
+		window->imeDismissed();
 		break;
     default:
         break;
@@ -138,7 +138,77 @@ enum {
     ServoUnityBrowserEvent_HistoryChanged = 5, // eventData1: 0=CantGoBack, 1=CanGoBack, eventData2: 0=CantGoForward, 1=CanGoForward
     ServoUnityBrowserEvent_TitleChanged = 6,
     ServoUnityBrowserEvent_URLChanged = 7,
-    Total = 8
+    ServoUnityBrowserEvent_EngineReady = 8, // Plugin event, delivered with uidExt 0 by servoUnityServicePluginEvents. eventData1: 0=Failed, 1=Ready.
+    ServoUnityBrowserEvent_MemoryPressure = 9, // eventData1: one of ServoUnityMemoryPressure_*, eventData2: one of ServoUnityMemoryPressureAction_*. Plugin event (uidExt 0), except for actions on one window.
+    ServoUnityBrowserEvent_TexturesEvicted = 10, // eventData1: 1=Evicted (Unity-side texture pools should be released too), 0=Restored. See ServoUnityParam_i_TextureBudgetMB.
+    Total = 11
+};
+
+enum {
+    ServoUnityMemoryPressure_None = 0,
+    ServoUnityMemoryPressure_Low = 1, // Servo's caches are cleared.
+    ServoUnityMemoryPressure_Moderate = 2, // Plugin caches (page snapshots, texture pools) are dropped.
+    ServoUnityMemoryPressure_High = 3, // Hidden windows are rendered at reduced size.
+    ServoUnityMemoryPressure_Critical = 4 // Hidden windows are suspended.
+};
+
+enum {
+    ServoUnityMemoryPressureAction_None = 0, // The level changed.
+    ServoUnityMemoryPressureAction_ClearEngineCaches = 1,
+    ServoUnityMemoryPressureAction_DropPluginCaches = 2, // Unity-side texture pools should be released too.
+    ServoUnityMemoryPressureAction_ShrinkHiddenWindow = 3, // Delivered to the window shrunk.
+    ServoUnityMemoryPressureAction_SuspendHiddenWindow = 4 // Delivered to the window suspended.
+};
+
+enum {
+    ServoUnityStartupPhase_Init = 0, // servoUnityInit.
+    ServoUnityStartupPhase_GStreamerEnv = 1, // GStreamer environment setup, within servoUnityInit.
+    ServoUnityStartupPhase_WindowCreated = 2, // Window creation, including the window-created callback into Unity.
+    ServoUnityStartupPhase_Prefs = 3, // Marshalling of Servo prefs and init options.
+    ServoUnityStartupPhase_EngineInit = 4, // init_with_gl / init_with_egl.
+    ServoUnityStartupPhase_FirstPerformUpdates = 5,
+    ServoUnityStartupPhase_FirstLoadStarted = 6, // Instantaneous.
+    ServoUnityStartupPhase_FirstFrame = 7, // First time a window's texture is filled. Instantaneous.
+    ServoUnityStartupPhase_FirstLoadEnded = 8, // Instantaneous.
+    ServoUnityStartupPhase_Max
+};
+
+enum {
+    ServoUnityPerformanceProfile_Default = 0, // Servo's own defaults.
+    ServoUnityPerformanceProfile_LowLatency = 1, // More layout threads and short GC slices, for interactive content.
+    ServoUnityPerformanceProfile_BatterySaver = 2, // Fewer threads doing less speculative work.
+    ServoUnityPerformanceProfile_HighQuality = 3, // Subpixel text antialiasing (on next Servo startup), GPU video.
+    ServoUnityPerformanceProfile_Kiosk = 4, // Bounded session history, for long-running unattended use.
+    ServoUnityPerformanceProfile_Max
+};
+
+enum {
+    ServoUnityStat_Frames = 0, // Frames in which Servo was serviced.
+    ServoUnityStat_TasksDelivered = 1, // Input events and other tasks delivered to Servo.
+    ServoUnityStat_FramesWithTasks = 2, // Frames in which at least one task was delivered.
+    ServoUnityStat_ServiceTimeMs = 3, // Render-thread time spent delivering tasks and in perform_updates.
+    ServoUnityStat_EngineCacheClears = 4, // Times Servo's caches were cleared under memory pressure.
+    ServoUnityStat_PluginCacheDrops = 5, // Times plugin caches were dropped under memory pressure.
+    ServoUnityStat_WindowsShrunk = 6, // Hidden windows shrunk under memory pressure.
+    ServoUnityStat_WindowsSuspended = 7, // Hidden windows suspended under memory pressure.
+    ServoUnityStat_TextureBytes = 8, // GPU memory held for windows' textures, in bytes, as of the last frame. Not reset.
+    ServoUnityStat_TextureBudgetBytes = 9, // ServoUnityParam_i_TextureBudgetMB in bytes, or 0 if unlimited. Not reset.
+    ServoUnityStat_TextureEvictions = 10, // Times a hidden window's textures were evicted to keep within the texture budget.
+    ServoUnityStat_WindowsEvicted = 11, // Windows whose textures are evicted, as of the last frame. Not reset.
+    ServoUnityStat_Max
+};
+
+enum {
+    ServoUnityNavigationPolicyCounter_Checked = 0, // Navigations checked against the navigation policy.
+    ServoUnityNavigationPolicyCounter_Blocked = 1, // Navigations blocked by a rule.
+    ServoUnityNavigationPolicyCounter_Redirected = 2, // Navigations redirected by a rule.
+    ServoUnityNavigationPolicyCounter_Max
+};
+
+enum {
+    ServoUnityGStreamerRegistryCache_Disabled = 0, // No resources path or GStreamer plugin path override was set.
+    ServoUnityGStreamerRegistryCache_Hit = 1, // A registry for the current plugin set was found, and plugins will not be rescanned.
+    ServoUnityGStreamerRegistryCache_Miss = 2 // GStreamer will scan plugins and write a registry for reuse on the next launch.
 };
 
 //
@@ -196,6 +266,84 @@ SERVO_UNITY_EXTERN void servoUnityInit(PFN_WINDOWCREATEDCALLBACK windowCreatedCa
 
 SERVO_UNITY_EXTERN void servoUnityFinalise(void);
 
+///
+/// Get the times of the phases of startup, for tracking cold-start performance.
+/// The timeline is also written to the log once the first page has loaded.
+/// @param startMs Array of count doubles, indexed by ServoUnityStartupPhase_*, which receives the time in milliseconds
+///     from the start of servoUnityInit at which each phase began, or -1 if it has not (yet) completed. May be NULL.
+/// @param durationMs Array of count doubles, which receives the duration of each phase in milliseconds
+///     (0 for instantaneous phases), or -1 if it has not (yet) completed. May be NULL.
+/// @return The number of phases filled, at most ServoUnityStartupPhase_Max.
+///
+SERVO_UNITY_EXTERN int servoUnityGetStartupTimeline(double *startMs, double *durationMs, int count);
+
+///
+/// Get the state of the GStreamer plugin registry cache. The cache is kept in the resources path,
+/// so servoUnitySetResourcesPath must be called before servoUnityInit for it to be used.
+/// @param savedMs If non-NULL, receives the milliseconds of engine startup saved by the cache on this
+///     launch, or -1 if not (yet) known.
+/// @return One of ServoUnityGStreamerRegistryCache_*.
+///
+SERVO_UNITY_EXTERN int servoUnityGetGStreamerRegistryCacheState(double *savedMs);
+
+///
+/// Get a cumulative engine statistic, one of ServoUnityStat_*, since startup or the last servoUnityResetStats.
+/// <remarks>E.g. to measure the effect of ServoUnityParam_b_BatchInput under heavy pointer input, compare
+/// ServoUnityStat_ServiceTimeMs / ServoUnityStat_Frames with it set and cleared.</remarks>
+///
+SERVO_UNITY_EXTERN double servoUnityGetStat(int stat);
+
+SERVO_UNITY_EXTERN void servoUnityResetStats(void);
+
+///
+/// Get a counter, one of ServoUnityNavigationPolicyCounter_*, of the navigation policy's decisions since it was loaded.
+/// The policy is read from navigation_policy.sunp in the resource archive, if present, by servoUnitySetResourcesPath,
+/// and decides every navigation. Returns 0 if there is no policy.
+///
+SERVO_UNITY_EXTERN uint64_t servoUnityGetNavigationPolicyCounter(int counter);
+
+/// Get the number of rules in the navigation policy, or 0 if there is no policy.
+SERVO_UNITY_EXTERN int servoUnityGetNavigationPolicyRuleCount(void);
+
+///
+/// Get how many navigations a rule of the navigation policy has decided.
+/// @param rule Index of the rule, in the order of the rules file it was compiled from.
+/// @param domainBuf If non-NULL, receives the domain the rule applies to, nul-terminated and truncated to domainBufLen.
+/// @return The number of navigations, or 0 if there is no such rule.
+///
+SERVO_UNITY_EXTERN uint64_t servoUnityGetNavigationPolicyRuleHits(int rule, char *domainBuf, int domainBufLen);
+
+///
+/// Get completions for text typed in an address bar, from the pages visited in any window.
+/// Short queries match the start of URLs, ignoring scheme and "www.". Longer queries also match anywhere in
+/// URLs and page titles, and queries of several words must match all of them. Completions are ranked by how
+/// often and how recently their page was visited.
+/// @param query The text typed so far.
+/// @param maxResults The most completions wanted, up to 32.
+/// @param buf Receives each completion as its URL, a tab, its page title (possibly empty) and a newline,
+///     best first, nul-terminated. Completions which don't fit in bufLen are omitted.
+/// @return The number of completions written to buf.
+///
+SERVO_UNITY_EXTERN int servoUnityQuerySuggestions(const char *query, int maxResults, char *buf, int bufLen);
+
+/// Forget all visited pages, including any logged in ServoUnityParam_s_HistoryPath.
+SERVO_UNITY_EXTERN void servoUnityClearHistory(void);
+
+///
+/// Get the memory pressure level the plugin is responding to, one of ServoUnityMemoryPressure_*.
+/// The monitor is started by servoUnityInit when ServoUnityParam_b_MemoryPressureResponse is set.
+/// As the level rises, the plugin clears Servo's caches (Low), drops its own caches (Moderate),
+/// shrinks hidden windows (High) and suspends hidden windows (Critical), delivering a
+/// ServoUnityBrowserEvent_MemoryPressure event for each. Hidden windows are restored when shown.
+///
+SERVO_UNITY_EXTERN int servoUnityGetMemoryPressureLevel(void);
+
+///
+/// Override the measured memory pressure level, e.g. to test the plugin's response.
+/// @param level One of ServoUnityMemoryPressure_*, or -1 to return to the measured level.
+///
+SERVO_UNITY_EXTERN void servoUnityInjectMemoryPressure(int level);
+
 ///
 /// Set the path in which the plugin should look for resources. Should be full filesystem path without trailing slash.
 /// This should be called early on in the plugin lifecycle, typically from a Unity MonoBehaviour.OnEnable() event.
@@ -283,10 +431,72 @@ enum {
 /// @param upDown Set to 1 for keyDown events, 0 for keyUp events.
 SERVO_UNITY_EXTERN void servoUnityKeyEvent(int windowIndex, int upDown, int keyCode, int character);
 
+///
+/// Send a run of text to Servo, e.g. text committed by an IME, or pasted.
+/// The text is decoded natively and delivered to Servo as a single queued operation, with each
+/// character sent as a key press. Line feeds are sent as Enter and tabs as Tab. Invalid UTF-8
+/// sequences are replaced by U+FFFD.
+/// @param utf8 The text, in UTF-8 encoding.
+/// @param len Length of utf8 in bytes, or -1 if utf8 is nul-terminated.
+///
+SERVO_UNITY_EXTERN void servoUnityWindowTextInput(int windowIndex, const char *utf8, int len);
+
 SERVO_UNITY_EXTERN int servoUnityGetWindowCount(void);
 
+///
+/// Gets how many windows can be open at once, as each needs its own Servo instance.
+/// <remarks>Prewarmed and detached windows count towards this. Beyond it, servoUnityRequestNewWindow
+/// and servoUnityPrewarm fail. This may be called at any time, including prior to calling servoUnityInit.</remarks>
+///
+SERVO_UNITY_EXTERN int servoUnityGetWindowCountMax(void);
+
 SERVO_UNITY_EXTERN bool servoUnityRequestNewWindow(int uidExt, int widthPixelsRequested, int heightPixelsRequested);
 
+///
+/// Start Servo ahead of time, so that the first window does not cause a hitch while Servo starts up.
+/// <remarks>This creates a hidden window, which the next call to servoUnityRequestNewWindow will
+/// return instead of creating a new window. Servo's startup needs the rendering context, so it is
+/// performed on the rendering thread when ServoUnityRenderEventID_Prewarm is next issued for the
+/// returned window index (or servoUnityPrewarmRenderer is called). When it completes, a
+/// ServoUnityBrowserEvent_EngineReady event is delivered by servoUnityServicePluginEvents. Must be
+/// called after servoUnityInit. For best results, pass the size the first window will be requested at.</remarks>
+/// @return The index of the prewarm window, or 0 on error.
+///
+SERVO_UNITY_EXTERN int servoUnityPrewarm(int widthPixels, int heightPixels);
+
+///
+/// Detach a window from Unity, leaving it and its Servo instance running, so that it can outlive the
+/// Unity objects representing it, e.g. across a scene change.
+/// <remarks>The window stops rendering into its Unity texture, and its callbacks are cleared; browser
+/// events are held until it is attached again, except for Shutdown after servoUnityCleanupRenderer, which is
+/// delivered with uidExt 0 by servoUnityServicePluginEvents. A detached window is not counted by servoUnityGetWindowCount.
+/// The caller must keep windowIndex, to pass to servoUnityAttachWindow, or to servoUnityCleanupRenderer and
+/// servoUnityCloseWindow for teardown. Must be called from main thread.</remarks>
+///
+SERVO_UNITY_EXTERN bool servoUnityDetachWindow(int windowIndex);
+
+///
+/// Attach a window detached with servoUnityDetachWindow to a new Unity object.
+/// <remarks>As for servoUnityRequestNewWindow, the window-created callback is invoked with uidExt, after
+/// which the caller must supply a texture with servoUnitySetWindowUnityTextureID. Must be called from main thread.</remarks>
+///
+SERVO_UNITY_EXTERN bool servoUnityAttachWindow(int windowIndex, int uidExt, int widthPixelsRequested, int heightPixelsRequested);
+
+///
+/// Must be called from rendering thread with active rendering context.
+/// As an alternative to invoking directly, an equivalent invocation can be invoked via a
+/// ServoUnityRenderEventID_Prewarm event issued with the function returned by GetRenderEventAndDataFunc(),
+/// with a ServoUnityRenderEventWindowData payload.
+/// @param windowIndex The index returned by servoUnityPrewarm.
+///
+SERVO_UNITY_EXTERN void servoUnityPrewarmRenderer(int windowIndex);
+
+///
+/// Deliver any pending events which are not specific to one window (e.g. ServoUnityBrowserEvent_EngineReady)
+/// to the browser event callback, with uidExt 0. Call periodically from the main Unity thread.
+///
+SERVO_UNITY_EXTERN void servoUnityServicePluginEvents(void);
+
 SERVO_UNITY_EXTERN bool servoUnityGetWindowTextureFormat(int windowIndex, int *width, int *height, int *format, bool *mipChain, bool *linear, void **nativeTextureID_p);
 
 SERVO_UNITY_EXTERN uint64_t servoUnityGetBufferSizeForTextureFormat(int width, int height, int format);
@@ -294,11 +504,26 @@ SERVO_UNITY_EXTERN uint64_t servoUnityGetBufferSizeForTextureFormat(int width, i
 ///
 /// On Direct3D-like devices pass a pointer to the base texture type (IDirect3DBaseTexture9 on D3D9, ID3D11Resource on D3D11),
 /// or on OpenGL-like devices pass the texture "name", casting the integer to a pointer.
+/// The texture's contents need not be initialised; the plugin will clear it to opaque black
+/// on the render thread at the next window update.
 ///
 SERVO_UNITY_EXTERN bool servoUnitySetWindowUnityTextureID(int windowIndex, void *nativeTexturePtr);
 
 SERVO_UNITY_EXTERN bool servoUnityRequestWindowSizeChange(int windowIndex, int width, int height);
 
+///
+/// Informs the plugin of the size (in screen pixels) that the window currently occupies on screen.
+/// When ServoUnityParam_b_DynamicResolution is enabled, this is used to reduce the render size of
+/// distant or small windows. Pass 0 for width and height if the projected size is unknown.
+///
+SERVO_UNITY_EXTERN void servoUnitySetWindowProjectedSize(int windowIndex, int width, int height);
+
+///
+/// Informs the plugin whether the window can currently be seen. Windows are visible when created.
+/// Under memory pressure, hidden windows may be shrunk or suspended until they are visible again.
+///
+SERVO_UNITY_EXTERN void servoUnitySetWindowVisible(int windowIndex, bool visible);
+
 SERVO_UNITY_EXTERN bool servoUnityCloseWindow(int windowIndex);
 
 SERVO_UNITY_EXTERN bool servoUnityCloseAllWindows(void);
@@ -314,7 +539,25 @@ SERVO_UNITY_EXTERN bool servoUnityCloseAllWindows(void);
 ///
 SERVO_UNITY_EXTERN void servoUnityServiceWindowEvents(int windowIndex);
 
-SERVO_UNITY_EXTERN void servoUnityGetWindowMetadata(int windowIndex, char *titleBuf, int titleBufLen, char *urlBuf, int urlBufLen);
+///
+/// Get the version of a window's metadata (title, URL, load state and history state).
+/// The version changes whenever any of these change, so callers can cache the metadata and
+/// fetch it again only when the version differs. Returns 0 if the window does not exist.
+///
+SERVO_UNITY_EXTERN int servoUnityGetWindowMetadataVersion(int windowIndex);
+
+///
+/// Copy a window's title and/or URL. Both are taken from the same snapshot of the metadata.
+/// Pass NULL for a buffer that is not required.
+/// Returns the version of the snapshot copied, or 0 if the window does not exist.
+///
+SERVO_UNITY_EXTERN int servoUnityGetWindowMetadata(int windowIndex, char *titleBuf, int titleBufLen, char *urlBuf, int urlBufLen);
+
+///
+/// Get a window's load and history state. Any of the pointers may be NULL.
+/// Returns the version of the metadata snapshot read, or 0 if the window does not exist.
+///
+SERVO_UNITY_EXTERN int servoUnityGetWindowNavigationState(int windowIndex, bool *loading_p, bool *canGoBack_p, bool *canGoForward_p);
 
 
 ///
@@ -326,16 +569,53 @@ SERVO_UNITY_EXTERN void servoUnityGetWindowMetadata(int windowIndex, char *title
 SERVO_UNITY_EXTERN void servoUnityRequestWindowUpdate(int windowIndex, float timeDelta);
 
 ///
+/// Update several windows at once. Servo's event loop is serviced once, and then the windows' textures
+/// are updated in the order listed.
 /// Must be called from rendering thread with active rendering context.
-/// As an alternative to invoking directly, an equivalent invocation can be invoked via call this sequence:
-///     servoUnitySetRenderEventFunc2Param(windowIndex);
-///     (*GetRenderEventFunc())(2);
+/// As an alternative to invoking directly, an equivalent invocation can be invoked via a
+/// ServoUnityRenderEventID_UpdateWindows event issued with the function returned by GetRenderEventAndDataFunc().
+///
+SERVO_UNITY_EXTERN void servoUnityRequestWindowsUpdate(const int32_t *windowIndices, int count, float timeDelta);
+
+///
+/// Must be called from rendering thread with active rendering context.
+/// As an alternative to invoking directly, an equivalent invocation can be invoked via a
+/// ServoUnityRenderEventID_CleanupRenderer event issued with the function returned by GetRenderEventAndDataFunc(),
+/// with a ServoUnityRenderEventWindowData payload.
 ///
 SERVO_UNITY_EXTERN void servoUnityCleanupRenderer(int windowIndex);
 
 SERVO_UNITY_EXTERN void servoUnitySetRenderEventFunc1Params(int windowIndex, float timeDelta);
 
-SERVO_UNITY_EXTERN void servoUnitySetRenderEventFunc2Param(int windowIndex);
+enum {
+    ServoUnityRenderEventID_UpdateWindow = 1, // Via GetRenderEventFunc(), with params set by servoUnitySetRenderEventFunc1Params.
+    ServoUnityRenderEventID_CleanupRenderer = 2, // Via GetRenderEventAndDataFunc(), with a ServoUnityRenderEventWindowData payload.
+    ServoUnityRenderEventID_UpdateWindows = 3, // Via GetRenderEventAndDataFunc(), with a ServoUnityRenderEventUpdateWindowsData payload.
+    ServoUnityRenderEventID_Prewarm = 4, // Via GetRenderEventAndDataFunc(), with a ServoUnityRenderEventWindowData payload. See servoUnityPrewarm.
+};
+
+#define SERVO_UNITY_RENDER_EVENT_WINDOWS_MAX 64
+
+///
+/// Payload for ServoUnityRenderEventID_UpdateWindows, e.g. issued via CommandBuffer.IssuePluginEventAndData
+/// with the function returned by GetRenderEventAndDataFunc(). All listed windows are updated in a single
+/// render-thread callback, in the order listed, so list the highest priority windows first.
+/// The payload must remain valid until the render thread has processed the event.
+///
+typedef struct {
+    float timeDelta;
+    int32_t windowCount;
+    int32_t windowIndices[SERVO_UNITY_RENDER_EVENT_WINDOWS_MAX];
+} ServoUnityRenderEventUpdateWindowsData;
+
+///
+/// Payload for the render events which act on a single window (ServoUnityRenderEventID_CleanupRenderer
+/// and ServoUnityRenderEventID_Prewarm). Each event carries its own window index, so several may be
+/// in flight at once. The payload must remain valid until the render thread has processed the event.
+///
+typedef struct {
+    int32_t windowIndex;
+} ServoUnityRenderEventWindowData;
 
 
 enum {
@@ -350,6 +630,9 @@ enum {
     ServoUnityPointerEventID_TouchMove = 8,
     ServoUnityPointerEventID_TouchEnd = 9,
     ServoUnityPointerEventID_TouchCancel = 10,
+    ServoUnityPointerEventID_ScrollGestureBegin = 11,
+    ServoUnityPointerEventID_ScrollGestureUpdate = 12,
+    ServoUnityPointerEventID_ScrollGestureEnd = 13,
     ServoUnityPointerEventID_Max
 };
 
@@ -368,14 +651,45 @@ enum {
 /// eventParam0 is a zero-based index for the mouse button, as indexed by the enum ServoUnityPointerEventMouseButtonID_*.
 /// For ServoUnityPointerEventID_TouchBegin, ServoUnityPointerEventID_TouchMove, ServoUnityPointerEventID_TouchEnd,
 /// and ServoUnityPointerEventID_TouchCancel event0 is an touch ID, which must be unique for any given finger for the duration of the
-/// touch event. For all other eventID types, unused.
+/// touch event. For ServoUnityPointerEventID_ScrollDiscrete, eventParam0 and eventParam1 are the horizontal and vertical scroll
+/// counts. For ServoUnityPointerEventID_ScrollGestureUpdate, they are the horizontal and vertical movement in pixels since the
+/// last update, with the same sign convention as ScrollDiscrete, and for ServoUnityPointerEventID_ScrollGestureEnd, they are the
+/// horizontal and vertical velocity at release, in pixels per second. If fast enough, the scroll then continues with momentum,
+/// decelerating by ServoUnityParam_f_KineticScrollFriction, until stopped or caught by the next ScrollGestureBegin.
+/// For all other eventID types, unused.
 /// </param>
-/// <param name="eventParam1"></param>
+/// <param name="eventParam1">See eventParam0.</param>
 /// <param name="windowX">Window x coordinate at which the event occured.</param>
 /// <param name="windowY">Window y coordinate at which the event occured.</param>
 ///
 SERVO_UNITY_EXTERN void servoUnityWindowPointerEvent(int windowIndex, int eventID, int eventParam0, int eventParam1, int windowX, int windowY);
 
+enum {
+    ServoUnityTouchPhase_Began = 0,
+    ServoUnityTouchPhase_Moved = 1,
+    ServoUnityTouchPhase_Ended = 2,
+    ServoUnityTouchPhase_Cancelled = 3,
+    ServoUnityTouchPhase_Max
+};
+
+typedef struct {
+    int32_t touchID; // Unique for any given finger for the duration of its touch.
+    int32_t phase; // One of ServoUnityTouchPhase_*.
+    int32_t windowX;
+    int32_t windowY;
+} ServoUnityTouch;
+
+///
+/// Send a batch of touch events to Servo, e.g. all touch changes in a frame.
+/// Moves of the same touch within the batch are coalesced. If ServoUnityParam_b_TouchGestures is set,
+/// two-finger pinch, pan and fling are recognised natively and sent to Servo as zoom and scroll,
+/// while single touches are passed to Servo unchanged.
+/// <param name="windowIndex"></param>
+/// <param name="touches">The touch events, in the order they occurred.</param>
+/// <param name="count">The number of entries in touches.</param>
+///
+SERVO_UNITY_EXTERN void servoUnityWindowTouchEvents(int windowIndex, const ServoUnityTouch *touches, int count);
+
 enum {
     ServoUnityWindowBrowserControlEventID_Refresh = 0,
     ServoUnityWindowBrowserControlEventID_Reload = 1,
@@ -394,6 +708,23 @@ enum {
 	ServoUnityParam_b_CloseNativeWindowOnClose = 0,
     ServoUnityParam_s_SearchURI = 1,
     ServoUnityParam_s_Homepage = 2,
+    ServoUnityParam_b_DynamicResolution = 3, // If true, window render size is chosen automatically from projected size and frame-time budget. Default false.
+    ServoUnityParam_f_FrameTimeBudget = 4, // Frame-time budget in milliseconds used by dynamic resolution. Default 16.667.
+    ServoUnityParam_f_DynamicResolutionMinScale = 5, // Smallest fraction of the requested size that dynamic resolution may choose. Default 0.25.
+    ServoUnityParam_f_ResizeSettleTime = 6, // Time in milliseconds a new window size must remain unchanged before Servo is resized. Default 250.
+    ServoUnityParam_i_PerformanceProfile = 7, // One of ServoUnityPerformanceProfile_*. Applied at Servo startup, and to a running engine where Servo allows. Default ServoUnityPerformanceProfile_Default.
+    ServoUnityParam_b_BatchInput = 8, // If true, each frame's input events are delivered to Servo in batch mode, and processed together. Default true.
+    ServoUnityParam_f_KineticScrollFriction = 9, // Fraction of scroll momentum velocity remaining after one second. 0 disables momentum. Default 0.135.
+    ServoUnityParam_b_TouchGestures = 10, // If true, two-finger gestures in servoUnityWindowTouchEvents are recognised as pinch-zoom and scroll. Default true.
+    ServoUnityParam_f_PinchThreshold = 11, // Pixels the spacing between two fingers must change by before a pinch begins. Default 24.
+    ServoUnityParam_f_PanThreshold = 12, // Pixels the midpoint between two fingers must move by before a pan begins. Default 12.
+    ServoUnityParam_b_Snapshots = 13, // If true, a snapshot of each page is kept, and shown while the page is reopened or revisited until Servo has drawn it. Default true.
+    ServoUnityParam_s_CachePath = 14, // Directory in which the plugin may keep caches, e.g. page snapshots. Default empty, i.e. caches are kept in memory only.
+    ServoUnityParam_s_HTTPCachePath = 15, // If set, a caching HTTP proxy is started on loopback by servoUnityInit, keeping responses in this directory, and Servo is pointed at it via http_proxy. Default empty, i.e. no proxy.
+    ServoUnityParam_i_HTTPCacheSize = 16, // Size budget of the HTTP proxy's cache, in megabytes. Default 256.
+    ServoUnityParam_s_HistoryPath = 17, // Directory in which visited pages are logged, and from which they're read back in the background when set. Default empty, i.e. history is kept in memory only.
+    ServoUnityParam_b_MemoryPressureResponse = 18, // If true, servoUnityInit starts monitoring memory pressure, and the plugin responds to it. See servoUnityGetMemoryPressureLevel. Default true.
+    ServoUnityParam_i_TextureBudgetMB = 19, // GPU memory, in megabytes, windows' textures should keep within. When over, the textures of the hidden windows least recently visible are reduced to a token size until they are visible again. Visible windows are never evicted. 0 for no budget. Default 0.
 	ServoUnityParam_Max
 };
 
@@ -15,15 +15,43 @@
 
 #pragma once
 #include <string>
+#include <memory>
 #include "servo_unity_c.h"
 
+class ServoUnityResourceArchive;
+class ServoUnityNavigationPolicy;
+
 // --------------------------------------------------------------------------
 //  Configuration parameters
 
 extern bool s_param_CloseNativeWindowOnClose;
 extern std::string s_param_SearchURI;
 extern std::string s_param_Homepage;
+extern bool s_param_DynamicResolution;
+extern float s_param_FrameTimeBudget;
+extern float s_param_DynamicResolutionMinScale;
+extern float s_param_ResizeSettleTime;
+extern int s_param_PerformanceProfile;
+extern bool s_param_BatchInput;
+extern float s_param_KineticScrollFriction;
+extern bool s_param_TouchGestures;
+extern float s_param_PinchThreshold;
+extern float s_param_PanThreshold;
+extern bool s_param_Snapshots;
+extern std::string s_param_CachePath;
+extern std::string s_param_HTTPCachePath;
+extern int s_param_HTTPCacheSize;
+extern std::string s_param_HistoryPath;
+extern bool s_param_MemoryPressureResponse;
+extern int s_param_TextureBudgetMB;
 
 // --------------------------------------------------------------------------
 //  Other internal globals
 
+/// The resource archive in the resources path, or nullptr if there is none. May be called from any thread.
+extern std::shared_ptr<const ServoUnityResourceArchive> servoUnityGetResourceArchive(void);
+/// The navigation policy from the resource archive, or nullptr if there is none. May be called from any thread.
+extern std::shared_ptr<const ServoUnityNavigationPolicy> servoUnityGetNavigationPolicy(void);
+/// Queue an event for delivery with uidExt 0 by servoUnityServicePluginEvents. May be called from any thread.
+extern void servoUnityQueuePluginEvent(int eventType, int eventData1, int eventData2);
+